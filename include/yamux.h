@@ -69,11 +69,24 @@ typedef struct {
  * Configuration structure
  */
 typedef struct {
-    uint32_t accept_backlog;
+    uint32_t accept_backlog;          /* Streams waiting to be accepted before more are reset (0 = default) */
     uint32_t enable_keepalive;
     uint32_t connection_write_timeout;
     uint32_t keepalive_interval;
     uint32_t max_stream_window_size;
+    uint32_t read_buffer_size;        /* Session ingress buffer in bytes (0 = default) */
+    uint32_t write_buffer_size;       /* Session egress queue in bytes (0 = default) */
+    uint32_t window_update_percent;   /* Consumed share of the window that triggers a WINDOW_UPDATE (0 = default) */
+    uint32_t stream_pool_size;        /* Streams whose memory is preallocated at session creation (0 = none) */
+    uint32_t recv_memory_budget;      /* Receive memory all the session's streams may commit in bytes (0 = unlimited) */
+    uint32_t thread_safe;             /* Allow calls from many threads (YAMUX_THREADS builds only; 0 = off) */
+    uint32_t egress_quantum;          /* Bytes per unit of weight a stream sends per scheduler turn (0 = no scheduler) */
+    uint32_t max_frame_size;          /* Largest DATA payload sent per frame (0 = YAMUX_MAX_DATA_FRAME_SIZE) */
+    uint32_t max_recv_frame_size;     /* Largest DATA payload accepted; longer is a protocol error (0 = only the window limits) */
+    uint32_t stream_open_timeout;     /* Reset a stream whose SYN goes unanswered this long, in ms (0 = never; needs ticks) */
+    uint32_t stream_close_timeout;    /* Reset a stream whose FIN goes unanswered this long, in ms (0 = never; needs ticks) */
+    uint32_t fixed_memory;            /* Allocate nothing once created: streams and buffers come only from the
+                                         stream_pool_size pools, and running out is YAMUX_ERR_NOMEM (0 = off) */
 } yamux_config_t;
 
 /**
@@ -86,6 +99,11 @@ typedef struct yamux_session yamux_session_t;
  */
 typedef struct yamux_stream yamux_stream_t;
 
+/**
+ * Timer wheel shared by sessions (opaque, see yamux_timer_wheel_create())
+ */
+typedef struct yamux_timer_wheel yamux_timer_wheel_t;
+
 /**
  * Stream states
  */
@@ -100,18 +118,73 @@ typedef enum {
 } yamux_stream_state_t;
 
 /**
- * I/O function callbacks
- * 
- * @note PORTING REQUIRED: These are platform-dependent I/O callbacks that must be implemented
- * for your specific system (e.g., socket, UART, etc.).
- * - read: Should return number of bytes read, 0 for EOF, or -1 for error
- * - write: Should return number of bytes written or -1 for error
+ * Buffer descriptor for vectored writes (mirrors struct iovec)
  */
 typedef struct {
-    int (*read)(void *ctx, uint8_t *buf, size_t len);
-    int (*write)(void *ctx, const uint8_t *buf, size_t len);
-    void *ctx;
-} yamux_io_t;
+    const uint8_t *base;
+    size_t len;
+} yamux_iovec_t;
+
+/**
+ * Conditions to wait for with yamux_stream_wait()
+ */
+typedef enum {
+    YAMUX_WAIT_READABLE = 0x1,   /* Data is buffered, or the peer finished sending */
+    YAMUX_WAIT_WRITABLE = 0x2    /* Send window and egress queue have room */
+} yamux_wait_t;
+
+/**
+ * Session counters (see yamux_session_get_stats())
+ */
+typedef struct {
+    uint64_t frames_in[4];           /* Frames received, indexed by yamux_type_t */
+    uint64_t frames_out[4];          /* Frames sent, indexed by yamux_type_t */
+    uint64_t bytes_in;               /* Bytes read from the transport */
+    uint64_t bytes_out;              /* Bytes written to the transport */
+    uint64_t data_bytes_in;          /* DATA payload received */
+    uint64_t data_bytes_out;         /* DATA payload sent */
+    uint64_t window_updates_in;      /* WINDOW_UPDATEs received that granted credit */
+    uint64_t window_updates_out;     /* WINDOW_UPDATEs sent to grant credit */
+    uint64_t window_stalls;          /* Times a stream ran out of send window */
+    uint64_t stall_ms;               /* Time streams spent out of send window, for ended stalls (needs a clock) */
+    uint64_t would_block;            /* Writes and flushes that returned YAMUX_ERR_WOULD_BLOCK */
+    uint64_t partial_writes;         /* Transport writes that took only part of what was offered */
+    uint64_t accept_overflows;       /* Inbound streams reset because the accept backlog was full */
+    size_t recv_high_water;          /* Most unread data any stream has held */
+    uint32_t accept_queue_depth;     /* Streams waiting to be accepted, when read */
+    uint32_t streams;                /* Streams in the session, when read */
+} yamux_session_stats_t;
+
+/**
+ * Stream counters (see yamux_stream_get_stats())
+ */
+typedef struct {
+    uint64_t frames_in;              /* DATA frames received */
+    uint64_t frames_out;             /* DATA frames sent */
+    uint64_t bytes_in;               /* DATA payload received */
+    uint64_t bytes_out;              /* DATA payload sent */
+    uint64_t window_updates_in;      /* WINDOW_UPDATEs received that granted credit */
+    uint64_t window_updates_out;     /* WINDOW_UPDATEs sent to grant credit */
+    uint64_t window_stalls;          /* Times the send window ran out */
+    uint64_t stall_ms;               /* Time spent out of send window, including now (needs a clock) */
+    uint64_t would_block;            /* Writes that returned YAMUX_ERR_WOULD_BLOCK */
+    size_t recv_high_water;          /* Most unread data the stream has held */
+    uint32_t ack_latency_ms;         /* Smoothed time from sending data to the peer's credit for it (needs a clock) */
+} yamux_stream_stats_t;
+
+/**
+ * Ping round-trip times (see yamux_session_get_rtt())
+ */
+typedef struct {
+    uint64_t samples;                /* Pings answered and timed */
+    uint32_t last_id;                /* ID of the latest ping timed */
+    uint32_t last_ms;                /* Its round trip */
+    uint32_t min_ms;                 /* Fastest round trip */
+    uint32_t avg_ms;                 /* Mean round trip */
+    uint32_t p99_ms;                 /* 99th percentile, to within a quarter of its power of two */
+    uint32_t max_ms;                 /* Slowest round trip */
+    uint32_t srtt_ms;                /* Smoothed estimate used for window auto-tuning */
+} yamux_rtt_stats_t;
 
 /**
  * Error codes
@@ -129,11 +202,100 @@ typedef enum {
     YAMUX_ERR_WOULD_BLOCK     = -9
 } yamux_result_t;
 
+/**
+ * Stream event callbacks (see yamux_session_set_callbacks())
+ * 
+ * Any member may be NULL. Each runs from yamux_session_process(), last in
+ * the handling of the frame that caused it, and may read, write or accept
+ * streams but must not close the stream it was given. Timeouts report
+ * from the tick that found them (yamux_session_tick()); those callbacks
+ * must not close the session either.
+ */
+typedef struct {
+    /* New data, or the end of the stream, is ready to read */
+    void (*on_stream_readable)(yamux_stream_t *stream, void *user_data);
+    /* The send window reopened after running out */
+    void (*on_stream_writable)(yamux_stream_t *stream, void *user_data);
+    /* The peer opened a stream; it is in the accept queue */
+    void (*on_stream_accept)(yamux_session_t *session, yamux_stream_t *stream, void *user_data);
+    /* The peer finished (FIN) or reset (RST) the stream, or a timeout did; a reset stream has left the session and is CLOSED */
+    void (*on_stream_closed)(yamux_stream_t *stream, void *user_data);
+    /* A timer failed the session (YAMUX_ERR_TIMEOUT): keepalives went unanswered or writes stopped leaving */
+    void (*on_session_failed)(yamux_session_t *session, yamux_result_t error, void *user_data);
+    void *user_data;             /* Passed through to every callback */
+} yamux_callbacks_t;
+
+/**
+ * I/O function callbacks
+ * 
+ * @note PORTING REQUIRED: These are platform-dependent I/O callbacks that must be implemented
+ * for your specific system (e.g., socket, UART, etc.).
+ * - read: Should return number of bytes read, 0 for EOF, or -1 for error
+ * - write: Should return number of bytes written or -1 for error
+ * - writev: Optional (may be NULL). Writes the iovcnt buffers in order as one
+ *   operation and returns the total number of bytes written or -1 for error.
+ *   When set, each frame's header and payload are emitted in a single call.
+ * - now_ms: Optional (may be NULL). Returns a monotonic clock in milliseconds.
+ *   When set, ping round trips are timed (yamux_session_get_rtt()) and stream receive windows are
+ *   auto-tuned between YAMUX_DEFAULT_WINDOW_SIZE and max_stream_window_size.
+ * - poll: Optional (may be NULL). Blocks until the transport is ready for
+ *   events (YAMUX_WAIT_READABLE and/or YAMUX_WAIT_WRITABLE) or timeout_ms
+ *   passes (0 = no limit). Returns >0 when ready, 0 on timeout, -1 for error.
+ *   When set, waiting calls on a single-threaded session sleep in it rather
+ *   than spin on a non-blocking transport.
+ * - sendfile: Optional (may be NULL). Writes up to len bytes of file fd,
+ *   starting at offset, to the transport (e.g. with sendfile(2) or splice(2))
+ *   and returns the number written, 0 if the transport is full, or -1 for
+ *   error. Needed by yamux_stream_sendfile().
+ */
+typedef struct {
+    int (*read)(void *ctx, uint8_t *buf, size_t len);
+    int (*write)(void *ctx, const uint8_t *buf, size_t len);
+    void *ctx;
+    int (*writev)(void *ctx, const yamux_iovec_t *iov, int iovcnt);
+    uint64_t (*now_ms)(void *ctx);
+    int (*poll)(void *ctx, int events, uint32_t timeout_ms);
+    int (*sendfile)(void *ctx, int fd, uint64_t offset, size_t len);
+} yamux_io_t;
+
 /**
  * Default configuration
  */
 extern const yamux_config_t yamux_default_config;
 
+/**
+ * Log sink callback
+ * 
+ * @param level YAMUX_LOG_LEVEL_* of the message (see yamux_config.h)
+ * @param message Formatted message, without a trailing newline
+ * @param user_data Value given to yamux_set_log_sink()
+ */
+typedef void (*yamux_log_fn)(int level, const char *message, void *user_data);
+
+/**
+ * Route log messages to a function
+ * 
+ * Only levels compiled in by YAMUX_LOG_LEVEL are ever produced. Without a
+ * sink, messages go to yamux_debug_log() in YAMUX_DEBUG builds and to
+ * stderr otherwise.
+ * 
+ * @param sink Sink function, or NULL to restore the default
+ * @param user_data Passed through to sink
+ */
+void yamux_set_log_sink(yamux_log_fn sink, void *user_data);
+
+/**
+ * Limit the receive memory committed by all sessions together
+ * 
+ * Like yamux_config_t.recv_memory_budget, but shared by every session in
+ * the process: window credit is only granted while the total of all
+ * streams' open windows and unread data stays within the budget, so fast
+ * senders stall through flow control instead of growing memory.
+ * 
+ * @param bytes Budget in bytes (0 = unlimited, the default)
+ */
+void yamux_set_global_recv_budget(size_t bytes);
+
 /**
  * Initialize the Yamux library
  * 
@@ -162,6 +324,9 @@ void yamux_destroy(void *session);
 /**
  * Process incoming data for a session
  * 
+ * Performs at most one read from the transport into the session's ingress
+ * buffer and then handles every complete frame that is buffered.
+ * 
  * @param session Session handle returned by yamux_init
  * @return 0 on success, negative value on error
  */
@@ -172,6 +337,13 @@ int yamux_process(void *session);
  * 
  * @note This is a low-level function. New applications should use yamux_init instead.
  * 
+ * With config->thread_safe set, any thread may call the session and stream
+ * functions: one lock per session serializes them, and frames from all
+ * writers share the egress queue, written out by one thread at a time.
+ * One thread at a time drives yamux_session_process(); the transport's
+ * read callback is called with the lock released, so it may block. Stop
+ * that thread before yamux_session_close().
+ * 
  * @param io I/O callbacks
  * @param client True if the session is a client, false if server
  * @param config Configuration or NULL for defaults
@@ -188,6 +360,9 @@ yamux_result_t yamux_session_create(
 /**
  * Close a yamux session
  * 
+ * Sends GO_AWAY unless the peer already did, resets the remaining streams
+ * and frees the session; neither it nor its streams may be used afterwards.
+ * 
  * @param session Session to close
  * @param err Error code to send (YAMUX_NORMAL for clean shutdown)
  * @return YAMUX_OK on success, error code otherwise
@@ -211,6 +386,26 @@ yamux_result_t yamux_stream_open_detailed(
     yamux_stream_t **stream
 );
 
+/**
+ * Open several streams at once
+ * 
+ * Takes stream IDs contiguously from the session's next ID and the stream
+ * objects the pool lacks in one allocation, and writes all the SYNs in one
+ * coalesced write (or one per egress queue's worth). Either every stream
+ * opens or none does.
+ * 
+ * @param session Session
+ * @param count Number of streams to open
+ * @param streams Output array receiving count streams
+ * @return YAMUX_OK on success, YAMUX_ERR_INVALID if the IDs would run out,
+ *         error code otherwise
+ */
+yamux_result_t yamux_stream_open_batch(
+    yamux_session_t *session,
+    uint32_t count,
+    yamux_stream_t **streams
+);
+
 /**
  * Accept a new stream (server only)
  * 
@@ -226,6 +421,10 @@ yamux_result_t yamux_stream_accept(
 /**
  * Close a stream
  * 
+ * A reset frees the stream. After a normal close (FIN) the stream stays
+ * the application's, so it can still read what the peer sends, until
+ * yamux_stream_free().
+ * 
  * @param stream Stream to close
  * @param reset True to reset the stream, false for normal close
  * @return YAMUX_OK on success, error code otherwise
@@ -235,6 +434,23 @@ yamux_result_t yamux_stream_close(
     int reset
 );
 
+/**
+ * Free a stream the application is done with
+ * 
+ * Closes the stream with FIN if it is still open. The stream goes back to
+ * the session's pool once both sides have finished, at once if they have
+ * or the stream was reset by the peer or a timeout. Callbacks no longer
+ * report it, and it may not be used afterwards. Every stream opened or
+ * accepted is freed this way or by a reset; streams still in the session
+ * when it closes are freed by yamux_session_close().
+ * 
+ * @param stream Stream to free
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_free(
+    yamux_stream_t *stream
+);
+
 /**
  * Read data from a stream
  * 
@@ -251,6 +467,127 @@ yamux_result_t yamux_stream_read(
     size_t *bytes_read
 );
 
+/**
+ * Read data from a stream, waiting for it to arrive
+ * 
+ * Returns as soon as some data is read. Waits as yamux_stream_wait() does.
+ * 
+ * @param stream Stream to read from
+ * @param buf Buffer to store data
+ * @param len Maximum number of bytes to read
+ * @param timeout_ms Longest wait in milliseconds (0 = no limit)
+ * @param bytes_read Number of bytes actually read; 0 with YAMUX_OK means
+ *        the peer finished sending
+ * @return YAMUX_OK on success, YAMUX_ERR_TIMEOUT if nothing arrived in time,
+ *         error code otherwise
+ */
+yamux_result_t yamux_stream_read_timeout(
+    yamux_stream_t *stream,
+    uint8_t *buf,
+    size_t len,
+    uint32_t timeout_ms,
+    size_t *bytes_read
+);
+
+/**
+ * Peek at buffered data on a stream without copying it
+ * 
+ * Returns the contiguous run of bytes at the front of the stream's receive
+ * buffer. Processing the session only appends, so the pointer stays valid
+ * until the next read or consume on the stream (either may resize the buffer
+ * when the window is auto-tuned) or until it is closed. If the buffered data
+ * wraps, consume this run and peek again for the rest.
+ * 
+ * @param stream Stream to peek at
+ * @param data Set to the first unread byte (NULL if nothing is buffered)
+ * @param len Set to the number of bytes available at data
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_peek(
+    yamux_stream_t *stream,
+    const uint8_t **data,
+    size_t *len
+);
+
+/**
+ * Release data returned by yamux_stream_peek()
+ * 
+ * Like yamux_stream_read(), counts the bytes as consumed for window credit.
+ * 
+ * @param stream Stream to consume from
+ * @param len Number of bytes to release (at most the buffered amount)
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_consume(
+    yamux_stream_t *stream,
+    size_t len
+);
+
+/**
+ * Completion callback for yamux_stream_post_read()
+ * 
+ * Runs from yamux_stream_post_read() itself when data is already buffered,
+ * otherwise from yamux_session_process() when the data arrives. It may post
+ * the next read, but must not close the stream.
+ * 
+ * @param stream Stream the read was posted on
+ * @param buf The posted buffer
+ * @param bytes_read Number of bytes placed in buf (0 at end of stream)
+ * @param result YAMUX_OK, or YAMUX_ERR_CLOSED if the stream closed first
+ * @param user_data Value given to yamux_stream_post_read()
+ */
+typedef void (*yamux_read_complete_fn)(
+    yamux_stream_t *stream,
+    uint8_t *buf,
+    size_t bytes_read,
+    yamux_result_t result,
+    void *user_data
+);
+
+/**
+ * Post a buffer for the next data to arrive on a stream
+ * 
+ * While the read is pending, incoming DATA payload is placed straight into
+ * buf rather than the stream's receive buffer, and counts as consumed for
+ * window credit as soon as it lands. One read may be pending per stream.
+ * 
+ * @param stream Stream to read from
+ * @param buf Buffer to receive data; must stay valid until completion
+ * @param len Size of buf
+ * @param cb Called once with the result
+ * @param user_data Passed through to cb
+ * @return YAMUX_OK if the read completed or was posted, error code otherwise
+ */
+yamux_result_t yamux_stream_post_read(
+    yamux_stream_t *stream,
+    uint8_t *buf,
+    size_t len,
+    yamux_read_complete_fn cb,
+    void *user_data
+);
+
+/**
+ * Set a stream's egress priority and weight
+ * 
+ * Used when config.egress_quantum enables the egress scheduler: data
+ * written to a stream is queued on the stream, streams at a lower
+ * priority level are served only while every higher level has nothing
+ * queued, and within a level each stream's turn is egress_quantum * weight
+ * bytes. Control frames always go ahead of queued data. New streams get
+ * YAMUX_DEFAULT_PRIORITY and YAMUX_DEFAULT_WEIGHT (yamux_config.h).
+ * Builds with YAMUX_SCHED 0 have no scheduler and return YAMUX_ERR_INVALID.
+ * 
+ * @param stream Stream
+ * @param priority Level, 0 (served first) to YAMUX_PRIORITY_LEVELS - 1
+ * @param weight Share of its level's bandwidth, at least 1
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_set_priority(
+    yamux_stream_t *stream,
+    uint8_t priority,
+    uint16_t weight
+);
+
 /**
  * Write data to a stream
  * 
@@ -267,16 +604,120 @@ yamux_result_t yamux_stream_write(
     size_t *bytes_written
 );
 
+/**
+ * Write several buffers to a stream as one (scatter-gather write)
+ *
+ * The segments go out back to back, packed into as few DATA frames as the
+ * frame size and send window allow. A frame written directly is handed to
+ * io.writev segment by segment, without copying. Like yamux_stream_write(),
+ * a short write is not an error.
+ *
+ * @param stream Stream to write to
+ * @param iov Segments to write, in order
+ * @param iovcnt Number of segments
+ * @param bytes_written Number of bytes actually written
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_writev(
+    yamux_stream_t *stream,
+    const yamux_iovec_t *iov,
+    int iovcnt,
+    size_t *bytes_written
+);
+
+/**
+ * Write part of a file to a stream without copying it
+ *
+ * The library writes each DATA frame's header and lets io.sendfile move the
+ * payload from the file to the transport, so the data never passes through
+ * user memory. Frames follow the send window and frame size as for
+ * yamux_stream_write(); frames queued earlier are written out first, even
+ * on a corked session. A short write is not an error.
+ *
+ * A frame the transport took only part of is finished by later flushes,
+ * so fd must stay open until yamux_session_flush() returns YAMUX_OK.
+ *
+ * @param stream Stream to write to
+ * @param fd File to read from
+ * @param offset Offset in the file of the first byte to write
+ * @param len Number of bytes to write
+ * @param bytes_written Number of bytes actually written
+ * @return YAMUX_OK on success, YAMUX_ERR_INVALID if the transport has no
+ *         io.sendfile, error code otherwise
+ */
+yamux_result_t yamux_stream_sendfile(
+    yamux_stream_t *stream,
+    int fd,
+    uint64_t offset,
+    size_t len,
+    size_t *bytes_written
+);
+
+/**
+ * Write all data to a stream, waiting for send window and queue space
+ * 
+ * Waits as yamux_stream_wait() does whenever the peer's window or the
+ * egress queue is full, instead of returning a short write.
+ * 
+ * @param stream Stream to write to
+ * @param buf Buffer containing data to write
+ * @param len Number of bytes to write
+ * @param timeout_ms Longest time to take in milliseconds (0 = the session's
+ *        connection_write_timeout, itself 0 for no limit)
+ * @param bytes_written Number of bytes written, len on success
+ * @return YAMUX_OK once everything is written, YAMUX_ERR_TIMEOUT if the
+ *         timeout passed first (bytes_written tells how far it got),
+ *         error code otherwise
+ */
+yamux_result_t yamux_stream_write_timeout(
+    yamux_stream_t *stream,
+    const uint8_t *buf,
+    size_t len,
+    uint32_t timeout_ms,
+    size_t *bytes_written
+);
+
 /**
  * Process incoming data
  * 
+ * Safe to drive from a non-blocking event loop: a partially received frame
+ * is kept on the session and completed by later calls.
+ * 
  * @param session Session
- * @return YAMUX_OK on success, error code otherwise
+ * @return YAMUX_OK on success, YAMUX_ERR_WOULD_BLOCK if only part of a frame
+ *         is available (or the transport would block), error code otherwise
  */
 yamux_result_t yamux_session_process(
     yamux_session_t *session
 );
 
+/**
+ * Wait until a stream is readable or writable
+ * 
+ * Blocks the calling thread until one of the conditions holds, typically
+ * after yamux_stream_read() returned no data or yamux_stream_write() wrote
+ * less than asked. In a thread-safe session the thread calling
+ * yamux_session_process() wakes it when data, window credit or a state
+ * change arrives. A single-threaded session is processed by the wait
+ * itself, sleeping in io.poll between reads when it is set.
+ * 
+ * The timeout is measured with io.now_ms (or the system clock where
+ * threads are supported); without a clock only io.poll enforces it.
+ * 
+ * @param stream Stream to wait on
+ * @param conditions YAMUX_WAIT_READABLE and/or YAMUX_WAIT_WRITABLE
+ * @param timeout_ms Longest wait in milliseconds (0 = no limit)
+ * @return YAMUX_OK when a condition holds, YAMUX_ERR_TIMEOUT, YAMUX_ERR_CLOSED
+ *         if the stream or session closed, YAMUX_ERR_WOULD_BLOCK if a
+ *         single-threaded session's transport has nothing to read and no
+ *         io.poll to wait in, error code otherwise
+ */
+yamux_result_t yamux_stream_wait(
+    yamux_stream_t *stream,
+    int conditions,
+    uint32_t timeout_ms
+);
+
 /**
  * Get the stream ID
  * 
@@ -297,6 +738,23 @@ yamux_stream_state_t yamux_stream_get_state(
     yamux_stream_t *stream
 );
 
+/**
+ * Set the largest DATA payload a stream sends in one frame
+ * 
+ * Overrides config.max_frame_size, e.g. larger frames for a bulk stream
+ * on a fast link. Frames never exceed the send window either, and must fit
+ * the egress queue (config.write_buffer_size, or YAMUX_ERR_INVALID).
+ * With YAMUX_FIXED_FRAME_SIZE only 0 and YAMUX_MAX_DATA_FRAME_SIZE are taken.
+ * 
+ * @param stream Stream
+ * @param max_frame_size Payload limit in bytes (0 = the session's)
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_set_max_frame_size(
+    yamux_stream_t *stream,
+    uint32_t max_frame_size
+);
+
 /**
  * Get the current send window size for a stream
  *
@@ -319,9 +777,26 @@ yamux_result_t yamux_stream_update_window(
     uint32_t increment
 );
 
+/**
+ * Shrink every stream's receive window back to its initial size
+ * 
+ * For use under memory pressure when windows have been auto-tuned upwards
+ * (see yamux_io_t.now_ms). Credit already granted to the peer is honoured;
+ * each receive buffer shrinks once the peer's share fits the smaller window.
+ * 
+ * @param session Session
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_session_trim_windows(
+    yamux_session_t *session
+);
+
 /**
  * Ping the remote endpoint
  * 
+ * With a clock (yamux_io_t.now_ms) the round trip is timed and feeds
+ * receive-window auto-tuning, so call it periodically (e.g. as keepalive).
+ * 
  * @param session Session
  * @return YAMUX_OK on success, error code otherwise
  */
@@ -329,6 +804,189 @@ yamux_result_t yamux_session_ping(
     yamux_session_t *session
 );
 
+/**
+ * Ping the remote endpoint, returning the ping's ID
+ * 
+ * The ID travels in the ping's length field, with no payload, and is
+ * echoed in the ACK; up to YAMUX_PING_SLOTS pings are timed at once.
+ * 
+ * @param session Session
+ * @param ping_id Set to the ping's opaque ID (see yamux_rtt_stats_t.last_id)
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_session_ping_id(
+    yamux_session_t *session,
+    uint32_t *ping_id
+);
+
+/**
+ * Read the ping round-trip statistics
+ * 
+ * Round trips are timed with the session clock: yamux_io_t.now_ms, or
+ * the system's monotonic clock in thread-safe sessions. Without one the
+ * statistics stay empty.
+ * 
+ * @param session Session
+ * @param rtt Filled with a snapshot (all zero before the first sample)
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_session_get_rtt(
+    yamux_session_t *session,
+    yamux_rtt_stats_t *rtt
+);
+
+/**
+ * Write out all frames queued on the session
+ * 
+ * @param session Session
+ * @return YAMUX_OK when the queue is empty, YAMUX_ERR_WOULD_BLOCK if the
+ *         transport took only part of it (the rest stays queued), error code otherwise
+ */
+yamux_result_t yamux_session_flush(
+    yamux_session_t *session
+);
+
+/**
+ * Cork the session: queue outgoing frames instead of writing them
+ * 
+ * Frames are coalesced in the egress queue and written in large batches
+ * when it fills or when the session is uncorked. Calls nest.
+ * 
+ * @param session Session
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_session_cork(
+    yamux_session_t *session
+);
+
+/**
+ * Uncork the session, flushing queued frames once the last cork is released
+ * 
+ * @param session Session
+ * @return Result of the flush, or YAMUX_OK if still corked
+ */
+yamux_result_t yamux_session_uncork(
+    yamux_session_t *session
+);
+
+/**
+ * Read a session's counters
+ * 
+ * Counters are plain fields updated as frames pass, cheap enough to leave
+ * on; time needs a clock (yamux_io_t.now_ms, or the system clock in
+ * thread-safe sessions). Builds with YAMUX_STATS 0 leave them out, and
+ * only the accept queue depth and stream count are filled in.
+ * 
+ * @param session Session
+ * @param stats Filled with a snapshot of the counters
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_session_get_stats(
+    yamux_session_t *session,
+    yamux_session_stats_t *stats
+);
+
+/**
+ * Read a stream's counters
+ * 
+ * @param stream Stream
+ * @param stats Filled with a snapshot of the counters
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_get_stats(
+    yamux_stream_t *stream,
+    yamux_stream_stats_t *stats
+);
+
+/**
+ * Create a timer wheel for many sessions' timers
+ * 
+ * A hierarchical wheel: arming, cancelling and expiring a timer are O(1),
+ * and a tick costs only the timers it expires, so one event loop can run
+ * the keepalive and timeouts of many sessions without scanning them. The
+ * wheel is not locked: tick it, and drive its sessions, from one thread.
+ * 
+ * @param now_ms Current time in milliseconds, on the clock later ticks use
+ * @param wheel Pointer to store the wheel
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_timer_wheel_create(
+    uint64_t now_ms,
+    yamux_timer_wheel_t **wheel
+);
+
+/**
+ * Destroy a timer wheel; close or detach its sessions first
+ * 
+ * @param wheel Wheel to destroy
+ */
+void yamux_timer_wheel_destroy(
+    yamux_timer_wheel_t *wheel
+);
+
+/**
+ * Advance a timer wheel, running the timers of all its sessions now due
+ * 
+ * @param wheel Wheel
+ * @param now_ms Current time in milliseconds
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_timer_wheel_tick(
+    yamux_timer_wheel_t *wheel,
+    uint64_t now_ms
+);
+
+/**
+ * Run a session's timers on a shared wheel
+ * 
+ * The session's keepalive and timeouts move to the wheel, and from then
+ * on run whenever the wheel is ticked. Thread-safe sessions keep a
+ * private wheel and cannot share one.
+ * 
+ * @param session Session
+ * @param wheel Wheel to use, or NULL to stop the session's timers
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_session_set_timer_wheel(
+    yamux_session_t *session,
+    yamux_timer_wheel_t *wheel
+);
+
+/**
+ * Run a session's timers
+ * 
+ * Sends keepalive pings every keepalive_interval (with enable_keepalive)
+ * and fails the session with YAMUX_ERR_TIMEOUT when one goes unanswered
+ * for connection_write_timeout, or when queued frames make no progress
+ * for that long; resets streams past stream_open_timeout or
+ * stream_close_timeout. Timers start with the first tick and run with
+ * YAMUX_TIMER_TICK_MS resolution, so call it at least that often. A session
+ * attached to a shared wheel ticks the whole wheel.
+ * 
+ * @param session Session
+ * @param now_ms Current time in milliseconds (any monotonic clock)
+ * @return YAMUX_OK, or YAMUX_ERR_TIMEOUT once the session has failed
+ */
+yamux_result_t yamux_session_tick(
+    yamux_session_t *session,
+    uint64_t now_ms
+);
+
+/**
+ * Set the callbacks told about stream events
+ * 
+ * Lets a scheduler touch only the streams that changed instead of polling
+ * every stream after each yamux_session_process().
+ * 
+ * @param session Session
+ * @param callbacks Callbacks to copy, or NULL to remove them
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_session_set_callbacks(
+    yamux_session_t *session,
+    const yamux_callbacks_t *callbacks
+);
+
 /*
  * ----- High-level stream API (for use with yamux_init) -----
  */
@@ -394,6 +1052,14 @@ uint32_t yamux_get_stream_id(void *stream);
  */
 int yamux_ping(void *session);
 
+/**
+ * Write out frames queued on the session
+ * 
+ * @param session Session handle returned by yamux_init
+ * @return 0 on success, negative value on error
+ */
+int yamux_flush(void *session);
+
 #ifdef __cplusplus
 }
 #endif
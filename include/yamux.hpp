@@ -0,0 +1,617 @@
+/**
+ * @file yamux.hpp
+ * @brief Header-only C++20 wrapper: RAII handles, span buffers and coroutines
+ *
+ * Session and Stream own a yamux_session_t and a yamux_stream_t and close
+ * them when destroyed; both are move-only. Reads and writes take
+ * std::span and go straight to the C calls, copying nothing on the way.
+ *
+ * co_await stream.read(buf) and co_await stream.write(buf) suspend on an
+ * empty receive buffer or a closed send window instead of blocking or
+ * spinning. The Session installs the stream event callbacks; a callback
+ * only marks the streams it names, and Session::process() (or tick() or
+ * flush()) retries the marked operations once the C call has returned and
+ * resumes the coroutines whose operation finished. Coroutines therefore
+ * never run inside a callback and may close streams freely.
+ *
+ * The wrapper keeps its waiters unlocked: drive each Session from one
+ * thread (thread_safe off, e.g. one shard of yamux_runtime.h). Destroy
+ * every Stream before its Session.
+ */
+
+#ifndef TINY_YAMUX_HPP
+#define TINY_YAMUX_HPP
+
+#if __cplusplus < 202002L
+#error "yamux.hpp needs C++20"
+#endif
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <span>
+#include <utility>
+
+#include "yamux.h"
+
+namespace yamux {
+
+class Session;
+class Stream;
+
+/**
+ * Outcome of an awaited read or write
+ */
+struct IoResult {
+    yamux_result_t result;      /* YAMUX_OK, or why the operation stopped */
+    size_t bytes;               /* Bytes moved (0 from a read = end of stream) */
+};
+
+namespace detail {
+
+/* One suspended co_await, linked into its session while it waits */
+struct Waiter {
+    Waiter *prev = nullptr;
+    Waiter *next = nullptr;
+    yamux_stream_t *stream = nullptr;       /* NULL once the Stream closed under it */
+    bool (*attempt)(Waiter *waiter) = nullptr;  /* Tries the operation; true when finished */
+    std::coroutine_handle<> handle;
+    bool writer = false;
+    bool signalled = false;                 /* A callback named the stream since the last attempt */
+    yamux_result_t result = YAMUX_OK;
+    size_t bytes = 0;
+};
+
+/* What a Session owns; on the heap so the callbacks' user_data survives a move */
+struct Core {
+    yamux_session_t *session = nullptr;
+    yamux_callbacks_t user = {};            /* Application callbacks, called after ours */
+    yamux_result_t failure = YAMUX_OK;      /* Set once the session failed */
+    Waiter *head = nullptr;
+    Waiter *tail = nullptr;
+
+    Core() = default;
+    Core(const Core &) = delete;
+    Core &operator=(const Core &) = delete;
+
+    ~Core() {
+        if (session) {
+            (void)yamux_session_close(session, YAMUX_NORMAL);
+        }
+    }
+
+    void link(Waiter *waiter) noexcept {
+        waiter->prev = tail;
+        waiter->next = nullptr;
+        if (tail) {
+            tail->next = waiter;
+        } else {
+            head = waiter;
+        }
+        tail = waiter;
+    }
+
+    void unlink(Waiter *waiter) noexcept {
+        if (waiter->prev) {
+            waiter->prev->next = waiter->next;
+        } else {
+            head = waiter->next;
+        }
+        if (waiter->next) {
+            waiter->next->prev = waiter->prev;
+        } else {
+            tail = waiter->prev;
+        }
+        waiter->prev = waiter->next = nullptr;
+    }
+
+    /* Mark the readers and/or writers of a stream for another attempt */
+    void signal(yamux_stream_t *stream, bool readers, bool writers) noexcept {
+        for (Waiter *w = head; w; w = w->next) {
+            if (w->stream == stream && (w->writer ? writers : readers)) {
+                w->signalled = true;
+            }
+        }
+    }
+
+    /* The stream's handle is gone: its waiters finish with YAMUX_ERR_CLOSED */
+    void cancel(yamux_stream_t *stream) noexcept {
+        for (Waiter *w = head; w; w = w->next) {
+            if (w->stream == stream) {
+                w->stream = nullptr;
+                w->result = YAMUX_ERR_CLOSED;
+            }
+        }
+    }
+
+    bool settle(Waiter *w) noexcept {
+        if (!w->stream) {
+            return true;
+        }
+        if (failure != YAMUX_OK) {
+            w->result = failure;
+            return true;
+        }
+        /* A writer with window credit left was held up by the egress queue: retry it too */
+        if (w->signalled || (w->writer && yamux_stream_get_send_window(w->stream) > 0)) {
+            w->signalled = false;
+            return w->attempt(w);
+        }
+        return false;
+    }
+
+    /* Retry what the callbacks marked and resume the finished coroutines, in the order they waited */
+    void resume_ready() noexcept {
+        Waiter *ready = nullptr;
+        Waiter *ready_tail = nullptr;
+        Waiter *w = head;
+
+        while (w) {
+            Waiter *next = w->next;
+
+            if (settle(w)) {
+                unlink(w);
+                if (ready_tail) {
+                    ready_tail->next = w;
+                } else {
+                    ready = w;
+                }
+                ready_tail = w;
+            }
+            w = next;
+        }
+
+        /* A resumed coroutine may end its frame, waiter included, or this session */
+        while (ready) {
+            std::coroutine_handle<> handle = ready->handle;
+
+            ready = ready->next;
+            handle.resume();
+        }
+    }
+
+    static Core *of(void *user_data) noexcept {
+        return static_cast<Core *>(user_data);
+    }
+
+    static void on_readable(yamux_stream_t *stream, void *user_data) {
+        Core *core = of(user_data);
+
+        core->signal(stream, true, false);
+        if (core->user.on_stream_readable) {
+            core->user.on_stream_readable(stream, core->user.user_data);
+        }
+    }
+
+    static void on_writable(yamux_stream_t *stream, void *user_data) {
+        Core *core = of(user_data);
+
+        core->signal(stream, false, true);
+        if (core->user.on_stream_writable) {
+            core->user.on_stream_writable(stream, core->user.user_data);
+        }
+    }
+
+    static void on_accept(yamux_session_t *session, yamux_stream_t *stream, void *user_data) {
+        Core *core = of(user_data);
+
+        if (core->user.on_stream_accept) {
+            core->user.on_stream_accept(session, stream, core->user.user_data);
+        }
+    }
+
+    static void on_closed(yamux_stream_t *stream, void *user_data) {
+        Core *core = of(user_data);
+
+        core->signal(stream, true, true);
+        if (core->user.on_stream_closed) {
+            core->user.on_stream_closed(stream, core->user.user_data);
+        }
+    }
+
+    static void on_failed(yamux_session_t *session, yamux_result_t error, void *user_data) {
+        Core *core = of(user_data);
+
+        core->failure = error;
+        if (core->user.on_session_failed) {
+            core->user.on_session_failed(session, error, core->user.user_data);
+        }
+    }
+
+    yamux_result_t install() noexcept {
+        yamux_callbacks_t callbacks = {};
+
+        callbacks.on_stream_readable = on_readable;
+        callbacks.on_stream_writable = on_writable;
+        callbacks.on_stream_accept = on_accept;
+        callbacks.on_stream_closed = on_closed;
+        callbacks.on_session_failed = on_failed;
+        callbacks.user_data = this;
+        return yamux_session_set_callbacks(session, &callbacks);
+    }
+
+    /* Finish a C call that processed frames: a hard error fails every waiter */
+    yamux_result_t after(yamux_result_t result) noexcept {
+        if (result != YAMUX_OK && result != YAMUX_ERR_WOULD_BLOCK && failure == YAMUX_OK) {
+            failure = result;
+        }
+        resume_ready();
+        return result;
+    }
+};
+
+} // namespace detail
+
+/**
+ * Awaitable read: finishes with up to buf.size() bytes, 0 at end of stream
+ *
+ * Returned by Stream::read(std::span<uint8_t>); co_await it once.
+ */
+class ReadAwaitable : private detail::Waiter {
+public:
+    ReadAwaitable(const ReadAwaitable &) = delete;
+    ReadAwaitable &operator=(const ReadAwaitable &) = delete;
+
+    bool await_ready() noexcept {
+        if (!core_ || !stream || failed()) {
+            return true;
+        }
+        return attempt(this);
+    }
+
+    void await_suspend(std::coroutine_handle<> h) noexcept {
+        handle = h;
+        core_->link(this);
+    }
+
+    IoResult await_resume() const noexcept {
+        return {result, bytes};
+    }
+
+private:
+    friend class Stream;
+
+    ReadAwaitable(detail::Core *core, yamux_stream_t *s, std::span<uint8_t> buf) noexcept
+        : core_(core), buf_(buf) {
+        stream = s;
+        attempt = try_read;
+        result = (core && s) ? YAMUX_OK : YAMUX_ERR_INVALID;
+    }
+
+    bool failed() noexcept {
+        if (core_->failure != YAMUX_OK) {
+            result = core_->failure;
+            return true;
+        }
+        return false;
+    }
+
+    static bool try_read(detail::Waiter *waiter) noexcept {
+        ReadAwaitable *self = static_cast<ReadAwaitable *>(waiter);
+        size_t n = 0;
+        bool finished;
+
+        if (self->buf_.empty()) {
+            self->result = YAMUX_OK;
+            return true;
+        }
+
+        /* Checked before reading: data never follows the FIN */
+        finished = (yamux_stream_get_state(self->stream) == YAMUX_STREAM_FIN_RECV);
+        self->result = yamux_stream_read(self->stream, self->buf_.data(), self->buf_.size(), &n);
+        self->bytes = n;
+        return self->result != YAMUX_OK || n > 0 || finished;
+    }
+
+    detail::Core *core_;
+    std::span<uint8_t> buf_;
+};
+
+/**
+ * Awaitable write: finishes once all of buf is written, or with the error that stopped it
+ *
+ * Returned by Stream::write(std::span<const uint8_t>); co_await it once.
+ * The data must stay valid until then. bytes counts what was written
+ * before an error.
+ */
+class WriteAwaitable : private detail::Waiter {
+public:
+    WriteAwaitable(const WriteAwaitable &) = delete;
+    WriteAwaitable &operator=(const WriteAwaitable &) = delete;
+
+    bool await_ready() noexcept {
+        if (!core_ || !stream || failed()) {
+            return true;
+        }
+        return attempt(this);
+    }
+
+    void await_suspend(std::coroutine_handle<> h) noexcept {
+        handle = h;
+        core_->link(this);
+    }
+
+    IoResult await_resume() const noexcept {
+        return {result, bytes};
+    }
+
+private:
+    friend class Stream;
+
+    WriteAwaitable(detail::Core *core, yamux_stream_t *s, std::span<const uint8_t> buf) noexcept
+        : core_(core), buf_(buf) {
+        stream = s;
+        attempt = try_write;
+        writer = true;
+        result = (core && s) ? YAMUX_OK : YAMUX_ERR_INVALID;
+    }
+
+    bool failed() noexcept {
+        if (core_->failure != YAMUX_OK) {
+            result = core_->failure;
+            return true;
+        }
+        return false;
+    }
+
+    static bool try_write(detail::Waiter *waiter) noexcept {
+        WriteAwaitable *self = static_cast<WriteAwaitable *>(waiter);
+        size_t n = 0;
+
+        while (self->bytes < self->buf_.size()) {
+            self->result = yamux_stream_write(self->stream, self->buf_.data() + self->bytes,
+                                              self->buf_.size() - self->bytes, &n);
+            if (self->result == YAMUX_ERR_WOULD_BLOCK) {
+                self->result = YAMUX_OK;
+                return false;
+            }
+            if (self->result != YAMUX_OK) {
+                return true;
+            }
+            if (n == 0) {
+                return false;
+            }
+            self->bytes += n;
+        }
+        self->result = YAMUX_OK;
+        return true;
+    }
+
+    detail::Core *core_;
+    std::span<const uint8_t> buf_;
+};
+
+/**
+ * A stream, closed (FIN) and freed when destroyed
+ */
+class Stream {
+public:
+    Stream() noexcept = default;
+
+    Stream(Stream &&other) noexcept
+        : core_(other.core_), stream_(std::exchange(other.stream_, nullptr)) {}
+
+    Stream &operator=(Stream &&other) noexcept {
+        if (this != &other) {
+            (void)close();
+            core_ = other.core_;
+            stream_ = std::exchange(other.stream_, nullptr);
+        }
+        return *this;
+    }
+
+    Stream(const Stream &) = delete;
+    Stream &operator=(const Stream &) = delete;
+
+    ~Stream() {
+        (void)close();
+    }
+
+    explicit operator bool() const noexcept {
+        return stream_ != nullptr;
+    }
+
+    /** The C handle, still owned by this Stream */
+    yamux_stream_t *get() const noexcept {
+        return stream_;
+    }
+
+    /** Give up ownership of the C handle without closing it (free it with yamux_stream_free()) */
+    yamux_stream_t *release() noexcept {
+        return std::exchange(stream_, nullptr);
+    }
+
+    uint32_t id() const noexcept {
+        return stream_ ? yamux_stream_get_id(stream_) : 0;
+    }
+
+    yamux_stream_state_t state() const noexcept {
+        return stream_ ? yamux_stream_get_state(stream_) : YAMUX_STREAM_CLOSED;
+    }
+
+    /**
+     * Close the stream and free the handle
+     *
+     * After a normal close the C stream goes back to the session's pool once
+     * the peer has finished too (yamux_stream_free()). A coroutine still awaiting the stream finishes with YAMUX_ERR_CLOSED
+     * at the session's next process().
+     *
+     * @param reset true to reset (RST), false for a normal close (FIN)
+     * @return YAMUX_OK on success, error code otherwise
+     */
+    yamux_result_t close(bool reset = false) noexcept {
+        yamux_stream_t *stream = release();
+
+        if (!stream) {
+            return YAMUX_ERR_INVALID;
+        }
+        if (core_) {
+            core_->cancel(stream);
+        }
+        return reset ? yamux_stream_close(stream, 1) : yamux_stream_free(stream);
+    }
+
+    /** Read what is buffered into buf (yamux_stream_read()) */
+    yamux_result_t read(std::span<uint8_t> buf, size_t &bytes_read) noexcept {
+        bytes_read = 0;
+        return yamux_stream_read(stream_, buf.data(), buf.size(), &bytes_read);
+    }
+
+    /** Write as much of buf as the window allows (yamux_stream_write()) */
+    yamux_result_t write(std::span<const uint8_t> buf, size_t &bytes_written) noexcept {
+        bytes_written = 0;
+        return yamux_stream_write(stream_, buf.data(), buf.size(), &bytes_written);
+    }
+
+    /** Write segments as one run of frames (yamux_stream_writev()) */
+    yamux_result_t writev(std::span<const yamux_iovec_t> iov, size_t &bytes_written) noexcept {
+        bytes_written = 0;
+        return yamux_stream_writev(stream_, iov.data(), static_cast<int>(iov.size()), &bytes_written);
+    }
+
+    /** co_await: wait for data (or the end of the stream) and read it into buf */
+    ReadAwaitable read(std::span<uint8_t> buf) noexcept {
+        return ReadAwaitable(core_, stream_, buf);
+    }
+
+    /** co_await: write all of buf, waiting for window credit as needed */
+    WriteAwaitable write(std::span<const uint8_t> buf) noexcept {
+        return WriteAwaitable(core_, stream_, buf);
+    }
+
+private:
+    friend class Session;
+
+    Stream(detail::Core *core, yamux_stream_t *stream) noexcept : core_(core), stream_(stream) {}
+
+    detail::Core *core_ = nullptr;
+    yamux_stream_t *stream_ = nullptr;
+};
+
+/**
+ * A single-threaded session, closed when destroyed
+ */
+class Session {
+public:
+    Session() noexcept = default;
+    Session(Session &&) noexcept = default;
+    Session &operator=(Session &&) noexcept = default;
+    Session(const Session &) = delete;
+    Session &operator=(const Session &) = delete;
+    ~Session() = default;
+
+    /**
+     * Create a session (yamux_session_create())
+     *
+     * @param io I/O callbacks (copied)
+     * @param client true for the client side, false for the server side
+     * @param config Configuration or NULL for defaults; thread_safe must be 0
+     * @param session Set to the new session on success
+     * @return YAMUX_OK on success, error code otherwise
+     */
+    static yamux_result_t create(const yamux_io_t &io, bool client, const yamux_config_t *config,
+                                 Session &session) noexcept {
+        std::unique_ptr<detail::Core> core(new (std::nothrow) detail::Core);
+        yamux_io_t copy = io;
+        yamux_result_t result;
+
+        if (config && config->thread_safe) {
+            return YAMUX_ERR_INVALID;
+        }
+        if (!core) {
+            return YAMUX_ERR_NOMEM;
+        }
+        result = yamux_session_create(&copy, client ? 1 : 0, config, &core->session);
+        if (result != YAMUX_OK) {
+            return result;
+        }
+        result = core->install();
+        if (result != YAMUX_OK) {
+            return result;
+        }
+        session.core_ = std::move(core);
+        return YAMUX_OK;
+    }
+
+    explicit operator bool() const noexcept {
+        return core_ != nullptr;
+    }
+
+    /** The C handle, still owned by this Session */
+    yamux_session_t *get() const noexcept {
+        return core_ ? core_->session : nullptr;
+    }
+
+    /**
+     * Set application callbacks, called after the wrapper's own
+     *
+     * @param callbacks Callbacks to copy, or NULL to remove them
+     * @return YAMUX_OK on success, YAMUX_ERR_INVALID without a session
+     */
+    yamux_result_t set_callbacks(const yamux_callbacks_t *callbacks) noexcept {
+        if (!core_) {
+            return YAMUX_ERR_INVALID;
+        }
+        core_->user = callbacks ? *callbacks : yamux_callbacks_t{};
+        return YAMUX_OK;
+    }
+
+    /**
+     * Process incoming data (yamux_session_process()), then resume the coroutines it unblocked
+     *
+     * An error other than YAMUX_ERR_WOULD_BLOCK fails the session: every
+     * awaited operation finishes with it.
+     */
+    yamux_result_t process() noexcept {
+        return core_ ? core_->after(yamux_session_process(core_->session)) : YAMUX_ERR_INVALID;
+    }
+
+    /** Run the session's timers (yamux_session_tick()), then resume what they unblocked */
+    yamux_result_t tick(uint64_t now_ms) noexcept {
+        return core_ ? core_->after(yamux_session_tick(core_->session, now_ms)) : YAMUX_ERR_INVALID;
+    }
+
+    /** Write out queued frames (yamux_session_flush()), then resume writers the queue held up */
+    yamux_result_t flush() noexcept {
+        return core_ ? core_->after(yamux_session_flush(core_->session)) : YAMUX_ERR_INVALID;
+    }
+
+    /** Open a stream (yamux_stream_open_detailed() with the next free ID) */
+    yamux_result_t open(Stream &stream) noexcept {
+        yamux_stream_t *s = nullptr;
+        yamux_result_t result;
+
+        if (!core_) {
+            return YAMUX_ERR_INVALID;
+        }
+        result = yamux_stream_open_detailed(core_->session, 0, &s);
+        if (result == YAMUX_OK) {
+            stream = Stream(core_.get(), s);
+        }
+        return result;
+    }
+
+    /** Take the next stream the peer opened (yamux_stream_accept()) */
+    yamux_result_t accept(Stream &stream) noexcept {
+        yamux_stream_t *s = nullptr;
+        yamux_result_t result;
+
+        if (!core_) {
+            return YAMUX_ERR_INVALID;
+        }
+        result = yamux_stream_accept(core_->session, &s);
+        if (result == YAMUX_OK) {
+            stream = Stream(core_.get(), s);
+        }
+        return result;
+    }
+
+private:
+    std::unique_ptr<detail::Core> core_;
+};
+
+} // namespace yamux
+
+#endif /* TINY_YAMUX_HPP */
@@ -14,9 +14,93 @@
 /* Protocol version */
 #define YAMUX_VERSION 0
 
+/**
+ * Build profiles
+ * The YAMUX_PROFILE CMake option defines one; each picks the defaults of
+ * the values below it has not been given on the command line.
+ *   YAMUX_PROFILE_EMBEDDED: small buffers, caches and batches, a fixed
+ *     4 KB frame size, no statistics and no egress scheduler (CMake also
+ *     turns off threads, the reactor, the runtime and logging)
+ *   YAMUX_PROFILE_SERVER: large buffers, caches and batches for many
+ *     busy sessions
+ */
+#if defined(YAMUX_PROFILE_EMBEDDED)
+#ifndef YAMUX_POOL_CACHE_SIZE
+#define YAMUX_POOL_CACHE_SIZE 1
+#endif
+#ifndef YAMUX_DEFAULT_READ_BUFFER_SIZE
+#define YAMUX_DEFAULT_READ_BUFFER_SIZE (4 * 1024)
+#endif
+#ifndef YAMUX_DEFAULT_WRITE_BUFFER_SIZE
+#define YAMUX_DEFAULT_WRITE_BUFFER_SIZE (8 * 1024)
+#endif
+#ifndef YAMUX_MAX_DATA_FRAME_SIZE
+#define YAMUX_MAX_DATA_FRAME_SIZE (4 * 1024)
+#endif
+#ifndef YAMUX_FIXED_FRAME_SIZE
+#define YAMUX_FIXED_FRAME_SIZE 1
+#endif
+#ifndef YAMUX_MAX_FRAME_SEGMENTS
+#define YAMUX_MAX_FRAME_SEGMENTS 4
+#endif
+#ifndef YAMUX_DECODE_BATCH
+#define YAMUX_DECODE_BATCH 4
+#endif
+#ifndef YAMUX_DEFAULT_ACCEPT_BACKLOG
+#define YAMUX_DEFAULT_ACCEPT_BACKLOG 16
+#endif
+#ifndef YAMUX_PING_SLOTS
+#define YAMUX_PING_SLOTS 1
+#endif
+#ifndef YAMUX_MAX_STREAMS
+#define YAMUX_MAX_STREAMS 64
+#endif
+#ifndef YAMUX_STATS
+#define YAMUX_STATS 0
+#endif
+#ifndef YAMUX_SCHED
+#define YAMUX_SCHED 0
+#endif
+#ifndef YAMUX_LOG_MESSAGE_SIZE
+#define YAMUX_LOG_MESSAGE_SIZE 128
+#endif
+#elif defined(YAMUX_PROFILE_SERVER)
+#ifndef YAMUX_POOL_CACHE_SIZE
+#define YAMUX_POOL_CACHE_SIZE 64
+#endif
+#ifndef YAMUX_DEFAULT_READ_BUFFER_SIZE
+#define YAMUX_DEFAULT_READ_BUFFER_SIZE (256 * 1024)
+#endif
+#ifndef YAMUX_DEFAULT_WRITE_BUFFER_SIZE
+#define YAMUX_DEFAULT_WRITE_BUFFER_SIZE (128 * 1024)
+#endif
+#ifndef YAMUX_MAX_FRAME_SEGMENTS
+#define YAMUX_MAX_FRAME_SEGMENTS 64
+#endif
+#ifndef YAMUX_DECODE_BATCH
+#define YAMUX_DECODE_BATCH 64
+#endif
+#ifndef YAMUX_URING_DEFAULT_BUFFERS
+#define YAMUX_URING_DEFAULT_BUFFERS 256
+#endif
+#ifndef YAMUX_DEFAULT_ACCEPT_BACKLOG
+#define YAMUX_DEFAULT_ACCEPT_BACKLOG 1024
+#endif
+#ifndef YAMUX_PING_SLOTS
+#define YAMUX_PING_SLOTS 8
+#endif
+#ifndef YAMUX_MAX_STREAMS
+#define YAMUX_MAX_STREAMS 65536
+#endif
+#endif
+
 /**
  * Memory allocation configuration
- * Uncomment to use static memory allocation instead of dynamic allocation
+ * Uncomment to use static memory allocation instead of dynamic allocation:
+ * every allocation then goes through yamux_alloc()/yamux_free(), which you
+ * provide (e.g. over a static arena). Set yamux_config_t.stream_pool_size
+ * so per-stream memory is all taken up front when the session is created,
+ * and yamux_config_t.fixed_memory to allocate nothing after that.
  */
 /* #define YAMUX_STATIC_MEMORY */
 
@@ -29,39 +113,177 @@ void *yamux_alloc(size_t size);
 void yamux_free(void *ptr);
 #endif
 
+/* Freed stream objects and receive buffers each session keeps for reuse,
+ * beyond those preallocated by yamux_config_t.stream_pool_size */
+#ifndef YAMUX_POOL_CACHE_SIZE
+#define YAMUX_POOL_CACHE_SIZE 4
+#endif
+
+/* Bytes of received data a stream holds in its own struct before it needs
+ * a receive buffer; buffers are only allocated while a stream holds data */
+#ifndef YAMUX_STREAM_INLINE_SIZE
+#define YAMUX_STREAM_INLINE_SIZE 64
+#endif
+
 /**
  * Buffer size configuration
  */
 /* Initial receive buffer size for streams */
+#ifndef YAMUX_INITIAL_BUFFER_SIZE
 #define YAMUX_INITIAL_BUFFER_SIZE 4096
+#endif
 
-/* Default window size for flow control */
+/* Initial window size for flow control; fixed by the protocol, since
+ * each peer assumes the other starts every stream with it */
 #define YAMUX_DEFAULT_WINDOW_SIZE (256 * 1024)
 
+/* Default share of the window, in percent, that must be consumed before
+ * the credit is returned in one WINDOW_UPDATE */
+#ifndef YAMUX_DEFAULT_WINDOW_UPDATE_PERCENT
+#define YAMUX_DEFAULT_WINDOW_UPDATE_PERCENT 50
+#endif
+
+/* Default session ingress buffer size (one transport read fills it) */
+#ifndef YAMUX_DEFAULT_READ_BUFFER_SIZE
+#define YAMUX_DEFAULT_READ_BUFFER_SIZE (32 * 1024)
+#endif
+
+/* Default session egress queue size (queued frames are flushed when it fills) */
+#ifndef YAMUX_DEFAULT_WRITE_BUFFER_SIZE
+#define YAMUX_DEFAULT_WRITE_BUFFER_SIZE (16 * 1024)
+#endif
+
+/* Largest DATA payload sent per frame (yamux_config_t.max_frame_size = 0) */
+#ifndef YAMUX_MAX_DATA_FRAME_SIZE
+#define YAMUX_MAX_DATA_FRAME_SIZE (16 * 1024)
+#endif
+
+/* Non-zero to send every DATA frame at up to YAMUX_MAX_DATA_FRAME_SIZE
+ * exactly: the limit folds to a constant, and config.max_frame_size and
+ * yamux_stream_set_max_frame_size() only accept 0 or that size */
+#ifndef YAMUX_FIXED_FRAME_SIZE
+#define YAMUX_FIXED_FRAME_SIZE 0
+#endif
+
+/* User segments yamux_stream_writev() packs into one DATA frame; each frame
+ * is one io.writev call of this many segments plus the header */
+#ifndef YAMUX_MAX_FRAME_SEGMENTS
+#define YAMUX_MAX_FRAME_SEGMENTS 16
+#endif
+
+/* Frame headers the ingress parser decodes in one pass before handling
+ * the frames; each takes 16 bytes of stack */
+#ifndef YAMUX_DECODE_BATCH
+#define YAMUX_DECODE_BATCH 16
+#endif
+
+/**
+ * io_uring transport configuration (yamux_uring.h)
+ */
+/* Default number of receive buffers registered with the kernel */
+#ifndef YAMUX_URING_DEFAULT_BUFFERS
+#define YAMUX_URING_DEFAULT_BUFFERS 64
+#endif
+
+/* Default size of each registered receive buffer */
+#ifndef YAMUX_URING_DEFAULT_BUFFER_SIZE
+#define YAMUX_URING_DEFAULT_BUFFER_SIZE (16 * 1024)
+#endif
+
+/* Egress staging per send; two are used so one fills while the other is sent */
+#ifndef YAMUX_URING_WRITE_BUFFER_SIZE
+#define YAMUX_URING_WRITE_BUFFER_SIZE (64 * 1024)
+#endif
+
 /**
  * Session configuration defaults
  */
 /* Default accept backlog size */
+#ifndef YAMUX_DEFAULT_ACCEPT_BACKLOG
 #define YAMUX_DEFAULT_ACCEPT_BACKLOG 256
+#endif
 
 /* Default keepalive enabled/disabled */
+#ifndef YAMUX_DEFAULT_KEEPALIVE_ENABLE
 #define YAMUX_DEFAULT_KEEPALIVE_ENABLE 1
+#endif
 
 /* Default connection write timeout in milliseconds */
+#ifndef YAMUX_DEFAULT_CONN_WRITE_TIMEOUT
 #define YAMUX_DEFAULT_CONN_WRITE_TIMEOUT 30000
+#endif
 
 /* Default keepalive interval in milliseconds */
+#ifndef YAMUX_DEFAULT_KEEPALIVE_INTERVAL
 #define YAMUX_DEFAULT_KEEPALIVE_INTERVAL 60000
+#endif
+
+/**
+ * Optional subsystems: 0 compiles one out, with its fields of the session
+ * and stream structures
+ */
+/* Counters and the ping round-trip histogram (yamux_session_get_stats(),
+ * yamux_stream_get_stats(), yamux_session_get_rtt()); without them the
+ * counters read zero and only the smoothed round trip is kept */
+#ifndef YAMUX_STATS
+#define YAMUX_STATS 1
+#endif
+
+/* Egress scheduler; without it sessions with config.egress_quantum set
+ * are refused and yamux_stream_set_priority() fails */
+#ifndef YAMUX_SCHED
+#define YAMUX_SCHED 1
+#endif
+
+/**
+ * Egress scheduler configuration (yamux_config_t.egress_quantum)
+ */
+/* Data each stream may have queued in the scheduler */
+#ifndef YAMUX_SCHED_QUEUE_SIZE
+#define YAMUX_SCHED_QUEUE_SIZE (64 * 1024)
+#endif
+
+/* Stream priority levels; level 0 is served first */
+#ifndef YAMUX_PRIORITY_LEVELS
+#define YAMUX_PRIORITY_LEVELS 8
+#endif
+
+/* Priority level and weight of a new stream */
+#ifndef YAMUX_DEFAULT_PRIORITY
+#define YAMUX_DEFAULT_PRIORITY 4
+#endif
+#ifndef YAMUX_DEFAULT_WEIGHT
+#define YAMUX_DEFAULT_WEIGHT 1
+#endif
+
+/* Pings timed at once; a ping sent with all in flight replaces the oldest */
+#ifndef YAMUX_PING_SLOTS
+#define YAMUX_PING_SLOTS 4
+#endif
+
+/* Resolution of session timers (yamux_session_tick()) in milliseconds */
+#ifndef YAMUX_TIMER_TICK_MS
+#define YAMUX_TIMER_TICK_MS 10
+#endif
 
 /**
  * Maximum stream configuration
  */
 /* Maximum number of concurrent streams per session */
+#ifndef YAMUX_MAX_STREAMS
 #define YAMUX_MAX_STREAMS 1024
+#endif
 
 /* Maximum stream ID value */
 #define YAMUX_MAX_STREAM_ID 0x7FFFFFFF
 
+/**
+ * Threading configuration
+ */
+/* Define (the YAMUX_THREADS CMake option does) to support thread-safe
+ * sessions, yamux_config_t.thread_safe, with POSIX threads */
+/* #define YAMUX_THREADS */
+
 /**
  * Debug configuration
  */
@@ -71,8 +293,34 @@ void yamux_free(void *ptr);
 #ifdef YAMUX_DEBUG
 /**
  * Define your own debug logging function
+ * Receives every message not taken by a sink set with yamux_set_log_sink()
  */
 void yamux_debug_log(const char *format, ...);
 #endif
 
+/**
+ * Logging configuration
+ */
+/* Log levels, most severe first */
+#define YAMUX_LOG_LEVEL_NONE  0
+#define YAMUX_LOG_LEVEL_ERROR 1
+#define YAMUX_LOG_LEVEL_WARN  2
+#define YAMUX_LOG_LEVEL_INFO  3
+#define YAMUX_LOG_LEVEL_DEBUG 4
+
+/* Most verbose level compiled in; messages above it cost nothing.
+ * Per-frame messages are DEBUG, so the default keeps them out. */
+#ifndef YAMUX_LOG_LEVEL
+#ifdef YAMUX_DEBUG
+#define YAMUX_LOG_LEVEL YAMUX_LOG_LEVEL_DEBUG
+#else
+#define YAMUX_LOG_LEVEL YAMUX_LOG_LEVEL_ERROR
+#endif
+#endif
+
+/* Longest formatted log message, including the terminator */
+#ifndef YAMUX_LOG_MESSAGE_SIZE
+#define YAMUX_LOG_MESSAGE_SIZE 256
+#endif
+
 #endif /* YAMUX_CONFIG_H */
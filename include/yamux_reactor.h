@@ -0,0 +1,188 @@
+/**
+ * @file yamux_reactor.h
+ * @brief Event-loop driver for many yamux sessions on one thread
+ *
+ * The reactor watches the non-blocking socket of each registered session
+ * with epoll (Linux) or kqueue (BSD, macOS). When a socket is readable the
+ * session's frames are processed; when frames are queued because the
+ * socket was full, the reactor waits for it to become writable and flushes
+ * them. One thread can so serve many multiplexed connections.
+ *
+ * The sessions' io callbacks must not block: yamux_fd_read() and
+ * yamux_fd_write() implement them over a file descriptor.
+ */
+
+#ifndef TINY_YAMUX_REACTOR_H
+#define TINY_YAMUX_REACTOR_H
+
+#include "yamux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Reactor handle
+ */
+typedef struct yamux_reactor yamux_reactor_t;
+
+/**
+ * Session event callback
+ *
+ * Called after a session's incoming frames were processed, so the
+ * application can accept streams and read data, and when the connection
+ * failed (result is then an error and the session should be removed).
+ *
+ * @param reactor Reactor
+ * @param fd Descriptor the session was registered with
+ * @param session Session
+ * @param result Result of processing, YAMUX_OK or an error
+ * @param user_data Value given to yamux_reactor_add()
+ */
+typedef void (*yamux_reactor_fn)(yamux_reactor_t *reactor, int fd, yamux_session_t *session,
+                                 yamux_result_t result, void *user_data);
+
+/**
+ * Create a reactor
+ *
+ * @param reactor Output parameter for the created reactor
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_reactor_create(
+    yamux_reactor_t **reactor
+);
+
+/**
+ * Destroy a reactor
+ *
+ * Sessions still registered are left open; their descriptors are not closed.
+ *
+ * @param reactor Reactor
+ */
+void yamux_reactor_destroy(
+    yamux_reactor_t *reactor
+);
+
+/**
+ * Register a session with the reactor
+ *
+ * @param reactor Reactor
+ * @param fd Non-blocking descriptor the session's transport uses
+ * @param session Session to drive
+ * @param callback Event callback (may be NULL)
+ * @param user_data Passed through to callback
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_reactor_add(
+    yamux_reactor_t *reactor,
+    int fd,
+    yamux_session_t *session,
+    yamux_reactor_fn callback,
+    void *user_data
+);
+
+/**
+ * Unregister a session; it may be closed afterwards
+ *
+ * Safe to call from the event callback, for any session.
+ *
+ * @param reactor Reactor
+ * @param fd Descriptor the session was registered with
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_reactor_remove(
+    yamux_reactor_t *reactor,
+    int fd
+);
+
+/**
+ * Flush a session's queued frames, waiting for writability if needed
+ *
+ * Call after writing to the session's streams outside the event callback,
+ * so that frames queued on a full socket are sent once it drains.
+ *
+ * @param reactor Reactor
+ * @param fd Descriptor the session was registered with
+ * @return YAMUX_OK if flushed or left for the reactor, error code otherwise
+ */
+yamux_result_t yamux_reactor_flush(
+    yamux_reactor_t *reactor,
+    int fd
+);
+
+/**
+ * Get the user_data a session was registered with
+ *
+ * @param reactor Reactor
+ * @param fd Descriptor the session was registered with
+ * @return The user_data given to yamux_reactor_add(), NULL if fd is not registered
+ */
+void *yamux_reactor_user_data(
+    yamux_reactor_t *reactor,
+    int fd
+);
+
+/**
+ * Make a running or the next yamux_reactor_poll() return at once
+ *
+ * The only reactor function that may be called from any thread, for
+ * handing work to the thread polling it.
+ *
+ * @param reactor Reactor
+ */
+void yamux_reactor_wake(
+    yamux_reactor_t *reactor
+);
+
+/**
+ * Wait for socket readiness and dispatch it to the sessions
+ *
+ * @param reactor Reactor
+ * @param timeout_ms Longest wait in milliseconds (-1 = no limit, 0 = do not wait)
+ * @return Number of descriptors serviced, or a negative error code
+ */
+int yamux_reactor_poll(
+    yamux_reactor_t *reactor,
+    int timeout_ms
+);
+
+/**
+ * yamux_io_t.read over a non-blocking descriptor
+ *
+ * @param ctx Pointer to the int descriptor
+ * @param buf Buffer to fill
+ * @param len Size of buf
+ * @return Bytes read, 0 if none are available, or YAMUX_ERR_IO on error or end of file
+ */
+int yamux_fd_read(void *ctx, uint8_t *buf, size_t len);
+
+/**
+ * yamux_io_t.write over a non-blocking descriptor
+ *
+ * @param ctx Pointer to the int descriptor
+ * @param buf Data to write
+ * @param len Length of data
+ * @return Bytes written, 0 if the descriptor is full, or YAMUX_ERR_IO on error
+ */
+int yamux_fd_write(void *ctx, const uint8_t *buf, size_t len);
+
+/**
+ * yamux_io_t.sendfile over a non-blocking descriptor
+ *
+ * Uses sendfile(2) on Linux, which unlike yamux_fd_write() cannot suppress
+ * SIGPIPE: ignore it when the peer may close the connection.
+ *
+ * @param ctx Pointer to the int descriptor
+ * @param fd File to read from
+ * @param offset Offset in the file
+ * @param len Bytes to write at most
+ * @return Bytes written, 0 if the descriptor is full, or YAMUX_ERR_IO on
+ *         error or if the file ends first
+ */
+int yamux_fd_sendfile(void *ctx, int fd, uint64_t offset, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TINY_YAMUX_REACTOR_H */
@@ -0,0 +1,213 @@
+/**
+ * @file yamux_runtime.h
+ * @brief Sharded multi-core runtime: one reactor thread per core
+ *
+ * The runtime starts N worker threads (shards), optionally pinned one per
+ * core. Each shard owns a reactor, a timer wheel and every session added
+ * to it, with the sessions' streams and pools, and is the only thread that
+ * touches them: sessions are single-threaded and the hot path takes no
+ * locks. A session is placed on a shard by a hash of its connection, so
+ * the same connection always lands on the same core.
+ *
+ * Other threads reach a shard by posting tasks to it through a lock-free
+ * queue; a task runs on the shard's thread, where it may use the shard's
+ * sessions and streams freely. This is how an application thread writes
+ * to a stream owned by another shard.
+ */
+
+#ifndef TINY_YAMUX_RUNTIME_H
+#define TINY_YAMUX_RUNTIME_H
+
+#include "yamux.h"
+#include "yamux_reactor.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Runtime handle
+ */
+typedef struct yamux_runtime yamux_runtime_t;
+
+/**
+ * One worker thread of a runtime and what it owns
+ */
+typedef struct yamux_shard yamux_shard_t;
+
+/**
+ * Work to run on a shard's thread (see yamux_shard_post())
+ *
+ * The caller owns the task and fills in run and arg. It must stay valid
+ * until run is called; run may free it or post it again.
+ */
+typedef struct yamux_shard_task {
+    struct yamux_shard_task *next;  /* Used by the runtime while queued */
+    void (*run)(yamux_shard_t *shard, struct yamux_shard_task *task);
+    void *arg;                      /* For the caller */
+} yamux_shard_task_t;
+
+/**
+ * Session event callback, run on the session's shard
+ *
+ * Called once the session is created (result YAMUX_OK), after its incoming
+ * frames were processed, and when it failed (result is an error, session
+ * may be NULL if it could not be created). A failed session is closed and
+ * unregistered when the callback returns; the descriptor is left open.
+ *
+ * @param shard Shard owning the session
+ * @param fd Descriptor the session was added with
+ * @param session Session
+ * @param result YAMUX_OK or an error
+ * @param user_data Value given to yamux_runtime_add()
+ */
+typedef void (*yamux_runtime_fn)(yamux_shard_t *shard, int fd, yamux_session_t *session,
+                                 yamux_result_t result, void *user_data);
+
+/**
+ * Create a runtime and start its shards
+ *
+ * @param shards Number of worker threads (0 = one per online CPU)
+ * @param pin Pin shard i to CPU i modulo the CPU count (Linux only; ignored elsewhere)
+ * @param runtime Output parameter for the created runtime
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_runtime_create(
+    uint32_t shards,
+    int pin,
+    yamux_runtime_t **runtime
+);
+
+/**
+ * Stop the shards and destroy the runtime
+ *
+ * Tasks already posted still run. Sessions still added are then closed;
+ * their descriptors are not. Must not be called from a shard.
+ *
+ * @param runtime Runtime
+ */
+void yamux_runtime_destroy(
+    yamux_runtime_t *runtime
+);
+
+/**
+ * Get the number of shards
+ *
+ * @param runtime Runtime
+ * @return Number of shards
+ */
+uint32_t yamux_runtime_shard_count(
+    const yamux_runtime_t *runtime
+);
+
+/**
+ * Get a shard by index
+ *
+ * @param runtime Runtime
+ * @param index Shard index, below yamux_runtime_shard_count()
+ * @return The shard, NULL if index is out of range
+ */
+yamux_shard_t *yamux_runtime_shard(
+    yamux_runtime_t *runtime,
+    uint32_t index
+);
+
+/**
+ * Get the shard a connection hash maps to
+ *
+ * @param runtime Runtime
+ * @param hash Any hash of the connection (e.g. of its address and port)
+ * @return The shard yamux_runtime_add() places the connection on
+ */
+yamux_shard_t *yamux_runtime_shard_for(
+    yamux_runtime_t *runtime,
+    uint64_t hash
+);
+
+/**
+ * Add a connection; its session is created on the shard hash maps to
+ *
+ * May be called from any thread. The session is created on the shard
+ * with config (thread_safe is ignored: shards need no locks), io
+ * callbacks over fd (yamux_fd_read(), yamux_fd_write(),
+ * yamux_fd_sendfile()) and the shard's timer wheel, and callback is then
+ * told about it. The runtime sets the session's on_session_failed
+ * callback to report timer failures; an application replacing the session
+ * callbacks must remove a failed session itself (yamux_shard_remove()).
+ *
+ * @param runtime Runtime
+ * @param fd Non-blocking connected socket
+ * @param hash Connection hash choosing the shard
+ * @param client 1 for the client side (odd stream IDs), 0 for the server side
+ * @param config Session configuration (NULL = defaults)
+ * @param callback Event callback (may be NULL)
+ * @param user_data Passed through to callback
+ * @return YAMUX_OK once the connection is handed to its shard, error code otherwise
+ */
+yamux_result_t yamux_runtime_add(
+    yamux_runtime_t *runtime,
+    int fd,
+    uint64_t hash,
+    int client,
+    const yamux_config_t *config,
+    yamux_runtime_fn callback,
+    void *user_data
+);
+
+/**
+ * Run a task on a shard's thread
+ *
+ * May be called from any thread, including the shard's own; never blocks
+ * and takes no lock. Tasks from one thread run in the order posted.
+ *
+ * @param shard Shard
+ * @param task Task, with run set
+ * @return YAMUX_OK on success, YAMUX_ERR_INVALID for missing arguments
+ */
+yamux_result_t yamux_shard_post(
+    yamux_shard_t *shard,
+    yamux_shard_task_t *task
+);
+
+/**
+ * Close and unregister a session of the shard; the descriptor stays open
+ *
+ * Call on the shard's thread only (from a callback or task).
+ *
+ * @param shard Shard
+ * @param fd Descriptor the session was added with
+ * @return YAMUX_OK on success, YAMUX_ERR_INVALID if fd has no session here
+ */
+yamux_result_t yamux_shard_remove(
+    yamux_shard_t *shard,
+    int fd
+);
+
+/**
+ * Get the reactor of a shard
+ *
+ * Use it on the shard's thread only, e.g. yamux_reactor_flush() after a
+ * task wrote to a stream.
+ *
+ * @param shard Shard
+ * @return The shard's reactor
+ */
+yamux_reactor_t *yamux_shard_reactor(
+    yamux_shard_t *shard
+);
+
+/**
+ * Get the index of a shard
+ *
+ * @param shard Shard
+ * @return Index from 0 to yamux_runtime_shard_count() - 1
+ */
+uint32_t yamux_shard_index(
+    const yamux_shard_t *shard
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TINY_YAMUX_RUNTIME_H */
@@ -0,0 +1,88 @@
+/**
+ * @file yamux_uring.h
+ * @brief io_uring transport for yamux sessions (Linux)
+ *
+ * The transport keeps a multishot receive posted on the socket, landing
+ * data in a ring of buffers registered with the kernel, and coalesces the
+ * session's writes into one send at a time. Read and write callbacks only
+ * touch shared memory: completions are picked up from the completion
+ * ring and data is copied out of (or into) the transport's buffers
+ * without a system call. yamux_uring_run() submits queued work, waits for
+ * completions when asked, and processes the data that arrived, all in one
+ * io_uring_enter() call.
+ */
+
+#ifndef TINY_YAMUX_URING_H
+#define TINY_YAMUX_URING_H
+
+#include "yamux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Transport handle
+ */
+typedef struct yamux_uring yamux_uring_t;
+
+/**
+ * Create an io_uring transport for a connected socket
+ *
+ * @param fd Connected stream socket (blocking or not)
+ * @param buf_count Receive buffers registered with the kernel, rounded up to a power of two (0 = default)
+ * @param buf_size Size of each receive buffer in bytes (0 = default)
+ * @param uring Output parameter for the created transport
+ * @return YAMUX_OK on success, YAMUX_ERR_IO if io_uring is unavailable, error code otherwise
+ */
+yamux_result_t yamux_uring_create(
+    int fd,
+    unsigned buf_count,
+    size_t buf_size,
+    yamux_uring_t **uring
+);
+
+/**
+ * Destroy a transport; outstanding operations are cancelled
+ *
+ * The socket is not closed.
+ *
+ * @param uring Transport
+ */
+void yamux_uring_destroy(
+    yamux_uring_t *uring
+);
+
+/**
+ * Set the transport callbacks of a session's io
+ *
+ * Fills in read, write and ctx; the other fields are left as they are.
+ *
+ * @param uring Transport
+ * @param io I/O callbacks to pass to yamux_session_create()
+ */
+void yamux_uring_io(
+    yamux_uring_t *uring,
+    yamux_io_t *io
+);
+
+/**
+ * Submit queued sends, collect completions and process received frames
+ *
+ * @param uring Transport
+ * @param session Session using the transport (NULL to only submit and reap)
+ * @param wait Non-zero to block until something completes if no data is waiting
+ * @return YAMUX_OK on success, YAMUX_ERR_IO if the connection failed or was closed,
+ *         or the error from processing the session
+ */
+yamux_result_t yamux_uring_run(
+    yamux_uring_t *uring,
+    yamux_session_t *session,
+    int wait
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TINY_YAMUX_URING_H */
@@ -1,17 +1,25 @@
 /**
  * @file yamux_buffer.c
  * @brief Implementation of buffer management for yamux
+ *
+ * Buffers are fixed-capacity rings: pos is the read offset, used the number
+ * of buffered bytes, and writes land at (pos + used) modulo storage_size.
+ *
+ * A lazy buffer has its capacity but no storage until data is written. A
+ * write that fits goes to the caller's small inline storage first; larger
+ * data moves everything to storage of the full capacity. Once drained the
+ * storage is released again, so idle streams hold no buffer memory.
  */
 
 #include "yamux_internal.h"
-#include <stdlib.h>
+#include "yamux_defs.h"
 #include <string.h>
 
 /**
- * Initialize a buffer with an initial size
+ * Initialize a buffer with a fixed capacity
  *
  * @param buffer Buffer to initialize
- * @param initial_size Initial size of the buffer
+ * @param initial_size Capacity of the buffer
  * @return YAMUX_OK on success, error code otherwise
  */
 yamux_result_t yamux_buffer_init(yamux_buffer_t *buffer, size_t initial_size)
@@ -20,8 +28,101 @@ yamux_result_t yamux_buffer_init(yamux_buffer_t *buffer, size_t initial_size)
         return YAMUX_ERR_INVALID;
     }
     
+    return yamux_buffer_init_pooled(buffer, NULL, initial_size);
+}
+
+/* Allocate storage, from the pool when the size is the one it serves;
+ * a fixed pool's buffers have no other size to fall back on */
+static uint8_t *yamux_buffer_alloc(yamux_pool_t *pool, size_t size)
+{
+    if (pool && size == pool->object_size) {
+        return (uint8_t *)yamux_pool_get(pool);
+    }
+    if (pool && pool->fixed) {
+        return NULL;
+    }
+    return (uint8_t *)YAMUX_MALLOC(size);
+}
+
+/* Release storage obtained from yamux_buffer_alloc() */
+static void yamux_buffer_release(yamux_pool_t *pool, uint8_t *data, size_t size)
+{
+    if (pool && data && size == pool->object_size) {
+        yamux_pool_put(pool, data);
+    } else {
+        YAMUX_FREE(data);
+    }
+}
+
+/* Drop a buffer's storage; inline storage is not owned */
+static void yamux_buffer_drop(yamux_buffer_t *buffer)
+{
+    if (buffer->data != buffer->inline_data) {
+        yamux_buffer_release(buffer->pool, buffer->data, buffer->storage_size);
+    }
+    buffer->data = NULL;
+    buffer->storage_size = 0;
+    buffer->pos = 0;
+}
+
+/*
+ * Make sure a lazy buffer's storage can take len more bytes: use the
+ * inline storage while the contents fit in it, else move to storage of
+ * the full capacity.
+ */
+static yamux_result_t yamux_buffer_attach(yamux_buffer_t *buffer, size_t len)
+{
+    uint8_t *data;
+    size_t copied = 0;
+    
+    if (buffer->data && buffer->used + len <= buffer->storage_size) {
+        return YAMUX_OK;
+    }
+    
+    if (!buffer->data && buffer->inline_data && len <= buffer->inline_size) {
+        buffer->data = buffer->inline_data;
+        buffer->storage_size = buffer->inline_size;
+        buffer->pos = 0;
+        return YAMUX_OK;
+    }
+    
+    data = yamux_buffer_alloc(buffer->pool, buffer->size);
+    if (!data) {
+        return YAMUX_ERR_NOMEM;
+    }
+    if (buffer->used > 0) {
+        (void)yamux_buffer_read(buffer, data, buffer->used, &copied);
+    }
+    if (buffer->data) {
+        yamux_buffer_drop(buffer);
+    }
+    buffer->data = data;
+    buffer->storage_size = buffer->size;
+    buffer->used = copied;
+    buffer->pos = 0;
+    
+    return YAMUX_OK;
+}
+
+/**
+ * Initialize a buffer whose storage comes from a pool
+ *
+ * Storage of pool->object_size bytes is taken from and returned to the
+ * pool, including across resizes; any other size uses the heap.
+ *
+ * @param buffer Buffer to initialize
+ * @param pool Pool for storage (NULL for the heap)
+ * @param initial_size Capacity of the buffer
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_buffer_init_pooled(yamux_buffer_t *buffer, yamux_pool_t *pool, size_t initial_size)
+{
+    if (!buffer || initial_size == 0) {
+        return YAMUX_ERR_INVALID;
+    }
+    
     /* Allocate buffer */
-    buffer->data = (uint8_t *)malloc(initial_size);
+    buffer->data = yamux_buffer_alloc(pool, initial_size);
     if (!buffer->data) {
         return YAMUX_ERR_NOMEM;
     }
@@ -30,6 +131,38 @@ yamux_result_t yamux_buffer_init(yamux_buffer_t *buffer, size_t initial_size)
     buffer->size = initial_size;
     buffer->used = 0;
     buffer->pos = 0;
+    buffer->storage_size = initial_size;
+    buffer->pool = pool;
+    buffer->inline_data = NULL;
+    buffer->inline_size = 0;
+    buffer->lazy = 0;
+    
+    return YAMUX_OK;
+}
+
+/**
+ * Initialize a buffer that allocates storage only while it holds data
+ *
+ * @param buffer Buffer to initialize
+ * @param pool Pool for storage (NULL for the heap)
+ * @param initial_size Capacity of the buffer
+ * @param inline_data Storage for small contents, owned by the caller (may be NULL)
+ * @param inline_size Bytes at inline_data
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_buffer_init_lazy(yamux_buffer_t *buffer, yamux_pool_t *pool, size_t initial_size,
+                                      uint8_t *inline_data, size_t inline_size)
+{
+    if (!buffer || initial_size == 0) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->size = initial_size;
+    buffer->pool = pool;
+    buffer->inline_data = inline_size > 0 ? inline_data : NULL;
+    buffer->inline_size = buffer->inline_data ? inline_size : 0;
+    buffer->lazy = 1;
     
     return YAMUX_OK;
 }
@@ -42,11 +175,9 @@ yamux_result_t yamux_buffer_init(yamux_buffer_t *buffer, size_t initial_size)
 void yamux_buffer_free(yamux_buffer_t *buffer)
 {
     if (buffer) {
-        free(buffer->data);
-        buffer->data = NULL;
+        yamux_buffer_drop(buffer);
         buffer->size = 0;
         buffer->used = 0;
-        buffer->pos = 0;
     }
 }
 
@@ -56,38 +187,39 @@ void yamux_buffer_free(yamux_buffer_t *buffer)
  * @param buffer Buffer to write to
  * @param data Data to write
  * @param len Length of data
- * @return YAMUX_OK on success, error code otherwise
+ * @return YAMUX_OK on success, YAMUX_ERR_NOMEM if len exceeds the free space,
+ *         error code otherwise
  */
 yamux_result_t yamux_buffer_write(yamux_buffer_t *buffer, const uint8_t *data, size_t len)
 {
-    uint8_t *new_data;
-    size_t new_size;
+    size_t tail;
+    size_t first;
     
     if (!buffer || !data || len == 0) {
         return YAMUX_ERR_INVALID;
     }
     
-    /* Check if buffer needs to be resized */
-    if (buffer->used + len > buffer->size) {
-        /* Calculate new size (double the current size or add enough for the new data) */
-        new_size = buffer->size * 2;
-        if (new_size < buffer->used + len) {
-            new_size = buffer->used + len;
-        }
-        
-        /* Resize buffer */
-        new_data = (uint8_t *)realloc(buffer->data, new_size);
-        if (!new_data) {
-            return YAMUX_ERR_NOMEM;
-        }
-        
-        /* Update buffer */
-        buffer->data = new_data;
-        buffer->size = new_size;
+    /* The capacity is fixed; never grow */
+    if (len > buffer->size - buffer->used) {
+        return YAMUX_ERR_NOMEM;
+    }
+    if (buffer->lazy && yamux_buffer_attach(buffer, len) != YAMUX_OK) {
+        return YAMUX_ERR_NOMEM;
     }
     
-    /* Copy data to buffer */
-    memcpy(buffer->data + buffer->used, data, len);
+    /* Copy up to the end of the storage, then wrap to the front */
+    tail = buffer->pos + buffer->used;
+    if (tail >= buffer->storage_size) {
+        tail -= buffer->storage_size;
+    }
+    first = buffer->storage_size - tail;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(buffer->data + tail, data, first);
+    if (len > first) {
+        memcpy(buffer->data, data + first, len - first);
+    }
     buffer->used += len;
     
     return YAMUX_OK;
@@ -104,56 +236,199 @@ yamux_result_t yamux_buffer_write(yamux_buffer_t *buffer, const uint8_t *data, s
  */
 yamux_result_t yamux_buffer_read(yamux_buffer_t *buffer, uint8_t *data, size_t len, size_t *bytes_read)
 {
-    size_t available;
+    yamux_iovec_t segs[2];
+    int nsegs;
+    size_t copied = 0;
+    int i;
     
     if (!buffer || !data || len == 0 || !bytes_read) {
         return YAMUX_ERR_INVALID;
     }
     
-    /* Calculate available bytes */
-    available = buffer->used - buffer->pos;
-    if (available == 0) {
-        *bytes_read = 0;
-        return YAMUX_OK;
+    /* Copy from both segments of the ring */
+    nsegs = yamux_buffer_peek(buffer, segs);
+    for (i = 0; i < nsegs && copied < len; i++) {
+        size_t n = segs[i].len;
+        if (n > len - copied) {
+            n = len - copied;
+        }
+        memcpy(data + copied, segs[i].base, n);
+        copied += n;
     }
     
-    /* Adjust read size if necessary */
-    if (len > available) {
-        len = available;
+    yamux_buffer_consume(buffer, copied);
+    *bytes_read = copied;
+    
+    return YAMUX_OK;
+}
+
+/**
+ * Get the buffered bytes without consuming them
+ *
+ * The data may wrap around the end of the storage, so it is described by
+ * up to two segments in order.
+ *
+ * @param buffer Buffer to inspect
+ * @param segs Output array of two segments
+ * @return Number of segments filled (0, 1 or 2)
+ */
+int yamux_buffer_peek(const yamux_buffer_t *buffer, yamux_iovec_t segs[2])
+{
+    size_t first;
+    
+    if (!buffer || !segs || buffer->used == 0) {
+        return 0;
     }
     
-    /* Copy data from buffer */
-    memcpy(data, buffer->data + buffer->pos, len);
+    first = buffer->storage_size - buffer->pos;
+    if (first >= buffer->used) {
+        segs[0].base = buffer->data + buffer->pos;
+        segs[0].len = buffer->used;
+        return 1;
+    }
+    
+    segs[0].base = buffer->data + buffer->pos;
+    segs[0].len = first;
+    segs[1].base = buffer->data;
+    segs[1].len = buffer->used - first;
+    return 2;
+}
+
+/**
+ * Discard bytes from the read side of a buffer
+ *
+ * @param buffer Buffer to consume from
+ * @param len Number of bytes to discard (clamped to the buffered amount)
+ */
+void yamux_buffer_consume(yamux_buffer_t *buffer, size_t len)
+{
+    if (!buffer) {
+        return;
+    }
+    
+    if (len > buffer->used) {
+        len = buffer->used;
+    }
     buffer->pos += len;
-    *bytes_read = len;
+    if (buffer->pos >= buffer->storage_size) {
+        buffer->pos -= buffer->storage_size;
+    }
+    buffer->used -= len;
     
-    return YAMUX_OK;
+    /* Rewind when empty so the next data is contiguous */
+    if (buffer->used == 0) {
+        buffer->pos = 0;
+        
+        /* Drained: give the storage back (grown heap storage is kept) */
+        if (buffer->lazy && buffer->data &&
+            (buffer->data == buffer->inline_data ||
+             (buffer->pool && buffer->storage_size == buffer->pool->object_size))) {
+            yamux_buffer_drop(buffer);
+        }
+    }
 }
 
 /**
- * Compact a buffer by removing already read data
+ * Get the contiguous free space at the write side of a buffer
  *
- * @param buffer Buffer to compact
- * @return YAMUX_OK on success, error code otherwise
+ * Lets a caller fill the buffer in place (e.g. straight from io.read);
+ * yamux_buffer_commit() then makes the bytes readable. The free space may
+ * wrap, in which case only the part before the end of storage is returned.
+ * A lazy buffer gets storage of its full capacity here.
+ *
+ * @param buffer Buffer to write into
+ * @param space Set to the start of the free space
+ * @return Number of bytes that may be written at space
  */
-yamux_result_t yamux_buffer_compact(yamux_buffer_t *buffer)
+size_t yamux_buffer_reserve(yamux_buffer_t *buffer, uint8_t **space)
+{
+    size_t tail;
+    size_t free_len;
+    
+    if (!buffer || !space) {
+        return 0;
+    }
+    
+    free_len = buffer->size - buffer->used;
+    if (buffer->lazy && free_len > 0 &&
+        yamux_buffer_attach(buffer, free_len) != YAMUX_OK) {
+        return 0;
+    }
+    tail = buffer->pos + buffer->used;
+    if (tail >= buffer->storage_size) {
+        tail -= buffer->storage_size;
+    }
+    
+    *space = buffer->data + tail;
+    return (buffer->storage_size - tail < free_len) ? buffer->storage_size - tail : free_len;
+}
+
+/**
+ * Make bytes written in place after yamux_buffer_reserve() readable
+ *
+ * @param buffer Buffer that was written
+ * @param len Number of bytes written (clamped to the free space)
+ */
+void yamux_buffer_commit(yamux_buffer_t *buffer, size_t len)
 {
     if (!buffer) {
+        return;
+    }
+    
+    if (len > buffer->size - buffer->used) {
+        len = buffer->size - buffer->used;
+    }
+    buffer->used += len;
+}
+
+/**
+ * Change the capacity of a buffer, keeping its contents
+ *
+ * The buffered bytes are moved to the front of the new storage, so any
+ * pointer previously returned by yamux_buffer_peek() becomes invalid.
+ * Buffers of a fixed pool keep the pool's size.
+ *
+ * @param buffer Buffer to resize
+ * @param new_size New capacity (at least the buffered amount)
+ * @return YAMUX_OK on success, YAMUX_ERR_NOMEM if the storage cannot change, error code otherwise
+ */
+yamux_result_t yamux_buffer_resize(yamux_buffer_t *buffer, size_t new_size)
+{
+    uint8_t *data;
+    size_t copied;
+    
+    if (!buffer || new_size == 0 || new_size < buffer->used) {
         return YAMUX_ERR_INVALID;
     }
+    if (buffer->pool && buffer->pool->fixed && new_size != buffer->size) {
+        return YAMUX_ERR_NOMEM;
+    }
     
-    /* Check if there's anything to compact */
-    if (buffer->pos == 0) {
+    /* Lazy storage is sized when it is next attached; inline contents stay put */
+    if (buffer->lazy && (buffer->used == 0 || buffer->data == buffer->inline_data)) {
+        if (buffer->used == 0 && buffer->data) {
+            yamux_buffer_drop(buffer);
+        }
+        buffer->size = new_size;
         return YAMUX_OK;
     }
     
-    /* Move data to the beginning of the buffer */
-    if (buffer->pos < buffer->used) {
-        memmove(buffer->data, buffer->data + buffer->pos, buffer->used - buffer->pos);
+    data = yamux_buffer_alloc(buffer->pool, new_size);
+    if (!data) {
+        return YAMUX_ERR_NOMEM;
+    }
+    
+    /* Unwrap into the new storage */
+    copied = 0;
+    if (buffer->used > 0) {
+        (void)yamux_buffer_read(buffer, data, buffer->used, &copied);
     }
     
-    /* Update buffer */
-    buffer->used -= buffer->pos;
+    yamux_buffer_drop(buffer);
+    buffer->data = data;
+    buffer->size = new_size;
+    buffer->storage_size = new_size;
+    buffer->used = copied;
     buffer->pos = 0;
     
     return YAMUX_OK;
@@ -7,6 +7,17 @@
 #define YAMUX_DEFS_H
 
 #include "../include/yamux.h"
+#include "../include/yamux_config.h"
+
+/* Memory allocation: the YAMUX_STATIC_MEMORY hooks replace malloc/free */
+#ifdef YAMUX_STATIC_MEMORY
+#define YAMUX_MALLOC(size) yamux_alloc(size)
+#define YAMUX_FREE(ptr) yamux_free(ptr)
+#else
+#include <stdlib.h>
+#define YAMUX_MALLOC(size) malloc(size)
+#define YAMUX_FREE(ptr) free(ptr)
+#endif
 
 /* Protocol constants */
 #define YAMUX_PROTO_VERSION 0
@@ -26,15 +37,21 @@
 /* Frame format */
 #define YAMUX_HEADER_SIZE   12  /* 8 bytes for header + 4 bytes for length */
 
-/* Flow control */
-#define YAMUX_DEFAULT_WINDOW_SIZE (256 * 1024)  /* 256 KB */
-#define YAMUX_WINDOW_UPDATE_THRESHOLD (YAMUX_DEFAULT_WINDOW_SIZE / 2)  /* 50% threshold for window update */
+/* Initial number of buckets in a session's stream table */
+#define YAMUX_STREAM_TABLE_INITIAL_CAPACITY 16
 
-/* Initial buffer size */
-#define YAMUX_INITIAL_BUFFER_SIZE 4096
+/* Stream states are defined in yamux.h, window and frame sizes in yamux_config.h */
 
-/* Stream states are defined in yamux.h */
+/* Largest payload accepted on a WINDOW_UPDATE, PING or GO_AWAY frame */
+#define YAMUX_MAX_CONTROL_PAYLOAD 8
 
-#define YAMUX_MAX_DATA_FRAME_SIZE 16384 /* 16KB, max payload for a single DATA frame */
+/* Round-trip histogram: four buckets per power of two of milliseconds */
+#define YAMUX_RTT_BUCKETS 124
+
+/* Smallest usable session ingress buffer: one header plus a control payload */
+#define YAMUX_MIN_READ_BUFFER_SIZE (YAMUX_HEADER_SIZE + YAMUX_MAX_CONTROL_PAYLOAD)
+
+/* Smallest session egress queue: one control frame */
+#define YAMUX_MIN_WRITE_BUFFER_SIZE (YAMUX_HEADER_SIZE + YAMUX_MAX_CONTROL_PAYLOAD)
 
 #endif /* YAMUX_DEFS_H */
@@ -5,6 +5,79 @@
 
 #include "../include/yamux.h"
 #include "yamux_internal.h"
+#include <string.h>
+
+/*
+ * Headers move as a 64-bit word (version, type, flags, stream ID) and a
+ * 32-bit length, each one unaligned big-endian load or store.
+ */
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define YAMUX_BE64(v) (v)
+#define YAMUX_BE32(v) (v)
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__BYTE_ORDER__) && \
+      __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define YAMUX_BE64(v) __builtin_bswap64(v)
+#define YAMUX_BE32(v) __builtin_bswap32(v)
+#endif
+
+static uint64_t yamux_load_be64(const uint8_t *p) {
+#ifdef YAMUX_BE64
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return YAMUX_BE64(v);
+#else
+    return ((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+           ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7];
+#endif
+}
+
+static uint32_t yamux_load_be32(const uint8_t *p) {
+#ifdef YAMUX_BE32
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return YAMUX_BE32(v);
+#else
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+#endif
+}
+
+static void yamux_store_be64(uint8_t *p, uint64_t v) {
+#ifdef YAMUX_BE64
+    v = YAMUX_BE64(v);
+    memcpy(p, &v, sizeof(v));
+#else
+    int i;
+    for (i = 7; i >= 0; i--, v >>= 8) {
+        p[i] = (uint8_t)v;
+    }
+#endif
+}
+
+static void yamux_store_be32(uint8_t *p, uint32_t v) {
+#ifdef YAMUX_BE32
+    v = YAMUX_BE32(v);
+    memcpy(p, &v, sizeof(v));
+#else
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+#endif
+}
+
+/*
+ * Split a header's leading word into the header. Version and type are its
+ * top 16 bits; less the version shifted up, a valid pair is just a type,
+ * so one unsigned comparison checks both.
+ */
+static yamux_result_t yamux_unpack_header(uint64_t word, uint32_t length, yamux_header_t *header) {
+    header->version = (uint8_t)(word >> 56);
+    header->type = (uint8_t)(word >> 48);
+    header->flags = (uint16_t)(word >> 32);
+    header->stream_id = (uint32_t)word;
+    header->length = length;
+    return ((word >> 48) - ((uint64_t)YAMUX_PROTO_VERSION << 8) > YAMUX_GO_AWAY) ? YAMUX_ERR_PROTOCOL : YAMUX_OK;
+}
 
 /**
  * Encode a yamux header into a binary buffer
@@ -24,27 +97,9 @@ yamux_result_t yamux_encode_header(const yamux_header_t *header, uint8_t *buffer
         return YAMUX_ERR_INVALID;
     }
     
-    /* Version */
-    buffer[0] = header->version;
-    
-    /* Type */
-    buffer[1] = header->type;
-    
-    /* Flags (big-endian) */
-    buffer[2] = (header->flags >> 8) & 0xFF;
-    buffer[3] = header->flags & 0xFF;
-    
-    /* Stream ID (big-endian) */
-    buffer[4] = (header->stream_id >> 24) & 0xFF;
-    buffer[5] = (header->stream_id >> 16) & 0xFF;
-    buffer[6] = (header->stream_id >> 8) & 0xFF;
-    buffer[7] = header->stream_id & 0xFF;
-    
-    /* Length (stored after the header in the following 4 bytes) */
-    buffer[8] = (header->length >> 24) & 0xFF;
-    buffer[9] = (header->length >> 16) & 0xFF;
-    buffer[10] = (header->length >> 8) & 0xFF;
-    buffer[11] = header->length & 0xFF;
+    yamux_store_be64(buffer, ((uint64_t)header->version << 56) | ((uint64_t)header->type << 48) |
+                             ((uint64_t)header->flags << 32) | header->stream_id);
+    yamux_store_be32(buffer + 8, header->length);
     
     return YAMUX_OK;
 }
@@ -59,39 +114,54 @@ yamux_result_t yamux_encode_header(const yamux_header_t *header, uint8_t *buffer
  */
 yamux_result_t yamux_decode_header(const uint8_t *buffer, size_t buffer_len, yamux_header_t *header)
 {
-    if (!buffer || !header) {
+    if (!buffer || !header || buffer_len < YAMUX_HEADER_SIZE) {
         return YAMUX_ERR_INVALID;
     }
     
-    /* Check buffer size - actual header is 8 bytes, not 12 */
-    if (buffer_len < 8) {
-        return YAMUX_ERR_INVALID;
-    }
-    
-    /* Version */
-    header->version = buffer[0];
-    
-    /* Check version */
-    if (header->version != YAMUX_PROTO_VERSION) {
-        return YAMUX_ERR_PROTOCOL;
-    }
-    
-    /* Type */
-    header->type = buffer[1];
+    return yamux_unpack_header(yamux_load_be64(buffer), yamux_load_be32(buffer + 8), header);
+}
+
+/**
+ * Decode the complete frames at the front of a buffer in one pass
+ * 
+ * A frame is complete once its header and all of its payload are in the
+ * buffer. Frames are laid end to end from buffer[0].
+ * 
+ * @param buffer Received bytes
+ * @param buffer_len Number of bytes in buffer
+ * @param frames Output descriptors, one per complete frame
+ * @param max Capacity of frames
+ * @param status Set to YAMUX_OK if max frames were decoded, YAMUX_ERR_WOULD_BLOCK
+ *        if the next frame is incomplete, or YAMUX_ERR_PROTOCOL if its header is malformed
+ * @return Number of frames decoded
+ */
+size_t yamux_decode_frames(const uint8_t *buffer, size_t buffer_len, yamux_frame_desc_t *frames,
+                           size_t max, yamux_result_t *status)
+{
+    size_t offset = 0;
+    size_t count = 0;
+    uint32_t length;
     
-    /* Check type */
-    if (header->type > YAMUX_GO_AWAY) {
-        return YAMUX_ERR_PROTOCOL;
+    *status = YAMUX_OK;
+    while (count < max) {
+        if (buffer_len - offset < YAMUX_HEADER_SIZE) {
+            *status = YAMUX_ERR_WOULD_BLOCK;
+            break;
+        }
+        length = yamux_load_be32(buffer + offset + 8);
+        if (yamux_unpack_header(yamux_load_be64(buffer + offset), length, &frames[count].header) != YAMUX_OK) {
+            *status = YAMUX_ERR_PROTOCOL;
+            break;
+        }
+        length = YAMUX_FRAME_PAYLOAD_LEN(&frames[count].header);
+        if (buffer_len - offset - YAMUX_HEADER_SIZE < length) {
+            *status = YAMUX_ERR_WOULD_BLOCK;
+            break;
+        }
+        frames[count].offset = (uint32_t)offset;
+        offset += YAMUX_HEADER_SIZE + (size_t)length;
+        count++;
     }
     
-    /* Flags (big-endian) */
-    header->flags = (buffer[2] << 8) | buffer[3];
-    
-    /* Stream ID (big-endian) */
-    header->stream_id = (buffer[4] << 24) | (buffer[5] << 16) | (buffer[6] << 8) | buffer[7];
-    
-    /* Length (big-endian) */
-    header->length = (buffer[8] << 24) | (buffer[9] << 16) | (buffer[10] << 8) | buffer[11];
-    
-    return YAMUX_OK;
+    return count;
 }
@@ -6,27 +6,85 @@
 #include "../include/yamux.h"
 #include "yamux_internal.h"
 #include "yamux_defs.h"
+#include "yamux_log.h"
 #include <stdlib.h>
-#include <stdio.h>
 #include <string.h>
+#include <arpa/inet.h>
+
+/* Stream events seen while handling a frame */
+#define YAMUX_EVENT_ACCEPT   0x1
+#define YAMUX_EVENT_READABLE 0x2
+#define YAMUX_EVENT_WRITABLE 0x4
+#define YAMUX_EVENT_CLOSED   0x8
+
+/*
+ * Run the application's callbacks for a stream's events. Called last in a
+ * handler, once the stream's state is final: the callbacks may use it.
+ */
+static void yamux_report_events(yamux_session_t *session, yamux_stream_t *stream, int events) {
+    const yamux_callbacks_t *cb = &session->callbacks;
+    
+    /* The application freed it and hears nothing more */
+    if (stream->orphaned) {
+        return;
+    }
+    if ((events & YAMUX_EVENT_ACCEPT) && cb->on_stream_accept) {
+        cb->on_stream_accept(session, stream, cb->user_data);
+    }
+    if ((events & YAMUX_EVENT_READABLE) && cb->on_stream_readable) {
+        cb->on_stream_readable(stream, cb->user_data);
+    }
+    if ((events & YAMUX_EVENT_WRITABLE) && cb->on_stream_writable) {
+        cb->on_stream_writable(stream, cb->user_data);
+    }
+    if ((events & YAMUX_EVENT_CLOSED) && cb->on_stream_closed) {
+        cb->on_stream_closed(stream, cb->user_data);
+    }
+}
+
+/*
+ * Apply a peer's RST, carried by a DATA or WINDOW_UPDATE frame: the
+ * stream closes at once, a waiting read fails, and the application hears
+ * of it, or a stream it already freed is released. The stream must not
+ * be touched after this returns.
+ */
+static void yamux_stream_reset_by_peer(yamux_session_t *session, yamux_stream_t *stream) {
+    int orphaned = stream->orphaned;
+    
+    stream->state = YAMUX_STREAM_CLOSED;
+    yamux_remove_stream(session, stream->id);
+    if (orphaned) {
+        yamux_stream_release(stream);
+        return;
+    }
+    yamux_stream_complete_read(stream, 0, YAMUX_ERR_CLOSED);
+    yamux_report_events(session, stream, YAMUX_EVENT_CLOSED);
+}
 
 /**
  * Handle a DATA frame
  * 
  * @param session Session context
  * @param header Frame header
+ * @param payload Frame payload (header->length bytes)
  * @return YAMUX_OK on success, error code otherwise
  */
-yamux_result_t yamux_handle_data(yamux_session_t *session, const yamux_header_t *header) {
-    yamux_stream_t *stream;
-    yamux_result_t result;
-    int bytes_read;
-    
-    /* Validate session and header */
-    if (!session || !header) {
+yamux_result_t yamux_handle_data(yamux_session_t *session, const yamux_header_t *header, const uint8_t *payload) {
+    if (!header) {
         return YAMUX_ERR_INVALID;
     }
     
+    return yamux_handle_data_chunk(session, header, payload, header->length, 1);
+}
+
+/*
+ * Find the stream a DATA frame is for and check that len more payload
+ * bytes may be accepted on it.
+ */
+static yamux_result_t yamux_data_stream(yamux_session_t *session, const yamux_header_t *header,
+                                        size_t len, yamux_stream_t **out) {
+    yamux_stream_t *stream;
+    
     /* Find the stream */
     stream = yamux_get_stream(session, header->stream_id);
     if (!stream) {
@@ -39,136 +97,275 @@ yamux_result_t yamux_handle_data(yamux_session_t *session, const yamux_header_t
         return YAMUX_ERR_CLOSED;
     }
     
+    /* The peer may not send past the window we advertised */
+    if (!yamux_window_admits(stream, len) || len > stream->recvbuf.size - stream->recvbuf.used) {
+        return YAMUX_ERR_PROTOCOL;
+    }
+    
+    *out = stream;
+    return YAMUX_OK;
+}
+
+/*
+ * Account for len payload bytes now in the stream's buffer, and apply FIN
+ * on the last chunk. Returns the events to report.
+ */
+static int yamux_data_received(yamux_stream_t *stream, const yamux_header_t *header, size_t len, int last) {
+    /* Credit comes back through yamux_window_release() as data is consumed */
+    yamux_window_charge(stream, (uint32_t)len);
+    yamux_stats_data_in(stream, len, last);
+    
     /* Check for FIN flag */
-    if (header->flags & YAMUX_FLAG_FIN) {
+    if (last && (header->flags & YAMUX_FLAG_FIN)) {
         if (stream->state == YAMUX_STREAM_ESTABLISHED) {
             stream->state = YAMUX_STREAM_FIN_RECV;
         } else if (stream->state == YAMUX_STREAM_FIN_SENT) {
+            /* Both sides finished: the ID is free, the stream stays the application's */
             stream->state = YAMUX_STREAM_CLOSED;
+            yamux_remove_stream(stream->session, stream->id);
         }
+        return YAMUX_EVENT_READABLE | YAMUX_EVENT_CLOSED;
     }
+    return 0;
+}
+
+/*
+ * Apply RST on the last chunk of a DATA frame, whatever the stream's
+ * state; the frame's payload is dropped with the stream. An RST for a
+ * stream already gone is ignored, as for WINDOW_UPDATE.
+ */
+static yamux_result_t yamux_data_reset(yamux_session_t *session, const yamux_header_t *header) {
+    yamux_stream_t *stream = yamux_get_stream(session, header->stream_id);
     
-    /* If there's no data, we're done */
-    if (header->length == 0) {
-        return YAMUX_OK;
+    if (stream) {
+        yamux_stream_reset_by_peer(session, stream);
+    } else {
+        YAMUX_LOG_WARN("yamux_handle_data: RST for non-existent stream %u", header->stream_id);
     }
+    return YAMUX_OK;
+}
+
+/*
+ * Complete a posted read that received placed bytes, or that will get no
+ * more data because the peer finished the stream. Runs last: the callback
+ * may post again.
+ */
+static void yamux_data_complete_read(yamux_stream_t *stream, size_t placed) {
+    if (!stream->read_buf) {
+        return;
+    }
+    if (placed > 0) {
+        yamux_stream_complete_read(stream, placed, YAMUX_OK);
+    } else if (stream->recvbuf.used == 0 &&
+               (stream->state == YAMUX_STREAM_FIN_RECV || stream->state == YAMUX_STREAM_CLOSED)) {
+        yamux_stream_complete_read(stream, 0, YAMUX_OK);
+    }
+}
+
+/**
+ * Handle part of a DATA frame's payload
+ * 
+ * Called once per run of payload bytes as they arrive. The frame's flags
+ * take effect with the last chunk so the reader sees the data before FIN.
+ * 
+ * @param session Session context
+ * @param header Frame header
+ * @param chunk Payload bytes received so far for this call
+ * @param len Number of bytes in chunk
+ * @param last Non-zero if chunk completes the frame
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_handle_data_chunk(yamux_session_t *session, const yamux_header_t *header,
+                                       const uint8_t *chunk, size_t len, int last) {
+    yamux_stream_t *stream;
+    yamux_result_t result;
+    size_t placed = 0;
+    int events;
     
-    /* Allocate a buffer for the data if needed */
-    if (header->length > session->recv_buf_size) {
-        uint8_t *new_buf = realloc(session->recv_buf, header->length);
-        if (!new_buf) {
-            return YAMUX_ERR_NOMEM;
+    /* Validate session and header */
+    if (!session || !header || (len > 0 && !chunk)) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    if (last && (header->flags & YAMUX_FLAG_RST)) {
+        return yamux_data_reset(session, header);
+    }
+    
+    result = yamux_data_stream(session, header, len, &stream);
+    if (result != YAMUX_OK) {
+        return result;
+    }
+    
+    /* A waiting reader takes the data first, straight into its buffer */
+    if (len > 0 && stream->read_buf && stream->recvbuf.used == 0) {
+        placed = (len < stream->read_len) ? len : stream->read_len;
+        memcpy(stream->read_buf, chunk, placed);
+    }
+    
+    /* Write the rest to the stream's receive buffer */
+    if (len > placed) {
+        result = yamux_buffer_write(&stream->recvbuf, chunk + placed, len - placed);
+        if (result != YAMUX_OK) {
+            return result;
         }
-        session->recv_buf = new_buf;
-        session->recv_buf_size = header->length;
     }
     
-    /* Read the data from the connection */
-    bytes_read = session->io.read(session->io.ctx, session->recv_buf, header->length);
-    if (bytes_read < 0) {
-        return YAMUX_ERR_IO;
+    events = yamux_data_received(stream, header, len, last);
+    if (len > placed) {
+        events |= YAMUX_EVENT_READABLE;
     }
+    yamux_data_complete_read(stream, placed);
+    yamux_report_events(session, stream, events);
+    yamux_stream_reap(stream);
     
-    /* Check if we got all the data */
-    if ((size_t)bytes_read < header->length) {
-        /* Partial read, not enough data */
-        return YAMUX_ERR_IO;
+    return YAMUX_OK;
+}
+
+/**
+ * Get the place in a stream's receive buffer for the rest of a DATA payload
+ * 
+ * The session reads the payload straight into this space instead of
+ * staging it in the ingress buffer, then calls yamux_handle_data_commit().
+ * The space is a posted read buffer if the stream has one waiting.
+ * 
+ * @param session Session context
+ * @param header Frame header
+ * @param remaining Payload bytes of the frame still to arrive
+ * @param space Set to the free space in the stream's receive buffer
+ * @param space_len Set to the number of bytes that fit at space (at most remaining)
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_handle_data_reserve(yamux_session_t *session, const yamux_header_t *header,
+                                         size_t remaining, uint8_t **space, size_t *space_len) {
+    yamux_stream_t *stream;
+    yamux_result_t result;
+    size_t n;
+    
+    if (!session || !header || remaining == 0 || !space || !space_len) {
+        return YAMUX_ERR_INVALID;
     }
     
-    /* Write the data to the stream's receive buffer */
-    result = yamux_buffer_write(&stream->recvbuf, session->recv_buf, bytes_read);
+    /* The whole rest of the frame must fit, as for a buffered chunk */
+    result = yamux_data_stream(session, header, remaining, &stream);
     if (result != YAMUX_OK) {
         return result;
     }
     
-    /* Update the receive window */
-    stream->recv_window -= bytes_read;
-    
-    /* Send a window update if needed */
-    if (stream->recv_window < YAMUX_WINDOW_UPDATE_THRESHOLD) {
-        /* Implement window update inline since the function might not be defined yet */
-        yamux_header_t update;
-        uint8_t frame[12];  /* 8-byte header + 4-byte window size */
-        yamux_session_t *sess = stream->session;
-        
-        /* Create window update frame */
-        memset(&update, 0, sizeof(update));
-        update.version = YAMUX_PROTO_VERSION;
-        update.type = YAMUX_WINDOW_UPDATE;
-        update.flags = 0;
-        update.stream_id = stream->id;
-        update.length = 4;  /* Window update is a 32-bit value */
-        
-        /* Encode header */
-        yamux_encode_header(&update, frame);
-        
-        /* Encode window update (big-endian) */
-        frame[8] = (YAMUX_DEFAULT_WINDOW_SIZE >> 24) & 0xFF;
-        frame[9] = (YAMUX_DEFAULT_WINDOW_SIZE >> 16) & 0xFF;
-        frame[10] = (YAMUX_DEFAULT_WINDOW_SIZE >> 8) & 0xFF;
-        frame[11] = YAMUX_DEFAULT_WINDOW_SIZE & 0xFF;
-        
-        /* Send frame */
-        if (sess->io.write(sess->io.ctx, frame, sizeof(frame)) != sizeof(frame)) {
-            return YAMUX_ERR_IO;
+    /* Prefer a waiting reader's buffer over the stream's own */
+    if (stream->read_buf && stream->recvbuf.used == 0) {
+        *space = stream->read_buf;
+        n = stream->read_len;
+    } else {
+        n = yamux_buffer_reserve(&stream->recvbuf, space);
+        if (n == 0) {
+            return YAMUX_ERR_NOMEM;
         }
-        
-        /* Update the window */
-        stream->recv_window = YAMUX_DEFAULT_WINDOW_SIZE;
     }
+    *space_len = (n < remaining) ? n : remaining;
     
     return YAMUX_OK;
 }
 
+/**
+ * Complete payload bytes read into the space from yamux_handle_data_reserve()
+ * 
+ * @param session Session context
+ * @param header Frame header
+ * @param len Number of bytes read into the reserved space
+ * @param last Non-zero if these bytes complete the frame
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_handle_data_commit(yamux_session_t *session, const yamux_header_t *header,
+                                        size_t len, int last) {
+    yamux_stream_t *stream;
+    yamux_result_t result;
+    size_t placed = 0;
+    int events;
+    
+    if (!session || !header) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    if (last && (header->flags & YAMUX_FLAG_RST)) {
+        return yamux_data_reset(session, header);
+    }
+    
+    result = yamux_data_stream(session, header, len, &stream);
+    if (result != YAMUX_OK) {
+        return result;
+    }
+    
+    /* Same choice of target as yamux_handle_data_reserve() */
+    if (stream->read_buf && stream->recvbuf.used == 0) {
+        placed = len;
+    } else {
+        yamux_buffer_commit(&stream->recvbuf, len);
+    }
+    events = yamux_data_received(stream, header, len, last);
+    if (len > placed) {
+        events |= YAMUX_EVENT_READABLE;
+    }
+    yamux_data_complete_read(stream, placed);
+    yamux_report_events(session, stream, events);
+    yamux_stream_reap(stream);
+    
+    return YAMUX_OK;
+}
+
+/* Refuse a stream the peer opened with a WINDOW_UPDATE RST */
+static yamux_result_t yamux_refuse_stream(yamux_session_t *session, uint32_t stream_id) {
+    yamux_header_t rst_header;
+    
+    memset(&rst_header, 0, sizeof(rst_header));
+    rst_header.version = YAMUX_PROTO_VERSION;
+    rst_header.type = YAMUX_WINDOW_UPDATE;
+    rst_header.flags = YAMUX_FLAG_RST;
+    rst_header.stream_id = stream_id;
+    return yamux_session_send_frame(session, &rst_header, NULL, 0);
+}
+
 /**
  * Handle a WINDOW_UPDATE frame
  * 
  * @param session Session context
  * @param header Frame header
+ * @param payload Frame payload (header->length bytes)
  * @return YAMUX_OK on success, error code otherwise
  */
-yamux_result_t yamux_handle_window_update(yamux_session_t *session, const yamux_header_t *header) {
-    printf("CASCADE_DEBUG_V7_ENTRY (yamux_handle_window_update): Handling WINDOW_UPDATE for stream %u, flags: 0x%x, length: %u\n", header->stream_id, header->flags, header->length);
+yamux_result_t yamux_handle_window_update(yamux_session_t *session, const yamux_header_t *header, const uint8_t *payload) {
+    YAMUX_LOG_DEBUG("yamux_handle_window_update: Handling WINDOW_UPDATE for stream %u, flags: 0x%x, length: %u", header->stream_id, header->flags, header->length);
 
     uint32_t window_val_payload = 0; // Initialize, used if payload is present and read
 
+    if (header->length > 0 && !payload) {
+        return YAMUX_ERR_INVALID;
+    }
+
     // Logic to determine if payload should be read and its expected length based on flags
     if (header->flags & YAMUX_FLAG_SYN && !(header->flags & YAMUX_FLAG_ACK)) { // Client is opening a stream with SYN
         if (header->length == 0) {
-            printf("DEBUG (yamux_handle_window_update): Client SYN with length 0. Peer will use its default initial window or server assumes one.\n");
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: Client SYN with length 0. Peer will use its default initial window or server assumes one.");
             // window_val_payload remains 0, server will set its send_window for this stream to a default.
         } else if (header->length == 4) {
-            printf("DEBUG (yamux_handle_window_update): Client SYN with length 4. Reading initial window from payload.\n");
-            uint8_t payload_buf[4];
-            int read_len = session->io.read(session->io.ctx, payload_buf, 4);
-            if (read_len != 4) {
-                printf("ERROR (yamux_handle_window_update): Failed to read 4-byte payload for SYN (len 4). Read %d.\n", read_len);
-                return YAMUX_ERR_IO;
-            }
-            memcpy(&window_val_payload, payload_buf, sizeof(uint32_t));
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: Client SYN with length 4. Reading initial window from payload.");
+            memcpy(&window_val_payload, payload, sizeof(uint32_t));
             window_val_payload = ntohl(window_val_payload);
-            printf("DEBUG (yamux_handle_window_update): Client SYN, read payload_window_value: %u\n", window_val_payload);
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: Client SYN, read payload_window_value: %u", window_val_payload);
         } else {
-            printf("ERROR (yamux_handle_window_update): Invalid header length %u for client SYN. Expected 0 or 4.\n", header->length);
+            YAMUX_LOG_ERROR("yamux_handle_window_update: Invalid header length %u for client SYN. Expected 0 or 4.", header->length);
             return YAMUX_ERR_PROTOCOL;
         }
     } else if (header->flags & (YAMUX_FLAG_FIN | YAMUX_FLAG_RST)) { // FIN or RST frame
         if (header->length == 0) {
-            printf("DEBUG (yamux_handle_window_update): FIN/RST with length 0.\n");
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: FIN/RST with length 0.");
             // No payload for typical FIN/RST
         } else if (header->length == 4 && (header->flags & YAMUX_FLAG_ACK)) { // e.g. FIN|ACK with payload - less common
-            printf("DEBUG (yamux_handle_window_update): FIN/RST with ACK and length 4. Reading payload.\n");
-            uint8_t payload_buf[4];
-            int read_len = session->io.read(session->io.ctx, payload_buf, 4);
-            if (read_len != 4) {
-                printf("ERROR (yamux_handle_window_update): Failed to read 4-byte payload for FIN/RST+ACK (len 4). Read %d.\n", read_len);
-                return YAMUX_ERR_IO;
-            }
-            memcpy(&window_val_payload, payload_buf, sizeof(uint32_t));
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: FIN/RST with ACK and length 4. Reading payload.");
+            memcpy(&window_val_payload, payload, sizeof(uint32_t));
             window_val_payload = ntohl(window_val_payload);
-            printf("DEBUG (yamux_handle_window_update): FIN/RST+ACK, read payload_window_value: %u\n", window_val_payload);
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: FIN/RST+ACK, read payload_window_value: %u", window_val_payload);
         } else {
-            printf("ERROR (yamux_handle_window_update): Invalid header length %u for FIN/RST. Expected 0, or 4 if ACK also set. Flags: 0x%x\n", header->length, header->flags);
+            YAMUX_LOG_ERROR("yamux_handle_window_update: Invalid header length %u for FIN/RST. Expected 0, or 4 if ACK also set. Flags: 0x%x", header->length, header->flags);
             return YAMUX_ERR_PROTOCOL;
         }
     } else { // This covers: Pure Window Update (no other significant flags), or ACK frames (including SYN+ACK, etc.)
@@ -177,47 +374,53 @@ yamux_result_t yamux_handle_window_update(yamux_session_t *session, const yamux_
         if (header->length != 4) {
             if (header->length == 0) {
                 // Go implementation commonly sends length 0 frames for ACK and other control scenarios
-                printf("DEBUG (yamux_handle_window_update): Received frame with flags 0x%x and length 0 (Go compatibility mode)\n", header->flags);
+                YAMUX_LOG_DEBUG("yamux_handle_window_update: Received frame with flags 0x%x and length 0 (Go compatibility mode)", header->flags);
                 window_val_payload = 0; // No window update in this case
             } else {
                 // Still reject lengths other than 0 or 4
-                printf("CASCADE_ERROR_V7_ELSE_BLOCK (yamux_handle_window_update): Invalid header length %u. Expected 4 or 0 for flags 0x%x.\n", header->length, header->flags);
+                YAMUX_LOG_ERROR("yamux_handle_window_update: Invalid header length %u. Expected 4 or 0 for flags 0x%x.", header->length, header->flags);
                 return YAMUX_ERR_PROTOCOL;
             }
         }
         // Only read payload if length is 4 (skip if we already handled length 0 case above)
         if (header->length == 4) {
-            printf("DEBUG (yamux_handle_window_update): Reading 4-byte payload for Window Update or SYN+ACK.\n");
-            uint8_t payload_buf[4];
-            int read_len = session->io.read(session->io.ctx, payload_buf, 4);
-            if (read_len != 4) {
-                printf("ERROR (yamux_handle_window_update): Failed to read 4-byte payload. Read %d.\n", read_len);
-                return YAMUX_ERR_IO;
-            }
-            memcpy(&window_val_payload, payload_buf, sizeof(uint32_t));
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: Reading 4-byte payload for Window Update or SYN+ACK.");
+            memcpy(&window_val_payload, payload, sizeof(uint32_t));
             window_val_payload = ntohl(window_val_payload);
-            printf("DEBUG (yamux_handle_window_update): Read payload_window_value: %u\n", window_val_payload);
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: Read payload_window_value: %u", window_val_payload);
         }
     }
 
     yamux_stream_t *stream = yamux_get_stream(session, header->stream_id);
+    uint32_t window_before = stream ? stream->send_window : 1; /* A new stream's window did not reopen */
+    int events = 0;
 
     if (header->flags & YAMUX_FLAG_SYN) {
-        printf("DEBUG (yamux_handle_window_update): SYN flag set.\n");
+        YAMUX_LOG_DEBUG("yamux_handle_window_update: SYN flag set.");
         if (!session->client) { // Server side: received SYN from client
-            printf("DEBUG (yamux_handle_window_update): Server received SYN for stream %u\n", header->stream_id);
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: Server received SYN for stream %u", header->stream_id);
             if (stream) {
-                printf("ERROR (yamux_handle_window_update): Stream %u already exists on server.\n", header->stream_id);
+                YAMUX_LOG_ERROR("yamux_handle_window_update: Stream %u already exists on server.", header->stream_id);
                 // This might be a duplicate SYN, could RST or ignore.
                 return YAMUX_ERR_PROTOCOL; 
             }
 
-            // Create a new stream structure for the incoming client stream
-            stream = (yamux_stream_t *)malloc(sizeof(yamux_stream_t));
+            // A full backlog refuses the stream with a WINDOW_UPDATE RST before anything is allocated for it, as Go yamux does
+            if (session->accept_len >= session->config.accept_backlog) {
+                YAMUX_STAT(session->stats.accept_overflows++);
+                YAMUX_LOG_WARN("yamux_handle_window_update: Accept backlog full, resetting stream %u", header->stream_id);
+                return yamux_refuse_stream(session, header->stream_id);
+            }
+
+            // Create a new stream structure for the incoming client stream;
+            // with fixed memory an empty pool refuses it like a full backlog
+            stream = yamux_stream_alloc(session);
+            if (!stream && session->config.fixed_memory) {
+                YAMUX_LOG_WARN("yamux_handle_window_update: Stream pool empty, resetting stream %u", header->stream_id);
+                return yamux_refuse_stream(session, header->stream_id);
+            }
             if (!stream) return YAMUX_ERR_NOMEM;
-            memset(stream, 0, sizeof(yamux_stream_t));
 
-            stream->session = session;
             stream->id = header->stream_id;
             stream->state = YAMUX_STREAM_SYN_RECV;
             // Client's initial recv_window is our initial send_window.
@@ -225,20 +428,20 @@ yamux_result_t yamux_handle_window_update(yamux_session_t *session, const yamux_
             // In that case, we use a default initial window for the client.
             // Otherwise, use the value from the payload (if client sent SYN with length 4).
             stream->send_window = (header->length == 0 && (header->flags & YAMUX_FLAG_SYN) && !(header->flags & YAMUX_FLAG_ACK)) 
-                                   ? session->config.max_stream_window_size 
+                                   ? YAMUX_DEFAULT_WINDOW_SIZE 
                                    : window_val_payload;
-            stream->recv_window = session->config.max_stream_window_size; // Our initial recv_window for the client
+            yamux_window_init(stream); // Our initial recv_window for the client
 
-            printf("DEBUG (yamux_handle_window_update): New stream %u created (server). send_window: %u, recv_window: %u\n", 
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: New stream %u created (server). send_window: %u, recv_window: %u", 
                    stream->id, stream->send_window, stream->recv_window);
 
-            if (yamux_buffer_init(&stream->recvbuf, YAMUX_INITIAL_BUFFER_SIZE) != YAMUX_OK) {
-                free(stream);
+            if (yamux_buffer_init_lazy(&stream->recvbuf, &session->buffer_pool, stream->recv_window_size,
+                                       stream->recv_inline, sizeof(stream->recv_inline)) != YAMUX_OK) {
+                yamux_stream_release(stream);
                 return YAMUX_ERR_NOMEM;
             }
             if (yamux_add_stream(session, stream) != YAMUX_OK) {
-                yamux_buffer_free(&stream->recvbuf);
-                free(stream);
+                yamux_stream_release(stream);
                 return YAMUX_ERR_INTERNAL;
             }
 
@@ -250,60 +453,62 @@ yamux_result_t yamux_handle_window_update(yamux_session_t *session, const yamux_
             resp_header.stream_id = stream->id;
             resp_header.length = 4; // Payload is our initial window size (4 bytes)
 
-            uint8_t frame_buf[YAMUX_HEADER_SIZE + 4];
-            yamux_encode_header(&resp_header, frame_buf);
-            
             /* Use the server's recv_window (which is non-zero) in the payload */
             uint32_t net_recv_window = htonl(stream->recv_window);
-            memcpy(frame_buf + YAMUX_HEADER_SIZE, &net_recv_window, sizeof(net_recv_window));
 
-            printf("DEBUG (yamux_handle_window_update): Server sending SYN-ACK for stream %u, payload_window: %u\n", stream->id, stream->recv_window);
-            if (session->io.write(session->io.ctx, frame_buf, sizeof(frame_buf)) != sizeof(frame_buf)) {
-                printf("ERROR (yamux_handle_window_update): io.write failed for SYN-ACK\n");
-                // Error sending SYN-ACK, cleanup stream?
-                yamux_remove_stream(session, stream->id); // This will free buffer and stream
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: Server sending SYN-ACK for stream %u, payload_window: %u", stream->id, stream->recv_window);
+            if (yamux_session_send_frame(session, &resp_header, (const uint8_t *)&net_recv_window,
+                                         sizeof(net_recv_window)) != YAMUX_OK) {
+                YAMUX_LOG_ERROR("yamux_handle_window_update: io.write failed for SYN-ACK");
+                // The peer never learns of the stream: unlink it, then free it and its buffer
+                yamux_remove_stream(session, stream->id);
+                yamux_stream_release(stream);
                 return YAMUX_ERR_IO;
             }
             /* Keep stream state as SYN_RECV until we receive ACK from client */
             /* stream state should remain at YAMUX_STREAM_SYN_RECV (set at line 221) */
-            printf("DEBUG (yamux_handle_window_update): Server stream %u SYN_RECV after sending SYN-ACK.\n", stream->id);
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: Server stream %u SYN_RECV after sending SYN-ACK.", stream->id);
 
             // Enqueue for accept by application if not already handled by a direct accept call
             // This logic might need refinement based on how yamux_accept_stream is used
-            if (yamux_enqueue_stream_for_accept(session, stream) != YAMUX_OK) {
-                // Handle error if necessary, though unlikely here
+            if (yamux_enqueue_stream_for_accept(session, stream) == YAMUX_OK) {
+                events |= YAMUX_EVENT_ACCEPT;
             }
 
         } else { // Client side: This case should not happen if SYN is only sent by client opening stream
                  // However, if it's a SYN-ACK (SYN|ACK), it will be handled below.
-            printf("WARN (yamux_handle_window_update): Client received a frame with only SYN flag. This is unexpected.\n");
+            YAMUX_LOG_WARN("yamux_handle_window_update: Client received a frame with only SYN flag. This is unexpected.");
         }
     }
 
     // Handle ACK flag (part of SYN-ACK for client, or standalone ACK for other purposes if defined)
     if (header->flags & YAMUX_FLAG_ACK) {
-        printf("DEBUG (yamux_handle_window_update): ACK flag set.\n");
+        YAMUX_LOG_DEBUG("yamux_handle_window_update: ACK flag set.");
         if (stream) {
             if (session->client && stream->state == YAMUX_STREAM_SYN_SENT && (header->flags & YAMUX_FLAG_SYN)) { // Client received SYN-ACK
-                printf("DEBUG (yamux_handle_window_update): Client received SYN-ACK for stream %u\n", stream->id);
-                stream->send_window = window_val_payload; // Server's initial recv_window is our send_window
+                YAMUX_LOG_DEBUG("yamux_handle_window_update: Client received SYN-ACK for stream %u", stream->id);
+                // Server's initial recv_window is our send_window, less what was sent before the ACK
+                // (a thread-safe session lets writers run ahead of the I/O thread)
+                uint32_t sent_early = (stream->send_window < YAMUX_DEFAULT_WINDOW_SIZE)
+                                          ? YAMUX_DEFAULT_WINDOW_SIZE - stream->send_window : 0;
+                stream->send_window = (window_val_payload > sent_early) ? window_val_payload - sent_early : 0;
                 stream->state = YAMUX_STREAM_ESTABLISHED;
-                printf("DEBUG (yamux_handle_window_update): Client stream %u ESTABLISHED. send_window updated to %u.\n", stream->id, stream->send_window);
+                YAMUX_LOG_DEBUG("yamux_handle_window_update: Client stream %u ESTABLISHED. send_window updated to %u.", stream->id, stream->send_window);
             } else if (!session->client && stream->state == YAMUX_STREAM_SYN_RECV && !(header->flags & YAMUX_FLAG_SYN)) { // Server received ACK (after sending SYN-ACK)
-                printf("DEBUG (yamux_handle_window_update): Server received ACK for stream %u\n", stream->id);
+                YAMUX_LOG_DEBUG("yamux_handle_window_update: Server received ACK for stream %u", stream->id);
                 stream->state = YAMUX_STREAM_ESTABLISHED;
-                printf("DEBUG (yamux_handle_window_update): Server stream %u ESTABLISHED after receiving ACK.\n", stream->id);
+                YAMUX_LOG_DEBUG("yamux_handle_window_update: Server stream %u ESTABLISHED after receiving ACK.", stream->id);
             } else if (stream->state == YAMUX_STREAM_FIN_SENT && (header->flags & YAMUX_FLAG_FIN)) {
                  // Handle FIN-ACK for stream closing
-                 printf("DEBUG (yamux_handle_window_update): FIN-ACK received for stream %u. Changing state to CLOSED.\n", stream->id);
+                 YAMUX_LOG_DEBUG("yamux_handle_window_update: FIN-ACK received for stream %u. Changing state to CLOSED.", stream->id);
                  stream->state = YAMUX_STREAM_CLOSED;
-                 // yamux_remove_stream might be called later by a cleanup task or when all data is read
+                 yamux_remove_stream(session, stream->id);
             } else {
                 // Other ACK scenarios, if any (e.g., ACK for data, though Yamux doesn't use explicit data ACKs like TCP)
-                printf("DEBUG (yamux_handle_window_update): Received ACK for stream %u in state %d. No specific action taken.\n", stream->id, stream->state);
+                YAMUX_LOG_DEBUG("yamux_handle_window_update: Received ACK for stream %u in state %d. No specific action taken.", stream->id, stream->state);
             }
         } else {
-            printf("WARN (yamux_handle_window_update): Received ACK for non-existent stream %u\n", header->stream_id);
+            YAMUX_LOG_WARN("yamux_handle_window_update: Received ACK for non-existent stream %u", header->stream_id);
             // Potentially send RST if an ACK is for an unknown stream
         }
     }
@@ -313,20 +518,30 @@ yamux_result_t yamux_handle_window_update(yamux_session_t *session, const yamux_
     if (!(header->flags & YAMUX_FLAG_SYN) && !(header->flags & YAMUX_FLAG_ACK)) {
         if (stream) {
             stream->send_window += window_val_payload;
-            printf("DEBUG (yamux_handle_window_update): Stream %u send_window increased by %u to %u\n", 
+            if (window_val_payload > 0) {
+                yamux_stats_credit_in(stream);
+            }
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: Stream %u send_window increased by %u to %u", 
                    stream->id, window_val_payload, stream->send_window);
         } else {
-            printf("WARN (yamux_handle_window_update): Window update for non-existent stream %u\n", header->stream_id);
+            YAMUX_LOG_WARN("yamux_handle_window_update: Window update for non-existent stream %u", header->stream_id);
             // Potentially send RST
         }
     }
     
     // If FIN flag is set (and not part of SYN-ACK or other combined flags handled above)
     if (header->flags & YAMUX_FLAG_FIN && !(header->flags & YAMUX_FLAG_ACK) && !(header->flags & YAMUX_FLAG_SYN)) {
-        printf("DEBUG (yamux_handle_window_update): FIN flag set (standalone).\n");
+        YAMUX_LOG_DEBUG("yamux_handle_window_update: FIN flag set (standalone).");
         if (stream) {
-            stream->state = YAMUX_STREAM_FIN_RECV;
-            printf("DEBUG (yamux_handle_window_update): Stream %u received FIN. State changed to FIN_RECV.\n", stream->id);
+            if (stream->state == YAMUX_STREAM_FIN_SENT) {
+                // Our FIN went first: both sides have finished
+                stream->state = YAMUX_STREAM_CLOSED;
+                yamux_remove_stream(session, stream->id);
+            } else {
+                stream->state = YAMUX_STREAM_FIN_RECV;
+            }
+            events |= YAMUX_EVENT_READABLE | YAMUX_EVENT_CLOSED;
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: Stream %u received FIN. State changed to %d.", stream->id, stream->state);
             // Application should see EOF on read. Send FIN-ACK back.
             yamux_header_t resp_header;
             resp_header.version = YAMUX_PROTO_VERSION;
@@ -335,36 +550,38 @@ yamux_result_t yamux_handle_window_update(yamux_session_t *session, const yamux_
             resp_header.stream_id = stream->id;
             resp_header.length = 0; // FIN-ACK typically has no payload
 
-            uint8_t frame_buf[YAMUX_HEADER_SIZE];
-            yamux_encode_header(&resp_header, frame_buf);
-
-            printf("DEBUG (yamux_handle_window_update): Sending FIN-ACK for stream %u\n", stream->id);
-            if (session->io.write(session->io.ctx, frame_buf, sizeof(frame_buf)) != sizeof(frame_buf)) {
-                printf("ERROR (yamux_handle_window_update): io.write failed for FIN-ACK\n");
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: Sending FIN-ACK for stream %u", stream->id);
+            if (yamux_session_send_frame(session, &resp_header, NULL, 0) != YAMUX_OK) {
+                YAMUX_LOG_ERROR("yamux_handle_window_update: io.write failed for FIN-ACK");
                 return YAMUX_ERR_IO;
             }
-            // If we also sent FIN previously, and now received FIN, then can move to CLOSED.
-            // This part of state machine needs careful review with yamux_close behavior.
         } else {
-            printf("WARN (yamux_handle_window_update): FIN for non-existent stream %u\n", header->stream_id);
+            YAMUX_LOG_WARN("yamux_handle_window_update: FIN for non-existent stream %u", header->stream_id);
         }
     }
 
     // Handle RST flag
     if (header->flags & YAMUX_FLAG_RST) {
-        printf("DEBUG (yamux_handle_window_update): RST flag set.\n");
+        YAMUX_LOG_DEBUG("yamux_handle_window_update: RST flag set.");
         if (stream) {
-            printf("DEBUG (yamux_handle_window_update): Stream %u received RST. Closing stream.\n", stream->id);
-            stream->state = YAMUX_STREAM_CLOSED; // Or a specific RST state
-            // Notify application, cleanup stream resources.
-            // Consider calling yamux_remove_stream or marking for removal.
-            // For now, just change state. The test might not cover RST fully.
-            yamux_remove_stream(session, stream->id); // Proactively remove and free
+            YAMUX_LOG_DEBUG("yamux_handle_window_update: Stream %u received RST. Closing stream.", stream->id);
+            yamux_stream_reset_by_peer(session, stream);
+            return YAMUX_OK;
         } else {
-            printf("WARN (yamux_handle_window_update): RST for non-existent stream %u\n", header->stream_id);
+            YAMUX_LOG_WARN("yamux_handle_window_update: RST for non-existent stream %u", header->stream_id);
         }
     }
 
+    /* Credit that took the window off zero (an update, or a SYN-ACK after an early write) */
+    if (stream && window_before == 0 && stream->send_window > 0) {
+        yamux_stats_stall_end(stream);
+        events |= YAMUX_EVENT_WRITABLE;
+    }
+    if (stream) {
+        yamux_report_events(session, stream, events);
+        yamux_stream_reap(stream);
+    }
+
     return YAMUX_OK;
 }
 
@@ -373,11 +590,11 @@ yamux_result_t yamux_handle_window_update(yamux_session_t *session, const yamux_
  * 
  * @param session Session context
  * @param header Frame header
+ * @param payload Unused: a PING has no payload, its length field is the opaque ID
  * @return YAMUX_OK on success, error code otherwise
  */
-yamux_result_t yamux_handle_ping(yamux_session_t *session, const yamux_header_t *header) {
-    uint8_t ping_data[8] = {0};
-    int bytes_read;
+yamux_result_t yamux_handle_ping(yamux_session_t *session, const yamux_header_t *header, const uint8_t *payload) {
+    (void)payload;
     
     /* Validate session and header */
     if (!session || !header) {
@@ -386,18 +603,14 @@ yamux_result_t yamux_handle_ping(yamux_session_t *session, const yamux_header_t
     
     /* Check if it's a ping request or response */
     if (header->flags & YAMUX_FLAG_ACK) {
-        /* Ping response, nothing to do */
+        /* Ping response: a round-trip sample, matched by the echoed ID */
+        yamux_stats_ping_acked(session, header->length);
+        
+        /* Any answer shows the peer alive */
+        yamux_timers_ping_acked(session);
         return YAMUX_OK;
     }
     
-    /* Ping request, read the data if any */
-    if (header->length > 0) {
-        bytes_read = session->io.read(session->io.ctx, ping_data, (header->length < 8) ? header->length : 8);
-        if (bytes_read < 0) {
-            return YAMUX_ERR_IO;
-        }
-    }
-    
     /* Send a ping response */
     yamux_header_t response = {
         .version = YAMUX_PROTO_VERSION,
@@ -407,22 +620,11 @@ yamux_result_t yamux_handle_ping(yamux_session_t *session, const yamux_header_t
         .length = header->length
     };
     
-    /* Encode the header */
-    yamux_encode_header(&response, session->recv_buf);
-    
-    /* Send the header */
-    if (session->io.write(session->io.ctx, session->recv_buf, 8) != 8) {
+    /* Send the response, echoing the ID */
+    if (yamux_session_send_frame(session, &response, NULL, 0) != YAMUX_OK) {
         return YAMUX_ERR_IO;
     }
     
-    /* Send the ping data if any */
-    if (header->length > 0) {
-        ssize_t written = session->io.write(session->io.ctx, ping_data, header->length);
-        if (written < 0 || (size_t)written != header->length) {
-            return YAMUX_ERR_IO;
-        }
-    }
-    
     return YAMUX_OK;
 }
 
@@ -431,36 +633,21 @@ yamux_result_t yamux_handle_ping(yamux_session_t *session, const yamux_header_t
  * 
  * @param session Session context
  * @param header Frame header
+ * @param payload Frame payload (header->length bytes)
  * @return YAMUX_OK on success, error code otherwise
  */
-yamux_result_t yamux_handle_go_away(yamux_session_t *session, const yamux_header_t *header) {
-    int bytes_read;
-    /* Parse reason code but we don't need to use it */
-    
+yamux_result_t yamux_handle_go_away(yamux_session_t *session, const yamux_header_t *header, const uint8_t *payload) {
     /* Validate session and header */
     if (!session || !header) {
         return YAMUX_ERR_INVALID;
     }
     
     /* Check frame size */
-    if (header->length != 4) {
+    if (header->length != 4 || !payload) {
         return YAMUX_ERR_PROTOCOL;
     }
     
-    /* Read the reason */
-    bytes_read = session->io.read(session->io.ctx, session->recv_buf, 4);
-    if (bytes_read < 0) {
-        return YAMUX_ERR_IO;
-    }
-    
-    /* Check if we got all the data */
-    if (bytes_read < 4) {
-        /* Partial read, not enough data */
-        return YAMUX_ERR_IO;
-    }
-    
-    /* Parse the reason (big-endian), but we don't need to store it
-     * We just need to read the reason bytes from the socket */
+    /* The reason code is not used; the session only needs to stop */
     
     /* Mark the session as going away */
     session->go_away_received = 1;
@@ -9,9 +9,75 @@
 // #include "../include/yamux.h" // Removed to avoid opaque type conflict
 #include "yamux_defs.h"
 
+#ifdef YAMUX_THREADS
+#include <pthread.h>
+#endif
+
 /* Forward declarations */
 struct yamux_stream;
 
+/* Stream table: open-addressed hash map keyed by stream ID */
+typedef struct {
+    yamux_stream_t **slots;         /* Bucket array, NULL marks an empty bucket */
+    uint32_t capacity;              /* Number of buckets (power of two) */
+    uint32_t shift;                 /* 32 - log2(capacity), for Fibonacci hashing */
+    uint32_t count;                 /* Number of live streams */
+} yamux_stream_table_t;
+
+/* Header of a block of objects added by yamux_pool_reserve() */
+typedef struct yamux_pool_block {
+    struct yamux_pool_block *next;  /* Next block of the pool */
+    uint32_t count;                 /* Objects in this block, after the header */
+} yamux_pool_block_t;
+
+/* Pool of fixed-size objects: a free list over one preallocated block and
+ * any reserved blocks, plus up to YAMUX_POOL_CACHE_SIZE recycled heap objects */
+typedef struct {
+    void *free_list;                /* Free objects, linked through their first word */
+    size_t object_size;             /* Size of every object */
+    uint8_t *arena;                 /* Preallocated block (NULL if none) */
+    uint32_t arena_count;           /* Objects in the arena */
+    yamux_pool_block_t *blocks;     /* Blocks added by yamux_pool_reserve() */
+    uint32_t free_count;            /* Objects on the free list */
+    uint32_t cached;                /* Heap objects on the free list */
+    uint32_t in_use;                /* Objects handed out and not returned */
+    int fixed;                      /* Never falls back to the heap once empty */
+} yamux_pool_t;
+
+/* A timer on a timer wheel (yamux_timer.c), embedded in its owner */
+typedef struct yamux_timer {
+    struct yamux_timer *next;       /* Next timer in the slot */
+    struct yamux_timer **pprev;     /* Link pointing at this timer (NULL = not armed) */
+    yamux_timer_wheel_t *wheel;     /* Wheel it is armed on */
+    uint64_t expires;               /* Deadline in wheel ticks */
+    void (*fire)(struct yamux_timer *timer); /* Run when the deadline passes */
+    void *owner;                    /* Session or stream the timer belongs to */
+} yamux_timer_t;
+
+/* A ping awaiting its ACK */
+typedef struct {
+    uint32_t id;                    /* Opaque ID carried in the payload */
+    uint64_t sent_ms;               /* Clock reading when it was sent */
+    int used;                       /* Slot holds an outstanding ping */
+} yamux_ping_slot_t;
+
+/* Round-trip samples (yamux_stats.c) */
+typedef struct {
+    uint32_t buckets[YAMUX_RTT_BUCKETS]; /* Sample counts by size class */
+    uint64_t count;                 /* Samples taken */
+    uint64_t sum_ms;                /* Sum of all samples */
+    uint32_t min_ms;                /* Smallest sample */
+    uint32_t max_ms;                /* Largest sample */
+    uint32_t last_ms;               /* Latest sample */
+    uint32_t last_id;               /* ID of the ping the latest sample timed */
+} yamux_rtt_hist_t;
+
+/* Ingress parser state */
+typedef enum {
+    YAMUX_RX_HEADER,                /* Waiting for a complete frame header */
+    YAMUX_RX_PAYLOAD                /* Delivering the rest of a DATA payload */
+} yamux_rx_state_t;
+
 /* Session structure */
 struct yamux_session {
     yamux_io_t io;                  /* I/O callbacks */
@@ -21,19 +87,76 @@ struct yamux_session {
     uint32_t remote_window;         /* Remote receive window size */
     uint32_t go_away_received;      /* Whether go away has been received */
     
-    yamux_stream_t **streams;       /* Array of active streams */
-    size_t stream_count;            /* Number of active streams */
-    size_t stream_capacity;         /* Capacity of streams array */
+    yamux_stream_table_t streams;   /* Active streams indexed by ID */
+    yamux_pool_t stream_pool;       /* Recycled yamux_stream_t objects */
+    yamux_pool_t buffer_pool;       /* Recycled receive-buffer storage of the initial window size */
     
-    yamux_stream_t *accept_queue;   /* Queue of streams pending accept */
+    yamux_stream_t *accept_queue;   /* Queue of streams pending accept (oldest first) */
+    yamux_stream_t *accept_tail;    /* Newest stream in the accept queue */
+    uint32_t accept_len;            /* Streams in the accept queue, at most accept_backlog */
     
     yamux_config_t config;          /* Session configuration */
     uint32_t last_ping_id;          /* ID of the last ping sent */
+    yamux_ping_slot_t pings[YAMUX_PING_SLOTS]; /* Pings being timed */
+    uint32_t rtt_ms;                /* Smoothed round-trip time (0 = no sample yet) */
+#if YAMUX_STATS
+    yamux_rtt_hist_t rtt;           /* Round-trip samples */
+#endif
+    size_t recv_committed;          /* Open receive windows plus unread data over all streams */
+    int recv_blocked;               /* Some stream has credit withheld by a memory budget */
+    yamux_callbacks_t callbacks;    /* Stream event callbacks (all NULL if unset) */
+#if YAMUX_STATS
+    yamux_session_stats_t stats;    /* Counters (yamux_stats.c) */
+#endif
     int keepalive_enabled;          /* Whether keepalive is enabled */
     uint32_t keepalive_interval;    /* Keepalive interval in milliseconds */
     
-    uint8_t *recv_buf;              /* Temporary receive buffer */
-    size_t recv_buf_size;           /* Size of receive buffer */
+    yamux_timer_wheel_t *timers;    /* Wheel the timers run on (NULL until ticked or attached) */
+    int own_timers;                 /* The wheel is private to this session */
+    yamux_timer_wheel_t *spare_timers; /* Private wheel kept for the next tick (fixed_memory only) */
+    yamux_timer_t keepalive_timer;  /* Sends the next keepalive ping */
+    yamux_timer_t dead_timer;       /* Fails the session if the keepalive goes unanswered */
+    yamux_timer_t write_timer;      /* Fails the session if queued frames stop leaving */
+    int tx_progress;                /* The transport took bytes since write_timer was armed */
+    yamux_result_t failure;         /* Why the timers failed the session (YAMUX_OK = alive) */
+    
+    uint8_t *recv_buf;              /* Ingress buffer filled by io.read */
+    size_t recv_buf_size;           /* Capacity of the ingress buffer */
+    size_t recv_buf_start;          /* Offset of the first unparsed byte */
+    size_t recv_buf_end;            /* Offset one past the last buffered byte */
+    
+    uint8_t *send_buf;              /* Egress queue of encoded frames */
+    size_t send_buf_size;           /* Capacity of the egress queue */
+    size_t send_buf_used;           /* Bytes queued and not yet written */
+    uint32_t cork_depth;            /* Nesting count of cork calls; 0 = write through */
+    
+    /* DATA frame from yamux_stream_sendfile(), written ahead of send_buf */
+    uint8_t file_header[YAMUX_HEADER_SIZE]; /* Its encoded header */
+    size_t file_header_left;        /* Header bytes not yet written */
+    int file_fd;                    /* File the payload is read from */
+    uint64_t file_offset;           /* Offset of the next payload byte */
+    size_t file_left;               /* Payload bytes not yet written */
+    
+    yamux_rx_state_t rx_state;      /* Ingress parser state */
+    yamux_header_t rx_header;       /* Header of the DATA frame being received */
+    uint32_t rx_remaining;          /* Payload bytes of rx_header still to come */
+    int rx_discard;                 /* Drop the remaining payload (handler failed) */
+    
+    int threaded;                   /* config.thread_safe: calls are serialized by lock */
+    int flushing;                   /* A thread is writing the egress queue out */
+    int processing;                 /* A thread is in yamux_session_process() */
+    
+#if YAMUX_SCHED
+    struct yamux_stream *sched_head[YAMUX_PRIORITY_LEVELS]; /* Round of streams with queued data, per level */
+    struct yamux_stream *sched_tail[YAMUX_PRIORITY_LEVELS]; /* Last stream of each round */
+    uint32_t sched_levels;          /* Bit per level whose round is not empty */
+#endif
+#ifdef YAMUX_THREADS
+    pthread_mutex_t lock;           /* Guards the session and its streams (recursive) */
+    pthread_cond_t changed;         /* Broadcast when data, credit, queue space or state changed */
+    uint32_t waiters;               /* Threads blocked in yamux_stream_wait() */
+    uint32_t lock_depth;            /* Nesting count of the lock held by its owner */
+#endif
 };
 
 /* Yamux context structure (exposed via opaque pointer in public API) */
@@ -43,18 +166,24 @@ typedef struct yamux_context {
     yamux_io_t io;                /* I/O callbacks */
     int is_client;                /* Client or server mode */
     yamux_config_t config;        /* Configuration */
+    yamux_pool_t handle_pool;     /* Recycled stream handles (yamux_port.c) */
 } yamux_context_t;
 
 /* Stream structure */
 
 /* Use stream state from yamux_defs.h */
 
-/* Buffer structure */
+/* Buffer structure (fixed-capacity ring) */
 typedef struct {
-    uint8_t *data;                /* Buffer data */
-    size_t size;                  /* Total size of the buffer */
-    size_t used;                  /* Used bytes in the buffer */
-    size_t pos;                   /* Current read position */
+    uint8_t *data;                /* Buffer data (NULL while a lazy buffer has no storage) */
+    size_t size;                  /* Capacity of the buffer */
+    size_t used;                  /* Bytes currently buffered */
+    size_t pos;                   /* Offset of the first buffered byte */
+    size_t storage_size;          /* Bytes at data: size, or inline_size while inline */
+    yamux_pool_t *pool;           /* Pool that storage of pool->object_size comes from (NULL: heap) */
+    uint8_t *inline_data;         /* Small storage used before any is allocated (lazy only) */
+    size_t inline_size;           /* Bytes at inline_data */
+    int lazy;                     /* Storage is attached on first write and released when drained */
 } yamux_buffer_t;
 
 /* Stream structure */
@@ -64,37 +193,207 @@ struct yamux_stream {
     yamux_stream_state_t state;     /* Stream state */
     
     yamux_buffer_t recvbuf;        /* Receive buffer */
+    uint8_t recv_inline[YAMUX_STREAM_INLINE_SIZE]; /* Storage for small payloads */
     uint32_t send_window;          /* Send window size */
     uint32_t recv_window;          /* Receive window size */
+    uint32_t recv_consumed;        /* Bytes consumed but not yet credited back to the peer */
+    uint32_t recv_window_size;     /* Current receive window size (auto-tuned) */
+    uint32_t recv_window_debt;     /* Credit to withhold after the window shrank */
+#if !YAMUX_FIXED_FRAME_SIZE
+    uint32_t max_frame_size;       /* DATA payload limit for sends (0 = the session's) */
+#endif
+    uint64_t recv_epoch_ms;        /* Clock reading at the last credit grant */
+    size_t recv_committed;         /* This stream's share of the session's recv_committed */
+    int recv_blocked;              /* Credit is owed but withheld by a memory budget */
+    int recv_detached;             /* Left the session; no longer counted against budgets */
+    
+    uint8_t *read_buf;             /* Posted read buffer (NULL if none) */
+    size_t read_len;               /* Size of the posted read buffer */
+    yamux_read_complete_fn read_cb; /* Posted read completion */
+    void *read_user_data;          /* Argument for read_cb */
+    
+#if YAMUX_SCHED
+    yamux_buffer_t sendq;          /* Data waiting in the egress scheduler */
+    struct yamux_stream *sched_next; /* Next stream in its level's round */
+    uint32_t sched_deficit;        /* Bytes left of the current turn */
+    uint16_t sched_weight;         /* Turn size in quanta */
+    uint8_t sched_priority;        /* Level, 0 served first */
+    uint8_t sched_active;          /* In its level's round */
+    uint8_t sched_fin;             /* Send FIN once sendq drains */
+#endif
+    
+#if YAMUX_STATS
+    yamux_stream_stats_t stats;    /* Counters (yamux_stats.c) */
+    uint64_t stall_start_ms;       /* Clock reading when the send window ran out */
+    int stalled;                   /* The send window is out and the stall is being timed */
+    uint64_t ack_start_ms;         /* Clock reading when data went out with no credit awaited */
+    int ack_pending;               /* Data sent, waiting for the WINDOW_UPDATE it earns */
+#endif
+    yamux_timer_t timer;           /* SYN or FIN timeout */
+    uint8_t failed;                /* Closed by a session failure, not yet reported */
+    uint8_t orphaned;              /* Freed by the application; released once CLOSED */
     
     struct yamux_stream *next;     /* Next stream in accept queue */
 };
 
+/* A complete frame found by yamux_decode_frames() */
+typedef struct {
+    yamux_header_t header;
+    uint32_t offset;                /* Of its header from the start of the buffer */
+} yamux_frame_desc_t;
+
+/* Bytes that follow a frame's header: a PING's length field is its opaque ID */
+#define YAMUX_FRAME_PAYLOAD_LEN(h) ((h)->type == YAMUX_PING ? 0u : (h)->length)
+
 /* Frame encoding/decoding functions */
 yamux_result_t yamux_encode_header(const yamux_header_t *header, uint8_t *buffer);
 yamux_result_t yamux_decode_header(const uint8_t *buffer, size_t buffer_len, yamux_header_t *header);
+size_t yamux_decode_frames(const uint8_t *buffer, size_t buffer_len, yamux_frame_desc_t *frames,
+                           size_t max, yamux_result_t *status);
 
 /* Frame handling functions */
-yamux_result_t yamux_handle_data(struct yamux_session *session, const yamux_header_t *header);
-yamux_result_t yamux_handle_window_update(struct yamux_session *session, const yamux_header_t *header);
-yamux_result_t yamux_handle_ping(struct yamux_session *session, const yamux_header_t *header);
-yamux_result_t yamux_handle_go_away(struct yamux_session *session, const yamux_header_t *header);
+/* Each handler receives the YAMUX_FRAME_PAYLOAD_LEN() payload bytes that follow the header */
+yamux_result_t yamux_handle_data(struct yamux_session *session, const yamux_header_t *header, const uint8_t *payload);
+yamux_result_t yamux_handle_data_chunk(struct yamux_session *session, const yamux_header_t *header,
+                                       const uint8_t *chunk, size_t len, int last);
+yamux_result_t yamux_handle_data_reserve(struct yamux_session *session, const yamux_header_t *header,
+                                         size_t remaining, uint8_t **space, size_t *space_len);
+yamux_result_t yamux_handle_data_commit(struct yamux_session *session, const yamux_header_t *header,
+                                        size_t len, int last);
+yamux_result_t yamux_handle_window_update(struct yamux_session *session, const yamux_header_t *header, const uint8_t *payload);
+yamux_result_t yamux_handle_ping(struct yamux_session *session, const yamux_header_t *header, const uint8_t *payload);
+yamux_result_t yamux_handle_go_away(struct yamux_session *session, const yamux_header_t *header, const uint8_t *payload);
 
 /* Core session processing function */
 yamux_result_t yamux_session_process(yamux_session_t *session);
+yamux_result_t yamux_session_process_input(struct yamux_session *session, int *input);
+
+/* Frame transmission (queue control lives in yamux.h: flush, cork, uncork) */
+yamux_result_t yamux_session_send_frame(struct yamux_session *session, const yamux_header_t *header,
+                                        const uint8_t *payload, size_t len);
+yamux_result_t yamux_session_send_framev(struct yamux_session *session, const yamux_header_t *header,
+                                         const yamux_iovec_t *iov, int iovcnt);
+yamux_result_t yamux_session_flush_locked(struct yamux_session *session);
+int yamux_session_queued(const struct yamux_session *session);
+yamux_result_t yamux_session_uncork_locked(struct yamux_session *session);
+
+/* Thread-safe sessions (yamux_lock.c); all no-ops unless session->threaded */
+yamux_result_t yamux_lock_init(struct yamux_session *session);
+void yamux_lock_destroy(struct yamux_session *session);
+void yamux_session_lock(struct yamux_session *session);
+void yamux_session_unlock(struct yamux_session *session);
+void yamux_session_notify(struct yamux_session *session);
+int yamux_session_wait_flushed(struct yamux_session *session);
+int yamux_session_clock_ms(struct yamux_session *session, uint64_t *now_ms);
+yamux_result_t yamux_stream_close_locked(yamux_stream_t *stream, int reset);
+#if YAMUX_FIXED_FRAME_SIZE
+#define yamux_stream_frame_limit(stream) ((void)(stream), (uint32_t)YAMUX_MAX_DATA_FRAME_SIZE)
+#else
+uint32_t yamux_stream_frame_limit(const yamux_stream_t *stream);
+#endif
+
+/* Egress scheduler (yamux_sched.c); used when config.egress_quantum is set */
+#if YAMUX_SCHED
+#define yamux_sched_enabled(session) ((session)->config.egress_quantum > 0)
+#define yamux_sched_idle(session) ((session)->sched_levels == 0)
+size_t yamux_sched_run(struct yamux_session *session);
+yamux_result_t yamux_sched_write(yamux_stream_t *stream, const uint8_t *buf, size_t len,
+                                 size_t *bytes_written);
+int yamux_sched_defer_fin(yamux_stream_t *stream);
+void yamux_sched_remove(yamux_stream_t *stream);
+void yamux_sched_clear(struct yamux_session *session);
+#else
+/* Compiled out: sessions with egress_quantum set are refused */
+#define yamux_sched_enabled(session) ((void)(session), 0)
+#define yamux_sched_idle(session) ((void)(session), 1)
+#define yamux_sched_run(session) ((void)(session), (size_t)0)
+#define yamux_sched_write(stream, buf, len, bytes_written) \
+    ((void)(stream), (void)(buf), (void)(len), (void)(bytes_written), YAMUX_ERR_INVALID)
+#define yamux_sched_defer_fin(stream) ((void)(stream), 0)
+#define yamux_sched_remove(stream) ((void)(stream))
+#define yamux_sched_clear(session) ((void)(session))
+#endif
+
+/* Counters (yamux_stats.c); YAMUX_STAT() wraps a direct counter update */
+#if YAMUX_STATS
+#define YAMUX_STAT(update) ((void)(update))
+void yamux_stats_frame_in(struct yamux_session *session, const yamux_header_t *header);
+void yamux_stats_frame_out(struct yamux_session *session, const yamux_header_t *header);
+void yamux_stats_data_in(yamux_stream_t *stream, size_t len, int last);
+void yamux_stats_data_out(yamux_stream_t *stream, size_t len);
+void yamux_stats_stall_begin(yamux_stream_t *stream);
+void yamux_stats_stall_end(yamux_stream_t *stream);
+void yamux_stats_credit_in(yamux_stream_t *stream);
+#else
+/* Compiled out; round trips are still timed when a clock is set, for window auto-tuning */
+#define YAMUX_STAT(update) ((void)0)
+#define yamux_stats_frame_in(session, header) ((void)(session), (void)(header))
+#define yamux_stats_frame_out(session, header) ((void)(session), (void)(header))
+#define yamux_stats_data_in(stream, len, last) ((void)(stream), (void)(len), (void)(last))
+#define yamux_stats_data_out(stream, len) ((void)(stream), (void)(len))
+#define yamux_stats_stall_begin(stream) ((void)(stream))
+#define yamux_stats_stall_end(stream) ((void)(stream))
+#define yamux_stats_credit_in(stream) ((void)(stream))
+#endif
+void yamux_stats_ping_sent(struct yamux_session *session, uint32_t id);
+void yamux_stats_ping_acked(struct yamux_session *session, uint32_t id);
+
+/* Timers (yamux_timer.c) */
+void yamux_timer_cancel(yamux_timer_t *timer);
+yamux_result_t yamux_timers_reserve(struct yamux_session *session);
+void yamux_timers_detach(struct yamux_session *session);
+void yamux_timers_stream_opened(yamux_stream_t *stream);
+void yamux_timers_stream_closing(yamux_stream_t *stream);
+void yamux_timers_write_blocked(struct yamux_session *session);
+void yamux_timers_ping_acked(struct yamux_session *session);
+
+/* Stream table functions */
+yamux_result_t yamux_stream_table_init(yamux_stream_table_t *table, uint32_t capacity);
+void yamux_stream_table_free(yamux_stream_table_t *table);
 
 /* Stream management functions */
 yamux_stream_t *yamux_get_stream(struct yamux_session *session, uint32_t stream_id);
 yamux_result_t yamux_add_stream(struct yamux_session *session, yamux_stream_t *stream);
 yamux_result_t yamux_remove_stream(struct yamux_session *session, uint32_t stream_id);
-yamux_result_t yamux_enqueue_stream(struct yamux_session *session, yamux_stream_t *stream);
 yamux_result_t yamux_enqueue_stream_for_accept(struct yamux_session *session, yamux_stream_t *stream);
+void yamux_stream_complete_read(yamux_stream_t *stream, size_t bytes_read, yamux_result_t result);
+
+/* Receive-window credit accounting and auto-tuning (yamux_window.c) */
+void yamux_window_init(yamux_stream_t *stream);
+uint32_t yamux_window_initial_size(const struct yamux_session *session);
+int yamux_window_admits(const yamux_stream_t *stream, size_t len);
+void yamux_window_charge(yamux_stream_t *stream, uint32_t len);
+void yamux_window_release(yamux_stream_t *stream, uint32_t len);
+void yamux_window_trim(yamux_stream_t *stream);
+void yamux_window_detach(yamux_stream_t *stream);
+void yamux_window_retry(struct yamux_session *session);
+size_t yamux_window_global_committed(void);
+void yamux_window_rtt_sample(struct yamux_session *session, uint32_t sample_ms);
+
+/* Object pools (yamux_pool.c) */
+yamux_result_t yamux_pool_init(yamux_pool_t *pool, size_t object_size, uint32_t preallocate);
+void *yamux_pool_get(yamux_pool_t *pool);
+yamux_result_t yamux_pool_reserve(yamux_pool_t *pool, uint32_t count);
+void yamux_pool_put(yamux_pool_t *pool, void *object);
+void yamux_pool_destroy(yamux_pool_t *pool);
+
+/* Stream object lifetime (pooled per session) */
+yamux_stream_t *yamux_stream_alloc(struct yamux_session *session);
+void yamux_stream_release(yamux_stream_t *stream);
+void yamux_stream_reap(yamux_stream_t *stream);
 
 /* Buffer management functions */
 yamux_result_t yamux_buffer_init(yamux_buffer_t *buffer, size_t initial_size);
+yamux_result_t yamux_buffer_init_pooled(yamux_buffer_t *buffer, yamux_pool_t *pool, size_t initial_size);
+yamux_result_t yamux_buffer_init_lazy(yamux_buffer_t *buffer, yamux_pool_t *pool, size_t initial_size,
+                                      uint8_t *inline_data, size_t inline_size);
 void yamux_buffer_free(yamux_buffer_t *buffer);
 yamux_result_t yamux_buffer_write(yamux_buffer_t *buffer, const uint8_t *data, size_t len);
 yamux_result_t yamux_buffer_read(yamux_buffer_t *buffer, uint8_t *data, size_t len, size_t *bytes_read);
-yamux_result_t yamux_buffer_compact(yamux_buffer_t *buffer);
+int yamux_buffer_peek(const yamux_buffer_t *buffer, yamux_iovec_t segs[2]);
+void yamux_buffer_consume(yamux_buffer_t *buffer, size_t len);
+size_t yamux_buffer_reserve(yamux_buffer_t *buffer, uint8_t **space);
+void yamux_buffer_commit(yamux_buffer_t *buffer, size_t len);
+yamux_result_t yamux_buffer_resize(yamux_buffer_t *buffer, size_t new_size);
 
 #endif /* YAMUX_INTERNAL_H */
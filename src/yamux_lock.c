@@ -0,0 +1,367 @@
+/**
+ * @file yamux_lock.c
+ * @brief Locking and wakeups for thread-safe sessions
+ *
+ * A thread-safe session (yamux_config_t.thread_safe) has one recursive
+ * mutex guarding the session and all its streams: the public functions
+ * take it, so a window or state change is never seen half done and
+ * frames of concurrent writers never interleave. The mutex is recursive
+ * because read completion callbacks run with it held and may call back
+ * into the library.
+ *
+ * Frames are only queued while the lock is held, and the queue is written
+ * out when the owner releases the lock's outermost level. The lock is so
+ * never dropped between queueing a frame and the state change that goes
+ * with it (a window credit, say), which the peer's reply could overtake.
+ *
+ * Threads parked in yamux_stream_wait() sleep on one condition variable
+ * per session, broadcast when frames were processed, the egress queue
+ * drained or a stream was closed locally, and only while someone waits.
+ *
+ * A single-threaded session has no one else to process it, so a waiter
+ * drives yamux_session_process() itself and sleeps in io.poll between
+ * reads when the transport provides it.
+ *
+ * Without YAMUX_THREADS the locking is a no-op and thread_safe is
+ * rejected at session creation.
+ */
+
+#include "../include/yamux.h"
+#include "yamux_internal.h"
+#include "yamux_defs.h"
+#include <errno.h>
+
+#ifdef YAMUX_THREADS
+#include <time.h>
+#endif
+
+/**
+ * Set up the lock of a session created with config.thread_safe
+ *
+ * @param session Session with its configuration set
+ * @return YAMUX_OK on success, YAMUX_ERR_INVALID if threads are not compiled in
+ */
+yamux_result_t yamux_lock_init(yamux_session_t *session)
+{
+#ifdef YAMUX_THREADS
+    pthread_mutexattr_t mutex_attr;
+    pthread_condattr_t cond_attr;
+    int failed;
+
+    if (!session->config.thread_safe) {
+        return YAMUX_OK;
+    }
+
+    if (pthread_mutexattr_init(&mutex_attr) != 0) {
+        return YAMUX_ERR_NOMEM;
+    }
+    failed = pthread_mutexattr_settype(&mutex_attr, PTHREAD_MUTEX_RECURSIVE) != 0 ||
+             pthread_mutex_init(&session->lock, &mutex_attr) != 0;
+    pthread_mutexattr_destroy(&mutex_attr);
+    if (failed) {
+        return YAMUX_ERR_NOMEM;
+    }
+
+    /* Timed waits measure against the monotonic clock where it can be chosen */
+    if (pthread_condattr_init(&cond_attr) != 0) {
+        pthread_mutex_destroy(&session->lock);
+        return YAMUX_ERR_NOMEM;
+    }
+#if !defined(__APPLE__)
+    (void)pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+#endif
+    failed = pthread_cond_init(&session->changed, &cond_attr) != 0;
+    pthread_condattr_destroy(&cond_attr);
+    if (failed) {
+        pthread_mutex_destroy(&session->lock);
+        return YAMUX_ERR_NOMEM;
+    }
+
+    session->threaded = 1;
+    return YAMUX_OK;
+#else
+    return session->config.thread_safe ? YAMUX_ERR_INVALID : YAMUX_OK;
+#endif
+}
+
+/**
+ * Tear down the lock of a session
+ *
+ * @param session Session no other thread uses any more
+ */
+void yamux_lock_destroy(yamux_session_t *session)
+{
+#ifdef YAMUX_THREADS
+    if (session->threaded) {
+        session->threaded = 0;
+        pthread_cond_destroy(&session->changed);
+        pthread_mutex_destroy(&session->lock);
+    }
+#else
+    (void)session;
+#endif
+}
+
+/**
+ * Take the session lock
+ *
+ * @param session Session
+ */
+void yamux_session_lock(yamux_session_t *session)
+{
+#ifdef YAMUX_THREADS
+    if (session->threaded) {
+        pthread_mutex_lock(&session->lock);
+        session->lock_depth++;
+    }
+#else
+    (void)session;
+#endif
+}
+
+/**
+ * Release the session lock
+ *
+ * Releasing the outermost level first writes out the frames queued under
+ * the lock, unless the session is corked or another thread is writing.
+ *
+ * @param session Session
+ */
+void yamux_session_unlock(yamux_session_t *session)
+{
+#ifdef YAMUX_THREADS
+    if (session->threaded) {
+        if (session->lock_depth == 1 && yamux_session_queued(session) &&
+            session->cork_depth == 0 && !session->flushing) {
+            /* Leaves the queue to the next unlock if the transport is full */
+            (void)yamux_session_flush_locked(session);
+        }
+        session->lock_depth--;
+        pthread_mutex_unlock(&session->lock);
+    }
+#else
+    (void)session;
+#endif
+}
+
+/**
+ * Wake the threads waiting on the session's streams
+ *
+ * Called with the lock held, after something a waiter may be waiting for
+ * changed.
+ *
+ * @param session Session
+ */
+void yamux_session_notify(yamux_session_t *session)
+{
+#ifdef YAMUX_THREADS
+    if (session->threaded && session->waiters > 0) {
+        pthread_cond_broadcast(&session->changed);
+    }
+#else
+    (void)session;
+#endif
+}
+
+/**
+ * Wait until no other thread is writing the egress queue out
+ *
+ * Called with the lock held. A waiting thread must hold it only once, as
+ * the wait releases a single level; nested callers do not wait.
+ *
+ * @param session Session
+ * @return 1 if the queue is no longer being written, 0 if it could not wait
+ */
+int yamux_session_wait_flushed(yamux_session_t *session)
+{
+#ifdef YAMUX_THREADS
+    if (!session->threaded || session->lock_depth != 1) {
+        return !session->flushing;
+    }
+    /* Other threads take the lock while this one sleeps */
+    session->lock_depth = 0;
+    session->waiters++;
+    while (session->flushing) {
+        pthread_cond_wait(&session->changed, &session->lock);
+    }
+    session->waiters--;
+    session->lock_depth = 1;
+    return 1;
+#else
+    return !session->flushing;
+#endif
+}
+
+/**
+ * Read the clock timeouts are measured with
+ *
+ * @param session Session
+ * @param now_ms Set to the time in milliseconds
+ * @return 1 on success, 0 if there is no clock (no io.now_ms, no threads)
+ */
+int yamux_session_clock_ms(yamux_session_t *session, uint64_t *now_ms)
+{
+#ifdef YAMUX_THREADS
+    struct timespec now;
+#endif
+
+    if (session->io.now_ms) {
+        *now_ms = session->io.now_ms(session->io.ctx);
+        return 1;
+    }
+#ifdef YAMUX_THREADS
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    *now_ms = (uint64_t)now.tv_sec * 1000u + (uint64_t)(now.tv_nsec / 1000000L);
+    return 1;
+#else
+    *now_ms = 0;
+    return 0;
+#endif
+}
+
+/* Check the wait conditions of a stream: YAMUX_OK if one holds */
+static yamux_result_t yamux_stream_poll_wait(yamux_stream_t *stream, int conditions)
+{
+    yamux_session_t *session = stream->session;
+
+    if (stream->state == YAMUX_STREAM_CLOSED || session->go_away_received) {
+        return YAMUX_ERR_CLOSED;
+    }
+
+    if ((conditions & YAMUX_WAIT_READABLE) &&
+        (stream->recvbuf.used > 0 || stream->state == YAMUX_STREAM_FIN_RECV)) {
+        return YAMUX_OK;
+    }
+
+    if (conditions & YAMUX_WAIT_WRITABLE) {
+        /* Writes fail once either side finished; report that instead of waiting */
+        if (stream->state == YAMUX_STREAM_FIN_SENT || stream->state == YAMUX_STREAM_FIN_RECV) {
+            return YAMUX_ERR_CLOSED;
+        }
+        /* Credit, and room in the egress queue for the frame it allows */
+        uint32_t frame = (stream->send_window < yamux_stream_frame_limit(stream))
+                             ? stream->send_window : yamux_stream_frame_limit(stream);
+#if YAMUX_SCHED
+        if (yamux_sched_enabled(session)) {
+            /* Scheduled: room in the stream's own queue */
+            return (frame > 0 && stream->sendq.used < stream->sendq.size) ? YAMUX_OK : YAMUX_ERR_WOULD_BLOCK;
+        }
+#endif
+        if (frame > 0 && session->send_buf_used + YAMUX_HEADER_SIZE + frame <= session->send_buf_size) {
+            return YAMUX_OK;
+        }
+    }
+
+    return YAMUX_ERR_WOULD_BLOCK;
+}
+
+/* Wait on a single-threaded session by processing it until a condition holds */
+static yamux_result_t yamux_stream_drive_wait(yamux_stream_t *stream, int conditions, uint32_t timeout_ms)
+{
+    yamux_session_t *session = stream->session;
+    yamux_result_t result;
+    uint64_t start_ms = 0;
+    uint64_t now_ms;
+    uint32_t left = timeout_ms;
+    int timed = (timeout_ms > 0) && yamux_session_clock_ms(session, &start_ms);
+    int events;
+    int ready;
+    int input;
+
+    while ((result = yamux_stream_poll_wait(stream, conditions)) == YAMUX_ERR_WOULD_BLOCK) {
+        if (timed) {
+            (void)yamux_session_clock_ms(session, &now_ms);
+            if (now_ms - start_ms >= timeout_ms) {
+                return YAMUX_ERR_TIMEOUT;
+            }
+            left = timeout_ms - (uint32_t)(now_ms - start_ms);
+        }
+
+        /* Sleep until a frame arrives, or queued frames can leave */
+        if (session->io.poll) {
+            events = YAMUX_WAIT_READABLE;
+            if (yamux_session_queued(session)) {
+                events |= YAMUX_WAIT_WRITABLE;
+            }
+            ready = session->io.poll(session->io.ctx, events, left);
+            if (ready < 0) {
+                return YAMUX_ERR_IO;
+            }
+            if (ready == 0 && timeout_ms > 0) {
+                return YAMUX_ERR_TIMEOUT;
+            }
+        }
+
+        result = yamux_session_process_input(session, &input);
+        if (result != YAMUX_OK && result != YAMUX_ERR_WOULD_BLOCK) {
+            return result;
+        }
+
+        /* Nothing came and nothing to sleep in: waiting longer would spin */
+        if (!input && !session->io.poll) {
+            return yamux_stream_poll_wait(stream, conditions);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Wait until a stream is readable or writable (thread-safe sessions)
+ *
+ * @param stream Stream to wait on
+ * @param conditions YAMUX_WAIT_READABLE and/or YAMUX_WAIT_WRITABLE
+ * @param timeout_ms Longest wait in milliseconds (0 = no limit)
+ * @return YAMUX_OK when a condition holds, error code otherwise
+ */
+yamux_result_t yamux_stream_wait(yamux_stream_t *stream, int conditions, uint32_t timeout_ms)
+{
+#ifdef YAMUX_THREADS
+    yamux_session_t *session;
+    yamux_result_t result;
+    struct timespec deadline;
+    int rc = 0;
+#endif
+
+    if (!stream || !stream->session || !(conditions & (YAMUX_WAIT_READABLE | YAMUX_WAIT_WRITABLE))) {
+        return YAMUX_ERR_INVALID;
+    }
+    if (!stream->session->threaded) {
+        return yamux_stream_drive_wait(stream, conditions, timeout_ms);
+    }
+
+#ifdef YAMUX_THREADS
+    session = stream->session;
+
+    if (timeout_ms > 0) {
+#if defined(__APPLE__)
+        clock_gettime(CLOCK_REALTIME, &deadline);
+#else
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+#endif
+        deadline.tv_sec += (time_t)(timeout_ms / 1000);
+        deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&session->lock);
+    session->waiters++;
+    while ((result = yamux_stream_poll_wait(stream, conditions)) == YAMUX_ERR_WOULD_BLOCK) {
+        if (rc == ETIMEDOUT) {
+            result = YAMUX_ERR_TIMEOUT;
+            break;
+        }
+        rc = (timeout_ms > 0) ? pthread_cond_timedwait(&session->changed, &session->lock, &deadline)
+                              : pthread_cond_wait(&session->changed, &session->lock);
+    }
+    session->waiters--;
+    pthread_mutex_unlock(&session->lock);
+
+    return result;
+#else
+    return YAMUX_ERR_INVALID;
+#endif
+}
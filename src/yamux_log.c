@@ -0,0 +1,56 @@
+/**
+ * @file yamux_log.c
+ * @brief Log sink for yamux
+ *
+ * Only reached for levels compiled in by YAMUX_LOG_LEVEL. Messages go to
+ * the runtime sink if one is set, otherwise to yamux_debug_log() in
+ * YAMUX_DEBUG builds, or to stderr.
+ */
+
+#include "../include/yamux.h"
+#include "yamux_log.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+static yamux_log_fn yamux_log_sink = NULL;
+static void *yamux_log_sink_data = NULL;
+
+/**
+ * Set the function that receives log messages
+ *
+ * @param sink Sink function, or NULL for the default
+ * @param user_data Passed through to sink
+ */
+void yamux_set_log_sink(yamux_log_fn sink, void *user_data)
+{
+    yamux_log_sink = sink;
+    yamux_log_sink_data = user_data;
+}
+
+/**
+ * Format a log message and deliver it
+ *
+ * @param level YAMUX_LOG_LEVEL_* of the message
+ * @param format printf-style format
+ */
+void yamux_log_write(int level, const char *format, ...)
+{
+    static const char *const names[] = {"NONE", "ERROR", "WARN", "INFO", "DEBUG"};
+    char message[YAMUX_LOG_MESSAGE_SIZE];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+
+    if (yamux_log_sink) {
+        yamux_log_sink(level, message, yamux_log_sink_data);
+        return;
+    }
+
+#ifdef YAMUX_DEBUG
+    yamux_debug_log("%s %s\n", names[level], message);
+#else
+    fprintf(stderr, "yamux %s: %s\n", names[level], message);
+#endif
+}
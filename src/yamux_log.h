@@ -0,0 +1,38 @@
+/**
+ * @file yamux_log.h
+ * @brief Compile-time levelled logging for yamux
+ *
+ * YAMUX_LOG_ERROR/WARN/INFO/DEBUG take printf-style arguments. Levels above
+ * YAMUX_LOG_LEVEL (see yamux_config.h) compile to nothing: the arguments
+ * are still type-checked but never evaluated, so the default build pays
+ * no logging cost per frame.
+ */
+
+#ifndef YAMUX_LOG_H
+#define YAMUX_LOG_H
+
+#include "../include/yamux_config.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define YAMUX_LOG_PRINTF(fmt, args) __attribute__((format(printf, fmt, args)))
+#else
+#define YAMUX_LOG_PRINTF(fmt, args)
+#endif
+
+/* Format a message and hand it to the sink (yamux_log.c) */
+void yamux_log_write(int level, const char *format, ...) YAMUX_LOG_PRINTF(2, 3);
+
+/* Emit at a level if it is compiled in */
+#define YAMUX_LOG_AT(level, ...) \
+    do { \
+        if ((level) <= YAMUX_LOG_LEVEL) { \
+            yamux_log_write((level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define YAMUX_LOG_ERROR(...) YAMUX_LOG_AT(YAMUX_LOG_LEVEL_ERROR, __VA_ARGS__)
+#define YAMUX_LOG_WARN(...)  YAMUX_LOG_AT(YAMUX_LOG_LEVEL_WARN, __VA_ARGS__)
+#define YAMUX_LOG_INFO(...)  YAMUX_LOG_AT(YAMUX_LOG_LEVEL_INFO, __VA_ARGS__)
+#define YAMUX_LOG_DEBUG(...) YAMUX_LOG_AT(YAMUX_LOG_LEVEL_DEBUG, __VA_ARGS__)
+
+#endif /* YAMUX_LOG_H */
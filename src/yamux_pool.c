@@ -0,0 +1,233 @@
+/**
+ * @file yamux_pool.c
+ * @brief Fixed-size object pools for streams and buffers
+ *
+ * A pool hands out objects of one size. Objects can be preallocated in a
+ * single block when the pool is created, so a session can be set up once
+ * and then open and close streams without touching the allocator. Freed
+ * objects from the heap are kept for reuse up to YAMUX_POOL_CACHE_SIZE.
+ * yamux_pool_reserve() adds further blocks when many objects are needed
+ * at once; like the preallocated block they stay with the pool. A fixed
+ * pool never touches the heap after it is created: once empty, it has
+ * nothing more to hand out.
+ */
+
+#include "../include/yamux.h"
+#include "yamux_internal.h"
+#include "yamux_defs.h"
+#include <string.h>
+
+/* Objects of a reserved block start after its header, suitably aligned */
+#define YAMUX_POOL_BLOCK_HEADER ((sizeof(yamux_pool_block_t) + 15) & ~(size_t)15)
+
+/* Whether an object lives in the preallocated block or a reserved one */
+static int yamux_pool_owns(const yamux_pool_t *pool, const void *object)
+{
+    const uint8_t *p = (const uint8_t *)object;
+    const yamux_pool_block_t *block;
+    const uint8_t *start;
+
+    if (pool->arena && p >= pool->arena &&
+        p < pool->arena + (size_t)pool->arena_count * pool->object_size) {
+        return 1;
+    }
+    for (block = pool->blocks; block; block = block->next) {
+        start = (const uint8_t *)block + YAMUX_POOL_BLOCK_HEADER;
+        if (p >= start && p < start + (size_t)block->count * pool->object_size) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Initialize a pool
+ *
+ * @param pool Pool to initialize
+ * @param object_size Size of every object (at least a pointer)
+ * @param preallocate Number of objects to allocate up front in one block
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_pool_init(yamux_pool_t *pool, size_t object_size, uint32_t preallocate)
+{
+    uint32_t i;
+
+    if (!pool || object_size < sizeof(void *)) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    memset(pool, 0, sizeof(*pool));
+    pool->object_size = object_size;
+
+    if (preallocate == 0) {
+        return YAMUX_OK;
+    }
+
+    pool->arena = (uint8_t *)YAMUX_MALLOC((size_t)preallocate * object_size);
+    if (!pool->arena) {
+        return YAMUX_ERR_NOMEM;
+    }
+    pool->arena_count = preallocate;
+
+    /* Thread the block onto the free list, first object on top */
+    for (i = preallocate; i > 0; i--) {
+        void *object = pool->arena + (size_t)(i - 1) * object_size;
+        *(void **)object = pool->free_list;
+        pool->free_list = object;
+    }
+    pool->free_count = preallocate;
+
+    return YAMUX_OK;
+}
+
+/**
+ * Make sure a pool can hand out count objects without further allocation
+ *
+ * Whatever the free list lacks is allocated as one block, which stays
+ * with the pool until it is destroyed. A fixed pool allocates nothing.
+ *
+ * @param pool Pool
+ * @param count Objects that must be free
+ * @return YAMUX_OK on success, YAMUX_ERR_NOMEM if the block cannot be allocated
+ */
+yamux_result_t yamux_pool_reserve(yamux_pool_t *pool, uint32_t count)
+{
+    yamux_pool_block_t *block;
+    uint8_t *objects;
+    uint32_t need;
+    uint32_t i;
+
+    if (!pool || pool->object_size == 0) {
+        return YAMUX_ERR_INVALID;
+    }
+    if (pool->free_count >= count) {
+        return YAMUX_OK;
+    }
+    if (pool->fixed) {
+        return YAMUX_ERR_NOMEM;
+    }
+
+    need = count - pool->free_count;
+    if ((SIZE_MAX - YAMUX_POOL_BLOCK_HEADER) / pool->object_size < need) {
+        return YAMUX_ERR_NOMEM;
+    }
+    block = (yamux_pool_block_t *)YAMUX_MALLOC(YAMUX_POOL_BLOCK_HEADER + (size_t)need * pool->object_size);
+    if (!block) {
+        return YAMUX_ERR_NOMEM;
+    }
+    block->count = need;
+    block->next = pool->blocks;
+    pool->blocks = block;
+
+    /* Thread it onto the free list in order, ahead of what was there */
+    objects = (uint8_t *)block + YAMUX_POOL_BLOCK_HEADER;
+    for (i = need; i > 0; i--) {
+        void *object = objects + (size_t)(i - 1) * pool->object_size;
+        *(void **)object = pool->free_list;
+        pool->free_list = object;
+    }
+    pool->free_count += need;
+
+    return YAMUX_OK;
+}
+
+/**
+ * Take an object from a pool
+ *
+ * @param pool Pool
+ * @return Uninitialized object, or NULL if none is free and allocation fails
+ *         (or the pool is fixed)
+ */
+void *yamux_pool_get(yamux_pool_t *pool)
+{
+    void *object;
+
+    if (!pool || pool->object_size == 0) {
+        return NULL;
+    }
+
+    object = pool->free_list;
+    if (object) {
+        pool->free_list = *(void **)object;
+        pool->free_count--;
+        if (!yamux_pool_owns(pool, object)) {
+            pool->cached--;
+        }
+    } else if (pool->fixed) {
+        return NULL;
+    } else {
+        object = YAMUX_MALLOC(pool->object_size);
+        if (!object) {
+            return NULL;
+        }
+    }
+
+    pool->in_use++;
+    return object;
+}
+
+/**
+ * Return an object to its pool
+ *
+ * @param pool Pool the object came from
+ * @param object Object to return (NULL is ignored)
+ */
+void yamux_pool_put(yamux_pool_t *pool, void *object)
+{
+    if (!pool || !object) {
+        return;
+    }
+
+    pool->in_use--;
+
+    /* Heap objects beyond the cache go back to the allocator */
+    if (!yamux_pool_owns(pool, object)) {
+        if (pool->cached >= YAMUX_POOL_CACHE_SIZE) {
+            YAMUX_FREE(object);
+            return;
+        }
+        pool->cached++;
+    }
+
+    *(void **)object = pool->free_list;
+    pool->free_list = object;
+    pool->free_count++;
+}
+
+/**
+ * Release a pool's memory
+ *
+ * Cached heap objects are freed. The preallocated and reserved blocks are
+ * freed only if every object has been returned; otherwise they are left to
+ * the objects still in use.
+ *
+ * @param pool Pool to destroy
+ */
+void yamux_pool_destroy(yamux_pool_t *pool)
+{
+    yamux_pool_block_t *block;
+    void *object;
+    void *next;
+
+    if (!pool) {
+        return;
+    }
+
+    for (object = pool->free_list; object; object = next) {
+        next = *(void **)object;
+        if (!yamux_pool_owns(pool, object)) {
+            YAMUX_FREE(object);
+        }
+    }
+
+    if (pool->in_use == 0) {
+        YAMUX_FREE(pool->arena);
+        while (pool->blocks) {
+            block = pool->blocks;
+            pool->blocks = block->next;
+            YAMUX_FREE(block);
+        }
+    }
+
+    memset(pool, 0, sizeof(*pool));
+}
@@ -9,7 +9,8 @@
 
 #include "../include/yamux.h"
 #include "yamux_internal.h"
-#include <stdio.h>
+#include "yamux_defs.h"
+#include "yamux_log.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -44,7 +45,7 @@ void* yamux_init(
     yamux_result_t result;
     
     /* Allocate context structure */
-    ctx = (yamux_context_t *)malloc(sizeof(yamux_context_t));
+    ctx = (yamux_context_t *)YAMUX_MALLOC(sizeof(yamux_context_t));
     if (!ctx) {
         return NULL;
     }
@@ -62,12 +63,19 @@ void* yamux_init(
     /* Create internal Yamux session */
     result = yamux_session_create(&ctx->io, is_client, &ctx->config, &ctx->session);
     if (result != YAMUX_OK) {
-        free(ctx);
+        YAMUX_FREE(ctx);
+        return NULL;
+    }
+    
+    /* Stream handles are recycled like the streams they wrap */
+    if (yamux_pool_init(&ctx->handle_pool, sizeof(yamux_stream_context_t),
+                        ctx->config.stream_pool_size) != YAMUX_OK) {
+        yamux_session_close(ctx->session, YAMUX_NORMAL);
+        YAMUX_FREE(ctx);
         return NULL;
     }
 
-    fprintf(stderr, "DEBUG: yamux_init (in yamux_port.c): created ctx = %p, ctx->session = %p\n", (void*)ctx, (void*)ctx->session);
-    fflush(stderr);
+    YAMUX_LOG_DEBUG("yamux_init: created ctx = %p, ctx->session = %p", (void*)ctx, (void*)ctx->session);
     
     return ctx;
 }
@@ -91,7 +99,8 @@ void yamux_destroy(void *session)
     }
     
     /* Free resources */
-    free(ctx);
+    yamux_pool_destroy(&ctx->handle_pool);
+    YAMUX_FREE(ctx);
 }
 
 /**
@@ -108,15 +117,8 @@ int yamux_process(void *session_handle)
     yamux_context_t *ctx = (yamux_context_t *)session_handle;
     yamux_result_t result;
 
-    // Added debug prints
-    fprintf(stderr, "DEBUG: yamux_process (in yamux_port.c): received session_handle = %p\n", session_handle);
-    fprintf(stderr, "DEBUG: yamux_process (in yamux_port.c): cast to ctx = %p\n", (void*)ctx);
-    if (ctx) {
-        fprintf(stderr, "DEBUG: yamux_process (in yamux_port.c): ctx->session = %p\n", (void*)ctx->session);
-    } else {
-        fprintf(stderr, "DEBUG: yamux_process (in yamux_port.c): ctx is NULL\n");
-    }
-    fflush(stderr);
+    YAMUX_LOG_DEBUG("yamux_process: ctx = %p, ctx->session = %p",
+                    (void*)ctx, ctx ? (void*)ctx->session : NULL);
     
     if (!ctx || !ctx->session) {
         return -1; // Should be YAMUX_ERR_INVALID or similar
@@ -147,7 +149,7 @@ void* yamux_open_stream(void *session)
     }
     
     /* Allocate stream context */
-    stream_ctx = (yamux_stream_context_t *)malloc(sizeof(yamux_stream_context_t));
+    stream_ctx = (yamux_stream_context_t *)yamux_pool_get(&ctx->handle_pool);
     if (!stream_ctx) {
         return NULL;
     }
@@ -155,7 +157,7 @@ void* yamux_open_stream(void *session)
     /* Open stream */
     result = yamux_stream_open_detailed(ctx->session, 0, &stream);
     if (result != YAMUX_OK) {
-        free(stream_ctx);
+        yamux_pool_put(&ctx->handle_pool, stream_ctx);
         return NULL;
     }
     
@@ -184,7 +186,7 @@ void* yamux_accept_stream(void *session)
     }
     
     /* Allocate stream context */
-    stream_ctx = (yamux_stream_context_t *)malloc(sizeof(yamux_stream_context_t));
+    stream_ctx = (yamux_stream_context_t *)yamux_pool_get(&ctx->handle_pool);
     if (!stream_ctx) {
         return NULL;
     }
@@ -192,7 +194,7 @@ void* yamux_accept_stream(void *session)
     /* Accept stream */
     result = yamux_stream_accept(ctx->session, &stream);
     if (result != YAMUX_OK) {
-        free(stream_ctx);
+        yamux_pool_put(&ctx->handle_pool, stream_ctx);
         return NULL;
     }
     
@@ -219,11 +221,11 @@ int yamux_close_stream(void *stream, int reset)
         return -1;
     }
     
-    /* Close stream */
-    result = yamux_stream_close(stream_ctx->stream, reset);
+    /* Close stream; the handle owned it, so a normal close frees it too */
+    result = reset ? yamux_stream_close(stream_ctx->stream, 1) : yamux_stream_free(stream_ctx->stream);
     
-    /* Free stream context */
-    free(stream_ctx);
+    /* Return stream context */
+    yamux_pool_put(&stream_ctx->context->handle_pool, stream_ctx);
     
     return (result == YAMUX_OK) ? 0 : (int)result;
 }
@@ -321,3 +323,24 @@ int yamux_ping(void *session)
     
     return (result == YAMUX_OK) ? 0 : (int)result;
 }
+
+/**
+ * Write out frames queued on the session
+ * 
+ * @param session Session handle returned by yamux_init
+ * @return 0 on success, negative value on error
+ */
+int yamux_flush(void *session)
+{
+    yamux_context_t *ctx = (yamux_context_t *)session;
+    yamux_result_t result;
+    
+    if (!ctx || !ctx->session) {
+        return -1;
+    }
+    
+    /* Flush egress queue */
+    result = yamux_session_flush(ctx->session);
+    
+    return (result == YAMUX_OK) ? 0 : (int)result;
+}
@@ -0,0 +1,561 @@
+/**
+ * @file yamux_reactor.c
+ * @brief epoll/kqueue event-loop driver for yamux sessions
+ *
+ * Sessions are kept in a table indexed by descriptor, so readiness is
+ * dispatched in O(1) and a callback may remove any session (even one with
+ * an event later in the same batch) without leaving a dangling pointer.
+ * The poller is level-triggered: a session processes one buffer's worth
+ * per readiness report and is reported again while its socket has data.
+ * Write interest is only registered while the session has queued frames.
+ */
+
+#include "../include/yamux.h"
+#include "../include/yamux_reactor.h"
+#include "yamux_internal.h"
+#include "yamux_defs.h"
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#define YAMUX_REACTOR_EPOLL 1
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || \
+      defined(__NetBSD__) || defined(__DragonFly__)
+#include <sys/event.h>
+#include <sys/time.h>
+#define YAMUX_REACTOR_KQUEUE 1
+#else
+#error "yamux_reactor.c needs epoll or kqueue"
+#endif
+
+/* Readiness reports taken from the kernel per poll */
+#define YAMUX_REACTOR_MAX_EVENTS 64
+
+/* Initial size of the descriptor table */
+#define YAMUX_REACTOR_INITIAL_FDS 64
+
+/* Bytes yamux_fd_sendfile() copies per call where there is no sendfile(2) */
+#define YAMUX_REACTOR_SENDFILE_BOUNCE 16384
+
+/* A registered session */
+typedef struct {
+    yamux_session_t *session;
+    yamux_reactor_fn callback;
+    void *user_data;
+    int writing;                    /* Write interest is registered */
+} yamux_reactor_entry_t;
+
+/* Reactor structure */
+struct yamux_reactor {
+    int poll_fd;                    /* epoll or kqueue descriptor */
+    yamux_reactor_entry_t **entries;/* Registered sessions indexed by descriptor */
+    int capacity;                   /* Length of entries */
+    int wake_fds[2];                /* Pipe yamux_reactor_wake() writes to */
+    int wake_pending;               /* A wakeup byte is in the pipe (atomic) */
+};
+
+/* Get the entry registered for fd, or NULL */
+static yamux_reactor_entry_t *yamux_reactor_lookup(const yamux_reactor_t *reactor, int fd)
+{
+    if (fd < 0 || fd >= reactor->capacity) {
+        return NULL;
+    }
+    return reactor->entries[fd];
+}
+
+/* Grow the descriptor table so that fd fits */
+static yamux_result_t yamux_reactor_reserve(yamux_reactor_t *reactor, int fd)
+{
+    yamux_reactor_entry_t **entries;
+    int capacity = reactor->capacity;
+
+    if (fd < capacity) {
+        return YAMUX_OK;
+    }
+    while (capacity <= fd) {
+        capacity *= 2;
+    }
+
+    entries = (yamux_reactor_entry_t **)YAMUX_MALLOC((size_t)capacity * sizeof(*entries));
+    if (!entries) {
+        return YAMUX_ERR_NOMEM;
+    }
+    memset(entries, 0, (size_t)capacity * sizeof(*entries));
+    memcpy(entries, reactor->entries, (size_t)reactor->capacity * sizeof(*entries));
+
+    YAMUX_FREE(reactor->entries);
+    reactor->entries = entries;
+    reactor->capacity = capacity;
+    return YAMUX_OK;
+}
+
+/* Register fd with the poller, for reading and optionally writing */
+static yamux_result_t yamux_reactor_watch(yamux_reactor_t *reactor, int fd, int add, int writing)
+{
+#ifdef YAMUX_REACTOR_EPOLL
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | (writing ? EPOLLOUT : 0);
+    ev.data.fd = fd;
+    if (epoll_ctl(reactor->poll_fd, add ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev) < 0) {
+        return YAMUX_ERR_IO;
+    }
+#else
+    struct kevent changes[2];
+    int n = 0;
+
+    if (add) {
+        EV_SET(&changes[n++], fd, EVFILT_READ, EV_ADD, 0, 0, NULL);
+    }
+    EV_SET(&changes[n++], fd, EVFILT_WRITE, writing ? (EV_ADD | EV_ENABLE) : (EV_ADD | EV_DISABLE),
+           0, 0, NULL);
+    if (kevent(reactor->poll_fd, changes, n, NULL, 0, NULL) < 0) {
+        return YAMUX_ERR_IO;
+    }
+#endif
+    return YAMUX_OK;
+}
+
+/* Stop watching fd */
+static void yamux_reactor_unwatch(yamux_reactor_t *reactor, int fd)
+{
+#ifdef YAMUX_REACTOR_EPOLL
+    struct epoll_event ev;
+
+    memset(&ev, 0, sizeof(ev));
+    (void)epoll_ctl(reactor->poll_fd, EPOLL_CTL_DEL, fd, &ev);
+#else
+    struct kevent changes[2];
+
+    EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+    EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+    (void)kevent(reactor->poll_fd, changes, 2, NULL, 0, NULL);
+#endif
+}
+
+/* Watch for writability exactly while the session has frames queued */
+static yamux_result_t yamux_reactor_update(yamux_reactor_t *reactor, int fd, yamux_reactor_entry_t *entry)
+{
+    int writing = yamux_session_queued(entry->session);
+
+    if (writing == entry->writing) {
+        return YAMUX_OK;
+    }
+    if (yamux_reactor_watch(reactor, fd, 0, writing) != YAMUX_OK) {
+        return YAMUX_ERR_IO;
+    }
+    entry->writing = writing;
+    return YAMUX_OK;
+}
+
+/**
+ * Create a reactor
+ *
+ * @param reactor Output parameter for the created reactor
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_reactor_create(yamux_reactor_t **reactor)
+{
+    yamux_reactor_t *r;
+
+    if (!reactor) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    r = (yamux_reactor_t *)YAMUX_MALLOC(sizeof(yamux_reactor_t));
+    if (!r) {
+        return YAMUX_ERR_NOMEM;
+    }
+    memset(r, 0, sizeof(yamux_reactor_t));
+
+    r->entries = (yamux_reactor_entry_t **)YAMUX_MALLOC(YAMUX_REACTOR_INITIAL_FDS * sizeof(*r->entries));
+    if (!r->entries) {
+        YAMUX_FREE(r);
+        return YAMUX_ERR_NOMEM;
+    }
+    memset(r->entries, 0, YAMUX_REACTOR_INITIAL_FDS * sizeof(*r->entries));
+    r->capacity = YAMUX_REACTOR_INITIAL_FDS;
+
+#ifdef YAMUX_REACTOR_EPOLL
+    r->poll_fd = epoll_create1(EPOLL_CLOEXEC);
+#else
+    r->poll_fd = kqueue();
+#endif
+    if (r->poll_fd < 0) {
+        YAMUX_FREE(r->entries);
+        YAMUX_FREE(r);
+        return YAMUX_ERR_IO;
+    }
+
+    /* Other threads interrupt the poll through a pipe it watches */
+    if (pipe(r->wake_fds) < 0) {
+        close(r->poll_fd);
+        YAMUX_FREE(r->entries);
+        YAMUX_FREE(r);
+        return YAMUX_ERR_IO;
+    }
+    (void)fcntl(r->wake_fds[0], F_SETFL, fcntl(r->wake_fds[0], F_GETFL, 0) | O_NONBLOCK);
+    (void)fcntl(r->wake_fds[1], F_SETFL, fcntl(r->wake_fds[1], F_GETFL, 0) | O_NONBLOCK);
+    (void)fcntl(r->wake_fds[0], F_SETFD, FD_CLOEXEC);
+    (void)fcntl(r->wake_fds[1], F_SETFD, FD_CLOEXEC);
+    if (yamux_reactor_watch(r, r->wake_fds[0], 1, 0) != YAMUX_OK) {
+        yamux_reactor_destroy(r);
+        return YAMUX_ERR_IO;
+    }
+
+    *reactor = r;
+    return YAMUX_OK;
+}
+
+/**
+ * Destroy a reactor
+ *
+ * @param reactor Reactor
+ */
+void yamux_reactor_destroy(yamux_reactor_t *reactor)
+{
+    int fd;
+
+    if (!reactor) {
+        return;
+    }
+
+    for (fd = 0; fd < reactor->capacity; fd++) {
+        YAMUX_FREE(reactor->entries[fd]);
+    }
+    close(reactor->wake_fds[0]);
+    close(reactor->wake_fds[1]);
+    close(reactor->poll_fd);
+    YAMUX_FREE(reactor->entries);
+    YAMUX_FREE(reactor);
+}
+
+/**
+ * Register a session with the reactor
+ *
+ * @param reactor Reactor
+ * @param fd Non-blocking descriptor the session's transport uses
+ * @param session Session to drive
+ * @param callback Event callback (may be NULL)
+ * @param user_data Passed through to callback
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_reactor_add(yamux_reactor_t *reactor, int fd, yamux_session_t *session,
+                                 yamux_reactor_fn callback, void *user_data)
+{
+    yamux_reactor_entry_t *entry;
+
+    if (!reactor || fd < 0 || !session || yamux_reactor_lookup(reactor, fd) || fd == reactor->wake_fds[0]) {
+        return YAMUX_ERR_INVALID;
+    }
+    if (yamux_reactor_reserve(reactor, fd) != YAMUX_OK) {
+        return YAMUX_ERR_NOMEM;
+    }
+
+    entry = (yamux_reactor_entry_t *)YAMUX_MALLOC(sizeof(yamux_reactor_entry_t));
+    if (!entry) {
+        return YAMUX_ERR_NOMEM;
+    }
+    entry->session = session;
+    entry->callback = callback;
+    entry->user_data = user_data;
+    entry->writing = yamux_session_queued(session);
+
+    if (yamux_reactor_watch(reactor, fd, 1, entry->writing) != YAMUX_OK) {
+        YAMUX_FREE(entry);
+        return YAMUX_ERR_IO;
+    }
+
+    reactor->entries[fd] = entry;
+    return YAMUX_OK;
+}
+
+/**
+ * Unregister a session
+ *
+ * @param reactor Reactor
+ * @param fd Descriptor the session was registered with
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_reactor_remove(yamux_reactor_t *reactor, int fd)
+{
+    yamux_reactor_entry_t *entry;
+
+    if (!reactor || !(entry = yamux_reactor_lookup(reactor, fd))) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    yamux_reactor_unwatch(reactor, fd);
+    reactor->entries[fd] = NULL;
+    YAMUX_FREE(entry);
+    return YAMUX_OK;
+}
+
+/**
+ * Flush a session's queued frames, waiting for writability if needed
+ *
+ * @param reactor Reactor
+ * @param fd Descriptor the session was registered with
+ * @return YAMUX_OK if flushed or left for the reactor, error code otherwise
+ */
+yamux_result_t yamux_reactor_flush(yamux_reactor_t *reactor, int fd)
+{
+    yamux_reactor_entry_t *entry;
+    yamux_result_t result;
+
+    if (!reactor || !(entry = yamux_reactor_lookup(reactor, fd))) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    result = yamux_session_flush(entry->session);
+    if (result != YAMUX_OK && result != YAMUX_ERR_WOULD_BLOCK) {
+        return result;
+    }
+    return yamux_reactor_update(reactor, fd, entry);
+}
+
+/**
+ * Get the user_data a session was registered with
+ *
+ * @param reactor Reactor
+ * @param fd Descriptor the session was registered with
+ * @return The user_data given to yamux_reactor_add(), NULL if fd is not registered
+ */
+void *yamux_reactor_user_data(yamux_reactor_t *reactor, int fd)
+{
+    yamux_reactor_entry_t *entry;
+
+    if (!reactor || !(entry = yamux_reactor_lookup(reactor, fd))) {
+        return NULL;
+    }
+    return entry->user_data;
+}
+
+/**
+ * Make a running or the next yamux_reactor_poll() return at once
+ *
+ * @param reactor Reactor
+ */
+void yamux_reactor_wake(yamux_reactor_t *reactor)
+{
+    const uint8_t byte = 0;
+
+    /* One byte in the pipe wakes the poll; more would only need draining */
+    if (reactor && !__atomic_exchange_n(&reactor->wake_pending, 1, __ATOMIC_ACQ_REL)) {
+        (void)!write(reactor->wake_fds[1], &byte, 1);
+    }
+}
+
+/* Empty the wake pipe; wakeups from here on write to it again */
+static void yamux_reactor_woken(yamux_reactor_t *reactor)
+{
+    uint8_t buf[64];
+
+    __atomic_store_n(&reactor->wake_pending, 0, __ATOMIC_RELEASE);
+    while (read(reactor->wake_fds[0], buf, sizeof(buf)) > 0) {
+    }
+}
+
+/* Act on the readiness of one descriptor */
+static void yamux_reactor_dispatch(yamux_reactor_t *reactor, int fd, int readable, int writable, int failed)
+{
+    yamux_reactor_entry_t *entry = yamux_reactor_lookup(reactor, fd);
+    yamux_result_t result = YAMUX_OK;
+
+    if (fd == reactor->wake_fds[0]) {
+        if (readable) {
+            yamux_reactor_woken(reactor);
+        }
+        return;
+    }
+    if (!entry) {
+        return; /* Removed earlier in this batch */
+    }
+
+    /* Queued frames go first, so responses to new frames keep their order */
+    if (writable) {
+        result = yamux_session_flush(entry->session);
+        if (result == YAMUX_ERR_WOULD_BLOCK) {
+            result = YAMUX_OK;
+        }
+    }
+    if (result == YAMUX_OK && readable) {
+        result = yamux_session_process(entry->session);
+        if (result == YAMUX_ERR_WOULD_BLOCK) {
+            result = YAMUX_OK;
+        }
+    }
+    if (result == YAMUX_OK && failed && !readable) {
+        result = YAMUX_ERR_IO;
+    }
+
+    if ((readable || result != YAMUX_OK) && entry->callback) {
+        entry->callback(reactor, fd, entry->session, result, entry->user_data);
+        entry = yamux_reactor_lookup(reactor, fd);
+        if (!entry) {
+            return;
+        }
+    }
+
+    /* Frames written by the callback may be waiting for the socket */
+    if (result == YAMUX_OK && yamux_reactor_update(reactor, fd, entry) != YAMUX_OK && entry->callback) {
+        entry->callback(reactor, fd, entry->session, YAMUX_ERR_IO, entry->user_data);
+    }
+}
+
+/**
+ * Wait for socket readiness and dispatch it to the sessions
+ *
+ * @param reactor Reactor
+ * @param timeout_ms Longest wait in milliseconds (-1 = no limit, 0 = do not wait)
+ * @return Number of descriptors serviced, or a negative error code
+ */
+int yamux_reactor_poll(yamux_reactor_t *reactor, int timeout_ms)
+{
+    int n;
+    int i;
+#ifdef YAMUX_REACTOR_EPOLL
+    struct epoll_event events[YAMUX_REACTOR_MAX_EVENTS];
+#else
+    struct kevent events[YAMUX_REACTOR_MAX_EVENTS];
+    struct timespec timeout;
+#endif
+
+    if (!reactor) {
+        return YAMUX_ERR_INVALID;
+    }
+
+#ifdef YAMUX_REACTOR_EPOLL
+    n = epoll_wait(reactor->poll_fd, events, YAMUX_REACTOR_MAX_EVENTS, timeout_ms);
+#else
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000L;
+    n = kevent(reactor->poll_fd, NULL, 0, events, YAMUX_REACTOR_MAX_EVENTS,
+               timeout_ms < 0 ? NULL : &timeout);
+#endif
+    if (n < 0) {
+        return (errno == EINTR) ? 0 : YAMUX_ERR_IO;
+    }
+
+    for (i = 0; i < n; i++) {
+#ifdef YAMUX_REACTOR_EPOLL
+        uint32_t ev = events[i].events;
+        yamux_reactor_dispatch(reactor, events[i].data.fd, (ev & EPOLLIN) != 0, (ev & EPOLLOUT) != 0,
+                               (ev & (EPOLLERR | EPOLLHUP)) != 0);
+#else
+        /* kqueue reports each filter separately; EOF still lets the last data be read */
+        yamux_reactor_dispatch(reactor, (int)events[i].ident, events[i].filter == EVFILT_READ,
+                               events[i].filter == EVFILT_WRITE,
+                               (events[i].flags & (EV_ERROR | EV_EOF)) != 0);
+#endif
+    }
+
+    return n;
+}
+
+/**
+ * yamux_io_t.read over a non-blocking descriptor
+ *
+ * @param ctx Pointer to the int descriptor
+ * @param buf Buffer to fill
+ * @param len Size of buf
+ * @return Bytes read, 0 if none are available, or YAMUX_ERR_IO on error or end of file
+ */
+int yamux_fd_read(void *ctx, uint8_t *buf, size_t len)
+{
+    ssize_t n;
+
+    do {
+        n = read(*(const int *)ctx, buf, len);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : YAMUX_ERR_IO;
+    }
+    /* End of file: the peer is gone */
+    return (n == 0) ? YAMUX_ERR_IO : (int)n;
+}
+
+/**
+ * yamux_io_t.write over a non-blocking descriptor
+ *
+ * @param ctx Pointer to the int descriptor
+ * @param buf Data to write
+ * @param len Length of data
+ * @return Bytes written, 0 if the descriptor is full, or YAMUX_ERR_IO on error
+ */
+int yamux_fd_write(void *ctx, const uint8_t *buf, size_t len)
+{
+    int fd = *(const int *)ctx;
+    ssize_t n;
+
+    do {
+#ifdef MSG_NOSIGNAL
+        /* A closed peer must not raise SIGPIPE in the event loop */
+        n = send(fd, buf, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == ENOTSOCK) {
+            n = write(fd, buf, len);
+        }
+#else
+        n = write(fd, buf, len);
+#endif
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : YAMUX_ERR_IO;
+    }
+    return (int)n;
+}
+
+/**
+ * yamux_io_t.sendfile over a non-blocking descriptor
+ *
+ * On Linux the kernel moves the file's pages to the descriptor with
+ * sendfile(2); elsewhere the data is read into a small buffer and written.
+ *
+ * @param ctx Pointer to the int descriptor
+ * @param fd File to read from
+ * @param offset Offset in the file
+ * @param len Bytes to write at most
+ * @return Bytes written, 0 if the descriptor is full, or YAMUX_ERR_IO on
+ *         error or if the file ends first
+ */
+int yamux_fd_sendfile(void *ctx, int fd, uint64_t offset, size_t len)
+{
+    ssize_t n;
+
+#ifdef YAMUX_REACTOR_EPOLL
+    off_t off = (off_t)offset;
+
+    do {
+        n = sendfile(*(const int *)ctx, fd, &off, len);
+    } while (n < 0 && errno == EINTR);
+
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : YAMUX_ERR_IO;
+    }
+    return (n == 0 && len > 0) ? YAMUX_ERR_IO : (int)n;
+#else
+    uint8_t buf[YAMUX_REACTOR_SENDFILE_BOUNCE];
+
+    if (len > sizeof(buf)) {
+        len = sizeof(buf);
+    }
+    do {
+        n = pread(fd, buf, len, (off_t)offset);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) {
+        return YAMUX_ERR_IO;
+    }
+    /* A short socket write leaves the rest to be read again */
+    return yamux_fd_write(ctx, buf, (size_t)n);
+#endif
+}
@@ -0,0 +1,535 @@
+/**
+ * @file yamux_runtime.c
+ * @brief Sharded multi-core runtime over per-thread reactors
+ *
+ * Each shard thread loops over its reactor: poll with a timeout of one
+ * timer tick, run the tasks other threads posted, then tick the shard's
+ * timer wheel. Sessions never leave their shard, so none of them is
+ * thread-safe and none takes a lock.
+ *
+ * Tasks are pushed onto a lock-free stack (a compare-and-swap on its
+ * head) and the shard takes the whole stack with one exchange, reversing
+ * it so tasks run in the order they were posted. As the consumer only
+ * ever takes everything, a node is never popped while another thread
+ * looks at it and the stack has no ABA problem. A post then wakes the
+ * reactor, which coalesces wakeups until the shard drains its pipe.
+ */
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* pthread_setaffinity_np(), CPU_SET() */
+#endif
+
+#include "../include/yamux.h"
+#include "../include/yamux_reactor.h"
+#include "../include/yamux_runtime.h"
+#include "yamux_internal.h"
+#include "yamux_defs.h"
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+/* A connection added to the runtime, owned by its shard */
+typedef struct yamux_runtime_conn {
+    struct yamux_runtime_conn *next;   /* Shard's connections */
+    struct yamux_runtime_conn *prev;
+    struct yamux_runtime_conn *failed_next; /* Failed by a timer, to be reported */
+    yamux_shard_t *shard;
+    yamux_shard_task_t open_task;      /* Creates the session on the shard */
+    int fd;                            /* io.ctx points here */
+    int client;
+    yamux_config_t config;
+    yamux_session_t *session;
+    yamux_result_t failure;            /* Set when a timer failed the session */
+    yamux_runtime_fn callback;
+    void *user_data;
+} yamux_runtime_conn_t;
+
+/* Shard structure */
+struct yamux_shard {
+    yamux_runtime_t *runtime;
+    uint32_t index;
+    pthread_t thread;
+    int started;                       /* thread is running */
+    int stop;                          /* Set to end the loop (atomic) */
+    yamux_reactor_t *reactor;
+    yamux_timer_wheel_t *timers;
+    yamux_shard_task_t *tasks;         /* Posted tasks, newest first (atomic) */
+    yamux_runtime_conn_t *conns;       /* Sessions of the shard */
+    yamux_runtime_conn_t *failed;      /* Sessions a timer failed this tick */
+};
+
+/* Runtime structure */
+struct yamux_runtime {
+    yamux_shard_t **shards;            /* Separately allocated, so shards share no cache line */
+    uint32_t count;
+    int pin;
+    long cpus;                         /* Online CPUs when created */
+};
+
+/* Monotonic clock for the shards' timers and the sessions' io.now_ms */
+static uint64_t yamux_runtime_now_ms(void *ctx)
+{
+    struct timespec now;
+
+    (void)ctx;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000u + (uint64_t)(now.tv_nsec / 1000000L);
+}
+
+/* Unlink, unregister and close a connection's session */
+static void yamux_shard_drop(yamux_shard_t *shard, yamux_runtime_conn_t *conn)
+{
+    yamux_runtime_conn_t **failed;
+
+    /* A callback may drop a session that is still to be reported */
+    if (conn->failure != YAMUX_OK) {
+        for (failed = &shard->failed; *failed; failed = &(*failed)->failed_next) {
+            if (*failed == conn) {
+                *failed = conn->failed_next;
+                break;
+            }
+        }
+    }
+    if (conn->prev) {
+        conn->prev->next = conn->next;
+    } else {
+        shard->conns = conn->next;
+    }
+    if (conn->next) {
+        conn->next->prev = conn->prev;
+    }
+    (void)yamux_reactor_remove(shard->reactor, conn->fd);
+    yamux_session_close(conn->session, YAMUX_NORMAL);
+    YAMUX_FREE(conn);
+}
+
+/* Reactor callback: pass the event on, then drop a failed session */
+static void yamux_shard_event(yamux_reactor_t *reactor, int fd, yamux_session_t *session,
+                              yamux_result_t result, void *user_data)
+{
+    yamux_runtime_conn_t *conn = (yamux_runtime_conn_t *)user_data;
+    yamux_shard_t *shard = conn->shard;
+
+    if (conn->callback) {
+        conn->callback(shard, fd, session, result, conn->user_data);
+    }
+    /* Unless the callback removed it already */
+    if (result != YAMUX_OK && yamux_reactor_user_data(reactor, fd) == conn) {
+        yamux_shard_drop(shard, conn);
+    }
+}
+
+/* on_session_failed: runs inside the wheel's tick, so only note the session */
+static void yamux_shard_session_failed(yamux_session_t *session, yamux_result_t error, void *user_data)
+{
+    yamux_runtime_conn_t *conn = (yamux_runtime_conn_t *)user_data;
+
+    (void)session;
+    if (conn->failure == YAMUX_OK) {
+        conn->failure = error;
+        conn->failed_next = conn->shard->failed;
+        conn->shard->failed = conn;
+    }
+}
+
+/* Task: create a connection's session and register it */
+static void yamux_shard_open(yamux_shard_t *shard, yamux_shard_task_t *task)
+{
+    yamux_runtime_conn_t *conn = (yamux_runtime_conn_t *)task->arg;
+    yamux_callbacks_t callbacks;
+    yamux_result_t result;
+    yamux_io_t io;
+
+    memset(&io, 0, sizeof(io));
+    io.read = yamux_fd_read;
+    io.write = yamux_fd_write;
+    io.sendfile = yamux_fd_sendfile;
+    io.now_ms = yamux_runtime_now_ms;
+    io.ctx = &conn->fd;
+
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.on_session_failed = yamux_shard_session_failed;
+    callbacks.user_data = conn;
+
+    result = yamux_session_create(&io, conn->client, &conn->config, &conn->session);
+    if (result == YAMUX_OK) {
+        result = yamux_session_set_timer_wheel(conn->session, shard->timers);
+    }
+    if (result == YAMUX_OK) {
+        result = yamux_session_set_callbacks(conn->session, &callbacks);
+    }
+    if (result == YAMUX_OK) {
+        result = yamux_reactor_add(shard->reactor, conn->fd, conn->session, yamux_shard_event, conn);
+    }
+    if (result != YAMUX_OK) {
+        if (conn->session) {
+            yamux_session_close(conn->session, YAMUX_NORMAL);
+        }
+        if (conn->callback) {
+            conn->callback(shard, conn->fd, NULL, result, conn->user_data);
+        }
+        YAMUX_FREE(conn);
+        return;
+    }
+
+    conn->next = shard->conns;
+    if (shard->conns) {
+        shard->conns->prev = conn;
+    }
+    shard->conns = conn;
+
+    /* May remove the session again */
+    if (conn->callback) {
+        conn->callback(shard, conn->fd, conn->session, YAMUX_OK, conn->user_data);
+    }
+}
+
+/* Run every task posted so far, oldest first */
+static void yamux_shard_run_tasks(yamux_shard_t *shard)
+{
+    yamux_shard_task_t *task = __atomic_exchange_n(&shard->tasks, NULL, __ATOMIC_ACQUIRE);
+    yamux_shard_task_t *ordered = NULL;
+    yamux_shard_task_t *next;
+
+    while (task) {
+        next = task->next;
+        task->next = ordered;
+        ordered = task;
+        task = next;
+    }
+    while (ordered) {
+        /* run may free or repost the task */
+        next = ordered->next;
+        ordered->run(shard, ordered);
+        ordered = next;
+    }
+}
+
+/* Report and drop the sessions timers failed during the last tick */
+static void yamux_shard_report_failed(yamux_shard_t *shard)
+{
+    yamux_runtime_conn_t *conn;
+
+    while ((conn = shard->failed) != NULL) {
+        shard->failed = conn->failed_next;
+        if (conn->callback) {
+            conn->callback(shard, conn->fd, conn->session, conn->failure, conn->user_data);
+        }
+        if (yamux_reactor_user_data(shard->reactor, conn->fd) == conn) {
+            yamux_shard_drop(shard, conn);
+        }
+    }
+}
+
+/* Shard thread: poll, run posted tasks, tick timers */
+static void *yamux_shard_main(void *arg)
+{
+    yamux_shard_t *shard = (yamux_shard_t *)arg;
+
+#ifdef __linux__
+    if (shard->runtime->pin) {
+        cpu_set_t cpus;
+
+        CPU_ZERO(&cpus);
+        CPU_SET((int)(shard->index % (uint32_t)shard->runtime->cpus), &cpus);
+        (void)pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+#endif
+
+    while (!__atomic_load_n(&shard->stop, __ATOMIC_ACQUIRE)) {
+        (void)yamux_reactor_poll(shard->reactor, YAMUX_TIMER_TICK_MS);
+        yamux_shard_run_tasks(shard);
+        (void)yamux_timer_wheel_tick(shard->timers, yamux_runtime_now_ms(NULL));
+        yamux_shard_report_failed(shard);
+    }
+
+    /* Tasks posted before the stop still run */
+    yamux_shard_run_tasks(shard);
+    return NULL;
+}
+
+/* Free a shard whose thread has ended, closing its sessions */
+static void yamux_shard_destroy(yamux_shard_t *shard)
+{
+    while (shard->conns) {
+        yamux_shard_drop(shard, shard->conns);
+    }
+    yamux_reactor_destroy(shard->reactor);
+    yamux_timer_wheel_destroy(shard->timers);
+    YAMUX_FREE(shard);
+}
+
+/* Create a shard, without starting its thread */
+static yamux_result_t yamux_shard_create(yamux_runtime_t *runtime, uint32_t index, yamux_shard_t **out)
+{
+    yamux_shard_t *shard;
+    yamux_result_t result;
+
+    shard = (yamux_shard_t *)YAMUX_MALLOC(sizeof(yamux_shard_t));
+    if (!shard) {
+        return YAMUX_ERR_NOMEM;
+    }
+    memset(shard, 0, sizeof(yamux_shard_t));
+    shard->runtime = runtime;
+    shard->index = index;
+
+    result = yamux_reactor_create(&shard->reactor);
+    if (result != YAMUX_OK) {
+        YAMUX_FREE(shard);
+        return result;
+    }
+    result = yamux_timer_wheel_create(yamux_runtime_now_ms(NULL), &shard->timers);
+    if (result != YAMUX_OK) {
+        yamux_reactor_destroy(shard->reactor);
+        YAMUX_FREE(shard);
+        return result;
+    }
+
+    *out = shard;
+    return YAMUX_OK;
+}
+
+/**
+ * Stop the shards and destroy the runtime
+ *
+ * @param runtime Runtime
+ */
+void yamux_runtime_destroy(yamux_runtime_t *runtime)
+{
+    yamux_shard_t *shard;
+    uint32_t i;
+
+    if (!runtime) {
+        return;
+    }
+
+    for (i = 0; i < runtime->count; i++) {
+        shard = runtime->shards[i];
+        if (shard && shard->started) {
+            __atomic_store_n(&shard->stop, 1, __ATOMIC_RELEASE);
+            yamux_reactor_wake(shard->reactor);
+        }
+    }
+    for (i = 0; i < runtime->count; i++) {
+        shard = runtime->shards[i];
+        if (!shard) {
+            continue;
+        }
+        if (shard->started) {
+            (void)pthread_join(shard->thread, NULL);
+        }
+        yamux_shard_destroy(shard);
+    }
+
+    YAMUX_FREE(runtime->shards);
+    YAMUX_FREE(runtime);
+}
+
+/**
+ * Create a runtime and start its shards
+ *
+ * @param shards Number of worker threads (0 = one per online CPU)
+ * @param pin Pin shard i to CPU i modulo the CPU count
+ * @param runtime Output parameter for the created runtime
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_runtime_create(uint32_t shards, int pin, yamux_runtime_t **runtime)
+{
+    yamux_runtime_t *rt;
+    yamux_result_t result;
+    uint32_t i;
+
+    if (!runtime) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    rt = (yamux_runtime_t *)YAMUX_MALLOC(sizeof(yamux_runtime_t));
+    if (!rt) {
+        return YAMUX_ERR_NOMEM;
+    }
+    memset(rt, 0, sizeof(yamux_runtime_t));
+    rt->pin = pin;
+    rt->cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (rt->cpus < 1) {
+        rt->cpus = 1;
+    }
+    if (shards == 0) {
+        shards = (uint32_t)rt->cpus;
+    }
+
+    rt->shards = (yamux_shard_t **)YAMUX_MALLOC(shards * sizeof(*rt->shards));
+    if (!rt->shards) {
+        YAMUX_FREE(rt);
+        return YAMUX_ERR_NOMEM;
+    }
+    memset(rt->shards, 0, shards * sizeof(*rt->shards));
+    rt->count = shards;
+
+    for (i = 0; i < shards; i++) {
+        result = yamux_shard_create(rt, i, &rt->shards[i]);
+        if (result != YAMUX_OK) {
+            yamux_runtime_destroy(rt);
+            return result;
+        }
+    }
+    for (i = 0; i < shards; i++) {
+        if (pthread_create(&rt->shards[i]->thread, NULL, yamux_shard_main, rt->shards[i]) != 0) {
+            yamux_runtime_destroy(rt);
+            return YAMUX_ERR_INTERNAL;
+        }
+        rt->shards[i]->started = 1;
+    }
+
+    *runtime = rt;
+    return YAMUX_OK;
+}
+
+/**
+ * Get the number of shards
+ *
+ * @param runtime Runtime
+ * @return Number of shards
+ */
+uint32_t yamux_runtime_shard_count(const yamux_runtime_t *runtime)
+{
+    return runtime ? runtime->count : 0;
+}
+
+/**
+ * Get a shard by index
+ *
+ * @param runtime Runtime
+ * @param index Shard index
+ * @return The shard, NULL if index is out of range
+ */
+yamux_shard_t *yamux_runtime_shard(yamux_runtime_t *runtime, uint32_t index)
+{
+    if (!runtime || index >= runtime->count) {
+        return NULL;
+    }
+    return runtime->shards[index];
+}
+
+/**
+ * Get the shard a connection hash maps to
+ *
+ * @param runtime Runtime
+ * @param hash Connection hash
+ * @return The shard
+ */
+yamux_shard_t *yamux_runtime_shard_for(yamux_runtime_t *runtime, uint64_t hash)
+{
+    if (!runtime) {
+        return NULL;
+    }
+    /* Mix first, so hashes differing only in a few bits (ports) still spread */
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return runtime->shards[hash % runtime->count];
+}
+
+/**
+ * Add a connection; its session is created on the shard hash maps to
+ *
+ * @param runtime Runtime
+ * @param fd Non-blocking connected socket
+ * @param hash Connection hash choosing the shard
+ * @param client 1 for the client side, 0 for the server side
+ * @param config Session configuration (NULL = defaults)
+ * @param callback Event callback (may be NULL)
+ * @param user_data Passed through to callback
+ * @return YAMUX_OK once the connection is handed to its shard, error code otherwise
+ */
+yamux_result_t yamux_runtime_add(yamux_runtime_t *runtime, int fd, uint64_t hash, int client,
+                                 const yamux_config_t *config, yamux_runtime_fn callback,
+                                 void *user_data)
+{
+    yamux_runtime_conn_t *conn;
+
+    if (!runtime || fd < 0) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    conn = (yamux_runtime_conn_t *)YAMUX_MALLOC(sizeof(yamux_runtime_conn_t));
+    if (!conn) {
+        return YAMUX_ERR_NOMEM;
+    }
+    memset(conn, 0, sizeof(yamux_runtime_conn_t));
+    conn->shard = yamux_runtime_shard_for(runtime, hash);
+    conn->fd = fd;
+    conn->client = client;
+    conn->config = config ? *config : yamux_default_config;
+    conn->config.thread_safe = 0;
+    conn->callback = callback;
+    conn->user_data = user_data;
+    conn->open_task.run = yamux_shard_open;
+    conn->open_task.arg = conn;
+
+    return yamux_shard_post(conn->shard, &conn->open_task);
+}
+
+/**
+ * Run a task on a shard's thread
+ *
+ * @param shard Shard
+ * @param task Task, with run set
+ * @return YAMUX_OK on success, YAMUX_ERR_INVALID for missing arguments
+ */
+yamux_result_t yamux_shard_post(yamux_shard_t *shard, yamux_shard_task_t *task)
+{
+    if (!shard || !task || !task->run) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    task->next = __atomic_load_n(&shard->tasks, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&shard->tasks, &task->next, task, 1,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+    }
+    yamux_reactor_wake(shard->reactor);
+    return YAMUX_OK;
+}
+
+/**
+ * Close and unregister a session of the shard
+ *
+ * @param shard Shard
+ * @param fd Descriptor the session was added with
+ * @return YAMUX_OK on success, YAMUX_ERR_INVALID if fd has no session here
+ */
+yamux_result_t yamux_shard_remove(yamux_shard_t *shard, int fd)
+{
+    yamux_runtime_conn_t *conn;
+
+    if (!shard || !(conn = (yamux_runtime_conn_t *)yamux_reactor_user_data(shard->reactor, fd))) {
+        return YAMUX_ERR_INVALID;
+    }
+    yamux_shard_drop(shard, conn);
+    return YAMUX_OK;
+}
+
+/**
+ * Get the reactor of a shard
+ *
+ * @param shard Shard
+ * @return The shard's reactor
+ */
+yamux_reactor_t *yamux_shard_reactor(yamux_shard_t *shard)
+{
+    return shard ? shard->reactor : NULL;
+}
+
+/**
+ * Get the index of a shard
+ *
+ * @param shard Shard
+ * @return Index of the shard
+ */
+uint32_t yamux_shard_index(const yamux_shard_t *shard)
+{
+    return shard ? shard->index : 0;
+}
@@ -0,0 +1,296 @@
+/**
+ * @file yamux_sched.c
+ * @brief Egress scheduler: per-stream data queues served by priority and weight
+ *
+ * With config.egress_quantum set, yamux_stream_write() copies data into
+ * the stream's own queue instead of the session's egress queue. The
+ * scheduler moves it into the egress queue a frame at a time, keeping at
+ * most one frame or half the queue there, so control frames (window
+ * updates, pings, SYN/FIN/RST) queued meanwhile find room and go out
+ * ahead of bulk data.
+ *
+ * Streams with queued data sit in one round per priority level; a lower
+ * level is only served while every higher one is empty. Within a level
+ * streams take turns by deficit round-robin: each turn grants
+ * egress_quantum * weight bytes, sent in frames of at most the stream's
+ * frame limit (yamux_stream_set_max_frame_size(), else config.max_frame_size).
+ * When the egress queue fills first, what is left of the turn is kept for
+ * the stream's next frame.
+ *
+ * Invariant: while any stream has queued data the egress queue is not
+ * empty, so every caller deciding whether to flush (the reactor, the
+ * wait conditions, the thread-safe unlock) keeps working unchanged.
+ *
+ * Built with YAMUX_SCHED 0 none of this is compiled: sessions asking for
+ * it are refused and stream priorities cannot be set.
+ */
+
+#include "../include/yamux.h"
+#include "yamux_internal.h"
+#include "yamux_defs.h"
+#include <string.h>
+
+#if YAMUX_SCHED
+
+/* Append a frame header to the egress queue, counting the frame; the caller checked for room */
+static void yamux_sched_append_header(yamux_session_t *session, uint16_t flags, uint32_t stream_id,
+                                      uint32_t length) {
+    yamux_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = YAMUX_DATA;
+    header.flags = flags;
+    header.stream_id = stream_id;
+    header.length = length;
+    yamux_encode_header(&header, session->send_buf + session->send_buf_used);
+    session->send_buf_used += YAMUX_HEADER_SIZE;
+    yamux_stats_frame_out(session, &header);
+}
+
+/* Take a stream out of its level's round */
+static void yamux_sched_unlink(yamux_session_t *session, yamux_stream_t *stream) {
+    uint8_t level = stream->sched_priority;
+    yamux_stream_t **link = &session->sched_head[level];
+    yamux_stream_t *prev = NULL;
+
+    /* Usually the head: the stream being served */
+    while (*link != stream) {
+        prev = *link;
+        link = &prev->sched_next;
+    }
+    *link = stream->sched_next;
+    if (session->sched_tail[level] == stream) {
+        session->sched_tail[level] = prev;
+    }
+    if (!session->sched_head[level]) {
+        session->sched_levels &= ~(1u << level);
+    }
+    stream->sched_next = NULL;
+    stream->sched_active = 0;
+    stream->sched_deficit = 0;
+}
+
+/* Append a stream to the end of its level's round */
+static void yamux_sched_push(yamux_session_t *session, yamux_stream_t *stream) {
+    uint8_t level = stream->sched_priority;
+
+    stream->sched_next = NULL;
+    if (session->sched_tail[level]) {
+        session->sched_tail[level]->sched_next = stream;
+    } else {
+        session->sched_head[level] = stream;
+        session->sched_levels |= 1u << level;
+    }
+    session->sched_tail[level] = stream;
+    stream->sched_active = 1;
+}
+
+/**
+ * Move scheduled stream data into the session's egress queue
+ *
+ * Stops once the backlog, one frame of the stream being served and at
+ * most half the queue, is reached or no stream has data. A stream whose
+ * queue drained with a close pending gets its FIN, in the half of the
+ * queue kept free.
+ *
+ * @param session Session
+ * @return Number of bytes added to the egress queue
+ */
+size_t yamux_sched_run(yamux_session_t *session) {
+    size_t before = session->send_buf_used;
+    yamux_stream_t *stream;
+    uint64_t turn;
+    size_t limit;
+    size_t n;
+    uint8_t level;
+
+    while (session->sched_levels) {
+        for (level = 0; !(session->sched_levels & (1u << level)); level++) {
+        }
+        stream = session->sched_head[level];
+
+        /* Backlog to fill to: one of this stream's frames, at most half the queue */
+        limit = YAMUX_HEADER_SIZE + (size_t)yamux_stream_frame_limit(stream);
+        if (limit > session->send_buf_size / 2) {
+            limit = session->send_buf_size / 2;
+        }
+        if (session->send_buf_used + YAMUX_HEADER_SIZE >= limit) {
+            break;
+        }
+
+        /* A new turn */
+        if (stream->sched_deficit == 0) {
+            turn = (uint64_t)session->config.egress_quantum * stream->sched_weight;
+            stream->sched_deficit = (turn > UINT32_MAX) ? UINT32_MAX : (uint32_t)turn;
+        }
+
+        n = stream->sendq.used;
+        if (n > yamux_stream_frame_limit(stream)) {
+            n = yamux_stream_frame_limit(stream);
+        }
+        if (n > stream->sched_deficit) {
+            n = stream->sched_deficit;
+        }
+        if (n > limit - session->send_buf_used - YAMUX_HEADER_SIZE) {
+            n = limit - session->send_buf_used - YAMUX_HEADER_SIZE;
+        }
+
+        yamux_sched_append_header(session, 0, stream->id, (uint32_t)n);
+        (void)yamux_buffer_read(&stream->sendq, session->send_buf + session->send_buf_used, n, &n);
+        session->send_buf_used += n;
+        stream->sched_deficit -= (uint32_t)n;
+        yamux_stats_data_out(stream, n);
+
+        if (stream->sendq.used == 0) {
+            /* Out of data: leave the round, and finish the stream if it was closed */
+            yamux_sched_unlink(session, stream);
+            if (stream->sched_fin) {
+                stream->sched_fin = 0;
+                yamux_sched_append_header(session, YAMUX_FLAG_FIN, stream->id, 0);
+            }
+        } else if (stream->sched_deficit == 0) {
+            /* Turn used up: to the back of the round */
+            yamux_sched_unlink(session, stream);
+            yamux_sched_push(session, stream);
+        }
+    }
+
+    return session->send_buf_used - before;
+}
+
+/**
+ * Queue stream data for the scheduler, with the session lock held
+ *
+ * The caller has checked the stream may send and clamped len to its send
+ * window; credit is used as the data is queued.
+ *
+ * @param stream Stream to write to
+ * @param buf Data to write
+ * @param len Number of bytes to write (non-zero)
+ * @param bytes_written Set to the number of bytes queued
+ * @return YAMUX_OK if anything was queued, YAMUX_ERR_WOULD_BLOCK if the
+ *         stream's queue is full, error code otherwise
+ */
+yamux_result_t yamux_sched_write(yamux_stream_t *stream, const uint8_t *buf, size_t len,
+                                 size_t *bytes_written) {
+    yamux_session_t *session = stream->session;
+    yamux_result_t result;
+    size_t room = stream->sendq.size - stream->sendq.used;
+
+    *bytes_written = 0;
+    if (room == 0) {
+        return YAMUX_ERR_WOULD_BLOCK;
+    }
+    if (len > room) {
+        len = room;
+    }
+
+    result = yamux_buffer_write(&stream->sendq, buf, len);
+    if (result != YAMUX_OK) {
+        return result;
+    }
+    stream->send_window -= (uint32_t)len;
+    *bytes_written = len;
+    if (stream->send_window == 0) {
+        yamux_stats_stall_begin(stream);
+    }
+
+    if (!stream->sched_active) {
+        yamux_sched_push(session, stream);
+    }
+    yamux_sched_run(session);
+
+    /* As for a queued frame: try to drain (a thread-safe session does on unlock) */
+    if (session->cork_depth == 0 && !session->threaded) {
+        result = yamux_session_flush_locked(session);
+        if (result != YAMUX_OK && result != YAMUX_ERR_WOULD_BLOCK) {
+            return result;
+        }
+    }
+
+    return YAMUX_OK;
+}
+
+/**
+ * Send a stream's FIN after its scheduled data, with the session lock held
+ *
+ * @param stream Stream being closed
+ * @return Non-zero if data is still queued and the FIN will follow it;
+ *         zero if the caller should send the FIN now
+ */
+int yamux_sched_defer_fin(yamux_stream_t *stream) {
+    if (!stream->sched_active) {
+        return 0;
+    }
+    stream->sched_fin = 1;
+    return 1;
+}
+
+/**
+ * Drop a stream's scheduled data, with the session lock held
+ *
+ * For resets and for streams being freed.
+ *
+ * @param stream Stream to take out of the scheduler
+ */
+void yamux_sched_remove(yamux_stream_t *stream) {
+    if (stream->sched_active) {
+        yamux_sched_unlink(stream->session, stream);
+    }
+    stream->sched_fin = 0;
+    if (stream->sendq.used > 0) {
+        yamux_buffer_consume(&stream->sendq, stream->sendq.used);
+    }
+}
+
+/**
+ * Drop the data of every scheduled stream, with the session lock held
+ *
+ * @param session Session being closed
+ */
+void yamux_sched_clear(yamux_session_t *session) {
+    uint8_t level;
+
+    for (level = 0; level < YAMUX_PRIORITY_LEVELS; level++) {
+        while (session->sched_head[level]) {
+            yamux_sched_remove(session->sched_head[level]);
+        }
+    }
+}
+
+/* Set a stream's scheduling priority and weight */
+yamux_result_t yamux_stream_set_priority(yamux_stream_t *stream, uint8_t priority, uint16_t weight) {
+    yamux_session_t *session;
+
+    if (!stream || !stream->session || priority >= YAMUX_PRIORITY_LEVELS || weight == 0) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    session = stream->session;
+    yamux_session_lock(session);
+
+    /* A queued stream moves to the back of its new level's round */
+    if (stream->sched_active && stream->sched_priority != priority) {
+        yamux_sched_unlink(session, stream);
+        stream->sched_priority = priority;
+        yamux_sched_push(session, stream);
+    }
+    stream->sched_priority = priority;
+    stream->sched_weight = weight;
+
+    yamux_session_unlock(session);
+    return YAMUX_OK;
+}
+
+#else
+
+/* Set a stream's scheduling priority and weight: no scheduler to use them */
+yamux_result_t yamux_stream_set_priority(yamux_stream_t *stream, uint8_t priority, uint16_t weight) {
+    (void)stream;
+    (void)priority;
+    (void)weight;
+    return YAMUX_ERR_INVALID;
+}
+
+#endif /* YAMUX_SCHED */
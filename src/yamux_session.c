@@ -11,13 +11,19 @@
 #include <stdio.h>
 #include <string.h>
 
-/* Default configuration values */
+/* Default configuration values (yamux_config.h, for the build profile) */
 const yamux_config_t yamux_default_config = {
-    .accept_backlog = 256,
-    .enable_keepalive = 1,
-    .connection_write_timeout = 30000, /* 30 seconds */
-    .keepalive_interval = 60000,      /* 60 seconds */
-    .max_stream_window_size = 256 * 1024  /* 256 KB */
+    .accept_backlog = YAMUX_DEFAULT_ACCEPT_BACKLOG,
+    .enable_keepalive = YAMUX_DEFAULT_KEEPALIVE_ENABLE,
+    .connection_write_timeout = YAMUX_DEFAULT_CONN_WRITE_TIMEOUT,
+    .keepalive_interval = YAMUX_DEFAULT_KEEPALIVE_INTERVAL,
+    .max_stream_window_size = YAMUX_DEFAULT_WINDOW_SIZE,
+    .read_buffer_size = YAMUX_DEFAULT_READ_BUFFER_SIZE,
+    .write_buffer_size = YAMUX_DEFAULT_WRITE_BUFFER_SIZE,
+    .window_update_percent = YAMUX_DEFAULT_WINDOW_UPDATE_PERCENT,
+    .max_frame_size = YAMUX_MAX_DATA_FRAME_SIZE,
+    .stream_open_timeout = 75000,         /* 75 seconds, as Go yamux */
+    .stream_close_timeout = 300000        /* 5 minutes, as Go yamux */
 };
 
 /* Add some fields to the session structure that weren't in yamux_internal.h */
@@ -38,14 +44,27 @@ yamux_result_t yamux_session_create(
     yamux_session_t **session)
 {
     yamux_session_t *s;
+    yamux_result_t result;
+    uint32_t initial_window;
+    uint32_t table_capacity;
+    uint32_t pooled;
     
     /* Validate parameters */
     if (!io || !session) {
         return YAMUX_ERR_INVALID;
     }
-    
+
+    /* Settings the build profile compiled out or fixed; the scheduler's
+     * stream queues come from the heap, so fixed memory rules it out */
+    if (config && ((!YAMUX_SCHED && config->egress_quantum > 0) ||
+                   (YAMUX_FIXED_FRAME_SIZE && config->max_frame_size != 0 &&
+                    config->max_frame_size != YAMUX_MAX_DATA_FRAME_SIZE) ||
+                   (config->fixed_memory && config->egress_quantum > 0))) {
+        return YAMUX_ERR_INVALID;
+    }
+
     /* Allocate session structure */
-    s = (yamux_session_t *)malloc(sizeof(yamux_session_t));
+    s = (yamux_session_t *)YAMUX_MALLOC(sizeof(yamux_session_t));
     if (!s) {
         return YAMUX_ERR_NOMEM;
     }
@@ -65,21 +84,124 @@ yamux_result_t yamux_session_create(
     } else {
         s->config = yamux_default_config;
     }
+    s->keepalive_enabled = s->config.enable_keepalive;
+    s->keepalive_interval = s->config.keepalive_interval;
+    
+    /* A zero window means the default; it caps each stream's (auto-tuned) receive window */
+    if (s->config.max_stream_window_size == 0) {
+        s->config.max_stream_window_size = YAMUX_DEFAULT_WINDOW_SIZE;
+    }
+    
+    /* Inbound streams beyond the backlog are reset (0 = the default) */
+    if (s->config.accept_backlog == 0) {
+        s->config.accept_backlog = YAMUX_DEFAULT_ACCEPT_BACKLOG;
+    }
+    
+    /* Credit is batched; a share above 100% would never be granted */
+    if (s->config.window_update_percent == 0) {
+        s->config.window_update_percent = YAMUX_DEFAULT_WINDOW_UPDATE_PERCENT;
+    } else if (s->config.window_update_percent > 100) {
+        s->config.window_update_percent = 100;
+    }
     
     /* Initialize stream ID based on client/server mode */
     /* Client uses odd IDs, server uses even IDs */
     s->next_stream_id = client ? 1 : 2;
     
-    /* Initialize streams array */
-    s->stream_capacity = 16;  /* Initial capacity */
-    s->streams = (yamux_stream_t **)malloc(s->stream_capacity * sizeof(yamux_stream_t *));
-    if (!s->streams) {
-        free(s);
+    /* Allocate the ingress buffer */
+    s->recv_buf_size = s->config.read_buffer_size ? s->config.read_buffer_size
+                                                  : YAMUX_DEFAULT_READ_BUFFER_SIZE;
+    if (s->recv_buf_size < YAMUX_MIN_READ_BUFFER_SIZE) {
+        s->recv_buf_size = YAMUX_MIN_READ_BUFFER_SIZE;
+    }
+    s->recv_buf = (uint8_t *)YAMUX_MALLOC(s->recv_buf_size);
+    if (!s->recv_buf) {
+        YAMUX_FREE(s);
+        return YAMUX_ERR_NOMEM;
+    }
+    
+    /* Frames larger than the default save per-frame overhead on fast links */
+    if (s->config.max_frame_size == 0) {
+        s->config.max_frame_size = YAMUX_MAX_DATA_FRAME_SIZE;
+    }
+    
+    /* Allocate the egress queue */
+    s->send_buf_size = s->config.write_buffer_size ? s->config.write_buffer_size
+                                                   : YAMUX_DEFAULT_WRITE_BUFFER_SIZE;
+    if (s->send_buf_size < YAMUX_MIN_WRITE_BUFFER_SIZE) {
+        s->send_buf_size = YAMUX_MIN_WRITE_BUFFER_SIZE;
+    }
+    /* A frame the transport took part of is queued whole, and concurrent
+     * writers never write past the queue, so every frame must fit */
+    if (s->send_buf_size < YAMUX_HEADER_SIZE + s->config.max_frame_size) {
+        s->send_buf_size = YAMUX_HEADER_SIZE + s->config.max_frame_size;
+    }
+    s->send_buf = (uint8_t *)YAMUX_MALLOC(s->send_buf_size);
+    if (!s->send_buf) {
+        YAMUX_FREE(s->recv_buf);
+        YAMUX_FREE(s);
+        return YAMUX_ERR_NOMEM;
+    }
+    
+    /* Initialize stream table; with fixed memory it must hold every pooled
+     * stream without growing (the load factor stays at or below 3/4) */
+    pooled = (s->config.stream_pool_size < YAMUX_MAX_STREAMS) ? s->config.stream_pool_size : YAMUX_MAX_STREAMS;
+    table_capacity = YAMUX_STREAM_TABLE_INITIAL_CAPACITY;
+    if (s->config.fixed_memory && pooled + pooled / 3 + 1 > table_capacity) {
+        table_capacity = pooled + pooled / 3 + 1;
+    }
+    if (yamux_stream_table_init(&s->streams, table_capacity) != YAMUX_OK) {
+        YAMUX_FREE(s->send_buf);
+        YAMUX_FREE(s->recv_buf);
+        YAMUX_FREE(s);
+        return YAMUX_ERR_NOMEM;
+    }
+    
+    /* Stream objects and initial receive buffers are recycled per session */
+    initial_window = yamux_window_initial_size(s);
+    if (yamux_pool_init(&s->stream_pool, sizeof(yamux_stream_t), s->config.stream_pool_size) != YAMUX_OK ||
+        (initial_window >= sizeof(void *) &&
+         yamux_pool_init(&s->buffer_pool, initial_window, s->config.stream_pool_size) != YAMUX_OK)) {
+        yamux_pool_destroy(&s->stream_pool);
+        yamux_stream_table_free(&s->streams);
+        YAMUX_FREE(s->send_buf);
+        YAMUX_FREE(s->recv_buf);
+        YAMUX_FREE(s);
         return YAMUX_ERR_NOMEM;
     }
     
+    /* Fixed memory: the pools are all there is, and the timer wheel is taken now */
+    if (s->config.fixed_memory) {
+        s->stream_pool.fixed = 1;
+        s->buffer_pool.fixed = 1;
+        if (yamux_timers_reserve(s) != YAMUX_OK) {
+            yamux_pool_destroy(&s->buffer_pool);
+            yamux_pool_destroy(&s->stream_pool);
+            yamux_stream_table_free(&s->streams);
+            YAMUX_FREE(s->send_buf);
+            YAMUX_FREE(s->recv_buf);
+            YAMUX_FREE(s);
+            return YAMUX_ERR_NOMEM;
+        }
+    }
+    
     /* Initialize accept queue */
     s->accept_queue = NULL;
+    s->accept_tail = NULL;
+    s->accept_len = 0;
+    
+    /* Thread-safe sessions get their lock last, so failures above need no unlock */
+    result = yamux_lock_init(s);
+    if (result != YAMUX_OK) {
+        yamux_timers_detach(s);
+        yamux_pool_destroy(&s->buffer_pool);
+        yamux_pool_destroy(&s->stream_pool);
+        yamux_stream_table_free(&s->streams);
+        YAMUX_FREE(s->send_buf);
+        YAMUX_FREE(s->recv_buf);
+        YAMUX_FREE(s);
+        return result;
+    }
     
     /* Set session pointer */
     *session = s;
@@ -92,164 +214,524 @@ yamux_result_t yamux_session_close(
     yamux_session_t *session, 
     yamux_error_t err)
 {
-    size_t i;
+    yamux_stream_table_t streams;
+    uint32_t i;
     
     /* Validate parameters */
     if (!session) {
         return YAMUX_ERR_INVALID;
     }
     
-    /* Check if already shut down */
-    if (yamux_session_is_shutdown(session)) {
-        return YAMUX_OK;
+    yamux_session_lock(session);
+    
+    /* Timers stop first, even when the peer already said GO_AWAY */
+    yamux_timers_detach(session);
+    
+    /* Send GoAway frame, unless the peer already ended the session with one */
+    if (!yamux_session_is_shutdown(session)) {
+        yamux_header_t header;
+        uint8_t frame[12];  /* 8-byte header + 4-byte error code */
+        
+        yamux_session_set_shutdown(session, err);
+        
+        memset(&header, 0, sizeof(header));
+        header.version = YAMUX_PROTO_VERSION;
+        header.type = YAMUX_GO_AWAY;
+        header.flags = 0;
+        header.stream_id = 0;
+        header.length = 4;  /* Error code is a 32-bit value */
+        yamux_encode_header(&header, frame);
+        
+        /* Encode error code (big-endian) */
+        frame[8] = (err >> 24) & 0xFF;
+        frame[9] = (err >> 16) & 0xFF;
+        frame[10] = (err >> 8) & 0xFF;
+        frame[11] = err & 0xFF;
+        
+        /* Send frame after anything still queued (ignore errors, we're shutting down anyway) */
+        session->cork_depth = 0;
+        (void)yamux_session_wait_flushed(session);
+        yamux_session_flush_locked(session);
+        yamux_sched_clear(session);
+        session->io.write(session->io.ctx, frame, sizeof(frame));
+    } else {
+        yamux_sched_clear(session);
     }
     
-    /* Mark as shut down */
-    yamux_session_set_shutdown(session, err);
+    /* Detach the stream table so resets below do not rehash it under us */
+    streams = session->streams;
+    memset(&session->streams, 0, sizeof(session->streams));
     
-    /* Send GoAway frame if possible */
-    yamux_header_t header;
-    memset(&header, 0, sizeof(header));
-    header.version = YAMUX_PROTO_VERSION;
-    header.type = YAMUX_GO_AWAY;
-    header.flags = 0;
-    header.stream_id = 0;
-    header.length = 4;  /* Error code is a 32-bit value */
+    /* Close all streams; a failed session's are closed already */
+    for (i = 0; i < streams.capacity; i++) {
+        if (streams.slots[i] && streams.slots[i]->state == YAMUX_STREAM_CLOSED) {
+            yamux_stream_release(streams.slots[i]);
+        } else if (streams.slots[i]) {
+            yamux_stream_close_locked(streams.slots[i], 1);
+        }
+    }
     
-    uint8_t frame[12];  /* 8-byte header + 4-byte error code */
-    yamux_encode_header(&header, frame);
+    /* Free stream table */
+    yamux_stream_table_free(&streams);
     
-    /* Encode error code (big-endian) */
-    frame[8] = (err >> 24) & 0xFF;
-    frame[9] = (err >> 16) & 0xFF;
-    frame[10] = (err >> 8) & 0xFF;
-    frame[11] = err & 0xFF;
+    /* Release pooled memory; a block still holding live streams is kept */
+    yamux_pool_destroy(&session->stream_pool);
+    yamux_pool_destroy(&session->buffer_pool);
     
-    /* Send frame (ignore errors, we're shutting down anyway) */
-    session->io.write(session->io.ctx, frame, sizeof(frame));
+    /* Free egress queue; frames the transport never took are dropped */
+    YAMUX_FREE(session->send_buf);
+    session->send_buf = NULL;
+    session->send_buf_size = 0;
+    session->send_buf_used = 0;
     
-    /* Close all streams */
-    for (i = 0; i < session->stream_count; i++) {
-        if (session->streams[i]) {
-            yamux_stream_close(session->streams[i], 1);
-        }
+    /* Free ingress buffer */
+    YAMUX_FREE(session->recv_buf);
+    session->recv_buf = NULL;
+    session->recv_buf_size = 0;
+    session->recv_buf_start = 0;
+    session->recv_buf_end = 0;
+    
+    /* Waiters see the session gone before the lock goes away */
+    yamux_session_notify(session);
+    yamux_session_unlock(session);
+    yamux_lock_destroy(session);
+    YAMUX_FREE(session);
+    
+    return YAMUX_OK;
+}
+
+/* Check a decoded header against the session's frame size limits */
+static yamux_result_t yamux_session_check_header(
+    yamux_session_t *session,
+    const yamux_header_t *header)
+{
+    /* Control frames carry at most a few bytes of payload */
+    if (header->type != YAMUX_DATA && YAMUX_FRAME_PAYLOAD_LEN(header) > YAMUX_MAX_CONTROL_PAYLOAD) {
+        return YAMUX_ERR_PROTOCOL;
     }
     
-    /* Free streams array */
-    free(session->streams);
-    session->streams = NULL;
-    session->stream_count = 0;
-    session->stream_capacity = 0;
+    /* DATA frames are bounded by the window, and optionally by a frame limit */
+    if (header->type == YAMUX_DATA && session->config.max_recv_frame_size > 0 &&
+        header->length > session->config.max_recv_frame_size) {
+        return YAMUX_ERR_PROTOCOL;
+    }
     
     return YAMUX_OK;
 }
 
-/* Process incoming data */
-yamux_result_t yamux_session_process(
-    yamux_session_t *session)
+/*
+ * Decode the frame header at the front of the ingress buffer.
+ * Returns YAMUX_OK when a header is available, YAMUX_ERR_WOULD_BLOCK when
+ * more bytes are needed, or an error for a malformed header. A complete
+ * control frame always fits: the buffer is at least YAMUX_MIN_READ_BUFFER_SIZE.
+ */
+static yamux_result_t yamux_session_peek_header(
+    yamux_session_t *session,
+    yamux_header_t *header)
 {
-    fprintf(stderr, "\n*** ULTRA DEBUG: ENTERING yamux_session_process - VERSION CHECKPOINT 05-15-A ***\n\n");
-    fflush(stderr);
-    uint8_t header_buf[YAMUX_HEADER_SIZE]; /* 12 bytes for header */
-    yamux_header_t header;
+    size_t avail = session->recv_buf_end - session->recv_buf_start;
     yamux_result_t result;
     
-    // ---- ADDED DEBUG ----
-    printf("DEBUG: INSIDE yamux_session_process: received session ptr = %p\n", (void*)session);
-    if (session) {
-        printf("DEBUG: INSIDE yamux_session_process: session->go_away_received = %d\n", session->go_away_received);
+    if (avail < YAMUX_HEADER_SIZE) {
+        return YAMUX_ERR_WOULD_BLOCK;
+    }
+    
+    result = yamux_decode_header(session->recv_buf + session->recv_buf_start, avail, header);
+    if (result != YAMUX_OK) {
+        return result;
     }
-    fflush(stdout);
-    // ---- END ADDED DEBUG ----
+    
+    return yamux_session_check_header(session, header);
+}
 
-    /* Validate parameters */
-    if (!session) {
-        return YAMUX_ERR_INVALID;
+/*
+ * Whether the parser can make progress without reading: part of a DATA
+ * payload is buffered, or a whole header is (control frames only once
+ * their payload is in as well).
+ */
+static int yamux_session_can_parse(yamux_session_t *session) {
+    size_t avail = session->recv_buf_end - session->recv_buf_start;
+    yamux_header_t header;
+    
+    if (session->rx_state == YAMUX_RX_PAYLOAD) {
+        return avail > 0;
+    }
+    if (yamux_session_peek_header(session, &header) == YAMUX_ERR_WOULD_BLOCK) {
+        return 0;
+    }
+    return header.type == YAMUX_DATA || avail >= YAMUX_HEADER_SIZE + YAMUX_FRAME_PAYLOAD_LEN(&header);
+}
+
+/*
+ * Top up the ingress buffer with a single transport read.
+ * Returns the read callback's result.
+ */
+static int yamux_session_fill(yamux_session_t *session) {
+    size_t pending = session->recv_buf_end - session->recv_buf_start;
+    int result;
+    
+    /* Slide the partial frame to the front so the read gets the whole tail */
+    if (session->recv_buf_start > 0) {
+        memmove(session->recv_buf, session->recv_buf + session->recv_buf_start, pending);
+        session->recv_buf_start = 0;
+        session->recv_buf_end = pending;
     }
     
-    /* Check if shut down */
-    if (session->go_away_received) {
-        return YAMUX_ERR_CLOSED;
+    if (session->recv_buf_end == session->recv_buf_size) {
+        return 0;
     }
     
-    /* Read header - only read YAMUX_HEADER_SIZE bytes for the actual header */
-    int read_result = session->io.read(session->io.ctx, header_buf, YAMUX_HEADER_SIZE);
-    printf("DEBUG: Header read result: %d, expected: %d\n", read_result, YAMUX_HEADER_SIZE);
-    if (read_result != YAMUX_HEADER_SIZE) {
-        fprintf(stderr, "DEBUG (yamux_session_process): Header read failed/short (read_result=%d), returning YAMUX_ERR_IO (%d)\n", read_result, YAMUX_ERR_IO);
-        fflush(stderr);
-        return YAMUX_ERR_IO;
+    if (!session->threaded) {
+        return session->io.read(session->io.ctx,
+                                session->recv_buf + session->recv_buf_end,
+                                session->recv_buf_size - session->recv_buf_end);
     }
     
-    /* Decode header */
-    fprintf(stderr, "DEBUG: --- PRE-HEX DUMP MARKER ---\n");
-    fflush(stderr);
-    fprintf(stderr, "DEBUG: Raw header_buf (%d bytes): ", read_result);
-    for (int i = 0; i < read_result; i++) {
-        fprintf(stderr, "%02x ", header_buf[i]);
+    /*
+     * Only this thread touches the ingress buffer, so the lock is released
+     * while the read blocks. Frames written meanwhile are not held back by
+     * the cork yamux_session_process() put on the session.
+     */
+    session->cork_depth--;
+    yamux_session_unlock(session);
+    result = session->io.read(session->io.ctx,
+                              session->recv_buf + session->recv_buf_end,
+                              session->recv_buf_size - session->recv_buf_end);
+    yamux_session_lock(session);
+    session->cork_depth++;
+    return result;
+}
+
+/* Mark n buffered bytes as parsed */
+static void yamux_session_consume(yamux_session_t *session, size_t n) {
+    session->recv_buf_start += n;
+    if (session->recv_buf_start == session->recv_buf_end) {
+        session->recv_buf_start = 0;
+        session->recv_buf_end = 0;
     }
-    fprintf(stderr, "\n");
-    fprintf(stderr, "DEBUG: --- POST-HEX DUMP MARKER ---\n");
-    fflush(stderr);
+}
 
-    fprintf(stderr, "MANUAL CHECK: header_buf[0] (Version) = %u | header_buf[1] (Type) = %u\n", header_buf[0], header_buf[1]);
-    fflush(stderr);
+/*
+ * Deliver buffered bytes of the DATA payload in progress.
+ * If the handler fails, the rest of the payload is still consumed (and
+ * dropped) so the next header is parsed from the right offset.
+ */
+static yamux_result_t yamux_session_process_payload(yamux_session_t *session) {
+    size_t avail = session->recv_buf_end - session->recv_buf_start;
+    size_t n = (avail < session->rx_remaining) ? avail : session->rx_remaining;
+    const uint8_t *chunk = session->recv_buf + session->recv_buf_start;
+    yamux_result_t result = YAMUX_OK;
+    
+    session->rx_remaining -= (uint32_t)n;
+    if (!session->rx_discard) {
+        result = yamux_handle_data_chunk(session, &session->rx_header, chunk, n,
+                                         session->rx_remaining == 0);
+        if (result != YAMUX_OK) {
+            session->rx_discard = 1;
+        }
+    }
+    yamux_session_consume(session, n);
+    
+    if (session->rx_remaining == 0) {
+        session->rx_state = YAMUX_RX_HEADER;
+        session->rx_discard = 0;
+    }
+    
+    return result;
+}
 
-    /* Decode header */
-    result = yamux_decode_header(header_buf, YAMUX_HEADER_SIZE, &header);
-    fprintf(stderr, "DEBUG: Decode header result: %d, frame type: %d, flags: 0x%x, stream_id: %u, length: %u\n", 
-           result, header.type, header.flags, header.stream_id, header.length);
-    fflush(stderr);
+/*
+ * Read the DATA payload in progress straight into the stream's receive
+ * buffer. Only used with the ingress buffer drained, so the bytes read
+ * are the next ones of the payload; never reads past the frame.
+ * Sets *progress when payload bytes arrived.
+ */
+static yamux_result_t yamux_session_read_payload(yamux_session_t *session, int *progress) {
+    uint8_t *space;
+    size_t space_len;
+    int read_result;
+    yamux_result_t result;
+    
+    result = yamux_handle_data_reserve(session, &session->rx_header, session->rx_remaining,
+                                       &space, &space_len);
     if (result != YAMUX_OK) {
+        /* The rest of the payload goes through the ingress buffer and is dropped */
+        session->rx_discard = 1;
         return result;
     }
     
-    /* Process frame based on type */
-    printf("DEBUG: Processing frame type: %d\n", header.type);
-    switch (header.type) {
+    read_result = session->io.read(session->io.ctx, space, space_len);
+    if (read_result < 0) {
+        return (read_result == YAMUX_ERR_WOULD_BLOCK) ? YAMUX_ERR_WOULD_BLOCK : YAMUX_ERR_IO;
+    }
+    if (read_result == 0) {
+        return YAMUX_OK;
+    }
+    
+    *progress = 1;
+    YAMUX_STAT(session->stats.bytes_in += (size_t)read_result);
+    session->rx_remaining -= (uint32_t)read_result;
+    result = yamux_handle_data_commit(session, &session->rx_header, (size_t)read_result,
+                                      session->rx_remaining == 0);
+    if (result != YAMUX_OK) {
+        session->rx_discard = 1;
+    }
+    if (session->rx_remaining == 0) {
+        session->rx_state = YAMUX_RX_HEADER;
+        session->rx_discard = 0;
+    }
+    
+    return result;
+}
+
+/* Hand a complete frame to the handler for its type */
+static yamux_result_t yamux_session_handle_frame(
+    yamux_session_t *session,
+    const yamux_header_t *header,
+    const uint8_t *payload)
+{
+    switch (header->type) {
         case YAMUX_DATA:
-            printf("DEBUG: Handling DATA frame\n");
-            result = yamux_handle_data(session, &header);
-            printf("DEBUG: DATA frame result: %d\n", result);
-            break;
+            return yamux_handle_data(session, header, payload);
         case YAMUX_WINDOW_UPDATE:
-            printf("DEBUG: Handling WINDOW_UPDATE frame\n");
-            result = yamux_handle_window_update(session, &header);
-            printf("DEBUG: WINDOW_UPDATE frame result: %d\n", result);
-            break;
+            return yamux_handle_window_update(session, header, payload);
         case YAMUX_PING:
-            printf("DEBUG: Handling PING frame\n");
-            result = yamux_handle_ping(session, &header);
-            printf("DEBUG: PING frame result: %d\n", result);
-            break;
+            return yamux_handle_ping(session, header, payload);
         case YAMUX_GO_AWAY:
-            printf("DEBUG: Handling GO_AWAY frame\n");
-            result = yamux_handle_go_away(session, &header);
-            printf("DEBUG: GO_AWAY frame result: %d\n", result);
-            break;
+            return yamux_handle_go_away(session, header, payload);
         default:
             /* Invalid frame type */
-            printf("DEBUG: Invalid frame type: %d\n", header.type);
             return YAMUX_ERR_PROTOCOL;
     }
+}
+
+/*
+ * Parse and handle buffered frames, reading from the transport at most once.
+ * Sets *input when the transport delivered bytes.
+ */
+static yamux_result_t yamux_session_process_frames(
+    yamux_session_t *session,
+    int *input)
+{
+    yamux_frame_desc_t frames[YAMUX_DECODE_BATCH];
+    yamux_header_t header;
+    yamux_result_t result;
+    const uint8_t *base;
+    size_t count;
+    size_t i;
+    int progress = 0;
+    int read_result;
+    
+    /* Validate parameters */
+    if (!session) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    /* Check if shut down */
+    if (session->go_away_received) {
+        return YAMUX_ERR_CLOSED;
+    }
+    
+    /* A session its timers failed reads no more */
+    if (session->failure != YAMUX_OK) {
+        return session->failure;
+    }
+    
+    /* Only touch the transport when the buffered bytes cannot be parsed */
+    if (!yamux_session_can_parse(session) && session->rx_state == YAMUX_RX_PAYLOAD &&
+        !session->rx_discard && !session->threaded) {
+        /* Mid-payload with nothing buffered: skip the ingress copy (readers
+         * of a thread-safe session could move the stream buffer under it) */
+        result = yamux_session_read_payload(session, &progress);
+        *input = progress;
+        if (result != YAMUX_OK) {
+            return result;
+        }
+    } else if (!yamux_session_can_parse(session)) {
+        read_result = yamux_session_fill(session);
+        if (read_result < 0) {
+            return (read_result == YAMUX_ERR_WOULD_BLOCK) ? YAMUX_ERR_WOULD_BLOCK : YAMUX_ERR_IO;
+        }
+        session->recv_buf_end += (size_t)read_result;
+        YAMUX_STAT(session->stats.bytes_in += (size_t)read_result);
+        *input = (read_result > 0);
+    }
+    
+    /* Parse until the buffer holds only part of a frame */
+    for (;;) {
+        if (session->rx_state == YAMUX_RX_PAYLOAD) {
+            if (session->recv_buf_end == session->recv_buf_start) {
+                break;
+            }
+            progress = 1;
+            result = yamux_session_process_payload(session);
+            if (result != YAMUX_OK) {
+                return result;
+            }
+            continue;
+        }
+        
+        /* Handle every complete frame buffered, decoding their headers in one pass */
+        base = session->recv_buf + session->recv_buf_start;
+        count = yamux_decode_frames(base, session->recv_buf_end - session->recv_buf_start,
+                                    frames, YAMUX_DECODE_BATCH, &result);
+        for (i = 0; i < count; i++) {
+            result = yamux_session_check_header(session, &frames[i].header);
+            if (result != YAMUX_OK) {
+                return result;
+            }
+            progress = 1;
+            yamux_stats_frame_in(session, &frames[i].header);
+            yamux_session_consume(session, YAMUX_HEADER_SIZE + (size_t)YAMUX_FRAME_PAYLOAD_LEN(&frames[i].header));
+            result = yamux_session_handle_frame(session, &frames[i].header,
+                                                base + frames[i].offset + YAMUX_HEADER_SIZE);
+            if (result != YAMUX_OK) {
+                return result;
+            }
+            
+            /* Nothing after a GO_AWAY is processed */
+            if (session->go_away_received) {
+                return YAMUX_OK;
+            }
+        }
+        if (count == YAMUX_DECODE_BATCH) {
+            continue;
+        }
+        
+        /* What is left is part of a frame, or a malformed header */
+        result = yamux_session_peek_header(session, &header);
+        if (result == YAMUX_ERR_WOULD_BLOCK) {
+            break;
+        }
+        if (result != YAMUX_OK) {
+            return result;
+        }
+        
+        /* A DATA payload may be delivered to the stream as it trickles in */
+        if (header.type != YAMUX_DATA) {
+            break;
+        }
+        progress = 1;
+        yamux_stats_frame_in(session, &header);
+        yamux_session_consume(session, YAMUX_HEADER_SIZE);
+        session->rx_state = YAMUX_RX_PAYLOAD;
+        session->rx_header = header;
+        session->rx_remaining = header.length;
+        session->rx_discard = 0;
+    }
+    
+    /* A partial frame with nothing handled means: call again when readable */
+    if (!progress && (session->rx_state == YAMUX_RX_PAYLOAD ||
+                      session->recv_buf_end > session->recv_buf_start)) {
+        return YAMUX_ERR_WOULD_BLOCK;
+    }
+    
+    return YAMUX_OK;
+}
+
+/**
+ * Process incoming data, noting whether the transport delivered any
+ * 
+ * @param session Session
+ * @param input Set when bytes were read from the transport
+ * @return As yamux_session_process()
+ */
+yamux_result_t yamux_session_process_input(
+    yamux_session_t *session,
+    int *input)
+{
+    yamux_result_t result;
+    yamux_result_t flush_result;
+    
+    *input = 0;
+    
+    /* One thread parses the ingress buffer at a time */
+    yamux_session_lock(session);
+    if (session->processing) {
+        yamux_session_unlock(session);
+        return YAMUX_ERR_WOULD_BLOCK;
+    }
+    session->processing = 1;
+    
+    /* Responses generated while handling frames leave in one write */
+    session->cork_depth++;
+    result = yamux_session_process_frames(session, input);
+    yamux_window_retry(session);
+    flush_result = yamux_session_uncork_locked(session);
+    
+    session->processing = 0;
+    yamux_session_notify(session);
+    yamux_session_unlock(session);
+    
+    /* A would-block flush leaves the frames queued for the next call */
+    if (result == YAMUX_OK && flush_result == YAMUX_ERR_IO) {
+        return YAMUX_ERR_IO;
+    }
     
     return result;
 }
 
+/* Process incoming data */
+yamux_result_t yamux_session_process(
+    yamux_session_t *session)
+{
+    int input;
+    
+    /* Validate parameters */
+    if (!session) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    return yamux_session_process_input(session, &input);
+}
+
+/* Set the stream event callbacks */
+yamux_result_t yamux_session_set_callbacks(
+    yamux_session_t *session,
+    const yamux_callbacks_t *callbacks)
+{
+    /* Validate parameters */
+    if (!session) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    yamux_session_lock(session);
+    if (callbacks) {
+        session->callbacks = *callbacks;
+    } else {
+        memset(&session->callbacks, 0, sizeof(session->callbacks));
+    }
+    yamux_session_unlock(session);
+    return YAMUX_OK;
+}
+
 /* Ping the remote endpoint */
 yamux_result_t yamux_session_ping(
     yamux_session_t *session)
+{
+    uint32_t ping_id;
+    
+    return yamux_session_ping_id(session, &ping_id);
+}
+
+/* Ping the remote endpoint, returning the ping's ID */
+yamux_result_t yamux_session_ping_id(
+    yamux_session_t *session,
+    uint32_t *ping_id)
 {
     yamux_header_t header;
-    uint8_t frame[8];
+    uint32_t id;
     
     /* Validate parameters */
-    if (!session) {
+    if (!session || !ping_id) {
         return YAMUX_ERR_INVALID;
     }
     
+    yamux_session_lock(session);
+    
     /* Check if shut down */
     if (session->go_away_received) {
+        yamux_session_unlock(session);
         return YAMUX_ERR_CLOSED;
     }
     
@@ -259,16 +741,22 @@ yamux_result_t yamux_session_ping(
     header.type = YAMUX_PING;
     header.flags = YAMUX_FLAG_SYN;  /* SYN indicates request, ACK indicates response */
     header.stream_id = 0;
-    header.length = 0;
     
-    /* Encode header */
-    yamux_encode_header(&header, frame);
+    /* The opaque ID rides in the length field, with no payload; the peer echoes it */
+    id = ++session->last_ping_id;
+    header.length = id;
     
     /* Send frame */
-    if (session->io.write(session->io.ctx, frame, sizeof(frame)) != sizeof(frame)) {
+    if (yamux_session_send_frame(session, &header, NULL, 0) != YAMUX_OK) {
+        yamux_session_unlock(session);
         return YAMUX_ERR_IO;
     }
     
+    /* Time the round trip */
+    yamux_stats_ping_sent(session, id);
+    *ping_id = id;
+    
+    yamux_session_unlock(session);
     return YAMUX_OK;
 }
 
@@ -278,7 +766,7 @@ yamux_result_t yamux_session_ping(
  */
 extern yamux_result_t yamux_encode_header(const yamux_header_t *header, uint8_t *buffer);
 extern yamux_result_t yamux_decode_header(const uint8_t *buffer, size_t buffer_len, yamux_header_t *header);
-extern yamux_result_t yamux_handle_data(yamux_session_t *session, const yamux_header_t *header);
-extern yamux_result_t yamux_handle_window_update(yamux_session_t *session, const yamux_header_t *header);
-extern yamux_result_t yamux_handle_ping(yamux_session_t *session, const yamux_header_t *header);
-extern yamux_result_t yamux_handle_go_away(yamux_session_t *session, const yamux_header_t *header);
+extern yamux_result_t yamux_handle_data(yamux_session_t *session, const yamux_header_t *header, const uint8_t *payload);
+extern yamux_result_t yamux_handle_window_update(yamux_session_t *session, const yamux_header_t *header, const uint8_t *payload);
+extern yamux_result_t yamux_handle_ping(yamux_session_t *session, const yamux_header_t *header, const uint8_t *payload);
+extern yamux_result_t yamux_handle_go_away(yamux_session_t *session, const yamux_header_t *header, const uint8_t *payload);
@@ -10,80 +10,426 @@
 #include <string.h>
 
 /**
- * Handle ping frame
- *
- * @param session Session
- * @param header Frame header
- * @return YAMUX_OK on success, error code otherwise
+ * Note: yamux_handle_ping and yamux_handle_go_away live in yamux_handlers.c
+ * alongside the other frame handlers.
  */
-yamux_result_t yamux_handle_ping(
-    yamux_session_t *session, 
-    const yamux_header_t *header)
-{
-    yamux_header_t response;
-    uint8_t frame[8];
-    
-    if (!session || !header) {
-        return YAMUX_ERR_INVALID;
+
+/* Copy len bytes of the segments, starting skip bytes in, to dst */
+static void yamux_iov_copy(uint8_t *dst, const yamux_iovec_t *iov, int iovcnt, size_t skip, size_t len) {
+    size_t n;
+    int i;
+    
+    for (i = 0; i < iovcnt && len > 0; i++) {
+        if (skip >= iov[i].len) {
+            skip -= iov[i].len;
+            continue;
+        }
+        n = iov[i].len - skip;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(dst, iov[i].base + skip, n);
+        dst += n;
+        len -= n;
+        skip = 0;
     }
+}
+
+/*
+ * Finish a direct write that the transport took written bytes of (or
+ * refused with an error). On a short write the unsent rest is queued, to
+ * be flushed when the transport can take more, so a non-blocking
+ * transport never tears a frame. The egress queue is empty on entry.
+ */
+static yamux_result_t yamux_session_send_rest(yamux_session_t *session, const uint8_t *frame,
+                                              size_t frame_len, const yamux_iovec_t *iov, int iovcnt,
+                                              size_t len, int written) {
+    size_t total = frame_len + len;
+    size_t sent;
     
-    /* Check if it's a ping request (SYN) or response (ACK) */
-    if (header->flags & YAMUX_FLAG_SYN) {
-        /* This is a ping request, send a response */
-        memset(&response, 0, sizeof(response));
-        response.version = YAMUX_PROTO_VERSION;
-        response.type = YAMUX_PING;
-        response.flags = YAMUX_FLAG_ACK;  /* ACK flag for response */
-        response.stream_id = 0;
-        response.length = 0;
-        
-        /* Encode header */
-        yamux_encode_header(&response, frame);
+    if (written < 0 && written != YAMUX_ERR_WOULD_BLOCK) {
+        return YAMUX_ERR_IO;
+    }
+    sent = (written > 0) ? (size_t)written : 0;
+    YAMUX_STAT(session->stats.bytes_out += sent);
+    if (sent >= total) {
+        return YAMUX_OK;
+    }
+    if (sent > 0) {
+        YAMUX_STAT(session->stats.partial_writes++);
+        session->tx_progress = 1;
+    }
+    
+    /* Nothing went out and it cannot be queued: the caller may retry */
+    if (session->send_buf_used + (total - sent) > session->send_buf_size) {
+        return (sent == 0) ? YAMUX_ERR_WOULD_BLOCK : YAMUX_ERR_IO;
+    }
+    
+    if (sent < frame_len) {
+        memcpy(session->send_buf + session->send_buf_used, frame + sent, frame_len - sent);
+        session->send_buf_used += frame_len - sent;
+        sent = frame_len;
+    }
+    if (total > sent) {
+        yamux_iov_copy(session->send_buf + session->send_buf_used, iov, iovcnt, sent - frame_len, total - sent);
+        session->send_buf_used += total - sent;
+    }
+    
+    /* The queue now waits on the transport */
+    yamux_timers_write_blocked(session);
+    return YAMUX_OK;
+}
+
+/**
+ * Write an encoded header and its payload segments straight to the transport
+ * 
+ * The header and payload go out in one io.writev call when the transport
+ * provides it. Otherwise a control-sized payload is copied behind the
+ * header for a single io.write, and larger payloads are written separately,
+ * one io.write per segment.
+ */
+static yamux_result_t yamux_session_send_direct(yamux_session_t *session, uint8_t *frame,
+                                                const yamux_iovec_t *iov, int iovcnt, size_t len) {
+    size_t frame_len = YAMUX_HEADER_SIZE;
+    size_t sent;
+    int written;
+    int i;
+    
+    /* Gather write: header and payload in one call */
+    if (session->io.writev && len > 0) {
+        yamux_iovec_t vec[1 + YAMUX_MAX_FRAME_SEGMENTS];
         
-        /* Send frame */
-        if (session->io.write(session->io.ctx, frame, sizeof(frame)) != sizeof(frame)) {
+        vec[0].base = frame;
+        vec[0].len = YAMUX_HEADER_SIZE;
+        memcpy(vec + 1, iov, (size_t)iovcnt * sizeof(*iov));
+        written = session->io.writev(session->io.ctx, vec, 1 + iovcnt);
+        return yamux_session_send_rest(session, frame, YAMUX_HEADER_SIZE, iov, iovcnt, len, written);
+    }
+    
+    /* Small payloads ride along in the header buffer */
+    if (len <= YAMUX_MAX_CONTROL_PAYLOAD) {
+        yamux_iov_copy(frame + YAMUX_HEADER_SIZE, iov, iovcnt, 0, len);
+        frame_len += len;
+        written = session->io.write(session->io.ctx, frame, frame_len);
+        return yamux_session_send_rest(session, frame, frame_len, NULL, 0, 0, written);
+    }
+    
+    /* Header, then payload */
+    written = session->io.write(session->io.ctx, frame, YAMUX_HEADER_SIZE);
+    if (written != YAMUX_HEADER_SIZE) {
+        return yamux_session_send_rest(session, frame, YAMUX_HEADER_SIZE, iov, iovcnt, len, written);
+    }
+    sent = YAMUX_HEADER_SIZE;
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].len == 0) {
+            continue;
+        }
+        written = session->io.write(session->io.ctx, iov[i].base, iov[i].len);
+        if (written < 0 && written != YAMUX_ERR_WOULD_BLOCK) {
             return YAMUX_ERR_IO;
         }
+        if (written > 0) {
+            sent += (size_t)written;
+        }
+        if (written <= 0 || (size_t)written < iov[i].len) {
+            break;
+        }
+    }
+    return yamux_session_send_rest(session, frame, YAMUX_HEADER_SIZE, iov, iovcnt, len, (int)sent);
+}
+
+/* Write or queue an encoded frame; yamux_session_send_framev() checked the arguments */
+static yamux_result_t yamux_session_write_frame(yamux_session_t *session, const yamux_header_t *header,
+                                                const yamux_iovec_t *iov, int iovcnt, size_t len) {
+    uint8_t frame[YAMUX_HEADER_SIZE + YAMUX_MAX_CONTROL_PAYLOAD];
+    size_t frame_len = YAMUX_HEADER_SIZE + len;
+    yamux_result_t result;
+    
+    /* Nothing to coalesce with (concurrent writers always go through the queue) */
+    if (session->cork_depth == 0 && !yamux_session_queued(session) && !session->threaded) {
+        yamux_encode_header(header, frame);
+        return yamux_session_send_direct(session, frame, iov, iovcnt, len);
     }
     
-    /* For ping response (ACK), do nothing */
+    /* Make room, writing out what is queued */
+    while (session->send_buf_used + frame_len > session->send_buf_size) {
+        result = yamux_session_flush_locked(session);
+        if (result != YAMUX_OK) {
+            return result;
+        }
+        if (session->send_buf_used + frame_len <= session->send_buf_size) {
+            break;
+        }
+        
+        /* Too large to ever queue; the queue is empty so order is kept */
+        if (session->send_buf_used == 0) {
+            yamux_encode_header(header, frame);
+            return yamux_session_send_direct(session, frame, iov, iovcnt, len);
+        }
+        
+        /* Other threads queued more, or are writing it out: let them finish */
+        if (session->flushing && !yamux_session_wait_flushed(session)) {
+            return YAMUX_ERR_WOULD_BLOCK;
+        }
+    }
+    
+    /* The header is encoded straight into the queue */
+    yamux_encode_header(header, session->send_buf + session->send_buf_used);
+    yamux_iov_copy(session->send_buf + session->send_buf_used + YAMUX_HEADER_SIZE, iov, iovcnt, 0, len);
+    session->send_buf_used += frame_len;
+    
+    /* Uncorked: only queued because of a backlog, so try to drain it. A
+     * thread-safe session drains it when the caller releases the lock. */
+    if (session->cork_depth == 0 && !session->threaded) {
+        result = yamux_session_flush_locked(session);
+        return (result == YAMUX_ERR_WOULD_BLOCK) ? YAMUX_OK : result;
+    }
     
     return YAMUX_OK;
 }
 
 /**
- * Handle go-away frame
- *
- * @param session Session
- * @param header Frame header
- * @return YAMUX_OK on success, error code otherwise
+ * Send a single frame
+ * 
+ * While the session is corked, or while earlier frames are still queued,
+ * the frame is appended to the session's egress buffer so ordering is kept
+ * and many frames leave in one write. Otherwise it is written immediately.
+ * 
+ * @param session Session context
+ * @param header Frame header (length must equal len)
+ * @param payload Frame payload, may be NULL if len is 0
+ * @param len Payload length
+ * @return YAMUX_OK once the frame is written or queued, YAMUX_ERR_WOULD_BLOCK
+ *         if the queue is full and the transport would block, YAMUX_ERR_IO on error
  */
-yamux_result_t yamux_handle_go_away(
-    yamux_session_t *session, 
-    const yamux_header_t *header)
-{
-    uint8_t data[4];
+yamux_result_t yamux_session_send_frame(yamux_session_t *session, const yamux_header_t *header,
+                                        const uint8_t *payload, size_t len) {
+    yamux_iovec_t iov;
     
-    if (!session || !header) {
+    if (len > 0 && !payload) {
         return YAMUX_ERR_INVALID;
     }
+    iov.base = payload;
+    iov.len = len;
+    return yamux_session_send_framev(session, header, &iov, (len > 0) ? 1 : 0);
+}
+
+/**
+ * Send a single frame whose payload is gathered from several segments
+ * 
+ * Queued like yamux_session_send_frame(). Written directly, the header and
+ * segments go to io.writev as they are, without being copied.
+ * 
+ * @param session Session context
+ * @param header Frame header (length must equal the segments' total)
+ * @param iov Payload segments, may be NULL if iovcnt is 0
+ * @param iovcnt Number of segments, at most YAMUX_MAX_FRAME_SEGMENTS
+ * @return As yamux_session_send_frame()
+ */
+yamux_result_t yamux_session_send_framev(yamux_session_t *session, const yamux_header_t *header,
+                                         const yamux_iovec_t *iov, int iovcnt) {
+    yamux_result_t result;
+    size_t len = 0;
+    int i;
     
-    /* Read reason code */
-    if (header->length != 4) {
-        /* Go-away reason must be 4 bytes */
-        return YAMUX_ERR_PROTOCOL;
+    if (!session || !header || iovcnt < 0 || iovcnt > YAMUX_MAX_FRAME_SEGMENTS || (iovcnt > 0 && !iov)) {
+        return YAMUX_ERR_INVALID;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        if (iov[i].len > 0 && !iov[i].base) {
+            return YAMUX_ERR_INVALID;
+        }
+        len += iov[i].len;
     }
     
-    /* Read reason code */
-    if (session->io.read(session->io.ctx, data, sizeof(data)) != sizeof(data)) {
-        return YAMUX_ERR_IO;
+    result = yamux_session_write_frame(session, header, iov, iovcnt, len);
+    if (result == YAMUX_OK) {
+        yamux_stats_frame_out(session, header);
     }
+    return result;
+}
+
+/**
+ * Check whether frames are waiting for the transport
+ * 
+ * @param session Session
+ * @return Non-zero while the egress queue or a file-backed frame has bytes left
+ */
+int yamux_session_queued(const yamux_session_t *session) {
+    return session->send_buf_used > 0 || session->file_header_left > 0 || session->file_left > 0;
+}
+
+/*
+ * Write out the file-backed DATA frame started by yamux_stream_sendfile(),
+ * which goes ahead of the egress queue: the header, then the file through
+ * io.sendfile. Called by the flushing thread, which drops the lock around
+ * each call as yamux_session_flush_locked() does.
+ */
+static yamux_result_t yamux_session_write_file(yamux_session_t *session) {
+    size_t len;
+    int written;
+    
+    while (session->file_header_left > 0 || session->file_left > 0) {
+        len = (session->file_header_left > 0) ? session->file_header_left : session->file_left;
+        
+        yamux_session_unlock(session);
+        if (session->file_header_left > 0) {
+            written = session->io.write(session->io.ctx,
+                                        session->file_header + YAMUX_HEADER_SIZE - session->file_header_left, len);
+        } else {
+            written = session->io.sendfile(session->io.ctx, session->file_fd, session->file_offset, len);
+        }
+        yamux_session_lock(session);
+        
+        if (written == 0 || written == YAMUX_ERR_WOULD_BLOCK) {
+            return YAMUX_ERR_WOULD_BLOCK;
+        }
+        if (written < 0) {
+            return YAMUX_ERR_IO;
+        }
+        YAMUX_STAT(session->stats.bytes_out += (size_t)written);
+        session->tx_progress = 1;
+        if ((size_t)written < len) {
+            YAMUX_STAT(session->stats.partial_writes++);
+        }
+        if (session->file_header_left > 0) {
+            session->file_header_left -= (size_t)written;
+        } else {
+            session->file_offset += (uint64_t)written;
+            session->file_left -= (size_t)written;
+        }
+    }
+    return YAMUX_OK;
+}
+
+/**
+ * Write out all queued frames, with the session lock held
+ * 
+ * In a thread-safe session one thread at a time writes the queue: it drops
+ * the lock around each io.write, and frames other threads append meanwhile
+ * go out in the same loop. A caller finding the queue being written
+ * returns at once.
+ * 
+ * @param session Session
+ * @return YAMUX_OK when the queue is empty or being written by another
+ *         thread, YAMUX_ERR_WOULD_BLOCK if the transport took only part of it
+ */
+yamux_result_t yamux_session_flush_locked(yamux_session_t *session) {
+    size_t sent = 0;
+    int written;
+    yamux_result_t result = YAMUX_OK;
+    
+    if (session->flushing) {
+        return YAMUX_OK;
+    }
+    session->flushing = 1;
+    
+    do {
+        /* A file-backed frame was started before anything now queued */
+        result = yamux_session_write_file(session);
+        
+        /* Bytes before send_buf_used are only moved by the flushing thread */
+        while (result == YAMUX_OK && sent < session->send_buf_used) {
+            const uint8_t *data = session->send_buf + sent;
+            size_t len = session->send_buf_used - sent;
+            
+            yamux_session_unlock(session);
+            written = session->io.write(session->io.ctx, data, len);
+            yamux_session_lock(session);
+            
+            if (written == 0 || written == YAMUX_ERR_WOULD_BLOCK) {
+                result = YAMUX_ERR_WOULD_BLOCK;
+                break;
+            }
+            if (written < 0) {
+                result = YAMUX_ERR_IO;
+                break;
+            }
+            YAMUX_STAT(session->stats.bytes_out += (size_t)written);
+            session->tx_progress = 1;
+            if ((size_t)written < len) {
+                YAMUX_STAT(session->stats.partial_writes++);
+            }
+            sent += (size_t)written;
+        }
+        
+        /* Keep whatever the transport did not take at the front of the queue */
+        if (sent > 0) {
+            memmove(session->send_buf, session->send_buf + sent, session->send_buf_used - sent);
+            session->send_buf_used -= sent;
+            sent = 0;
+        }
+        
+        /* Once drained, scheduled stream data takes its turn */
+    } while (result == YAMUX_OK && yamux_sched_run(session) > 0);
+    
+    session->flushing = 0;
+    if (result == YAMUX_ERR_WOULD_BLOCK) {
+        yamux_timers_write_blocked(session);
+    }
+    yamux_session_notify(session);
+    return result;
+}
+
+/* Write out all queued frames */
+yamux_result_t yamux_session_flush(yamux_session_t *session) {
+    yamux_result_t result;
     
-    /* Decode reason (big-endian) - we don't use it currently */
-    /* yamux_error_t err = (data[0] << 24) | (data[1] << 16) | (data[2] << 8) | data[3]; */
+    if (!session) {
+        return YAMUX_ERR_INVALID;
+    }
     
-    /* Mark session as shut down */
-    session->go_away_received = 1;
+    yamux_session_lock(session);
+    result = yamux_session_flush_locked(session);
+    if (result == YAMUX_ERR_WOULD_BLOCK) {
+        YAMUX_STAT(session->stats.would_block++);
+    }
+    yamux_session_unlock(session);
+    
+    return result;
+}
+
+/* Start coalescing outgoing frames */
+yamux_result_t yamux_session_cork(yamux_session_t *session) {
+    if (!session) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    yamux_session_lock(session);
+    session->cork_depth++;
+    yamux_session_unlock(session);
     
     return YAMUX_OK;
 }
+
+/**
+ * Release one cork, with the session lock held
+ * 
+ * @param session Session
+ * @return Result of the flush, or YAMUX_OK if still corked
+ */
+yamux_result_t yamux_session_uncork_locked(yamux_session_t *session) {
+    if (session->cork_depth > 0) {
+        session->cork_depth--;
+    }
+    if (session->cork_depth > 0) {
+        return YAMUX_OK;
+    }
+    
+    return yamux_session_flush_locked(session);
+}
+
+/* Stop coalescing and write out the queued frames */
+yamux_result_t yamux_session_uncork(yamux_session_t *session) {
+    yamux_result_t result;
+    
+    if (!session) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    yamux_session_lock(session);
+    result = yamux_session_uncork_locked(session);
+    yamux_session_unlock(session);
+    
+    return result;
+}
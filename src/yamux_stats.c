@@ -0,0 +1,341 @@
+/**
+ * @file yamux_stats.c
+ * @brief Session and stream counters for telemetry
+ *
+ * The counters are plain fields of the session and stream structures,
+ * updated with the session lock held (or single-threaded) as frames pass,
+ * so keeping them on costs a few increments per frame and no atomics.
+ * Send-window stalls, ping round trips and the wait for credit after
+ * sending are timed with the session clock when there is one.
+ *
+ * Built with YAMUX_STATS 0 only the ping timing is kept, for window
+ * auto-tuning: the counters, the histogram and their fields are gone,
+ * and the getters report zeros besides the live queue and stream counts.
+ */
+
+#include "../include/yamux.h"
+#include "yamux_internal.h"
+#include "yamux_defs.h"
+#include <string.h>
+
+#if YAMUX_STATS
+/**
+ * Count a frame received, once its header is parsed
+ *
+ * @param session Session
+ * @param header Frame header
+ */
+void yamux_stats_frame_in(yamux_session_t *session, const yamux_header_t *header) {
+    if (header->type <= YAMUX_GO_AWAY) {
+        session->stats.frames_in[header->type]++;
+    }
+}
+
+/**
+ * Count a frame sent (written or queued)
+ *
+ * @param session Session
+ * @param header Frame header
+ */
+void yamux_stats_frame_out(yamux_session_t *session, const yamux_header_t *header) {
+    if (header->type <= YAMUX_GO_AWAY) {
+        session->stats.frames_out[header->type]++;
+    }
+    if (header->type == YAMUX_DATA) {
+        session->stats.data_bytes_out += header->length;
+    }
+}
+
+/**
+ * Count DATA payload delivered to a stream
+ *
+ * @param stream Stream
+ * @param len Payload bytes in this chunk
+ * @param last Non-zero if the chunk completes the frame
+ */
+void yamux_stats_data_in(yamux_stream_t *stream, size_t len, int last) {
+    yamux_session_stats_t *session_stats = &stream->session->stats;
+
+    stream->stats.bytes_in += len;
+    session_stats->data_bytes_in += len;
+    if (last) {
+        stream->stats.frames_in++;
+    }
+    if (stream->recvbuf.used > stream->stats.recv_high_water) {
+        stream->stats.recv_high_water = stream->recvbuf.used;
+        if (stream->recvbuf.used > session_stats->recv_high_water) {
+            session_stats->recv_high_water = stream->recvbuf.used;
+        }
+    }
+}
+
+/**
+ * Count a DATA frame sent on a stream
+ *
+ * @param stream Stream
+ * @param len Payload bytes of the frame
+ */
+void yamux_stats_data_out(yamux_stream_t *stream, size_t len) {
+    stream->stats.frames_out++;
+    stream->stats.bytes_out += len;
+
+    /* Time the first frame since the last credit until the next arrives */
+    if (!stream->ack_pending && yamux_session_clock_ms(stream->session, &stream->ack_start_ms)) {
+        stream->ack_pending = 1;
+    }
+}
+
+/**
+ * Count a WINDOW_UPDATE that granted a stream credit
+ *
+ * @param stream Stream
+ */
+void yamux_stats_credit_in(yamux_stream_t *stream) {
+    uint64_t now_ms;
+    uint32_t sample;
+
+    stream->stats.window_updates_in++;
+    stream->session->stats.window_updates_in++;
+
+    if (!stream->ack_pending || !yamux_session_clock_ms(stream->session, &now_ms)) {
+        return;
+    }
+    stream->ack_pending = 0;
+    sample = (now_ms > stream->ack_start_ms) ? (uint32_t)(now_ms - stream->ack_start_ms) : 0;
+    stream->stats.ack_latency_ms = stream->stats.ack_latency_ms
+                                       ? (stream->stats.ack_latency_ms * 7 + sample) / 8
+                                       : sample;
+}
+
+/**
+ * Start timing a stall: the stream's send window just ran out
+ *
+ * @param stream Stream
+ */
+void yamux_stats_stall_begin(yamux_stream_t *stream) {
+    if (stream->stalled) {
+        return;
+    }
+    stream->stalled = 1;
+    stream->stats.window_stalls++;
+    stream->session->stats.window_stalls++;
+    if (!yamux_session_clock_ms(stream->session, &stream->stall_start_ms)) {
+        stream->stall_start_ms = 0;
+    }
+}
+
+/**
+ * Stop timing a stall: credit arrived
+ *
+ * @param stream Stream
+ */
+void yamux_stats_stall_end(yamux_stream_t *stream) {
+    uint64_t now_ms;
+
+    if (!stream->stalled) {
+        return;
+    }
+    stream->stalled = 0;
+    if (yamux_session_clock_ms(stream->session, &now_ms) && now_ms > stream->stall_start_ms) {
+        stream->stats.stall_ms += now_ms - stream->stall_start_ms;
+        stream->session->stats.stall_ms += now_ms - stream->stall_start_ms;
+    }
+}
+
+/* Histogram bucket of a sample: exact below 4 ms, then four per power of two */
+static unsigned yamux_rtt_bucket(uint32_t ms) {
+    unsigned shift = 0;
+
+    if (ms < 4) {
+        return ms;
+    }
+    while ((ms >> shift) >= 8) {
+        shift++;
+    }
+    return 4 + shift * 4 + ((ms >> shift) & 3);
+}
+
+/* Largest sample that falls in a bucket */
+static uint32_t yamux_rtt_bucket_max(unsigned bucket) {
+    uint64_t top;
+
+    if (bucket < 4) {
+        return bucket;
+    }
+    top = ((uint64_t)(5 + (bucket - 4) % 4) << ((bucket - 4) / 4)) - 1;
+    return (top > UINT32_MAX) ? UINT32_MAX : (uint32_t)top;
+}
+#endif /* YAMUX_STATS */
+
+/**
+ * Start timing a ping
+ *
+ * @param session Session that sent it
+ * @param id The ping's ID
+ */
+void yamux_stats_ping_sent(yamux_session_t *session, uint32_t id) {
+    yamux_ping_slot_t *slot = &session->pings[0];
+    uint64_t now_ms;
+    int i;
+
+    if (!yamux_session_clock_ms(session, &now_ms)) {
+        return;
+    }
+
+    /* A free slot, or else the oldest: a ping that long unanswered was lost */
+    for (i = 0; i < YAMUX_PING_SLOTS; i++) {
+        if (!session->pings[i].used) {
+            slot = &session->pings[i];
+            break;
+        }
+        if (session->pings[i].sent_ms < slot->sent_ms) {
+            slot = &session->pings[i];
+        }
+    }
+    slot->id = id;
+    slot->sent_ms = now_ms;
+    slot->used = 1;
+}
+
+/**
+ * Take a round-trip sample from a ping ACK
+ *
+ * An ACK whose ID matches no outstanding ping gives no sample.
+ *
+ * @param session Session that sent the ping
+ * @param id The ID echoed in the ACK's length field
+ */
+void yamux_stats_ping_acked(yamux_session_t *session, uint32_t id) {
+#if YAMUX_STATS
+    yamux_rtt_hist_t *rtt = &session->rtt;
+#endif
+    yamux_ping_slot_t *slot = NULL;
+    uint64_t now_ms;
+    uint32_t sample;
+    int i;
+
+    for (i = 0; i < YAMUX_PING_SLOTS; i++) {
+        if (!session->pings[i].used) {
+            continue;
+        }
+        if (session->pings[i].id == id) {
+            slot = &session->pings[i];
+            break;
+        }
+    }
+    if (!slot || !yamux_session_clock_ms(session, &now_ms)) {
+        return;
+    }
+    slot->used = 0;
+
+    sample = (now_ms > slot->sent_ms) ? (uint32_t)(now_ms - slot->sent_ms) : 0;
+#if YAMUX_STATS
+    rtt->buckets[yamux_rtt_bucket(sample)]++;
+    rtt->sum_ms += sample;
+    if (rtt->count == 0 || sample < rtt->min_ms) {
+        rtt->min_ms = sample;
+    }
+    if (sample > rtt->max_ms) {
+        rtt->max_ms = sample;
+    }
+    rtt->count++;
+    rtt->last_ms = sample;
+    rtt->last_id = slot->id;
+#endif
+
+    yamux_window_rtt_sample(session, sample);
+}
+
+/* Read the ping round-trip statistics */
+yamux_result_t yamux_session_get_rtt(yamux_session_t *session, yamux_rtt_stats_t *stats) {
+#if YAMUX_STATS
+    const yamux_rtt_hist_t *rtt;
+    uint64_t rank;
+    uint64_t seen = 0;
+    unsigned bucket;
+#endif
+
+    if (!session || !stats) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    memset(stats, 0, sizeof(*stats));
+    yamux_session_lock(session);
+#if YAMUX_STATS
+    rtt = &session->rtt;
+    if (rtt->count > 0) {
+        stats->samples = rtt->count;
+        stats->last_id = rtt->last_id;
+        stats->last_ms = rtt->last_ms;
+        stats->min_ms = rtt->min_ms;
+        stats->avg_ms = (uint32_t)(rtt->sum_ms / rtt->count);
+        stats->max_ms = rtt->max_ms;
+        stats->srtt_ms = session->rtt_ms;
+
+        /* The bucket holding the sample that 99% of the others do not exceed */
+        rank = (rtt->count * 99 + 99) / 100;
+        for (bucket = 0; bucket < YAMUX_RTT_BUCKETS; bucket++) {
+            seen += rtt->buckets[bucket];
+            if (seen >= rank) {
+                break;
+            }
+        }
+        stats->p99_ms = yamux_rtt_bucket_max(bucket);
+        if (stats->p99_ms > rtt->max_ms) {
+            stats->p99_ms = rtt->max_ms;
+        }
+        if (stats->p99_ms < rtt->min_ms) {
+            stats->p99_ms = rtt->min_ms;
+        }
+    }
+#else
+    stats->srtt_ms = session->rtt_ms;
+#endif
+    yamux_session_unlock(session);
+
+    return YAMUX_OK;
+}
+
+/* Read a session's counters */
+yamux_result_t yamux_session_get_stats(yamux_session_t *session, yamux_session_stats_t *stats) {
+    if (!session || !stats) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    yamux_session_lock(session);
+#if YAMUX_STATS
+    *stats = session->stats;
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif
+    stats->accept_queue_depth = session->accept_len;
+    stats->streams = session->streams.count;
+    yamux_session_unlock(session);
+
+    return YAMUX_OK;
+}
+
+/* Read a stream's counters */
+yamux_result_t yamux_stream_get_stats(yamux_stream_t *stream, yamux_stream_stats_t *stats) {
+#if YAMUX_STATS
+    uint64_t now_ms;
+#endif
+
+    if (!stream || !stream->session || !stats) {
+        return YAMUX_ERR_INVALID;
+    }
+
+#if YAMUX_STATS
+    yamux_session_lock(stream->session);
+    *stats = stream->stats;
+    if (stream->stalled && yamux_session_clock_ms(stream->session, &now_ms) &&
+        now_ms > stream->stall_start_ms) {
+        stats->stall_ms += now_ms - stream->stall_start_ms;
+    }
+    yamux_session_unlock(stream->session);
+#else
+    memset(stats, 0, sizeof(*stats));
+#endif
+
+    return YAMUX_OK;
+}
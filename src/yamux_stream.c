@@ -6,21 +6,68 @@
 #include "../include/yamux.h"
 #include "yamux_internal.h"
 #include "yamux_defs.h"
+#include "yamux_log.h"
 #include <stdlib.h>
 #include <string.h>
-#include <stdio.h>
+#include <arpa/inet.h>
 
 /* Use definitions from yamux_defs.h */
 
 /**
- * Create a new stream
+ * Allocate a zeroed stream from the session's stream pool
  *
  * @param session Parent session
- * @param stream_id Stream ID (0 for auto-assign)
- * @param stream Output parameter for the created stream
- * @return YAMUX_OK on success, error code otherwise
+ * @return Stream with its session set, or NULL on allocation failure
  */
-yamux_result_t yamux_stream_open_detailed(
+yamux_stream_t *yamux_stream_alloc(yamux_session_t *session)
+{
+    yamux_stream_t *s = (yamux_stream_t *)yamux_pool_get(&session->stream_pool);
+
+    if (s) {
+        memset(s, 0, sizeof(yamux_stream_t));
+        s->session = session;
+#if YAMUX_SCHED
+        s->sched_priority = YAMUX_DEFAULT_PRIORITY;
+        s->sched_weight = YAMUX_DEFAULT_WEIGHT;
+        (void)yamux_buffer_init_lazy(&s->sendq, NULL, YAMUX_SCHED_QUEUE_SIZE, NULL, 0);
+#endif
+    }
+    return s;
+}
+
+/**
+ * Free a stream's buffers and return it to the stream pool
+ *
+ * @param stream Stream from yamux_stream_alloc(), already out of the table
+ */
+void yamux_stream_release(yamux_stream_t *stream)
+{
+    yamux_timer_cancel(&stream->timer);
+    yamux_window_detach(stream);
+    yamux_sched_remove(stream);
+    yamux_buffer_free(&stream->recvbuf);
+#if YAMUX_SCHED
+    yamux_buffer_free(&stream->sendq);
+#endif
+    yamux_pool_put(&stream->session->stream_pool, stream);
+}
+
+/**
+ * Release a stream the application freed, if it has left the session
+ *
+ * Called where a stream becomes CLOSED, after its events are reported.
+ *
+ * @param stream Stream, possibly orphaned by yamux_stream_free()
+ */
+void yamux_stream_reap(yamux_stream_t *stream)
+{
+    if (stream->orphaned && stream->state == YAMUX_STREAM_CLOSED) {
+        yamux_stream_release(stream);
+    }
+}
+
+/* Create a new stream, with the session lock held */
+static yamux_result_t yamux_stream_open_locked(
     yamux_session_t *session, 
     uint32_t stream_id, 
     yamux_stream_t **stream)
@@ -28,39 +75,34 @@ yamux_result_t yamux_stream_open_detailed(
     yamux_stream_t *s;
     yamux_result_t result;
     yamux_header_t header;
-    uint8_t frame[YAMUX_HEADER_SIZE + 4];  /* 8-byte header + 4-byte window size payload */
     
-    printf("DEBUG: yamux_stream_open: Entered. session=%p, stream_id=%u\n", (void*)session, stream_id);
+    YAMUX_LOG_DEBUG("yamux_stream_open: Entered. session=%p, stream_id=%u", (void*)session, stream_id);
 
     /* Validate parameters */
     if (!session || !stream) {
-        printf("DEBUG: yamux_stream_open: Invalid params (session or stream is NULL)\n");
+        YAMUX_LOG_DEBUG("yamux_stream_open: Invalid params (session or stream is NULL)");
         return YAMUX_ERR_INVALID;
     }
     
-    /* Check if session is shut down */
-    if (session->go_away_received) {
-        printf("DEBUG: yamux_stream_open: Session go_away_received\n");
+    /* Check if session is shut down or failed */
+    if (session->go_away_received || session->failure != YAMUX_OK) {
+        YAMUX_LOG_DEBUG("yamux_stream_open: Session go_away_received");
         return YAMUX_ERR_CLOSED;
     }
     
     /* Validate stream ID - 0xFFFFFFFF is invalid as per Go implementation */
     if (stream_id == 0xFFFFFFFF) {
-        printf("DEBUG: yamux_stream_open: Invalid stream ID 0xFFFFFFFF\n");
+        YAMUX_LOG_DEBUG("yamux_stream_open: Invalid stream ID 0xFFFFFFFF");
         return YAMUX_ERR_INVALID;
     }
     
     /* Allocate stream structure */
-    s = (yamux_stream_t *)malloc(sizeof(yamux_stream_t));
+    s = yamux_stream_alloc(session);
     if (!s) {
-        printf("ERROR: yamux_stream_open: malloc for stream failed!\n");
+        YAMUX_LOG_ERROR("yamux_stream_open: allocating the stream failed!");
         return YAMUX_ERR_NOMEM;
     }
-    printf("DEBUG: yamux_stream_open: Stream structure allocated s=%p\n", (void*)s);
-    
-    /* Initialize stream */
-    memset(s, 0, sizeof(yamux_stream_t));
-    s->session = session;
+    YAMUX_LOG_DEBUG("yamux_stream_open: Stream structure allocated s=%p", (void*)s);
     
     /* Set stream ID */
     if (stream_id == 0) {
@@ -72,22 +114,39 @@ yamux_result_t yamux_stream_open_detailed(
         s->id = stream_id;
     }
     
-    /* Initialize receive buffer */
-    result = yamux_buffer_init(&s->recvbuf, YAMUX_INITIAL_BUFFER_SIZE);
+    /* Set initial window sizes */
+    s->send_window = YAMUX_DEFAULT_WINDOW_SIZE;
+    yamux_window_init(s);
+    
+    /* Receive buffer bounded by the receive window; storage comes with the first data */
+    result = yamux_buffer_init_lazy(&s->recvbuf, &session->buffer_pool, s->recv_window_size,
+                                    s->recv_inline, sizeof(s->recv_inline));
     if (result != YAMUX_OK) {
-        printf("ERROR: yamux_stream_open: yamux_buffer_init failed with %d\n", result);
-        free(s);
+        YAMUX_LOG_ERROR("yamux_stream_open: yamux_buffer_init failed with %d", result);
+        yamux_stream_release(s);
         return result;
     }
-    printf("DEBUG: yamux_stream_open: Recv buffer initialized.\n");
-    
-    /* Set initial window sizes */
-    s->send_window = YAMUX_DEFAULT_WINDOW_SIZE;
-    s->recv_window = YAMUX_DEFAULT_WINDOW_SIZE;
+    YAMUX_LOG_DEBUG("yamux_stream_open: Recv buffer initialized.");
     
     /* Set initial state */
     s->state = YAMUX_STREAM_IDLE;
     
+    /*
+     * Add stream to session before the SYN goes out: in a thread-safe
+     * session the lock is released while the queue is written, and the
+     * peer's reply may be processed before yamux_session_send_frame returns.
+     */
+    result = yamux_add_stream(session, s);
+    if (result != YAMUX_OK) {
+        YAMUX_LOG_ERROR("yamux_stream_open: yamux_add_stream failed with %d", result);
+        yamux_stream_release(s);
+        return result;
+    }
+    YAMUX_LOG_DEBUG("yamux_stream_open: Stream added to session.");
+    
+    /* Update state */
+    s->state = YAMUX_STREAM_SYN_SENT;
+    
     /* Send SYN frame */
     memset(&header, 0, sizeof(header));
     header.version = YAMUX_PROTO_VERSION;
@@ -96,33 +155,20 @@ yamux_result_t yamux_stream_open_detailed(
     header.stream_id = s->id;
     header.length = 4;  /* Window size is a 32-bit value */
     
-    /* Encode header */
-    yamux_encode_header(&header, frame);
-    
     /* Encode initial window size into the payload */
     uint32_t net_initial_window_size = htonl(s->recv_window);
-    memcpy(frame + YAMUX_HEADER_SIZE, &net_initial_window_size, sizeof(net_initial_window_size));
     
-    printf("DEBUG: yamux_stream_open: Sending SYN for stream %u, header.length: %u, payload_window: %u\n", s->id, header.length, s->recv_window);
-    if (session->io.write(session->io.ctx, frame, sizeof(frame)) != sizeof(frame)) {
-        printf("DEBUG: yamux_stream_open: io.write failed for SYN\n");
-        yamux_buffer_free(&s->recvbuf);
-        free(s);
+    YAMUX_LOG_DEBUG("yamux_stream_open: Sending SYN for stream %u, header.length: %u, payload_window: %u", s->id, header.length, s->recv_window);
+    if (yamux_session_send_frame(session, &header, (const uint8_t *)&net_initial_window_size,
+                                 sizeof(net_initial_window_size)) != YAMUX_OK) {
+        YAMUX_LOG_DEBUG("yamux_stream_open: io.write failed for SYN");
+        yamux_remove_stream(session, s->id);
+        yamux_stream_release(s);
         return YAMUX_ERR_IO;
     }
     
-    /* Add stream to session after successful SYN */
-    result = yamux_add_stream(session, s);
-    if (result != YAMUX_OK) {
-        printf("ERROR: yamux_stream_open: yamux_add_stream failed with %d\n", result);
-        yamux_buffer_free(&s->recvbuf);
-        free(s);
-        return result;
-    }
-    printf("DEBUG: yamux_stream_open: Stream added to session.\n");
-    
-    /* Update state */
-    s->state = YAMUX_STREAM_SYN_SENT;
+    /* An unanswered SYN times out */
+    yamux_timers_stream_opened(s);
     
     /* Set stream pointer */
     *stream = s;
@@ -130,6 +176,102 @@ yamux_result_t yamux_stream_open_detailed(
     return YAMUX_OK;
 }
 
+/**
+ * Create a new stream
+ *
+ * @param session Parent session
+ * @param stream_id Stream ID (0 for auto-assign)
+ * @param stream Output parameter for the created stream
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_open_detailed(
+    yamux_session_t *session, 
+    uint32_t stream_id, 
+    yamux_stream_t **stream)
+{
+    yamux_result_t result;
+    
+    if (!session) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    yamux_session_lock(session);
+    result = yamux_stream_open_locked(session, stream_id, stream);
+    yamux_session_unlock(session);
+    
+    return result;
+}
+
+/**
+ * Open several streams at once
+ *
+ * @param session Parent session
+ * @param count Number of streams to open
+ * @param streams Output array of count streams
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_open_batch(
+    yamux_session_t *session,
+    uint32_t count,
+    yamux_stream_t **streams)
+{
+    yamux_result_t result = YAMUX_OK;
+    yamux_result_t flush_result;
+    uint32_t opened;
+    
+    /* Validate parameters */
+    if (!session || !streams || count == 0) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    yamux_session_lock(session);
+    
+    if (session->go_away_received || session->failure != YAMUX_OK) {
+        yamux_session_unlock(session);
+        return YAMUX_ERR_CLOSED;
+    }
+    
+    /* The IDs must all fit below 0xFFFFFFFF */
+    if ((uint64_t)session->next_stream_id + 2 * (uint64_t)(count - 1) >= 0xFFFFFFFFu) {
+        yamux_session_unlock(session);
+        return YAMUX_ERR_INVALID;
+    }
+    
+    /* One allocation for every stream object the pool lacks */
+    if (yamux_pool_reserve(&session->stream_pool, count) != YAMUX_OK) {
+        yamux_session_unlock(session);
+        return YAMUX_ERR_NOMEM;
+    }
+    
+    /* The SYNs collect in the egress queue and leave together */
+    session->cork_depth++;
+    for (opened = 0; opened < count; opened++) {
+        result = yamux_stream_open_locked(session, 0, &streams[opened]);
+        if (result != YAMUX_OK) {
+            break;
+        }
+    }
+    
+    flush_result = yamux_session_uncork_locked(session);
+    
+    /* A would-block flush leaves the SYNs queued for the next write */
+    if (result == YAMUX_OK && flush_result == YAMUX_ERR_IO) {
+        result = YAMUX_ERR_IO;
+    }
+    
+    /* All or none: a failure resets the streams already opened */
+    if (result != YAMUX_OK) {
+        while (opened > 0) {
+            opened--;
+            (void)yamux_stream_close_locked(streams[opened], 1);
+            streams[opened] = NULL;
+        }
+    }
+    yamux_session_unlock(session);
+    
+    return result;
+}
+
 /**
  * Accept a new stream (server only)
  *
@@ -148,20 +290,29 @@ yamux_result_t yamux_stream_accept(
         return YAMUX_ERR_INVALID;
     }
     
+    yamux_session_lock(session);
+    
     /* Check if session is shut down */
     if (session->go_away_received) {
+        yamux_session_unlock(session);
         return YAMUX_ERR_CLOSED;
     }
     
     /* Check if there are any streams to accept */
     if (!session->accept_queue) {
+        yamux_session_unlock(session);
         return YAMUX_ERR_TIMEOUT;
     }
     
     /* Get the first stream from the accept queue */
     s = session->accept_queue;
     session->accept_queue = s->next;
+    if (!session->accept_queue) {
+        session->accept_tail = NULL;
+    }
+    session->accept_len--;
     s->next = NULL;
+    yamux_session_unlock(session);
     
     /* Accept queue size updated */
     
@@ -177,18 +328,17 @@ yamux_result_t yamux_stream_accept(
 }
 
 /**
- * Close a stream
+ * Close a stream, with the session lock held
  *
  * @param stream Stream to close
  * @param reset True to reset the stream, false for normal close
  * @return YAMUX_OK on success, error code otherwise
  */
-yamux_result_t yamux_stream_close(
+yamux_result_t yamux_stream_close_locked(
     yamux_stream_t *stream, 
     int reset)
 {
     yamux_header_t header;
-    uint8_t frame[YAMUX_HEADER_SIZE]; 
     yamux_session_t *session;
     
     /* Validate parameters */
@@ -224,18 +374,21 @@ yamux_result_t yamux_stream_close(
     header.stream_id = stream->id;
     header.length = 0;
     
-    /* Encode header */
-    yamux_encode_header(&header, frame);
+    /* A reset drops data still scheduled; a FIN goes out after it */
+    if (reset) {
+        yamux_sched_remove(stream);
+    }
     
     /* Send frame (ignore errors, we're closing anyway) */
     // TODO: Add proper error checking for this write?
-    // For now, log the attempt and result if possible, but don't let it stop closure.
-    if (session && session->io.write) { // Basic check before calling
-        ssize_t bytes_written = session->io.write(session->io.ctx, frame, YAMUX_HEADER_SIZE); // Corrected size
-        // Optionally, log bytes_written or check for errors if debugging close issues
-        (void)bytes_written; // Suppress unused variable warning if not logging
+    // For now, don't let a failed write stop closure.
+    if (session && session->io.write && (reset || !yamux_sched_defer_fin(stream))) {
+        (void)yamux_session_send_frame(session, &header, NULL, 0);
     }
     
+    /* A pending read will never complete now */
+    yamux_stream_complete_read(stream, 0, YAMUX_ERR_CLOSED);
+    
     /* Update state */
     if (reset) {
         /* Immediate close for RST */
@@ -245,8 +398,7 @@ yamux_result_t yamux_stream_close(
         yamux_remove_stream(session, stream->id);
         
         /* Free resources */
-        yamux_buffer_free(&stream->recvbuf);
-        free(stream);
+        yamux_stream_release(stream);
     } else {
         /* Normal close logic depends on current stream state */
         if (stream->state == YAMUX_STREAM_FIN_RECV) {
@@ -254,15 +406,82 @@ yamux_result_t yamux_stream_close(
             stream->state = YAMUX_STREAM_CLOSED;
             yamux_remove_stream(session, stream->id);
             yamux_buffer_free(&stream->recvbuf);
-            /* Do not free(stream) so tests can still check error handling */
+            /* The stream stays the application's until yamux_stream_free() */
         } else {
             /* Otherwise mark FIN_SENT and wait for acknowledgement */
             stream->state = YAMUX_STREAM_FIN_SENT;
+            yamux_timers_stream_closing(stream);
             /* Do not cleanup resources until we receive FIN-ACK */
             /* The stream will be fully closed when we receive a FIN frame from the peer */
         }
     }
     
+    /* Threads waiting to write see the stream finished */
+    yamux_session_notify(session);
+    
+    return YAMUX_OK;
+}
+
+/**
+ * Close a stream
+ *
+ * @param stream Stream to close
+ * @param reset True to reset the stream, false for normal close
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_close(
+    yamux_stream_t *stream, 
+    int reset)
+{
+    yamux_session_t *session;
+    yamux_result_t result;
+    
+    /* Validate parameters */
+    if (!stream || !stream->session) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    session = stream->session;
+    yamux_session_lock(session);
+    result = yamux_stream_close_locked(stream, reset);
+    yamux_session_unlock(session);
+    
+    return result;
+}
+
+/**
+ * Free a stream the application is done with
+ *
+ * @param stream Stream to free
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_free(
+    yamux_stream_t *stream)
+{
+    yamux_session_t *session;
+    
+    /* Validate parameters */
+    if (!stream || !stream->session) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    session = stream->session;
+    yamux_session_lock(session);
+    if (stream->state != YAMUX_STREAM_CLOSED && stream->state != YAMUX_STREAM_FIN_SENT) {
+        (void)yamux_stream_close_locked(stream, 0);
+    }
+    
+    /* Still open on the peer's side: released when it finishes (or times out) */
+    stream->orphaned = 1;
+    if (stream->state == YAMUX_STREAM_CLOSED) {
+        /* A failed session keeps its closed streams in the table */
+        if (yamux_get_stream(session, stream->id) == stream) {
+            yamux_remove_stream(session, stream->id);
+        }
+        yamux_stream_release(stream);
+    }
+    yamux_session_unlock(session);
+    
     return YAMUX_OK;
 }
 
@@ -281,6 +500,7 @@ yamux_result_t yamux_stream_read(
     size_t len, 
     size_t *bytes_read)
 {
+    yamux_session_t *session;
     yamux_result_t result;
     
     /* Validate parameters */
@@ -288,87 +508,264 @@ yamux_result_t yamux_stream_read(
         return YAMUX_ERR_INVALID;
     }
     
+    session = stream->session;
+    yamux_session_lock(session);
+    
     /* Check if stream is closed */
     if (stream->state == YAMUX_STREAM_CLOSED) {
+        yamux_session_unlock(session);
         return YAMUX_ERR_CLOSED;
     }
     
     /* Read data from receive buffer */
     result = yamux_buffer_read(&stream->recvbuf, buf, len, bytes_read);
-    if (result != YAMUX_OK) {
-        return result;
-    }
     
     /* If we read some data, send a window update */
-    if (*bytes_read > 0) {
-        yamux_header_t header_val; // Renamed to avoid conflict with any parameter named 'header'
-        uint8_t frame_buf[YAMUX_HEADER_SIZE + 4]; // Buffer for header + 4-byte payload
-        uint32_t window_increment = YAMUX_DEFAULT_WINDOW_SIZE - stream->recv_window; // Send an increment to fill the window
-        // Ensure increment isn't excessively large if recv_window was somehow corrupted to be > DEFAULT_WINDOW_SIZE
-        // Or, more simply, the increment is what we've made available, up to filling the window.
-        // A common strategy is to send an update for the amount of data just read (*bytes_read),
-        // or an update that brings the window back to full if enough has been processed.
-        // Let's use *bytes_read as the increment for now, as it's specific to data just processed.
-        // However, the original logic was to fill up to YAMUX_DEFAULT_WINDOW_SIZE. Let's stick to that concept.
-        // The amount of data just read is *bytes_read.
-        // The amount to increment to reach the default full window from current is window_increment.
-        // We should send the actual amount by which the window should be incremented.
-        // The current code was trying to send *bytes_read as the increment value.
-
-        if (window_increment == 0 && *bytes_read > 0) { // If window is already full but we read something, use *bytes_read.
-                                                       // This case should be rare if recv_window is managed correctly.
-            window_increment = *bytes_read; 
-        } else if (window_increment < *bytes_read && stream->recv_window + *bytes_read <= YAMUX_DEFAULT_WINDOW_SIZE) {
-            // If calculated increment is less than what we just read, but adding *bytes_read doesn't exceed max,
-            // it might be better to signal the larger availability. But let's stick to *bytes_read for precision of what was freed.
-            // For now, let's use *bytes_read as the increment if it's positive.
-            window_increment = *bytes_read; // This is simpler and reflects space just freed.
-        }
-        if (window_increment == 0) { // Do not send a zero increment update unless it's a SYN/ACK type scenario (not here)
-            // This check can be removed if we ensure *bytes_read is always the increment and positive.
-            // Given *bytes_read must be > 0 for this path (len > 0 for read, and some bytes were read), it's fine.
-            window_increment = *bytes_read; // Ensure we use the amount just read.
+    if (result == YAMUX_OK && *bytes_read > 0) {
+        yamux_window_release(stream, (uint32_t)*bytes_read);
+    }
+    
+    yamux_session_unlock(session);
+    return result;
+}
+
+/*
+ * Wait on a stream for what is left of timeout_ms since start_ms. Without
+ * a clock (timed == 0) every wait gets the whole timeout.
+ */
+static yamux_result_t yamux_stream_wait_left(yamux_stream_t *stream, int conditions,
+                                             uint32_t timeout_ms, int timed, uint64_t start_ms)
+{
+    uint64_t now_ms;
+    uint32_t left = timeout_ms;
+    
+    if (timed) {
+        (void)yamux_session_clock_ms(stream->session, &now_ms);
+        if (now_ms - start_ms >= timeout_ms) {
+            return YAMUX_ERR_TIMEOUT;
         }
+        left = timeout_ms - (uint32_t)(now_ms - start_ms);
+    }
+    
+    return yamux_stream_wait(stream, conditions, left);
+}
 
-        /* Prepare header */
-        header_val.version = YAMUX_PROTO_VERSION;
-        header_val.type = YAMUX_WINDOW_UPDATE;
-        header_val.flags = 0;
-        header_val.stream_id = stream->id;
-        header_val.length = 4; /* Payload length is always 4 for the window increment value */
-        
-        yamux_encode_header(&header_val, frame_buf);
+/**
+ * Read data from a stream, waiting for it to arrive
+ *
+ * @param stream Stream to read from
+ * @param buf Buffer to store data
+ * @param len Maximum number of bytes to read
+ * @param timeout_ms Longest wait in milliseconds (0 = no limit)
+ * @param bytes_read Number of bytes actually read (0 at end of stream)
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_read_timeout(
+    yamux_stream_t *stream,
+    uint8_t *buf,
+    size_t len,
+    uint32_t timeout_ms,
+    size_t *bytes_read)
+{
+    yamux_result_t result;
+    uint64_t start_ms = 0;
+    int timed;
+    int finished;
+    
+    if (!stream || !stream->session || !buf || len == 0 || !bytes_read) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    timed = (timeout_ms > 0) && yamux_session_clock_ms(stream->session, &start_ms);
+    for (;;) {
+        /* Checked before reading: data never follows the FIN */
+        finished = (yamux_stream_get_state(stream) == YAMUX_STREAM_FIN_RECV);
         
-        /* Encode window increment value (big-endian) into the payload part of frame_buf */
-        frame_buf[YAMUX_HEADER_SIZE + 0] = (window_increment >> 24) & 0xFF;
-        frame_buf[YAMUX_HEADER_SIZE + 1] = (window_increment >> 16) & 0xFF;
-        frame_buf[YAMUX_HEADER_SIZE + 2] = (window_increment >> 8) & 0xFF;
-        frame_buf[YAMUX_HEADER_SIZE + 3] = window_increment & 0xFF;
+        *bytes_read = 0;
+        result = yamux_stream_read(stream, buf, len, bytes_read);
+        if (result != YAMUX_OK || *bytes_read > 0 || finished) {
+            return result;
+        }
         
-        /* Send frame (header + payload) */
-        // Ignoring errors for now, as per original code for this specific update.
-        // A production system should handle this write error.
-        stream->session->io.write(stream->session->io.ctx, frame_buf, YAMUX_HEADER_SIZE + 4);
+        result = yamux_stream_wait_left(stream, YAMUX_WAIT_READABLE, timeout_ms, timed, start_ms);
+        if (result != YAMUX_OK) {
+            return result;
+        }
+    }
+}
+
+/**
+ * Peek at buffered data on a stream without copying it
+ *
+ * Returns the contiguous run at the front of the receive buffer. When the
+ * buffered data wraps, consume this run and peek again for the rest.
+ *
+ * @param stream Stream to peek at
+ * @param data Set to the first unread byte (NULL if nothing is buffered)
+ * @param len Set to the number of bytes available at data
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_peek(
+    yamux_stream_t *stream,
+    const uint8_t **data,
+    size_t *len)
+{
+    yamux_iovec_t segs[2];
+    
+    /* Validate parameters */
+    if (!stream || !data || !len) {
+        return YAMUX_ERR_INVALID;
     }
     
-    /* Compact buffer if needed */
-    if (stream->recvbuf.pos > 0 && stream->recvbuf.pos == stream->recvbuf.used) {
-        yamux_buffer_compact(&stream->recvbuf);
+    yamux_session_lock(stream->session);
+    
+    /* Check if stream is closed */
+    if (stream->state == YAMUX_STREAM_CLOSED) {
+        yamux_session_unlock(stream->session);
+        return YAMUX_ERR_CLOSED;
     }
     
+    if (yamux_buffer_peek(&stream->recvbuf, segs) == 0) {
+        *data = NULL;
+        *len = 0;
+    } else {
+        *data = segs[0].base;
+        *len = segs[0].len;
+    }
+    
+    yamux_session_unlock(stream->session);
     return YAMUX_OK;
 }
 
 /**
- * Write data to a stream
+ * Release data previously returned by yamux_stream_peek()
  *
- * @param stream Stream to write to
- * @param buf Buffer containing data to write
- * @param len Number of bytes to write
- * @param bytes_written_out Number of bytes actually written
+ * The consumed bytes are credited back to the peer's send window, as
+ * yamux_stream_read() does for the bytes it copies out.
+ *
+ * @param stream Stream to consume from
+ * @param len Number of bytes to release (at most the buffered amount)
  * @return YAMUX_OK on success, error code otherwise
  */
-yamux_result_t yamux_stream_write(
+yamux_result_t yamux_stream_consume(
+    yamux_stream_t *stream,
+    size_t len)
+{
+    yamux_result_t result = YAMUX_OK;
+    
+    /* Validate parameters */
+    if (!stream) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    yamux_session_lock(stream->session);
+    
+    if (len > stream->recvbuf.used) {
+        result = YAMUX_ERR_INVALID;
+    } else if (stream->state == YAMUX_STREAM_CLOSED) {
+        /* Check if stream is closed */
+        result = YAMUX_ERR_CLOSED;
+    } else if (len > 0) {
+        yamux_buffer_consume(&stream->recvbuf, len);
+        yamux_window_release(stream, (uint32_t)len);
+    }
+    
+    yamux_session_unlock(stream->session);
+    return result;
+}
+
+/**
+ * Complete the read posted on a stream
+ *
+ * bytes_read bytes must already be in the posted buffer; they count as
+ * consumed, so their window credit is recorded before the callback runs.
+ *
+ * @param stream Stream with a posted read
+ * @param bytes_read Number of bytes placed in the posted buffer
+ * @param result Result to report
+ */
+void yamux_stream_complete_read(yamux_stream_t *stream, size_t bytes_read, yamux_result_t result)
+{
+    yamux_read_complete_fn cb = stream->read_cb;
+    uint8_t *buf = stream->read_buf;
+    void *user_data = stream->read_user_data;
+    
+    if (!buf) {
+        return;
+    }
+    
+    /* Clear first so the callback can post the next read */
+    stream->read_buf = NULL;
+    stream->read_len = 0;
+    stream->read_cb = NULL;
+    stream->read_user_data = NULL;
+    
+    if (bytes_read > 0) {
+        yamux_window_release(stream, (uint32_t)bytes_read);
+    }
+    
+    cb(stream, buf, bytes_read, result, user_data);
+}
+
+/**
+ * Post a buffer for the next data to arrive on a stream
+ *
+ * @param stream Stream to read from
+ * @param buf Buffer to receive data
+ * @param len Size of buf
+ * @param cb Completion callback
+ * @param user_data Passed through to cb
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_post_read(
+    yamux_stream_t *stream,
+    uint8_t *buf,
+    size_t len,
+    yamux_read_complete_fn cb,
+    void *user_data)
+{
+    yamux_session_t *session;
+    size_t bytes_read = 0;
+    
+    /* Validate parameters */
+    if (!stream || !buf || len == 0 || !cb) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    session = stream->session;
+    yamux_session_lock(session);
+    
+    /* One read may be posted at a time */
+    if (stream->read_buf) {
+        yamux_session_unlock(session);
+        return YAMUX_ERR_INVALID;
+    }
+    
+    /* Check if stream is closed */
+    if (stream->state == YAMUX_STREAM_CLOSED) {
+        yamux_session_unlock(session);
+        return YAMUX_ERR_CLOSED;
+    }
+    
+    stream->read_buf = buf;
+    stream->read_len = len;
+    stream->read_cb = cb;
+    stream->read_user_data = user_data;
+    
+    /* Data already buffered, or end of stream: complete now */
+    if (stream->recvbuf.used > 0) {
+        (void)yamux_buffer_read(&stream->recvbuf, buf, len, &bytes_read);
+        yamux_stream_complete_read(stream, bytes_read, YAMUX_OK);
+    } else if (stream->state == YAMUX_STREAM_FIN_RECV) {
+        yamux_stream_complete_read(stream, 0, YAMUX_OK);
+    }
+    
+    yamux_session_unlock(session);
+    return YAMUX_OK;
+}
+
+/* Write data to a stream, with the session lock held */
+static yamux_result_t yamux_stream_write_locked(
     yamux_stream_t *stream, 
     const uint8_t *buf, 
     size_t len,
@@ -376,81 +773,87 @@ yamux_result_t yamux_stream_write(
 {
     yamux_session_t *session;
     yamux_header_t header;
-    uint8_t frame_header[YAMUX_HEADER_SIZE]; 
     size_t total_written = 0;
 
-    printf("DEBUG: yamux_stream_write: Entered. stream=%p, buf=%p, len=%zu\n", (void*)stream, (const void*)buf, len); fflush(stdout);
+    YAMUX_LOG_DEBUG("yamux_stream_write: Entered. stream=%p, buf=%p, len=%zu", (void*)stream, (const void*)buf, len);
     
     if (!bytes_written_out) {
-        printf("DEBUG: yamux_stream_write: Error - bytes_written_out is NULL\n"); fflush(stdout);
+        YAMUX_LOG_DEBUG("yamux_stream_write: bytes_written_out is NULL");
         return YAMUX_ERR_INVALID; // Critical to have this out-param pointer
     }
     *bytes_written_out = 0; // Initialize
 
     /* Validate parameters */
     if (!stream) {
-        printf("DEBUG: yamux_stream_write: Error - stream is NULL\n"); fflush(stdout);
+        YAMUX_LOG_DEBUG("yamux_stream_write: stream is NULL");
         return YAMUX_ERR_INVALID;
     }
     if (!buf && len > 0) { // Allow buf to be NULL if len is 0 (for FIN frames, though this func is for data)
-        printf("DEBUG: yamux_stream_write: Error - buf is NULL but len > 0\n"); fflush(stdout);
+        YAMUX_LOG_DEBUG("yamux_stream_write: buf is NULL but len > 0");
         return YAMUX_ERR_INVALID;
     }
     
     /* Get session */
     session = stream->session;
     if (!session) {
-        printf("DEBUG: yamux_stream_write: Error - session is NULL\n"); fflush(stdout);
+        YAMUX_LOG_DEBUG("yamux_stream_write: session is NULL");
         return YAMUX_ERR_INVALID;
     }
-    printf("DEBUG: yamux_stream_write: session=%p, stream_id=%u, stream_state=%d\n", (void*)session, stream->id, stream->state); fflush(stdout);
+    YAMUX_LOG_DEBUG("yamux_stream_write: session=%p, stream_id=%u, stream_state=%d", (void*)session, stream->id, stream->state);
     
     /* Check stream state */
     if (stream->state == YAMUX_STREAM_CLOSED || 
         stream->state == YAMUX_STREAM_FIN_SENT || 
         stream->state == YAMUX_STREAM_FIN_RECV) {
-        printf("DEBUG: yamux_stream_write: Error - stream closed or closing. State: %d\n", stream->state); fflush(stdout);
+        YAMUX_LOG_DEBUG("yamux_stream_write: stream closed or closing. State: %d", stream->state);
         return YAMUX_ERR_CLOSED; // Corrected error code
     }
 
     // If len is 0, it might be an intention to send a FIN or other control frame, but this function sends DATA frames.
     // For now, if len is 0, we'll just return OK with 0 bytes written.
     if (len == 0) {
-        printf("DEBUG: yamux_stream_write: len is 0, returning OK with 0 bytes written.\n"); fflush(stdout);
+        YAMUX_LOG_DEBUG("yamux_stream_write: len is 0, returning OK with 0 bytes written.");
         return YAMUX_OK;
     }
     
-    /* TODO: Handle send window properly with blocking/waiting */
-    printf("DEBUG: yamux_stream_write: Current send_window for stream %u: %u\n", stream->id, stream->send_window); fflush(stdout);
+    /* Out of credit is a short write here; yamux_stream_write_timeout() waits for it */
+    YAMUX_LOG_DEBUG("yamux_stream_write: Current send_window for stream %u: %u", stream->id, stream->send_window);
     if (stream->send_window == 0) {
-        printf("DEBUG: yamux_stream_write: send_window is 0 for stream %u. Returning YAMUX_ERR_WOULD_BLOCK (simulated).\n", stream->id); fflush(stdout);
+        YAMUX_LOG_DEBUG("yamux_stream_write: send_window is 0 for stream %u. Returning YAMUX_ERR_WOULD_BLOCK (simulated).", stream->id);
+        yamux_stats_stall_begin(stream);
         return YAMUX_ERR_WOULD_BLOCK; // Simulate blocking if window is zero
     }
 
     size_t len_to_write = len;
     if (len > stream->send_window) {
-        printf("WARNING: yamux_stream_write: Attempting to write %zu bytes but send_window is only %u for stream %u. Will write only %u bytes.\n", len, stream->send_window, stream->id, stream->send_window); fflush(stdout);
+        YAMUX_LOG_DEBUG("yamux_stream_write: Attempting to write %zu bytes but send_window is only %u for stream %u. Will write only %u bytes.", len, stream->send_window, stream->id, stream->send_window);
         len_to_write = stream->send_window; // Only write up to current window allows
     }
     
+    /* With the egress scheduler the data waits its turn on the stream */
+    if (yamux_sched_enabled(session)) {
+        return yamux_sched_write(stream, buf, len_to_write, bytes_written_out);
+    }
+    
     /* Send data in chunks */
     while (total_written < len_to_write) {
         size_t chunk_size = len_to_write - total_written;
-        if (chunk_size > YAMUX_MAX_DATA_FRAME_SIZE) {
-            chunk_size = YAMUX_MAX_DATA_FRAME_SIZE;
+        if (chunk_size > yamux_stream_frame_limit(stream)) {
+            chunk_size = yamux_stream_frame_limit(stream);
         }
-        // Ensure chunk_size doesn't exceed remaining send_window (after previous chunks in this call)
-        // This is a more granular check within the loop, though the initial len_to_write already capped it.
-        if (chunk_size > (stream->send_window - total_written) && (stream->send_window - total_written) < YAMUX_MAX_DATA_FRAME_SIZE) {
-             chunk_size = stream->send_window - total_written;
+        // Ensure chunk_size doesn't exceed the remaining send_window. It is re-read for every
+        // chunk: in a thread-safe session another writer may have used credit while a flush
+        // had the lock released.
+        if (chunk_size > stream->send_window) {
+             chunk_size = stream->send_window;
         }
 
         if (chunk_size == 0) { // Should not happen if len_to_write > 0 and send_window > 0 initially
-            printf("DEBUG: yamux_stream_write: chunk_size is 0, breaking loop. total_written=%zu\n", total_written); fflush(stdout);
+            YAMUX_LOG_DEBUG("yamux_stream_write: chunk_size is 0, breaking loop. total_written=%zu", total_written);
             break; 
         }
 
-        printf("DEBUG: yamux_stream_write: Loop iter: total_written=%zu, chunk_size=%zu to send\n", total_written, chunk_size); fflush(stdout);
+        YAMUX_LOG_DEBUG("yamux_stream_write: Loop iter: total_written=%zu, chunk_size=%zu to send", total_written, chunk_size);
         
         /* Prepare header */
         memset(&header, 0, sizeof(header));
@@ -460,29 +863,16 @@ yamux_result_t yamux_stream_write(
         header.stream_id = stream->id;
         header.length = chunk_size;
         
-        /* Encode header */
-        yamux_encode_header(&header, frame_header);
-        
-        /* Send header */
-        printf("DEBUG: yamux_stream_write: Writing header (%zu bytes) for stream %u\n", (size_t)YAMUX_HEADER_SIZE, stream->id); fflush(stdout);
-        ssize_t header_write_res = session->io.write(session->io.ctx, frame_header, YAMUX_HEADER_SIZE);
-        printf("DEBUG: yamux_stream_write: Header write result: %zd\n", header_write_res); fflush(stdout);
-        if (header_write_res < 0 || (size_t)header_write_res != YAMUX_HEADER_SIZE) {
-            printf("ERROR: yamux_stream_write: Failed to write header. Expected %d, got %zd\n", YAMUX_HEADER_SIZE, header_write_res); fflush(stdout);
+        /* Send header and data chunk */
+        YAMUX_LOG_DEBUG("yamux_stream_write: Writing frame (%zu byte payload) for stream %u", chunk_size, stream->id);
+        yamux_result_t send_result = yamux_session_send_frame(session, &header, buf + total_written, chunk_size);
+        if (send_result != YAMUX_OK) {
+            YAMUX_LOG_DEBUG("yamux_stream_write: Failed to write frame for stream %u (%d)", stream->id, send_result);
             *bytes_written_out = total_written; // Report what was written before failure
-            return YAMUX_ERR_IO;
-        }
-        
-        /* Send data chunk */
-        printf("DEBUG: yamux_stream_write: Writing data chunk (%zu bytes) for stream %u\n", chunk_size, stream->id); fflush(stdout);
-        ssize_t chunk_write_res = session->io.write(session->io.ctx, buf + total_written, chunk_size);
-        printf("DEBUG: yamux_stream_write: Chunk write result: %zd\n", chunk_write_res); fflush(stdout);
-        if (chunk_write_res < 0 || (size_t)chunk_write_res != chunk_size) {
-            printf("ERROR: yamux_stream_write: Failed to write chunk. Expected %zu, got %zd\n", chunk_size, chunk_write_res); fflush(stdout);
-            *bytes_written_out = total_written; // Report what was written before failure
-            // If some part of the chunk was written (chunk_write_res > 0), update total_written and stream->send_window
-            if (chunk_write_res > 0) total_written += chunk_write_res;
-            // stream->send_window -= total_written; // Decrement send_window by actual bytes SENT (header + data body)
+            // A full egress queue is a short write, not an error, once something went out
+            if (send_result == YAMUX_ERR_WOULD_BLOCK) {
+                return (total_written > 0) ? YAMUX_OK : YAMUX_ERR_WOULD_BLOCK;
+            }
             return YAMUX_ERR_IO;
         }
         
@@ -495,10 +885,416 @@ yamux_result_t yamux_stream_write(
                                          // A more correct model is that stream->send_window is the peer's window size for us.
                                          // We decrement it as we send. It gets incremented by WINDOW_UPDATE from peer.
         stream->send_window -= chunk_size; // Simplified send window decrement.
+        yamux_stats_data_out(stream, chunk_size);
+        if (stream->send_window == 0) {
+            yamux_stats_stall_begin(stream);
+        }
 
     }
     
     *bytes_written_out = total_written;
-    printf("DEBUG: yamux_stream_write: Exiting successfully. total_written=%zu, remaining send_window=%u\n", total_written, stream->send_window); fflush(stdout);
+    YAMUX_LOG_DEBUG("yamux_stream_write: Exiting successfully. total_written=%zu, remaining send_window=%u", total_written, stream->send_window);
+    return YAMUX_OK;
+}
+
+/**
+ * Write data to a stream
+ *
+ * @param stream Stream to write to
+ * @param buf Buffer containing data to write
+ * @param len Number of bytes to write
+ * @param bytes_written_out Number of bytes actually written
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_write(
+    yamux_stream_t *stream, 
+    const uint8_t *buf, 
+    size_t len,
+    size_t *bytes_written_out)
+{
+    yamux_session_t *session;
+    yamux_result_t result;
+    
+    if (!stream || !stream->session) {
+        if (bytes_written_out) {
+            *bytes_written_out = 0;
+        }
+        return YAMUX_ERR_INVALID;
+    }
+    
+    session = stream->session;
+    yamux_session_lock(session);
+    result = yamux_stream_write_locked(stream, buf, len, bytes_written_out);
+    if (result == YAMUX_ERR_WOULD_BLOCK) {
+        YAMUX_STAT(stream->stats.would_block++);
+        YAMUX_STAT(session->stats.would_block++);
+    }
+    yamux_session_unlock(session);
+    
+    return result;
+}
+
+/* Gather-write segments to a stream, with the session lock held */
+static yamux_result_t yamux_stream_writev_locked(
+    yamux_stream_t *stream,
+    const yamux_iovec_t *iov,
+    int iovcnt,
+    size_t *bytes_written_out)
+{
+    yamux_session_t *session = stream->session;
+    yamux_iovec_t frame_iov[YAMUX_MAX_FRAME_SEGMENTS];
+    yamux_header_t header;
+    yamux_result_t result;
+    size_t total = 0;
+    size_t len_to_write;
+    size_t total_written = 0;
+    size_t offset = 0;      /* Bytes of iov[seg] already sent */
+    size_t written;
+    int seg = 0;
+    int i;
+    
+    for (i = 0; i < iovcnt; i++) {
+        if ((iov[i].len > 0 && !iov[i].base) || total + iov[i].len < total) {
+            return YAMUX_ERR_INVALID;
+        }
+        total += iov[i].len;
+    }
+    
+    if (stream->state == YAMUX_STREAM_CLOSED ||
+        stream->state == YAMUX_STREAM_FIN_SENT ||
+        stream->state == YAMUX_STREAM_FIN_RECV) {
+        return YAMUX_ERR_CLOSED;
+    }
+    if (total == 0) {
+        return YAMUX_OK;
+    }
+    
+    /* Out of credit is a short write, as for yamux_stream_write() */
+    if (stream->send_window == 0) {
+        yamux_stats_stall_begin(stream);
+        return YAMUX_ERR_WOULD_BLOCK;
+    }
+    len_to_write = (total < stream->send_window) ? total : stream->send_window;
+    
+    /* With the egress scheduler the segments are queued on the stream in turn */
+    if (yamux_sched_enabled(session)) {
+        for (i = 0; i < iovcnt && total_written < len_to_write; i++) {
+            size_t n = iov[i].len;
+            
+            if (n > len_to_write - total_written) {
+                n = len_to_write - total_written;
+            }
+            if (n == 0) {
+                continue;
+            }
+            result = yamux_sched_write(stream, iov[i].base, n, &written);
+            total_written += written;
+            if (result != YAMUX_OK || written < n) {
+                *bytes_written_out = total_written;
+                if (result == YAMUX_ERR_WOULD_BLOCK || result == YAMUX_OK) {
+                    return (total_written > 0) ? YAMUX_OK : YAMUX_ERR_WOULD_BLOCK;
+                }
+                return result;
+            }
+        }
+        *bytes_written_out = total_written;
+        return YAMUX_OK;
+    }
+    
+    /* Each frame takes as many segments, or parts of them, as fit */
+    while (total_written < len_to_write) {
+        size_t chunk_size = len_to_write - total_written;
+        size_t packed = 0;
+        int count = 0;
+        
+        if (chunk_size > yamux_stream_frame_limit(stream)) {
+            chunk_size = yamux_stream_frame_limit(stream);
+        }
+        /* Re-read per frame: another thread may have used credit during a flush */
+        if (chunk_size > stream->send_window) {
+            chunk_size = stream->send_window;
+        }
+        if (chunk_size == 0) {
+            break;
+        }
+        
+        while (packed < chunk_size && count < YAMUX_MAX_FRAME_SEGMENTS) {
+            size_t n = iov[seg].len - offset;
+            
+            if (n == 0) {
+                seg++;
+                offset = 0;
+                continue;
+            }
+            if (n > chunk_size - packed) {
+                n = chunk_size - packed;
+            }
+            frame_iov[count].base = iov[seg].base + offset;
+            frame_iov[count].len = n;
+            count++;
+            packed += n;
+            offset += n;
+            if (offset == iov[seg].len) {
+                seg++;
+                offset = 0;
+            }
+        }
+        
+        memset(&header, 0, sizeof(header));
+        header.version = YAMUX_PROTO_VERSION;
+        header.type = YAMUX_DATA;
+        header.stream_id = stream->id;
+        header.length = (uint32_t)packed;
+        
+        result = yamux_session_send_framev(session, &header, frame_iov, count);
+        if (result != YAMUX_OK) {
+            *bytes_written_out = total_written;
+            if (result == YAMUX_ERR_WOULD_BLOCK) {
+                return (total_written > 0) ? YAMUX_OK : YAMUX_ERR_WOULD_BLOCK;
+            }
+            return YAMUX_ERR_IO;
+        }
+        
+        total_written += packed;
+        stream->send_window -= (uint32_t)packed;
+        yamux_stats_data_out(stream, packed);
+        if (stream->send_window == 0) {
+            yamux_stats_stall_begin(stream);
+        }
+    }
+    
+    *bytes_written_out = total_written;
+    return YAMUX_OK;
+}
+
+/**
+ * Write several buffers to a stream as one
+ *
+ * The segments are packed into as few DATA frames as the frame size and
+ * send window allow, each frame taking up to YAMUX_MAX_FRAME_SEGMENTS of
+ * them. A frame written directly goes to io.writev with the segments as
+ * they are; nothing is copied unless the frame has to be queued.
+ *
+ * @param stream Stream to write to
+ * @param iov Segments to write, in order
+ * @param iovcnt Number of segments
+ * @param bytes_written_out Number of bytes actually written
+ * @return As yamux_stream_write()
+ */
+yamux_result_t yamux_stream_writev(
+    yamux_stream_t *stream,
+    const yamux_iovec_t *iov,
+    int iovcnt,
+    size_t *bytes_written_out)
+{
+    yamux_session_t *session;
+    yamux_result_t result;
+    
+    if (!bytes_written_out) {
+        return YAMUX_ERR_INVALID;
+    }
+    *bytes_written_out = 0;
+    if (!stream || !stream->session || iovcnt < 0 || (iovcnt > 0 && !iov)) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    session = stream->session;
+    yamux_session_lock(session);
+    result = yamux_stream_writev_locked(stream, iov, iovcnt, bytes_written_out);
+    if (result == YAMUX_ERR_WOULD_BLOCK) {
+        YAMUX_STAT(stream->stats.would_block++);
+        YAMUX_STAT(session->stats.would_block++);
+    }
+    yamux_session_unlock(session);
+    
+    return result;
+}
+
+/* Write part of a file to a stream, with the session lock held */
+static yamux_result_t yamux_stream_sendfile_locked(
+    yamux_stream_t *stream,
+    int fd,
+    uint64_t offset,
+    size_t len,
+    size_t *bytes_written_out)
+{
+    yamux_session_t *session = stream->session;
+    yamux_header_t header;
+    yamux_result_t result;
+    size_t total_written = 0;
+    size_t chunk_size;
+    
+    if (stream->state == YAMUX_STREAM_CLOSED ||
+        stream->state == YAMUX_STREAM_FIN_SENT ||
+        stream->state == YAMUX_STREAM_FIN_RECV) {
+        return YAMUX_ERR_CLOSED;
+    }
+    if (len == 0) {
+        return YAMUX_OK;
+    }
+    if (stream->send_window == 0) {
+        yamux_stats_stall_begin(stream);
+        return YAMUX_ERR_WOULD_BLOCK;
+    }
+    
+    while (total_written < len) {
+        /* The frame's payload cannot be queued: everything before it goes first */
+        while (yamux_session_queued(session)) {
+            result = yamux_session_flush_locked(session);
+            if (result == YAMUX_ERR_IO) {
+                *bytes_written_out = total_written;
+                return result;
+            }
+            if (!yamux_session_queued(session)) {
+                break;
+            }
+            if (!session->flushing || !yamux_session_wait_flushed(session)) {
+                *bytes_written_out = total_written;
+                return (total_written > 0) ? YAMUX_OK : YAMUX_ERR_WOULD_BLOCK;
+            }
+        }
+        
+        /* Re-read per frame: a flush may have let other threads use credit or close */
+        if (stream->state == YAMUX_STREAM_CLOSED ||
+            stream->state == YAMUX_STREAM_FIN_SENT ||
+            stream->state == YAMUX_STREAM_FIN_RECV) {
+            break;
+        }
+        chunk_size = len - total_written;
+        if (chunk_size > yamux_stream_frame_limit(stream)) {
+            chunk_size = yamux_stream_frame_limit(stream);
+        }
+        if (chunk_size > stream->send_window) {
+            chunk_size = stream->send_window;
+        }
+        if (chunk_size == 0) {
+            break;
+        }
+        
+        memset(&header, 0, sizeof(header));
+        header.version = YAMUX_PROTO_VERSION;
+        header.type = YAMUX_DATA;
+        header.stream_id = stream->id;
+        header.length = (uint32_t)chunk_size;
+        
+        /* Committed: the flush finishes the frame, now or later */
+        yamux_encode_header(&header, session->file_header);
+        session->file_header_left = YAMUX_HEADER_SIZE;
+        session->file_fd = fd;
+        session->file_offset = offset + total_written;
+        session->file_left = chunk_size;
+        yamux_stats_frame_out(session, &header);
+        
+        total_written += chunk_size;
+        stream->send_window -= (uint32_t)chunk_size;
+        yamux_stats_data_out(stream, chunk_size);
+        if (stream->send_window == 0) {
+            yamux_stats_stall_begin(stream);
+        }
+        
+        result = yamux_session_flush_locked(session);
+        if (result == YAMUX_ERR_IO) {
+            *bytes_written_out = total_written;
+            return result;
+        }
+    }
+    
+    *bytes_written_out = total_written;
+    return YAMUX_OK;
+}
+
+/**
+ * Write part of a file to a stream without copying it
+ *
+ * @param stream Stream to write to
+ * @param fd File to read from
+ * @param offset Offset in the file of the first byte to write
+ * @param len Number of bytes to write
+ * @param bytes_written_out Number of bytes actually written
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_sendfile(
+    yamux_stream_t *stream,
+    int fd,
+    uint64_t offset,
+    size_t len,
+    size_t *bytes_written_out)
+{
+    yamux_session_t *session;
+    yamux_result_t result;
+    
+    if (!bytes_written_out) {
+        return YAMUX_ERR_INVALID;
+    }
+    *bytes_written_out = 0;
+    if (!stream || !stream->session || !stream->session->io.sendfile || fd < 0) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    session = stream->session;
+    yamux_session_lock(session);
+    result = yamux_stream_sendfile_locked(stream, fd, offset, len, bytes_written_out);
+    if (result == YAMUX_ERR_WOULD_BLOCK) {
+        YAMUX_STAT(stream->stats.would_block++);
+        YAMUX_STAT(session->stats.would_block++);
+    }
+    yamux_session_unlock(session);
+    
+    return result;
+}
+
+/**
+ * Write all data to a stream, waiting for send window and queue space
+ *
+ * @param stream Stream to write to
+ * @param buf Buffer containing data to write
+ * @param len Number of bytes to write
+ * @param timeout_ms Longest time to take (0 = connection_write_timeout)
+ * @param bytes_written Number of bytes written
+ * @return YAMUX_OK once everything is written, error code otherwise
+ */
+yamux_result_t yamux_stream_write_timeout(
+    yamux_stream_t *stream,
+    const uint8_t *buf,
+    size_t len,
+    uint32_t timeout_ms,
+    size_t *bytes_written)
+{
+    yamux_result_t result;
+    uint64_t start_ms = 0;
+    size_t written;
+    int timed;
+    
+    if (!bytes_written) {
+        return YAMUX_ERR_INVALID;
+    }
+    *bytes_written = 0;
+    if (!stream || !stream->session || (!buf && len > 0)) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    if (timeout_ms == 0) {
+        timeout_ms = stream->session->config.connection_write_timeout;
+    }
+    timed = (timeout_ms > 0) && yamux_session_clock_ms(stream->session, &start_ms);
+    
+    while (*bytes_written < len) {
+        written = 0;
+        result = yamux_stream_write(stream, buf + *bytes_written, len - *bytes_written, &written);
+        *bytes_written += written;
+        if (result != YAMUX_OK && result != YAMUX_ERR_WOULD_BLOCK) {
+            return result;
+        }
+        if (*bytes_written == len) {
+            break;
+        }
+        
+        /* Out of window or queue space: sleep until a WINDOW_UPDATE or a flush */
+        result = yamux_stream_wait_left(stream, YAMUX_WAIT_WRITABLE, timeout_ms, timed, start_ms);
+        if (result != YAMUX_OK) {
+            return result;
+        }
+    }
+    
     return YAMUX_OK;
 }
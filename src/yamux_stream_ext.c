@@ -13,11 +13,17 @@
  * @return The current send window size
  */
 uint32_t yamux_stream_get_send_window(yamux_stream_t *stream) {
+    uint32_t window;
+    
     if (!stream) {
         return 0;
     }
     
-    return stream->send_window;
+    yamux_session_lock(stream->session);
+    window = stream->send_window;
+    yamux_session_unlock(stream->session);
+    
+    return window;
 }
 
 /**
@@ -27,11 +33,17 @@ uint32_t yamux_stream_get_send_window(yamux_stream_t *stream) {
  * @return The current stream state
  */
 yamux_stream_state_t yamux_stream_get_state(yamux_stream_t *stream) {
+    yamux_stream_state_t state;
+    
     if (!stream) {
         return YAMUX_STREAM_CLOSED;
     }
     
-    return stream->state;
+    yamux_session_lock(stream->session);
+    state = stream->state;
+    yamux_session_unlock(stream->session);
+    
+    return state;
 }
 
 /**
@@ -46,7 +58,59 @@ yamux_result_t yamux_stream_update_window(yamux_stream_t *stream, uint32_t incre
         return YAMUX_ERR_INVALID;
     }
     
+    yamux_session_lock(stream->session);
     stream->send_window += increment;
+    if (stream->send_window > 0) {
+        yamux_stats_stall_end(stream);
+    }
+    yamux_session_notify(stream->session);
+    yamux_session_unlock(stream->session);
+    
+    return YAMUX_OK;
+}
+
+/**
+ * Get the largest DATA payload a stream sends per frame, with the session lock held
+ *
+ * @param stream Stream
+ * @return The stream's override, or the session's config.max_frame_size
+ */
+#if !YAMUX_FIXED_FRAME_SIZE
+uint32_t yamux_stream_frame_limit(const yamux_stream_t *stream) {
+    return stream->max_frame_size ? stream->max_frame_size : stream->session->config.max_frame_size;
+}
+#endif
+
+/**
+ * Set the largest DATA payload a stream sends in one frame
+ *
+ * @param stream Stream
+ * @param max_frame_size Payload limit in bytes (0 = the session's)
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_set_max_frame_size(yamux_stream_t *stream, uint32_t max_frame_size) {
+    yamux_session_t *session;
+    
+    if (!stream || !stream->session) {
+        return YAMUX_ERR_INVALID;
+    }
+    session = stream->session;
+    
+    /* A short write queues the rest of the frame, so a frame must fit the egress queue */
+    if ((size_t)max_frame_size + YAMUX_HEADER_SIZE > session->send_buf_size) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+#if YAMUX_FIXED_FRAME_SIZE
+    /* Every frame's limit is the compiled-in size */
+    if (max_frame_size != 0 && max_frame_size != YAMUX_MAX_DATA_FRAME_SIZE) {
+        return YAMUX_ERR_INVALID;
+    }
+#else
+    yamux_session_lock(session);
+    stream->max_frame_size = max_frame_size;
+    yamux_session_unlock(session);
+#endif
     
     return YAMUX_OK;
 }
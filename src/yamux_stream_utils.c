@@ -6,9 +6,9 @@
 #include "../include/yamux.h"
 #include "yamux_internal.h"
 #include "yamux_defs.h"
+#include "yamux_log.h"
 #include <stdlib.h>
 #include <string.h>
-#include <stdio.h>
 
 /**
  * Get the stream ID
@@ -26,6 +26,110 @@ uint32_t yamux_stream_get_id(
     return stream->id;
 }
 
+/**
+ * Compute the home bucket of a stream ID
+ *
+ * Stream IDs are allocated sequentially with a stride of two, so a
+ * multiplicative (Fibonacci) hash spreads both parities evenly.
+ *
+ * @param table Stream table
+ * @param stream_id Stream ID
+ * @return Bucket index
+ */
+static uint32_t yamux_stream_table_bucket(
+    const yamux_stream_table_t *table, 
+    uint32_t stream_id)
+{
+    return (uint32_t)(stream_id * 2654435769u) >> table->shift;
+}
+
+/**
+ * Initialize a stream table
+ *
+ * @param table Table to initialize
+ * @param capacity Initial number of buckets (rounded up to a power of two)
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_stream_table_init(
+    yamux_stream_table_t *table, 
+    uint32_t capacity)
+{
+    uint32_t bits = 1;
+    
+    if (!table || capacity == 0) {
+        return YAMUX_ERR_INVALID;
+    }
+    
+    /* Round capacity up to a power of two */
+    while ((1u << bits) < capacity) {
+        bits++;
+    }
+    
+    table->slots = (yamux_stream_t **)YAMUX_MALLOC((1u << bits) * sizeof(yamux_stream_t *));
+    if (!table->slots) {
+        return YAMUX_ERR_NOMEM;
+    }
+    memset(table->slots, 0, (1u << bits) * sizeof(yamux_stream_t *));
+    
+    table->capacity = 1u << bits;
+    table->shift = 32 - bits;
+    table->count = 0;
+    
+    return YAMUX_OK;
+}
+
+/**
+ * Free a stream table (the streams themselves are not freed)
+ *
+ * @param table Table to free
+ */
+void yamux_stream_table_free(yamux_stream_table_t *table)
+{
+    if (table) {
+        YAMUX_FREE(table->slots);
+        table->slots = NULL;
+        table->capacity = 0;
+        table->shift = 0;
+        table->count = 0;
+    }
+}
+
+/**
+ * Double the number of buckets and rehash all streams
+ *
+ * @param table Table to grow
+ * @return YAMUX_OK on success, error code otherwise
+ */
+static yamux_result_t yamux_stream_table_grow(yamux_stream_table_t *table)
+{
+    yamux_stream_table_t grown;
+    uint32_t i, mask, b;
+    yamux_result_t result;
+    
+    result = yamux_stream_table_init(&grown, table->capacity * 2);
+    if (result != YAMUX_OK) {
+        return result;
+    }
+    
+    /* Reinsert every live stream into the new bucket array */
+    mask = grown.capacity - 1;
+    for (i = 0; i < table->capacity; i++) {
+        if (table->slots[i]) {
+            b = yamux_stream_table_bucket(&grown, table->slots[i]->id);
+            while (grown.slots[b]) {
+                b = (b + 1) & mask;
+            }
+            grown.slots[b] = table->slots[i];
+        }
+    }
+    grown.count = table->count;
+    
+    YAMUX_FREE(table->slots);
+    *table = grown;
+    
+    return YAMUX_OK;
+}
+
 /**
  * Find a stream by ID
  *
@@ -37,16 +141,20 @@ yamux_stream_t *yamux_get_stream(
     yamux_session_t *session, 
     uint32_t stream_id)
 {
-    size_t i;
+    const yamux_stream_table_t *table;
+    uint32_t b, mask;
     
-    if (!session) {
+    if (!session || !session->streams.slots) {
         return NULL;
     }
     
-    /* Search for stream */
-    for (i = 0; i < session->stream_count; i++) {
-        if (session->streams[i] && session->streams[i]->id == stream_id) {
-            return session->streams[i];
+    table = &session->streams;
+    mask = table->capacity - 1;
+    
+    /* Probe linearly from the home bucket until an empty bucket is hit */
+    for (b = yamux_stream_table_bucket(table, stream_id); table->slots[b]; b = (b + 1) & mask) {
+        if (table->slots[b]->id == stream_id) {
+            return table->slots[b];
         }
     }
     
@@ -64,11 +172,11 @@ yamux_result_t yamux_add_stream(
     yamux_session_t *session, 
     yamux_stream_t *stream)
 {
-    yamux_stream_t **new_streams;
-    size_t new_capacity;
-    size_t i;
+    yamux_stream_table_t *table;
+    uint32_t b, mask;
+    yamux_result_t result;
     
-    if (!session || !stream) {
+    if (!session || !stream || !session->streams.slots) {
         return YAMUX_ERR_INVALID;
     }
     
@@ -77,45 +185,31 @@ yamux_result_t yamux_add_stream(
         return YAMUX_ERR_CLOSED;
     }
     
-    /* Check if stream already exists */
-    if (yamux_get_stream(session, stream->id)) {
-        return YAMUX_ERR_INVALID;
+    table = &session->streams;
+    
+    /* Enforce the per-session stream limit */
+    if (table->count >= YAMUX_MAX_STREAMS) {
+        return YAMUX_ERR_NOMEM;
     }
     
-    /* Find an empty slot */
-    for (i = 0; i < session->stream_count; i++) {
-        if (!session->streams[i]) {
-            session->streams[i] = stream;
-            return YAMUX_OK;
+    /* Keep the load factor at or below 3/4 so probe sequences stay short */
+    if ((table->count + 1) * 4 > table->capacity * 3) {
+        result = yamux_stream_table_grow(table);
+        if (result != YAMUX_OK) {
+            return result;
         }
     }
     
-    /* Check if we need to resize the streams array */
-    if (session->stream_count >= session->stream_capacity) {
-        /* Double the capacity */
-        new_capacity = session->stream_capacity * 2;
-        new_streams = (yamux_stream_t **)realloc(
-            session->streams, 
-            new_capacity * sizeof(yamux_stream_t *)
-        );
-        
-        if (!new_streams) {
-            return YAMUX_ERR_NOMEM;
+    /* Find the stream's bucket, rejecting duplicates on the way */
+    mask = table->capacity - 1;
+    for (b = yamux_stream_table_bucket(table, stream->id); table->slots[b]; b = (b + 1) & mask) {
+        if (table->slots[b]->id == stream->id) {
+            return YAMUX_ERR_INVALID;
         }
-        
-        /* Initialize new slots */
-        for (i = session->stream_capacity; i < new_capacity; i++) {
-            new_streams[i] = NULL;
-        }
-        
-        /* Update session */
-        session->streams = new_streams;
-        session->stream_capacity = new_capacity;
     }
     
-    /* Add stream to the first empty slot */
-    session->streams[session->stream_count] = stream;
-    session->stream_count++;
+    table->slots[b] = stream;
+    table->count++;
     
     return YAMUX_OK;
 }
@@ -123,6 +217,9 @@ yamux_result_t yamux_add_stream(
 /**
  * Remove a stream from a session
  *
+ * Uses backward-shift deletion, so the table never accumulates tombstones
+ * and lookups never have to skip over holes left by closed streams.
+ *
  * @param session Session
  * @param stream_id Stream ID to remove
  * @return YAMUX_OK on success, error code otherwise
@@ -131,60 +228,43 @@ yamux_result_t yamux_remove_stream(
     yamux_session_t *session, 
     uint32_t stream_id)
 {
-    size_t i;
+    yamux_stream_table_t *table;
+    uint32_t hole, next, home, mask;
     
-    if (!session) {
+    if (!session || !session->streams.slots) {
         return YAMUX_ERR_INVALID;
     }
     
-    /* Search for stream */
-    for (i = 0; i < session->stream_count; i++) {
-        if (session->streams[i] && session->streams[i]->id == stream_id) {
-            /* Remove stream */
-            session->streams[i] = NULL;
-            
-            /* If it's the last stream, update stream count */
-            if (i == session->stream_count - 1) {
-                session->stream_count--;
-            }
-            
-            return YAMUX_OK;
+    table = &session->streams;
+    mask = table->capacity - 1;
+    
+    /* Locate the stream */
+    for (hole = yamux_stream_table_bucket(table, stream_id); table->slots[hole]; hole = (hole + 1) & mask) {
+        if (table->slots[hole]->id == stream_id) {
+            break;
         }
     }
-    
-    return YAMUX_ERR_INVALID;
-}
-
-/**
- * Add a stream to the accept queue
- *
- * @param session Session
- * @param stream Stream to add
- * @return YAMUX_OK on success, error code otherwise
- */
-yamux_result_t yamux_enqueue_stream(
-    yamux_session_t *session, 
-    yamux_stream_t *stream)
-{
-    if (!session || !stream) {
+    if (!table->slots[hole]) {
         return YAMUX_ERR_INVALID;
     }
     
-    /* Check if session is shut down */
-    if (session->go_away_received) {
-        return YAMUX_ERR_CLOSED;
-    }
+    /* Its memory no longer counts against the session's budget, nor its timeout */
+    yamux_window_detach(table->slots[hole]);
+    yamux_timer_cancel(&table->slots[hole]->timer);
     
-    /* Check accept backlog limit - not using accept_queue_size since it's not in the structure */
-    if (session->config.accept_backlog == 0) {
-        return YAMUX_ERR_TIMEOUT;
+    /* Shift later members of the probe cluster back into the hole */
+    for (next = (hole + 1) & mask; table->slots[next]; next = (next + 1) & mask) {
+        home = yamux_stream_table_bucket(table, table->slots[next]->id);
+        
+        /* An entry may move only if its home bucket is not in (hole, next] */
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            table->slots[hole] = table->slots[next];
+            hole = next;
+        }
     }
     
-    /* Add to accept queue */
-    stream->next = session->accept_queue;
-    session->accept_queue = stream;
-    
-    /* Accept queue size is managed by the queue itself */
+    table->slots[hole] = NULL;
+    table->count--;
     
     return YAMUX_OK;
 }
@@ -192,35 +272,34 @@ yamux_result_t yamux_enqueue_stream(
 /**
  * Enqueue a stream to the session's accept queue.
  * This is typically called when a server-side stream enters SYN_RECV state.
+ * Appending is O(1); the queue never holds more than accept_backlog streams.
  *
  * @param session The session.
  * @param stream The stream to enqueue.
- * @return YAMUX_OK on success, or an error code.
+ * @return YAMUX_OK on success, YAMUX_ERR_WOULD_BLOCK if the backlog is full,
+ *         or an error code.
  */
 yamux_result_t yamux_enqueue_stream_for_accept(yamux_session_t *session, yamux_stream_t *stream) {
     if (!session || !stream) {
         return YAMUX_ERR_INVALID;
     }
 
+    if (session->accept_len >= session->config.accept_backlog) {
+        return YAMUX_ERR_WOULD_BLOCK;
+    }
+
     // Ensure stream is not already in a queue or linked elsewhere inappropriately
     stream->next = NULL;
 
-    if (!session->accept_queue) {
-        // Queue is empty, this stream becomes the head
-        session->accept_queue = stream;
+    if (session->accept_tail) {
+        session->accept_tail->next = stream;
     } else {
-        // Add to the end of the queue
-        yamux_stream_t *current = session->accept_queue;
-        while (current->next) {
-            current = current->next;
-        }
-        current->next = stream;
+        session->accept_queue = stream;
     }
-    
-    // TODO: Potentially signal or notify that a stream is ready for accept if using blocking accept.
-    // For now, yamux_accept_stream will just pick it up on the next call.
+    session->accept_tail = stream;
+    session->accept_len++;
 
-    printf("DEBUG: Enqueued stream %u for acceptance.\n", stream->id);
+    YAMUX_LOG_DEBUG("Enqueued stream %u for acceptance.", stream->id);
     return YAMUX_OK;
 }
 
@@ -0,0 +1,496 @@
+/**
+ * @file yamux_timer.c
+ * @brief Timer wheel for keepalives and timeouts
+ *
+ * Timers live in a hierarchical wheel of YAMUX_TIMER_LEVELS levels of
+ * YAMUX_TIMER_SLOTS slots, each level's slot spanning a whole turn of the
+ * level below. A timer goes into the coarsest level that can tell its
+ * deadline apart and moves one level down each time the wheel reaches its
+ * slot, so arming and cancelling are O(1) and a tick only touches the
+ * timers it reaches. Deadlines beyond the wheel's span wait in its last
+ * slot and are placed again. The wheel has no lock of its own: it is
+ * ticked either under the lock of the one session it belongs to, or from
+ * the single thread that drives all sessions sharing it.
+ */
+
+#include "../include/yamux.h"
+#include "yamux_internal.h"
+#include "yamux_defs.h"
+#include <string.h>
+
+#define YAMUX_TIMER_BITS   6
+#define YAMUX_TIMER_SLOTS  (1u << YAMUX_TIMER_BITS)
+#define YAMUX_TIMER_LEVELS 4
+#define YAMUX_TIMER_SPAN   (1ull << (YAMUX_TIMER_BITS * YAMUX_TIMER_LEVELS))
+
+struct yamux_timer_wheel {
+    yamux_timer_t *slots[YAMUX_TIMER_LEVELS][YAMUX_TIMER_SLOTS];
+    uint64_t tick;                  /* Last tick run, in YAMUX_TIMER_TICK_MS */
+    uint32_t count;                 /* Timers armed */
+    int running;                    /* A tick is running timers */
+};
+
+/* Link a timer into the slot its deadline falls in */
+static void yamux_timer_insert(yamux_timer_wheel_t *wheel, yamux_timer_t *timer) {
+    uint64_t at = (timer->expires > wheel->tick) ? timer->expires : wheel->tick;
+    uint64_t delta = at - wheel->tick;
+    yamux_timer_t **slot;
+    int level = 0;
+
+    /* Past the span: wait at its end and be placed again from there */
+    if (delta >= YAMUX_TIMER_SPAN) {
+        delta = YAMUX_TIMER_SPAN - 1;
+        at = wheel->tick + delta;
+    }
+    while (level < YAMUX_TIMER_LEVELS - 1 && delta >= (1ull << (YAMUX_TIMER_BITS * (level + 1)))) {
+        level++;
+    }
+
+    slot = &wheel->slots[level][(at >> (YAMUX_TIMER_BITS * level)) & (YAMUX_TIMER_SLOTS - 1)];
+    timer->next = *slot;
+    if (timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    *slot = timer;
+    timer->pprev = slot;
+}
+
+/* Arm a timer to fire ticks ticks from now (at least one) */
+static void yamux_timer_arm_ticks(yamux_timer_wheel_t *wheel, yamux_timer_t *timer, uint64_t ticks) {
+    yamux_timer_cancel(timer);
+    timer->wheel = wheel;
+    timer->expires = wheel->tick + (ticks ? ticks : 1);
+    yamux_timer_insert(wheel, timer);
+    wheel->count++;
+}
+
+/* Arm a timer to fire delay_ms from now, rounded up to whole ticks */
+static void yamux_timer_arm(yamux_timer_wheel_t *wheel, yamux_timer_t *timer, uint32_t delay_ms) {
+    yamux_timer_arm_ticks(wheel, timer, ((uint64_t)delay_ms + YAMUX_TIMER_TICK_MS - 1) / YAMUX_TIMER_TICK_MS);
+}
+
+/**
+ * Disarm a timer; nothing happens if it is not armed
+ *
+ * @param timer Timer
+ */
+void yamux_timer_cancel(yamux_timer_t *timer) {
+    if (!timer->pprev) {
+        return;
+    }
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->wheel->count--;
+}
+
+/* Move an armed timer to another wheel (or disarm it), keeping what is left of it */
+static void yamux_timer_move(yamux_timer_t *timer, yamux_timer_wheel_t *to) {
+    uint64_t left;
+
+    if (!timer->pprev) {
+        return;
+    }
+    left = (timer->expires > timer->wheel->tick) ? timer->expires - timer->wheel->tick : 0;
+    yamux_timer_cancel(timer);
+    if (to) {
+        yamux_timer_arm_ticks(to, timer, left);
+    }
+}
+
+/* Empty a wheel and set its clock to now_ms */
+static void yamux_timer_wheel_start(yamux_timer_wheel_t *wheel, uint64_t now_ms) {
+    memset(wheel, 0, sizeof(yamux_timer_wheel_t));
+    wheel->tick = now_ms / YAMUX_TIMER_TICK_MS;
+}
+
+/* Create a timer wheel */
+yamux_result_t yamux_timer_wheel_create(
+    uint64_t now_ms,
+    yamux_timer_wheel_t **wheel)
+{
+    yamux_timer_wheel_t *w;
+
+    if (!wheel) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    w = (yamux_timer_wheel_t *)YAMUX_MALLOC(sizeof(yamux_timer_wheel_t));
+    if (!w) {
+        return YAMUX_ERR_NOMEM;
+    }
+    yamux_timer_wheel_start(w, now_ms);
+
+    *wheel = w;
+    return YAMUX_OK;
+}
+
+/* Destroy a timer wheel */
+void yamux_timer_wheel_destroy(
+    yamux_timer_wheel_t *wheel)
+{
+    YAMUX_FREE(wheel);
+}
+
+/* Run the timers due by now_ms */
+yamux_result_t yamux_timer_wheel_tick(
+    yamux_timer_wheel_t *wheel,
+    uint64_t now_ms)
+{
+    uint64_t target;
+    yamux_timer_t *timer;
+    yamux_timer_t *list;
+    yamux_timer_t **slot;
+    int level;
+
+    if (!wheel) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    /* A timer ticking the wheel again gets its turn from the outer tick */
+    if (wheel->running) {
+        return YAMUX_OK;
+    }
+    wheel->running = 1;
+
+    target = now_ms / YAMUX_TIMER_TICK_MS;
+    while (wheel->tick < target) {
+        /* An empty wheel has nothing to step through */
+        if (wheel->count == 0) {
+            wheel->tick = target;
+            break;
+        }
+        wheel->tick++;
+
+        /* Slots of coarser levels reached this tick move down, coarsest first */
+        for (level = YAMUX_TIMER_LEVELS - 1; level > 0; level--) {
+            if (wheel->tick & ((1ull << (YAMUX_TIMER_BITS * level)) - 1)) {
+                continue;
+            }
+            slot = &wheel->slots[level][(wheel->tick >> (YAMUX_TIMER_BITS * level)) & (YAMUX_TIMER_SLOTS - 1)];
+            list = *slot;
+            *slot = NULL;
+            while ((timer = list) != NULL) {
+                list = timer->next;
+                yamux_timer_insert(wheel, timer);
+            }
+        }
+
+        /* Fire what is due; a fired timer may arm or cancel any timer */
+        slot = &wheel->slots[0][wheel->tick & (YAMUX_TIMER_SLOTS - 1)];
+        while ((timer = *slot) != NULL) {
+            yamux_timer_cancel(timer);
+            if (timer->expires > wheel->tick) {
+                yamux_timer_arm_ticks(wheel, timer, timer->expires - wheel->tick);
+            } else {
+                timer->fire(timer);
+            }
+        }
+    }
+
+    wheel->running = 0;
+    return YAMUX_OK;
+}
+
+/* Keepalive: ping, expect the answer within the write timeout, and go again */
+static void yamux_keepalive_fire(yamux_timer_t *timer) {
+    yamux_session_t *session = (yamux_session_t *)timer->owner;
+    uint32_t wait_ms;
+    uint32_t id;
+
+    if (session->go_away_received || session->failure != YAMUX_OK) {
+        return;
+    }
+
+    if (yamux_session_ping_id(session, &id) == YAMUX_OK && !session->dead_timer.pprev) {
+        wait_ms = session->config.connection_write_timeout ? session->config.connection_write_timeout
+                                                           : session->keepalive_interval;
+        yamux_timer_arm(timer->wheel, &session->dead_timer, wait_ms);
+    }
+    yamux_timer_arm(timer->wheel, timer, session->keepalive_interval);
+}
+
+/**
+ * Fail a session: every stream closes with the error, and nothing more is
+ * read. Only yamux_session_close() remains for the application.
+ *
+ * @param session Session
+ * @param error Why (YAMUX_ERR_TIMEOUT)
+ */
+static void yamux_session_fail(yamux_session_t *session, yamux_result_t error) {
+    const yamux_callbacks_t *cb = &session->callbacks;
+    yamux_stream_t *stream;
+    uint32_t i;
+
+    if (session->failure != YAMUX_OK) {
+        return;
+    }
+
+    yamux_session_lock(session);
+    session->failure = error;
+    yamux_timer_cancel(&session->keepalive_timer);
+    yamux_timer_cancel(&session->dead_timer);
+    yamux_timer_cancel(&session->write_timer);
+    yamux_sched_clear(session);
+
+    /* Streams stay in the table, closed, until the session is */
+    for (i = 0; i < session->streams.capacity; i++) {
+        stream = session->streams.slots[i];
+        if (stream && stream->state != YAMUX_STREAM_CLOSED) {
+            yamux_timer_cancel(&stream->timer);
+            yamux_stream_complete_read(stream, 0, error);
+            stream->state = YAMUX_STREAM_CLOSED;
+            stream->failed = 1;
+        }
+    }
+    yamux_session_notify(session);
+
+    /* Report once every stream is closed: callbacks may look at any of them */
+    for (i = 0; i < session->streams.capacity; i++) {
+        stream = session->streams.slots[i];
+        if (stream && stream->failed) {
+            stream->failed = 0;
+            if (cb->on_stream_closed && !stream->orphaned) {
+                cb->on_stream_closed(stream, cb->user_data);
+            }
+        }
+    }
+    if (cb->on_session_failed) {
+        cb->on_session_failed(session, error, cb->user_data);
+    }
+    yamux_session_unlock(session);
+}
+
+/* Dead peer: the keepalive ping went unanswered */
+static void yamux_dead_fire(yamux_timer_t *timer) {
+    yamux_session_fail((yamux_session_t *)timer->owner, YAMUX_ERR_TIMEOUT);
+}
+
+/* Write timeout: queued frames must keep leaving for the timer to go again */
+static void yamux_write_fire(yamux_timer_t *timer) {
+    yamux_session_t *session = (yamux_session_t *)timer->owner;
+
+    if (!yamux_session_queued(session) && yamux_sched_idle(session)) {
+        return;
+    }
+    if (!session->tx_progress) {
+        yamux_session_fail(session, YAMUX_ERR_TIMEOUT);
+        return;
+    }
+    session->tx_progress = 0;
+    yamux_timer_arm(timer->wheel, timer, session->config.connection_write_timeout);
+}
+
+/* SYN or FIN timeout: reset the stream, as if the peer had */
+static void yamux_stream_timer_fire(yamux_timer_t *timer) {
+    yamux_stream_t *stream = (yamux_stream_t *)timer->owner;
+    yamux_session_t *session = stream->session;
+    const yamux_callbacks_t *cb = &session->callbacks;
+    yamux_header_t header;
+
+    if (stream->state != YAMUX_STREAM_SYN_SENT && stream->state != YAMUX_STREAM_FIN_SENT) {
+        return;
+    }
+
+    yamux_session_lock(session);
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = YAMUX_DATA;
+    header.flags = YAMUX_FLAG_RST;
+    header.stream_id = stream->id;
+    yamux_sched_remove(stream);
+    (void)yamux_session_send_frame(session, &header, NULL, 0);
+
+    /* Left to the application like a stream the peer reset */
+    yamux_stream_complete_read(stream, 0, YAMUX_ERR_TIMEOUT);
+    stream->state = YAMUX_STREAM_CLOSED;
+    yamux_remove_stream(session, stream->id);
+    yamux_session_notify(session);
+
+    if (cb->on_stream_closed && !stream->orphaned) {
+        cb->on_stream_closed(stream, cb->user_data);
+    }
+    yamux_stream_reap(stream);
+    yamux_session_unlock(session);
+}
+
+/* Start the keepalive if it is enabled and not running */
+static void yamux_timers_start(yamux_session_t *session) {
+    if (session->keepalive_enabled && session->keepalive_interval > 0 && !session->keepalive_timer.pprev) {
+        yamux_timer_arm(session->timers, &session->keepalive_timer, session->keepalive_interval);
+    }
+}
+
+/* Move a session's timers, and its streams', to another wheel (NULL disarms them) */
+static void yamux_timers_switch(yamux_session_t *session, yamux_timer_wheel_t *wheel, int own) {
+    uint32_t i;
+
+    yamux_timer_move(&session->keepalive_timer, wheel);
+    yamux_timer_move(&session->dead_timer, wheel);
+    yamux_timer_move(&session->write_timer, wheel);
+    for (i = 0; i < session->streams.capacity; i++) {
+        if (session->streams.slots[i]) {
+            yamux_timer_move(&session->streams.slots[i]->timer, wheel);
+        }
+    }
+
+    /* A fixed_memory session keeps its wheel to tick on again, should it be detached */
+    if (session->own_timers && session->config.fixed_memory) {
+        session->spare_timers = session->timers;
+    } else if (session->own_timers) {
+        yamux_timer_wheel_destroy(session->timers);
+    }
+    session->timers = wheel;
+    session->own_timers = own;
+
+    session->keepalive_timer.fire = yamux_keepalive_fire;
+    session->keepalive_timer.owner = session;
+    session->dead_timer.fire = yamux_dead_fire;
+    session->dead_timer.owner = session;
+    session->write_timer.fire = yamux_write_fire;
+    session->write_timer.owner = session;
+    if (wheel) {
+        yamux_timers_start(session);
+    }
+}
+
+/**
+ * Allocate the private wheel a fixed_memory session ticks on, which
+ * yamux_session_tick() would otherwise create at the first tick
+ *
+ * @param session Session being created
+ * @return YAMUX_OK on success, YAMUX_ERR_NOMEM if the wheel cannot be allocated
+ */
+yamux_result_t yamux_timers_reserve(yamux_session_t *session) {
+    return yamux_timer_wheel_create(0, &session->spare_timers);
+}
+
+/**
+ * Stop a session's timers and free its private wheel
+ *
+ * @param session Session
+ */
+void yamux_timers_detach(yamux_session_t *session) {
+    if (session->timers) {
+        yamux_timers_switch(session, NULL, 0);
+    }
+    if (session->spare_timers) {
+        yamux_timer_wheel_destroy(session->spare_timers);
+        session->spare_timers = NULL;
+    }
+}
+
+/**
+ * Time the SYN of a stream just opened
+ *
+ * @param stream Stream in SYN_SENT
+ */
+void yamux_timers_stream_opened(yamux_stream_t *stream) {
+    yamux_session_t *session = stream->session;
+
+    if (session->timers && session->config.stream_open_timeout > 0) {
+        stream->timer.fire = yamux_stream_timer_fire;
+        stream->timer.owner = stream;
+        yamux_timer_arm(session->timers, &stream->timer, session->config.stream_open_timeout);
+    }
+}
+
+/**
+ * Time the FIN of a stream just half-closed
+ *
+ * @param stream Stream in FIN_SENT
+ */
+void yamux_timers_stream_closing(yamux_stream_t *stream) {
+    yamux_session_t *session = stream->session;
+
+    yamux_timer_cancel(&stream->timer);
+    if (session->timers && session->config.stream_close_timeout > 0) {
+        stream->timer.fire = yamux_stream_timer_fire;
+        stream->timer.owner = stream;
+        yamux_timer_arm(session->timers, &stream->timer, session->config.stream_close_timeout);
+    }
+}
+
+/**
+ * Start the write timeout when frames wait on the transport
+ *
+ * @param session Session whose egress queue is not empty
+ */
+void yamux_timers_write_blocked(yamux_session_t *session) {
+    if (session->timers && session->config.connection_write_timeout > 0 && !session->write_timer.pprev) {
+        session->tx_progress = 0;
+        yamux_timer_arm(session->timers, &session->write_timer, session->config.connection_write_timeout);
+    }
+}
+
+/**
+ * Note a keepalive answered
+ *
+ * @param session Session
+ */
+void yamux_timers_ping_acked(yamux_session_t *session) {
+    yamux_timer_cancel(&session->dead_timer);
+}
+
+/* Run a session's timers on a shared wheel */
+yamux_result_t yamux_session_set_timer_wheel(
+    yamux_session_t *session,
+    yamux_timer_wheel_t *wheel)
+{
+    if (!session || (wheel && session->threaded)) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    yamux_session_lock(session);
+    if (wheel != session->timers) {
+        yamux_timers_switch(session, wheel, 0);
+    }
+    yamux_session_unlock(session);
+
+    return YAMUX_OK;
+}
+
+/* Run a session's timers */
+yamux_result_t yamux_session_tick(
+    yamux_session_t *session,
+    uint64_t now_ms)
+{
+    yamux_timer_wheel_t *wheel;
+    yamux_result_t result;
+
+    if (!session) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    /* Check if shut down */
+    if (session->go_away_received) {
+        return YAMUX_ERR_CLOSED;
+    }
+
+    yamux_session_lock(session);
+
+    /* The first tick gives the session a wheel of its own */
+    if (!session->timers && session->spare_timers) {
+        wheel = session->spare_timers;
+        session->spare_timers = NULL;
+        yamux_timer_wheel_start(wheel, now_ms);
+        yamux_timers_switch(session, wheel, 1);
+    } else if (!session->timers) {
+        result = yamux_timer_wheel_create(now_ms, &wheel);
+        if (result != YAMUX_OK) {
+            yamux_session_unlock(session);
+            return result;
+        }
+        yamux_timers_switch(session, wheel, 1);
+    }
+
+    (void)yamux_timer_wheel_tick(session->timers, now_ms);
+    result = session->failure;
+
+    yamux_session_unlock(session);
+    return result;
+}
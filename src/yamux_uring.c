@@ -0,0 +1,648 @@
+/**
+ * @file yamux_uring.c
+ * @brief io_uring transport for yamux sessions
+ *
+ * One multishot receive stays posted on the socket. The kernel picks a
+ * buffer from a ring registered with it (IORING_REGISTER_PBUF_RING) for
+ * every chunk it receives and posts a completion naming the buffer; the
+ * read callback copies out of completed buffers and hands each back by
+ * advancing the ring's tail, which is plain shared memory.
+ *
+ * Writes are copied into one of two staging buffers; while one is being
+ * sent the other fills, so everything the session writes between two
+ * submissions leaves in a single send. Submission and waiting share one
+ * io_uring_enter() per yamux_uring_run().
+ *
+ * The rings are set up with raw system calls, so liburing is not needed.
+ */
+
+#include "../include/yamux.h"
+#include "../include/yamux_uring.h"
+#include "yamux_internal.h"
+#include "yamux_defs.h"
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+/* Submission queue entries; at most a receive, a send and a cancel are outstanding */
+#define YAMUX_URING_SQ_ENTRIES 8
+
+/* Largest receive buffer ring the kernel accepts */
+#define YAMUX_URING_MAX_BUFFERS 32768
+
+/* Completion tags */
+#define YAMUX_URING_TAG_RECV 1
+#define YAMUX_URING_TAG_SEND 2
+#define YAMUX_URING_TAG_CANCEL 3
+
+/* Buffer group of the receive ring */
+#define YAMUX_URING_BGID 0
+
+/* A completed receive buffer */
+typedef struct {
+    uint16_t bid;                   /* Buffer index */
+    uint32_t len;                   /* Bytes received into it */
+} yamux_uring_chunk_t;
+
+/* Transport structure */
+struct yamux_uring {
+    int fd;                         /* Socket */
+    int ring_fd;                    /* io_uring descriptor */
+
+    /* Submission queue */
+    void *sq_map;
+    size_t sq_map_len;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned *sq_array;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+    unsigned sq_pending;            /* Queued entries the kernel has not taken */
+
+    /* Completion queue (may share sq_map) */
+    void *cq_map;
+    size_t cq_map_len;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* Receive buffers */
+    struct io_uring_buf *buf_ring;  /* Ring shared with the kernel; bufs[0].resv is its tail */
+    size_t buf_ring_len;
+    uint8_t *bufs;                  /* buf_count buffers of buf_size bytes */
+    unsigned buf_count;
+    size_t buf_size;
+    uint16_t buf_tail;              /* Next ring slot to hand a buffer back in */
+
+    /* Received chunks not yet read, oldest first */
+    yamux_uring_chunk_t *chunks;
+    unsigned chunk_head;
+    unsigned chunk_count;
+    size_t chunk_offset;            /* Bytes already read from the oldest chunk */
+    size_t recv_pending;            /* Bytes in all chunks, not yet read */
+    int recv_armed;                 /* Multishot receive is posted */
+    int recv_closed;                /* End of stream or error seen */
+
+    /* Egress staging */
+    uint8_t *send_bufs[2];
+    size_t send_used[2];
+    int send_fill;                  /* Buffer the write callback fills */
+    int send_inflight;              /* The other buffer is being sent */
+    int send_posted;                /* A send entry for it is outstanding */
+    size_t send_offset;             /* Bytes of the in-flight buffer already sent */
+    int send_failed;
+    int cancel_pending;
+};
+
+static int yamux_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int yamux_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int yamux_uring_register(int ring_fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+/* Take a free submission entry, or NULL if the queue is full */
+static struct io_uring_sqe *yamux_uring_get_sqe(yamux_uring_t *u)
+{
+    unsigned tail = *u->sq_tail;
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    struct io_uring_sqe *sqe;
+
+    if (tail - head > u->sq_mask) {
+        return NULL;
+    }
+    sqe = &u->sqes[tail & u->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+/* Publish the entry taken last by yamux_uring_get_sqe() */
+static void yamux_uring_queue_sqe(yamux_uring_t *u)
+{
+    unsigned tail = *u->sq_tail;
+
+    u->sq_array[tail & u->sq_mask] = tail & u->sq_mask;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    u->sq_pending++;
+}
+
+/* Hand a receive buffer back to the kernel */
+static void yamux_uring_recycle(yamux_uring_t *u, uint16_t bid)
+{
+    struct io_uring_buf *buf = &u->buf_ring[u->buf_tail & (u->buf_count - 1)];
+
+    buf->addr = (uint64_t)(uintptr_t)(u->bufs + (size_t)bid * u->buf_size);
+    buf->len = (uint32_t)u->buf_size;
+    buf->bid = bid;
+    u->buf_tail++;
+    __atomic_store_n(&u->buf_ring[0].resv, u->buf_tail, __ATOMIC_RELEASE);
+}
+
+/* Post the multishot receive if it is not posted and a buffer is free */
+static void yamux_uring_arm_recv(yamux_uring_t *u)
+{
+    struct io_uring_sqe *sqe;
+
+    if (u->recv_armed || u->recv_closed || u->chunk_count == u->buf_count) {
+        return;
+    }
+    sqe = yamux_uring_get_sqe(u);
+    if (!sqe) {
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = u->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = YAMUX_URING_BGID;
+    sqe->user_data = YAMUX_URING_TAG_RECV;
+    yamux_uring_queue_sqe(u);
+    u->recv_armed = 1;
+}
+
+/* Post a send of the staged bytes, unless one is outstanding */
+static void yamux_uring_start_send(yamux_uring_t *u)
+{
+    struct io_uring_sqe *sqe;
+    int index;
+
+    if (u->send_failed || u->send_posted) {
+        return;
+    }
+    if (!u->send_inflight) {
+        if (u->send_used[u->send_fill] == 0) {
+            return;
+        }
+        /* The filled buffer goes out; the idle one takes new writes */
+        u->send_fill = !u->send_fill;
+        u->send_offset = 0;
+        u->send_inflight = 1;
+    }
+
+    /* A full queue leaves the send to be posted by the next call */
+    sqe = yamux_uring_get_sqe(u);
+    if (!sqe) {
+        return;
+    }
+    index = !u->send_fill;
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = u->fd;
+    sqe->addr = (uint64_t)(uintptr_t)(u->send_bufs[index] + u->send_offset);
+    sqe->len = (uint32_t)(u->send_used[index] - u->send_offset);
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = YAMUX_URING_TAG_SEND;
+    yamux_uring_queue_sqe(u);
+    u->send_posted = 1;
+}
+
+/* Handle a receive completion */
+static void yamux_uring_recv_done(yamux_uring_t *u, const struct io_uring_cqe *cqe)
+{
+    yamux_uring_chunk_t *chunk;
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        u->recv_armed = 0;
+    }
+
+    if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+        chunk = &u->chunks[(u->chunk_head + u->chunk_count) & (u->buf_count - 1)];
+        chunk->bid = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        chunk->len = (uint32_t)cqe->res;
+        u->chunk_count++;
+        u->recv_pending += (size_t)cqe->res;
+    } else if (cqe->res == -ENOBUFS || cqe->res == -EINTR || cqe->res == -EAGAIN) {
+        /* Reposted once the reader hands buffers back */
+    } else if (cqe->res <= 0 && !u->cancel_pending) {
+        /* End of stream or a socket error */
+        u->recv_closed = 1;
+    }
+}
+
+/* Handle a send completion */
+static void yamux_uring_send_done(yamux_uring_t *u, const struct io_uring_cqe *cqe)
+{
+    int index = !u->send_fill;
+
+    u->send_posted = 0;
+    if (cqe->res < 0 && cqe->res != -EINTR && cqe->res != -EAGAIN) {
+        u->send_failed = 1;
+        u->send_inflight = 0;
+        return;
+    }
+    if (cqe->res > 0) {
+        u->send_offset += (size_t)cqe->res;
+    }
+    if (u->send_offset < u->send_used[index]) {
+        /* Short send: the remainder goes next */
+        yamux_uring_start_send(u);
+        return;
+    }
+
+    u->send_used[index] = 0;
+    u->send_inflight = 0;
+    yamux_uring_start_send(u);
+}
+
+/* Collect all posted completions */
+static void yamux_uring_reap(yamux_uring_t *u)
+{
+    unsigned head = *u->cq_head;
+    unsigned tail = __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    const struct io_uring_cqe *cqe;
+
+    while (head != tail) {
+        cqe = &u->cqes[head & u->cq_mask];
+        switch (cqe->user_data) {
+        case YAMUX_URING_TAG_RECV:
+            yamux_uring_recv_done(u, cqe);
+            break;
+        case YAMUX_URING_TAG_SEND:
+            yamux_uring_send_done(u, cqe);
+            break;
+        case YAMUX_URING_TAG_CANCEL:
+            u->cancel_pending = 0;
+            break;
+        default:
+            break;
+        }
+        head++;
+    }
+    __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Submit queued entries, waiting for a completion if asked */
+static yamux_result_t yamux_uring_submit(yamux_uring_t *u, int wait)
+{
+    int submitted;
+
+    if (u->sq_pending == 0 && !wait) {
+        return YAMUX_OK;
+    }
+    submitted = yamux_uring_enter(u->ring_fd, u->sq_pending, wait ? 1 : 0,
+                                  wait ? IORING_ENTER_GETEVENTS : 0);
+    if (submitted < 0) {
+        return (errno == EINTR || errno == EAGAIN || errno == EBUSY) ? YAMUX_OK : YAMUX_ERR_IO;
+    }
+    u->sq_pending -= ((unsigned)submitted < u->sq_pending) ? (unsigned)submitted : u->sq_pending;
+    return YAMUX_OK;
+}
+
+/* yamux_io_t.read: copy out of completed receive buffers */
+static int yamux_uring_read(void *ctx, uint8_t *buf, size_t len)
+{
+    yamux_uring_t *u = (yamux_uring_t *)ctx;
+    yamux_uring_chunk_t *chunk;
+    size_t copied = 0;
+    size_t n;
+
+    while (copied < len && u->chunk_count > 0) {
+        chunk = &u->chunks[u->chunk_head];
+        n = chunk->len - u->chunk_offset;
+        if (n > len - copied) {
+            n = len - copied;
+        }
+        memcpy(buf + copied, u->bufs + (size_t)chunk->bid * u->buf_size + u->chunk_offset, n);
+        copied += n;
+        u->chunk_offset += n;
+        u->recv_pending -= n;
+
+        if (u->chunk_offset == chunk->len) {
+            yamux_uring_recycle(u, chunk->bid);
+            u->chunk_head = (u->chunk_head + 1) & (u->buf_count - 1);
+            u->chunk_count--;
+            u->chunk_offset = 0;
+        }
+    }
+
+    if (copied > 0) {
+        return (int)copied;
+    }
+    return u->recv_closed ? YAMUX_ERR_IO : 0;
+}
+
+/* yamux_io_t.write: stage bytes for the next send */
+static int yamux_uring_write(void *ctx, const uint8_t *buf, size_t len)
+{
+    yamux_uring_t *u = (yamux_uring_t *)ctx;
+    size_t *used = &u->send_used[u->send_fill];
+    size_t room = YAMUX_URING_WRITE_BUFFER_SIZE - *used;
+
+    if (u->send_failed) {
+        return YAMUX_ERR_IO;
+    }
+    if (len > room) {
+        len = room;
+    }
+    if (len > INT32_MAX) {
+        len = INT32_MAX;
+    }
+    memcpy(u->send_bufs[u->send_fill] + *used, buf, len);
+    *used += len;
+
+    /* Only queued here; the next yamux_uring_run() submits it */
+    yamux_uring_start_send(u);
+    return (int)len;
+}
+
+/* Map the submission and completion rings */
+static yamux_result_t yamux_uring_map(yamux_uring_t *u, const struct io_uring_params *p)
+{
+    uint8_t *sq;
+    uint8_t *cq;
+
+    u->sq_map_len = p->sq_off.array + p->sq_entries * sizeof(unsigned);
+    u->cq_map_len = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    if ((p->features & IORING_FEAT_SINGLE_MMAP) && u->cq_map_len > u->sq_map_len) {
+        u->sq_map_len = u->cq_map_len;
+    }
+
+    u->sq_map = mmap(NULL, u->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     u->ring_fd, IORING_OFF_SQ_RING);
+    if (u->sq_map == MAP_FAILED) {
+        u->sq_map = NULL;
+        return YAMUX_ERR_IO;
+    }
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_map = u->sq_map;
+    } else {
+        u->cq_map = mmap(NULL, u->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         u->ring_fd, IORING_OFF_CQ_RING);
+        if (u->cq_map == MAP_FAILED) {
+            u->cq_map = NULL;
+            return YAMUX_ERR_IO;
+        }
+    }
+
+    u->sqes_len = p->sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = (struct io_uring_sqe *)mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE,
+                                          MAP_SHARED | MAP_POPULATE, u->ring_fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        return YAMUX_ERR_IO;
+    }
+
+    sq = (uint8_t *)u->sq_map;
+    cq = (uint8_t *)u->cq_map;
+    u->sq_head = (unsigned *)(sq + p->sq_off.head);
+    u->sq_tail = (unsigned *)(sq + p->sq_off.tail);
+    u->sq_mask = *(unsigned *)(sq + p->sq_off.ring_mask);
+    u->sq_array = (unsigned *)(sq + p->sq_off.array);
+    u->cq_head = (unsigned *)(cq + p->cq_off.head);
+    u->cq_tail = (unsigned *)(cq + p->cq_off.tail);
+    u->cq_mask = *(unsigned *)(cq + p->cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+    return YAMUX_OK;
+}
+
+/* Register the receive buffer ring and fill it */
+static yamux_result_t yamux_uring_setup_buffers(yamux_uring_t *u)
+{
+    struct io_uring_buf_reg reg;
+    unsigned i;
+
+    u->bufs = (uint8_t *)YAMUX_MALLOC((size_t)u->buf_count * u->buf_size);
+    u->chunks = (yamux_uring_chunk_t *)YAMUX_MALLOC(u->buf_count * sizeof(yamux_uring_chunk_t));
+    u->send_bufs[0] = (uint8_t *)YAMUX_MALLOC(YAMUX_URING_WRITE_BUFFER_SIZE);
+    u->send_bufs[1] = (uint8_t *)YAMUX_MALLOC(YAMUX_URING_WRITE_BUFFER_SIZE);
+    if (!u->bufs || !u->chunks || !u->send_bufs[0] || !u->send_bufs[1]) {
+        return YAMUX_ERR_NOMEM;
+    }
+
+    /* The ring must be page aligned, which mmap gives */
+    u->buf_ring_len = u->buf_count * sizeof(struct io_uring_buf);
+    u->buf_ring = (struct io_uring_buf *)mmap(NULL, u->buf_ring_len, PROT_READ | PROT_WRITE,
+                                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->buf_ring == MAP_FAILED) {
+        u->buf_ring = NULL;
+        return YAMUX_ERR_NOMEM;
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)u->buf_ring;
+    reg.ring_entries = u->buf_count;
+    reg.bgid = YAMUX_URING_BGID;
+    if (yamux_uring_register(u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return YAMUX_ERR_IO;
+    }
+
+    for (i = 0; i < u->buf_count; i++) {
+        yamux_uring_recycle(u, (uint16_t)i);
+    }
+    return YAMUX_OK;
+}
+
+/**
+ * Create an io_uring transport for a connected socket
+ *
+ * @param fd Connected stream socket
+ * @param buf_count Receive buffers, rounded up to a power of two (0 = default)
+ * @param buf_size Size of each receive buffer in bytes (0 = default)
+ * @param uring Output parameter for the created transport
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_uring_create(int fd, unsigned buf_count, size_t buf_size, yamux_uring_t **uring)
+{
+    struct io_uring_params params;
+    yamux_uring_t *u;
+    yamux_result_t result;
+    unsigned count = 1;
+
+    if (fd < 0 || !uring || buf_count > YAMUX_URING_MAX_BUFFERS || buf_size > UINT32_MAX) {
+        return YAMUX_ERR_INVALID;
+    }
+    if (buf_count == 0) {
+        buf_count = YAMUX_URING_DEFAULT_BUFFERS;
+    }
+    while (count < buf_count) {
+        count *= 2;
+    }
+
+    u = (yamux_uring_t *)YAMUX_MALLOC(sizeof(yamux_uring_t));
+    if (!u) {
+        return YAMUX_ERR_NOMEM;
+    }
+    memset(u, 0, sizeof(yamux_uring_t));
+    u->fd = fd;
+    u->buf_count = count;
+    u->buf_size = buf_size ? buf_size : YAMUX_URING_DEFAULT_BUFFER_SIZE;
+
+    /* Every receive buffer may complete before the completions are reaped */
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = 2 * (count + YAMUX_URING_SQ_ENTRIES);
+    u->ring_fd = yamux_uring_setup(YAMUX_URING_SQ_ENTRIES, &params);
+    if (u->ring_fd < 0) {
+        YAMUX_FREE(u);
+        return YAMUX_ERR_IO;
+    }
+
+    result = yamux_uring_map(u, &params);
+    if (result == YAMUX_OK) {
+        result = yamux_uring_setup_buffers(u);
+    }
+    if (result != YAMUX_OK) {
+        yamux_uring_destroy(u);
+        return result;
+    }
+
+    yamux_uring_arm_recv(u);
+    *uring = u;
+    return YAMUX_OK;
+}
+
+/**
+ * Destroy a transport; outstanding operations are cancelled
+ *
+ * @param uring Transport
+ */
+void yamux_uring_destroy(yamux_uring_t *uring)
+{
+    struct io_uring_sqe *sqe;
+    int attempts;
+
+    if (!uring) {
+        return;
+    }
+
+    /* The kernel must be done with our buffers before they are freed */
+    if (uring->sqes && (uring->recv_armed || uring->send_posted)) {
+        sqe = yamux_uring_get_sqe(uring);
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+            sqe->user_data = YAMUX_URING_TAG_CANCEL;
+            yamux_uring_queue_sqe(uring);
+            uring->cancel_pending = 1;
+        }
+        for (attempts = 0; attempts < 16 && (uring->recv_armed || uring->send_posted ||
+                                             uring->cancel_pending); attempts++) {
+            if (yamux_uring_submit(uring, 1) != YAMUX_OK) {
+                break;
+            }
+            yamux_uring_reap(uring);
+        }
+    }
+
+    if (uring->sqes) {
+        munmap(uring->sqes, uring->sqes_len);
+    }
+    if (uring->cq_map && uring->cq_map != uring->sq_map) {
+        munmap(uring->cq_map, uring->cq_map_len);
+    }
+    if (uring->sq_map) {
+        munmap(uring->sq_map, uring->sq_map_len);
+    }
+    close(uring->ring_fd);
+    if (uring->buf_ring) {
+        munmap(uring->buf_ring, uring->buf_ring_len);
+    }
+
+    YAMUX_FREE(uring->bufs);
+    YAMUX_FREE(uring->chunks);
+    YAMUX_FREE(uring->send_bufs[0]);
+    YAMUX_FREE(uring->send_bufs[1]);
+    YAMUX_FREE(uring);
+}
+
+/**
+ * Set the transport callbacks of a session's io
+ *
+ * @param uring Transport
+ * @param io I/O callbacks to fill
+ */
+void yamux_uring_io(yamux_uring_t *uring, yamux_io_t *io)
+{
+    if (!uring || !io) {
+        return;
+    }
+    io->read = yamux_uring_read;
+    io->write = yamux_uring_write;
+    io->ctx = uring;
+}
+
+/*
+ * Process what was received, then queue the session's frames for sending
+ * and repost the receive. Returns the first session error.
+ */
+static yamux_result_t yamux_uring_dispatch(yamux_uring_t *u, yamux_session_t *session)
+{
+    yamux_result_t result;
+    size_t pending;
+
+    while (session && u->recv_pending > 0) {
+        pending = u->recv_pending;
+        result = yamux_session_process(session);
+        if (result != YAMUX_OK && result != YAMUX_ERR_WOULD_BLOCK) {
+            return result;
+        }
+        if (u->recv_pending == pending) {
+            break;
+        }
+    }
+
+    /* Frames queued while the staging buffers were full go out now */
+    if (session && session->send_buf_used > 0) {
+        result = yamux_session_flush(session);
+        if (result != YAMUX_OK && result != YAMUX_ERR_WOULD_BLOCK) {
+            return result;
+        }
+    }
+    yamux_uring_start_send(u);
+    yamux_uring_arm_recv(u);
+
+    if (u->send_failed || (u->recv_closed && u->recv_pending == 0)) {
+        return YAMUX_ERR_IO;
+    }
+    return YAMUX_OK;
+}
+
+/**
+ * Submit queued sends, collect completions and process received frames
+ *
+ * @param uring Transport
+ * @param session Session using the transport (may be NULL)
+ * @param wait Non-zero to block until something completes if no data is waiting
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_uring_run(yamux_uring_t *uring, yamux_session_t *session, int wait)
+{
+    yamux_result_t result;
+
+    if (!uring) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    /* Completions posted since the last call need no system call */
+    yamux_uring_reap(uring);
+    result = yamux_uring_dispatch(uring, session);
+    if (result != YAMUX_OK) {
+        return result;
+    }
+
+    /* Nothing to wait for if data is already waiting */
+    if (uring->recv_pending > 0 || (!uring->recv_armed && !uring->send_posted)) {
+        wait = 0;
+    }
+    result = yamux_uring_submit(uring, wait);
+    if (result != YAMUX_OK) {
+        return result;
+    }
+
+    yamux_uring_reap(uring);
+    return yamux_uring_dispatch(uring, session);
+}
@@ -0,0 +1,410 @@
+/**
+ * @file yamux_window.c
+ * @brief Receive-window credit accounting for yamux streams
+ *
+ * Every byte the peer sends is charged against the stream's recv_window.
+ * Bytes the application consumes (read, peek/consume or a posted read)
+ * are collected in recv_consumed and credited back with one WINDOW_UPDATE
+ * once they reach window_update_percent of the window, as Go yamux does.
+ *
+ * With a clock (yamux_io_t.now_ms) the window is auto-tuned: it starts at
+ * the protocol default and doubles, up to max_stream_window_size, whenever
+ * the reader drains a window's worth of credit within two round trips,
+ * i.e. whenever the window rather than the reader limits throughput.
+ * yamux_session_trim_windows() shrinks the windows back under memory
+ * pressure by withholding credit until the peer's share fits again.
+ *
+ * Memory budgets (config.recv_memory_budget per session and
+ * yamux_set_global_recv_budget() per process) bound what the peer can make
+ * us hold: a stream commits its open window plus its unread data, and a
+ * grant is clamped to the budget left. Withheld credit is granted from
+ * yamux_session_process() once reading or closing streams frees budget.
+ */
+
+#include "../include/yamux.h"
+#include "yamux_internal.h"
+#include "yamux_defs.h"
+#include <string.h>
+
+/* Process-wide receive budget shared by all sessions (0 = unlimited) */
+static size_t yamux_global_recv_budget;
+static size_t yamux_global_recv_committed;
+
+#ifdef YAMUX_THREADS
+/* Sessions driven from different threads share the global counters */
+static pthread_mutex_t yamux_global_recv_lock = PTHREAD_MUTEX_INITIALIZER;
+#define YAMUX_GLOBAL_RECV_LOCK() pthread_mutex_lock(&yamux_global_recv_lock)
+#define YAMUX_GLOBAL_RECV_UNLOCK() pthread_mutex_unlock(&yamux_global_recv_lock)
+#else
+#define YAMUX_GLOBAL_RECV_LOCK() ((void)0)
+#define YAMUX_GLOBAL_RECV_UNLOCK() ((void)0)
+#endif
+
+/**
+ * Limit the receive memory committed by all sessions together
+ *
+ * @param bytes Budget in bytes (0 = unlimited)
+ */
+void yamux_set_global_recv_budget(size_t bytes)
+{
+    YAMUX_GLOBAL_RECV_LOCK();
+    yamux_global_recv_budget = bytes;
+    YAMUX_GLOBAL_RECV_UNLOCK();
+}
+
+/**
+ * Get the receive memory committed by all sessions together
+ *
+ * @return Committed bytes
+ */
+size_t yamux_window_global_committed(void)
+{
+    size_t committed;
+
+    YAMUX_GLOBAL_RECV_LOCK();
+    committed = yamux_global_recv_committed;
+    YAMUX_GLOBAL_RECV_UNLOCK();
+    return committed;
+}
+
+/* Bytes that may still be committed, across the session and global budgets */
+static size_t yamux_window_budget_room(const yamux_session_t *session)
+{
+    size_t budget = session->config.recv_memory_budget;
+    size_t room = (size_t)-1;
+
+    if (budget > 0) {
+        room = (session->recv_committed < budget) ? budget - session->recv_committed : 0;
+    }
+    YAMUX_GLOBAL_RECV_LOCK();
+    if (yamux_global_recv_budget > 0) {
+        size_t global_room = (yamux_global_recv_committed < yamux_global_recv_budget)
+                                 ? yamux_global_recv_budget - yamux_global_recv_committed
+                                 : 0;
+        if (global_room < room) {
+            room = global_room;
+        }
+    }
+    YAMUX_GLOBAL_RECV_UNLOCK();
+    return room;
+}
+
+/* Count len more bytes as committed by a stream */
+static void yamux_window_commit(yamux_stream_t *stream, size_t len)
+{
+    if (stream->recv_detached) {
+        return;
+    }
+    stream->recv_committed += len;
+    stream->session->recv_committed += len;
+    YAMUX_GLOBAL_RECV_LOCK();
+    yamux_global_recv_committed += len;
+    YAMUX_GLOBAL_RECV_UNLOCK();
+}
+
+/* Count up to len of a stream's committed bytes as freed */
+static void yamux_window_uncommit(yamux_stream_t *stream, size_t len)
+{
+    if (len > stream->recv_committed) {
+        len = stream->recv_committed;
+    }
+    stream->recv_committed -= len;
+    stream->session->recv_committed -= len;
+    YAMUX_GLOBAL_RECV_LOCK();
+    yamux_global_recv_committed -= len;
+    YAMUX_GLOBAL_RECV_UNLOCK();
+}
+
+/**
+ * Get the window a new stream starts with
+ *
+ * @param session Session
+ * @return Initial receive window size in bytes
+ */
+uint32_t yamux_window_initial_size(const yamux_session_t *session)
+{
+    uint32_t max = session->config.max_stream_window_size;
+
+    /* Without a clock there is nothing to tune by: use the configured size */
+    if (!session->io.now_ms || max < YAMUX_DEFAULT_WINDOW_SIZE) {
+        return max;
+    }
+    return YAMUX_DEFAULT_WINDOW_SIZE;
+}
+
+/* Consumed bytes that justify a WINDOW_UPDATE on this stream */
+static uint32_t yamux_window_threshold(const yamux_stream_t *stream)
+{
+    uint64_t threshold = (uint64_t)stream->recv_window_size *
+                         stream->session->config.window_update_percent / 100;
+
+    return threshold > 0 ? (uint32_t)threshold : 1;
+}
+
+/*
+ * Extra credit to grant by growing the window, measured at a grant.
+ * The window limits throughput when its threshold drained in under two
+ * round trips since the previous grant.
+ */
+static uint32_t yamux_window_grow(yamux_stream_t *stream)
+{
+    yamux_session_t *session = stream->session;
+    uint32_t max = session->config.max_stream_window_size;
+    uint32_t new_size;
+    uint64_t now;
+    uint64_t elapsed;
+
+    if (!session->io.now_ms) {
+        return 0;
+    }
+    now = session->io.now_ms(session->io.ctx);
+    elapsed = now - stream->recv_epoch_ms;
+    stream->recv_epoch_ms = now;
+
+    if (session->rtt_ms == 0 || stream->recv_window_debt > 0 ||
+        stream->recv_window_size >= max || elapsed >= 2 * (uint64_t)session->rtt_ms) {
+        return 0;
+    }
+
+    new_size = (stream->recv_window_size > max / 2) ? max : stream->recv_window_size * 2;
+    if (yamux_buffer_resize(&stream->recvbuf, new_size) != YAMUX_OK) {
+        return 0;
+    }
+
+    new_size -= stream->recv_window_size;
+    stream->recv_window_size += new_size;
+    return new_size;
+}
+
+/**
+ * Set up the receive window of a new stream
+ *
+ * Must run before the stream's receive buffer is allocated; the buffer is
+ * sized to recv_window_size.
+ *
+ * @param stream Stream with its session set
+ */
+void yamux_window_init(yamux_stream_t *stream)
+{
+    yamux_session_t *session = stream->session;
+
+    stream->recv_window_size = yamux_window_initial_size(session);
+    stream->recv_window = stream->recv_window_size;
+    stream->recv_consumed = 0;
+    stream->recv_window_debt = 0;
+    stream->recv_epoch_ms = session->io.now_ms ? session->io.now_ms(session->io.ctx) : 0;
+
+    /* The initial window is fixed by the handshake; it counts, unclamped */
+    yamux_window_commit(stream, stream->recv_window);
+}
+
+/**
+ * Check whether the peer may send len more bytes on a stream
+ *
+ * @param stream Receiving stream
+ * @param len Number of payload bytes
+ * @return Non-zero if len fits in the advertised window
+ */
+int yamux_window_admits(const yamux_stream_t *stream, size_t len)
+{
+    return len <= stream->recv_window;
+}
+
+/**
+ * Charge received payload bytes against a stream's window
+ *
+ * @param stream Receiving stream (len must have been admitted)
+ * @param len Number of payload bytes received
+ */
+void yamux_window_charge(yamux_stream_t *stream, uint32_t len)
+{
+    stream->recv_window -= len;
+}
+
+/*
+ * Grant a stream's owed credit (plus any growth) in one WINDOW_UPDATE,
+ * clamped to the memory budget left. Credit that is not granted stays
+ * owed; if the budget held it back the stream is marked blocked.
+ */
+static void yamux_window_grant(yamux_stream_t *stream)
+{
+    yamux_session_t *session = stream->session;
+    yamux_header_t header;
+    uint8_t increment_buf[4];
+    size_t room = yamux_window_budget_room(session);
+    uint32_t owed;
+    uint32_t increment;
+
+    /* Only grow while the budget could cover it */
+    owed = stream->recv_consumed;
+    if (room > owed) {
+        owed += yamux_window_grow(stream);
+    }
+    increment = (owed > room) ? (uint32_t)room : owed;
+    stream->recv_consumed = owed;
+    stream->recv_blocked = (increment < owed);
+    if (stream->recv_blocked) {
+        session->recv_blocked = 1;
+    }
+    if (increment == 0) {
+        return;
+    }
+
+    /* Prepare header */
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = YAMUX_WINDOW_UPDATE;
+    header.flags = 0;
+    header.stream_id = stream->id;
+    header.length = 4; /* Payload length is always 4 for the window increment value */
+
+    /* Encode window increment value (big-endian) */
+    increment_buf[0] = (increment >> 24) & 0xFF;
+    increment_buf[1] = (increment >> 16) & 0xFF;
+    increment_buf[2] = (increment >> 8) & 0xFF;
+    increment_buf[3] = increment & 0xFF;
+
+    /* If the frame cannot be queued the credit stays owed, with any growth */
+    if (yamux_session_send_frame(session, &header, increment_buf, sizeof(increment_buf)) != YAMUX_OK) {
+        return;
+    }
+
+    YAMUX_STAT(stream->stats.window_updates_out++);
+    YAMUX_STAT(session->stats.window_updates_out++);
+    stream->recv_window += increment;
+    stream->recv_consumed -= increment;
+    yamux_window_commit(stream, increment);
+}
+
+/**
+ * Record bytes the application consumed from a stream
+ *
+ * Sends a WINDOW_UPDATE for everything consumed so far once that reaches
+ * the threshold. If the frame cannot be queued the credit is kept for the
+ * next call, so it is never lost.
+ *
+ * @param stream Stream whose data was consumed
+ * @param len Number of bytes consumed
+ */
+void yamux_window_release(yamux_stream_t *stream, uint32_t len)
+{
+    uint32_t withheld;
+
+    stream->recv_consumed += len;
+    yamux_window_uncommit(stream, len);
+
+    /* After a shrink, consumed space is not offered to the peer again */
+    if (stream->recv_window_debt > 0) {
+        withheld = (stream->recv_consumed < stream->recv_window_debt) ? stream->recv_consumed
+                                                                      : stream->recv_window_debt;
+        stream->recv_consumed -= withheld;
+        stream->recv_window_debt -= withheld;
+        if (stream->recv_window_debt == 0 && stream->recvbuf.size > stream->recv_window_size) {
+            /* The peer's share fits again; failing to give memory back is harmless */
+            (void)yamux_buffer_resize(&stream->recvbuf, stream->recv_window_size);
+        }
+    }
+
+    /* Credit the budget held back is granted as soon as it can be */
+    if (stream->recv_consumed < yamux_window_threshold(stream) && !stream->recv_blocked) {
+        return;
+    }
+    yamux_window_grant(stream);
+}
+
+/**
+ * Stop counting a stream against the memory budgets
+ *
+ * Called when the stream leaves the session; safe to call more than once.
+ *
+ * @param stream Stream being removed or freed
+ */
+void yamux_window_detach(yamux_stream_t *stream)
+{
+    yamux_window_uncommit(stream, stream->recv_committed);
+    stream->recv_detached = 1;
+    stream->recv_blocked = 0;
+}
+
+/**
+ * Grant credit withheld by a memory budget, where budget is now free
+ *
+ * @param session Session
+ */
+void yamux_window_retry(yamux_session_t *session)
+{
+    yamux_stream_t *stream;
+    uint32_t i;
+
+    if (!session->recv_blocked || yamux_window_budget_room(session) == 0) {
+        return;
+    }
+    session->recv_blocked = 0;
+
+    for (i = 0; i < session->streams.capacity; i++) {
+        stream = session->streams.slots[i];
+        if (stream && stream->recv_blocked) {
+            yamux_window_grant(stream);
+        }
+    }
+}
+
+/**
+ * Shrink a stream's receive window back to its initial size
+ *
+ * Credit already granted cannot be revoked, so the difference is withheld
+ * from future grants; the receive buffer shrinks once it is paid off.
+ *
+ * @param stream Stream to trim
+ */
+void yamux_window_trim(yamux_stream_t *stream)
+{
+    uint32_t initial = yamux_window_initial_size(stream->session);
+
+    if (stream->recv_window_size <= initial) {
+        return;
+    }
+    stream->recv_window_debt += stream->recv_window_size - initial;
+    stream->recv_window_size = initial;
+}
+
+/**
+ * Shrink every stream's receive window back to its initial size
+ *
+ * @param session Session
+ * @return YAMUX_OK on success, error code otherwise
+ */
+yamux_result_t yamux_session_trim_windows(yamux_session_t *session)
+{
+    uint32_t i;
+
+    if (!session) {
+        return YAMUX_ERR_INVALID;
+    }
+
+    yamux_session_lock(session);
+    for (i = 0; i < session->streams.capacity; i++) {
+        if (session->streams.slots[i]) {
+            yamux_window_trim(session->streams.slots[i]);
+        }
+    }
+    yamux_session_unlock(session);
+
+    return YAMUX_OK;
+}
+
+/**
+ * Fold a ping round trip into the smoothed estimate
+ *
+ * @param session Session that sent the ping
+ * @param sample Round trip in milliseconds
+ */
+void yamux_window_rtt_sample(yamux_session_t *session, uint32_t sample)
+{
+    if (sample == 0) {
+        sample = 1;
+    }
+
+    /* Smooth like TCP's SRTT: 7/8 of the old estimate plus 1/8 of the sample */
+    session->rtt_ms = session->rtt_ms ? (session->rtt_ms * 7 + sample) / 8 : sample;
+}
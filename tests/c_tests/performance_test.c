@@ -1,273 +0,0 @@
-#include "../../src/yamux_internal.h"
-#include <stdio.h>
-#include <string.h>
-#include <stdlib.h>
-#include <time.h>
-#include <assert.h>
-#include "mock_io.h"
-
-/* Using mock IO functions from mock_io.h */
-
-/* Performance test with multiple streams and large data transfers */
-void test_stream_throughput(void) {
-    printf("Testing stream throughput performance...\n");
-    yamux_session_t *client_session, *server_session;
-    yamux_io_t client_io, server_io;
-    mock_io_t *client_mock, *server_mock;
-    yamux_config_t config;
-    yamux_result_t result;
-    
-    const int num_streams = 10;
-    const int num_iterations = 50;
-    const size_t data_size = 64 * 1024; /* 64 KB per write */
-    
-    yamux_stream_t *client_streams[num_streams];
-    yamux_stream_t *server_streams[num_streams];
-    
-    uint8_t *data = malloc(data_size);
-    uint8_t *read_buf = malloc(data_size);
-    
-    clock_t start, end;
-    double cpu_time_used;
-    size_t total_bytes = 0;
-    
-    /* Initialize test data */
-    for (size_t i = 0; i < data_size; i++) {
-        data[i] = i & 0xFF;
-    }
-    
-    /* Initialize mock IOs with large buffers */
-    client_mock = mock_io_init(1024 * 1024); /* 1 MB buffer */
-    server_mock = mock_io_init(1024 * 1024);
-    
-    /* Set up IO callbacks */
-    client_io.read = mock_read;
-    client_io.write = mock_write;
-    client_io.ctx = client_mock;
-    
-    server_io.read = mock_read;
-    server_io.write = mock_write;
-    server_io.ctx = server_mock;
-    
-    /* Set config */
-    memset(&config, 0, sizeof(config));
-    config.accept_backlog = 256;
-    /* Note: window size is controlled by YAMUX_DEFAULT_WINDOW_SIZE in yamux_defs.h */
-    
-    /* Create client and server sessions */
-    result = yamux_session_create(&client_io, 1, &config, &client_session);
-    assert(result == YAMUX_OK);
-    
-    result = yamux_session_create(&server_io, 0, &config, &server_session);
-    assert(result == YAMUX_OK);
-    
-    printf("Starting performance test with %d streams, %d iterations, %zu bytes per write\n", 
-           num_streams, num_iterations, data_size);
-    
-    /* Start timing */
-    start = clock();
-    
-    /* Open multiple streams from client */
-    for (int i = 0; i < num_streams; i++) {
-        result = yamux_stream_open_detailed(client_session, 0, &client_streams[i]);
-        if (result != YAMUX_OK) {
-            fprintf(stderr, "Failed to open client stream %d\n", i);
-            goto cleanup;
-        }
-    }
-    
-    /* Process all SYN messages on server side */
-    mock_io_swap_buffers(client_mock, server_mock);
-    
-    for (int i = 0; i < num_streams; i++) {
-        result = yamux_session_process(server_session);
-        assert(result == YAMUX_OK);
-        
-        result = yamux_stream_accept(server_session, &server_streams[i]);
-        assert(result == YAMUX_OK);
-    }
-    
-    /* Process all ACK messages on client side */
-    mock_io_swap_buffers(server_mock, client_mock);
-    
-    for (int i = 0; i < num_streams; i++) {
-        result = yamux_session_process(client_session);
-        assert(result == YAMUX_OK);
-    }
-    
-    /* Transfer data in multiple iterations */
-    for (int iter = 0; iter < num_iterations; iter++) {
-        /* Write data on all streams */
-        for (int i = 0; i < num_streams; i++) {
-            size_t bytes_written;
-            result = yamux_stream_write(client_streams[i], data, data_size, &bytes_written);
-            assert(result == YAMUX_OK);
-        }
-        
-        /* Process all data messages on server side */
-        mock_io_swap_buffers(client_mock, server_mock);
-        
-        while (server_mock->read_buf_used > 0) {
-            result = yamux_session_process(server_session);
-            assert(result == YAMUX_OK);
-        }
-        
-        /* Read data on all streams */
-        for (int i = 0; i < num_streams; i++) {
-            size_t bytes_read = 0;
-            size_t total_read = 0;
-            
-            while (total_read < data_size) {
-                result = yamux_stream_read(server_streams[i], read_buf + total_read, 
-                                        data_size - total_read, &bytes_read);
-                assert(result == YAMUX_OK);
-                
-                if (bytes_read == 0) {
-                    /* No more data available, need to process more */
-                    break;
-                }
-                
-                total_read += bytes_read;
-            }
-            
-            /* Verify data */
-            assert(total_read == data_size);
-            assert(memcmp(data, read_buf, data_size) == 0);
-            
-            total_bytes += total_read;
-        }
-        
-        /* Process window updates on client side */
-        mock_io_swap_buffers(server_mock, client_mock);
-        
-        while (client_mock->read_buf_used > 0) {
-            result = yamux_session_process(client_session);
-            assert(result == YAMUX_OK);
-        }
-    }
-    
-    /* End timing */
-    end = clock();
-    cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
-    
-    /* Calculate throughput */
-    double throughput = (total_bytes / (1024.0 * 1024.0)) / cpu_time_used; /* MB/s */
-    
-    printf("Performance results:\n");
-    printf("  Total data transferred: %.2f MB\n", total_bytes / (1024.0 * 1024.0));
-    printf("  Time elapsed: %.2f seconds\n", cpu_time_used);
-    printf("  Throughput: %.2f MB/s\n", throughput);
-    
-    /* Clean up */
-    for (int i = 0; i < num_streams; i++) {
-        yamux_stream_close(client_streams[i], 0);
-        yamux_stream_close(server_streams[i], 0);
-    }
-    
-    yamux_session_close(client_session, 0);
-    yamux_session_close(server_session, 0);
-    
-    mock_io_free(client_mock);
-    mock_io_free(server_mock);
-    
-    free(data);
-    free(read_buf);
-    return;
-
-cleanup:
-    for (int i = 0; i < num_streams; i++) {
-        if (client_streams[i]) {
-            yamux_stream_close(client_streams[i], 0);
-        }
-    }
-    
-    yamux_session_close(client_session, 0);
-    yamux_session_close(server_session, 0);
-    
-    mock_io_free(client_mock);
-    mock_io_free(server_mock);
-    
-    free(data);
-    free(read_buf);
-}
-
-/* Test session creation and stream processing overhead */
-void test_session_overhead(void) {
-    yamux_session_t *session;
-    yamux_io_t io;
-    mock_io_t *mock;
-    yamux_config_t config;
-    yamux_result_t result;
-    
-    const int num_iterations = 10000;
-    clock_t start, end;
-    double cpu_time_used;
-    
-    /* Initialize mock IO */
-    mock = mock_io_init(4096);
-    
-    /* Set up IO callbacks */
-    io.read = mock_read;
-    io.write = mock_write;
-    io.ctx = mock;
-    
-    /* Set config */
-    memset(&config, 0, sizeof(config));
-    config.accept_backlog = 128;
-    
-    printf("Testing session processing overhead with %d iterations\n", num_iterations);
-    
-    /* Measure session creation time */
-    start = clock();
-    
-    for (int i = 0; i < 1000; i++) {
-        result = yamux_session_create(&io, 1, &config, &session);
-        assert(result == YAMUX_OK);
-        
-        yamux_session_close(session, 0);
-    }
-    
-    end = clock();
-    cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
-    
-    printf("Session creation/destruction (1000 iterations): %.2f ms\n", 
-           cpu_time_used * 1000.0);
-    
-    /* Create a session for processing test */
-    result = yamux_session_create(&io, 1, &config, &session);
-    assert(result == YAMUX_OK);
-    
-    /* Measure session processing time */
-    start = clock();
-    
-    for (int i = 0; i < num_iterations; i++) {
-        result = yamux_session_process(session);
-        assert(result == YAMUX_OK);
-    }
-    
-    end = clock();
-    cpu_time_used = ((double) (end - start)) / CLOCKS_PER_SEC;
-    
-    printf("Session processing (%d iterations): %.2f ms\n", 
-           num_iterations, cpu_time_used * 1000.0);
-    
-    /* Clean up */
-    yamux_session_close(session, 0);
-    mock_io_free(mock);
-}
-
-int main(void) {
-    printf("==== YAMUX PERFORMANCE TESTS ====\n\n");
-    
-    /* Test session overhead */
-    test_session_overhead();
-    
-    printf("\n");
-    
-    /* Test stream throughput */
-    test_stream_throughput();
-    
-    printf("\nAll performance tests completed successfully.\n");
-    
-    return 0;
-}
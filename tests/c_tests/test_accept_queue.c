@@ -0,0 +1,202 @@
+/**
+ * @file test_accept_queue.c
+ * @brief Test for the accept queue order and backlog limit
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+/* SYNs in a flood: four times the default backlog */
+#define ACCEPT_TEST_FLOOD (4 * YAMUX_DEFAULT_ACCEPT_BACKLOG)
+
+static yamux_session_t *create_session(mock_io_t *mock, int client, uint32_t backlog) {
+    yamux_config_t config = yamux_default_config;
+    yamux_io_t io;
+    yamux_session_t *session;
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+    config.accept_backlog = backlog;
+
+    assert_true(yamux_session_create(&io, client, &config, &session) == YAMUX_OK, "Failed to create session");
+    return session;
+}
+
+static yamux_session_t *create_server(mock_io_t *mock, uint32_t backlog) {
+    return create_session(mock, 0, backlog);
+}
+
+/* Feed SYNs for count streams from first_id on and process them */
+static void feed_syns(yamux_session_t *session, mock_io_t *mock, uint32_t first_id, int count) {
+    yamux_header_t header;
+    int i;
+
+    mock->read_buf_used = 0;
+    mock->read_pos = 0;
+    mock->write_buf_used = 0;
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = YAMUX_WINDOW_UPDATE;
+    header.flags = YAMUX_FLAG_SYN;
+    for (i = 0; i < count; i++) {
+        header.stream_id = first_id + 2 * (uint32_t)i;
+        yamux_encode_header(&header, mock->read_buf + mock->read_buf_used);
+        mock->read_buf_used += YAMUX_HEADER_SIZE;
+    }
+    /* As many calls as it takes the ingress buffer to read them all */
+    do {
+        assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process SYNs");
+    } while (mock->read_pos < mock->read_buf_used);
+}
+
+/* Count the RSTs written since the last feed_syns(), noting the last stream reset */
+static int count_resets(mock_io_t *mock, uint32_t *last_id) {
+    yamux_header_t header;
+    size_t pos = 0;
+    int resets = 0;
+
+    while (pos + YAMUX_HEADER_SIZE <= mock->write_buf_used) {
+        assert_true(yamux_decode_header(mock->write_buf + pos, YAMUX_HEADER_SIZE, &header) == YAMUX_OK,
+                    "Bad frame written");
+        if (header.flags & YAMUX_FLAG_RST) {
+            *last_id = header.stream_id;
+            resets++;
+        }
+        pos += YAMUX_HEADER_SIZE + YAMUX_FRAME_PAYLOAD_LEN(&header);
+    }
+    return resets;
+}
+
+/* Streams are accepted in the order their SYNs arrived */
+static void test_accept_fifo(void) {
+    mock_io_t *mock = mock_io_init(1024);
+    yamux_session_t *session = create_server(mock, 0);
+    yamux_session_stats_t stats;
+    yamux_stream_t *stream;
+    uint32_t id;
+
+    feed_syns(session, mock, 1, 3);
+    assert_true(yamux_session_get_stats(session, &stats) == YAMUX_OK && stats.accept_queue_depth == 3,
+                "Queue depth wrong");
+    for (id = 1; id <= 5; id += 2) {
+        assert_true(yamux_stream_accept(session, &stream) == YAMUX_OK && stream->id == id,
+                    "Streams accepted out of order");
+    }
+    assert_true(yamux_stream_accept(session, &stream) == YAMUX_ERR_TIMEOUT, "Empty queue accepted");
+
+    /* The emptied queue takes new streams at its head again */
+    feed_syns(session, mock, 7, 1);
+    assert_true(yamux_stream_accept(session, &stream) == YAMUX_OK && stream->id == 7,
+                "Refilled queue lost its stream");
+    assert_true(yamux_session_get_stats(session, &stats) == YAMUX_OK && stats.accept_queue_depth == 0,
+                "Queue depth after accepting wrong");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* SYNs beyond the backlog are reset at once; accepting makes room */
+static void test_accept_backlog(void) {
+    mock_io_t *mock = mock_io_init(1024);
+    yamux_session_t *session = create_server(mock, 2);
+    yamux_session_stats_t stats;
+    yamux_stream_t *stream;
+    uint32_t reset_id = 0;
+
+    feed_syns(session, mock, 1, 3);
+    assert_true(count_resets(mock, &reset_id) == 1 && reset_id == 5, "Third stream not reset");
+    assert_true(yamux_get_stream(session, 5) == NULL, "Reset stream kept");
+    assert_true(yamux_session_get_stats(session, &stats) == YAMUX_OK && stats.accept_queue_depth == 2 &&
+                (!YAMUX_STATS || stats.accept_overflows == 1) && stats.streams == 2, "Overflow not counted");
+
+    assert_true(yamux_stream_accept(session, &stream) == YAMUX_OK && stream->id == 1, "Accept failed");
+    feed_syns(session, mock, 7, 2);
+    assert_true(count_resets(mock, &reset_id) == 1 && reset_id == 9, "Freed slot not reused");
+    assert_true(yamux_stream_accept(session, &stream) == YAMUX_OK && stream->id == 3 &&
+                yamux_stream_accept(session, &stream) == YAMUX_OK && stream->id == 7,
+                "Queue order wrong after overflow");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* Last stream the client saw reset */
+static uint32_t closed_id;
+
+static void on_closed(yamux_stream_t *stream, void *user_data) {
+    (void)user_data;
+    closed_id = stream->id;
+}
+
+/* Move what one side wrote into the other's input and process it all */
+static void deliver(mock_io_t *from, yamux_session_t *to, mock_io_t *to_mock) {
+    memcpy(to_mock->read_buf, from->write_buf, from->write_buf_used);
+    to_mock->read_buf_used = from->write_buf_used;
+    to_mock->read_pos = 0;
+    from->write_buf_used = 0;
+    do {
+        assert_true(yamux_session_process(to) == YAMUX_OK, "Failed to process delivered frames");
+    } while (to_mock->read_pos < to_mock->read_buf_used);
+}
+
+/* The client's stream refused over the backlog ends up reset, not left half-open */
+static void test_accept_refused_client(void) {
+    mock_io_t *client_mock = mock_io_init(1024);
+    mock_io_t *server_mock = mock_io_init(1024);
+    yamux_session_t *client = create_session(client_mock, 1, 0);
+    yamux_session_t *server = create_server(server_mock, 2);
+    yamux_callbacks_t callbacks;
+    yamux_stream_t *streams[3];
+    yamux_stream_t *stream;
+
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.on_stream_closed = on_closed;
+    assert_true(yamux_session_set_callbacks(client, &callbacks) == YAMUX_OK, "Failed to set callbacks");
+    assert_true(yamux_stream_open_batch(client, 3, streams) == YAMUX_OK, "Failed to open streams");
+
+    closed_id = 0;
+    deliver(client_mock, server, server_mock);
+    deliver(server_mock, client, client_mock);
+    assert_true(closed_id == 5 && yamux_get_stream(client, 5) == NULL, "Refused stream not reset on the client");
+    assert_true(yamux_get_stream(client, 1) != NULL && yamux_get_stream(client, 3) != NULL,
+                "Queued streams reset on the client");
+    assert_true(yamux_stream_accept(server, &stream) == YAMUX_OK && stream->id == 1, "Accept failed");
+
+    /* The reset stream stays the application's until freed */
+    assert_true(yamux_stream_free(streams[2]) == YAMUX_OK, "Failed to free reset stream");
+    yamux_session_close(server, YAMUX_NORMAL);
+    yamux_session_close(client, YAMUX_NORMAL);
+    mock_io_free(server_mock);
+    mock_io_free(client_mock);
+}
+
+/* A flood stops at the default backlog instead of growing the queue */
+static void test_accept_flood(void) {
+    mock_io_t *mock = mock_io_init(ACCEPT_TEST_FLOOD * YAMUX_HEADER_SIZE);
+    yamux_session_t *session = create_server(mock, 0);
+    yamux_session_stats_t stats;
+    uint32_t reset_id = 0;
+
+    feed_syns(session, mock, 1, ACCEPT_TEST_FLOOD);
+    assert_true(count_resets(mock, &reset_id) == ACCEPT_TEST_FLOOD - YAMUX_DEFAULT_ACCEPT_BACKLOG &&
+                reset_id == 2 * ACCEPT_TEST_FLOOD - 1,
+                "Flood past the backlog not reset");
+    assert_true(yamux_session_get_stats(session, &stats) == YAMUX_OK &&
+                stats.accept_queue_depth == YAMUX_DEFAULT_ACCEPT_BACKLOG &&
+                (!YAMUX_STATS || stats.accept_overflows == ACCEPT_TEST_FLOOD - YAMUX_DEFAULT_ACCEPT_BACKLOG),
+                "Queue outgrew the backlog");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+void test_accept_queue(void) {
+    printf("Testing the accept queue...\n");
+
+    test_accept_fifo();
+    test_accept_backlog();
+    test_accept_refused_client();
+    test_accept_flood();
+}
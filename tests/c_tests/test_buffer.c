@@ -10,48 +10,74 @@ void test_buffer(void) {
     yamux_result_t result;
     uint8_t data[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
     uint8_t read_data[16];
+    yamux_iovec_t segs[2];
     size_t bytes_read;
+    int nsegs;
     
     printf("Testing buffer functionality...\n");
     
     /* Initialize buffer */
-    result = yamux_buffer_init(&buffer, 8);
+    result = yamux_buffer_init(&buffer, 16);
     assert(result == YAMUX_OK);
-    assert(buffer.size == 8);
+    assert(buffer.size == 16);
     assert(buffer.used == 0);
     assert(buffer.pos == 0);
     
-    /* Write to buffer (with resize) */
+    /* Fill buffer to capacity */
     result = yamux_buffer_write(&buffer, data, sizeof(data));
     assert(result == YAMUX_OK);
-    assert(buffer.size >= 16);
     assert(buffer.used == 16);
     assert(buffer.pos == 0);
     
+    /* Capacity is fixed: no room for more */
+    result = yamux_buffer_write(&buffer, data, 1);
+    assert(result == YAMUX_ERR_NOMEM);
+    assert(buffer.size == 16);
+    
     /* Read from buffer */
     result = yamux_buffer_read(&buffer, read_data, 8, &bytes_read);
     assert(result == YAMUX_OK);
     assert(bytes_read == 8);
     assert(buffer.pos == 8);
+    assert(buffer.used == 8);
     assert(memcmp(read_data, data, 8) == 0);
     
-    /* Read more from buffer */
-    result = yamux_buffer_read(&buffer, read_data + 8, 8, &bytes_read);
+    /* Write wraps around the end of the storage */
+    result = yamux_buffer_write(&buffer, data, 6);
     assert(result == YAMUX_OK);
-    assert(bytes_read == 8);
-    assert(buffer.pos == 16);
-    assert(memcmp(read_data + 8, data + 8, 8) == 0);
+    assert(buffer.used == 14);
     
-    /* Buffer should be empty now */
-    result = yamux_buffer_read(&buffer, read_data, 8, &bytes_read);
+    /* Peek sees the tail segment, then the wrapped head */
+    nsegs = yamux_buffer_peek(&buffer, segs);
+    assert(nsegs == 2);
+    assert(segs[0].len == 8);
+    assert(memcmp(segs[0].base, data + 8, 8) == 0);
+    assert(segs[1].len == 6);
+    assert(memcmp(segs[1].base, data, 6) == 0);
+    assert(buffer.used == 14);
+    
+    /* Read across the wrap point */
+    result = yamux_buffer_read(&buffer, read_data, 12, &bytes_read);
     assert(result == YAMUX_OK);
-    assert(bytes_read == 0);
+    assert(bytes_read == 12);
+    assert(memcmp(read_data, data + 8, 8) == 0);
+    assert(memcmp(read_data + 8, data, 4) == 0);
+    assert(buffer.used == 2);
+    
+    /* Consume the rest without copying */
+    nsegs = yamux_buffer_peek(&buffer, segs);
+    assert(nsegs == 1);
+    assert(segs[0].len == 2);
+    assert(memcmp(segs[0].base, data + 4, 2) == 0);
+    yamux_buffer_consume(&buffer, segs[0].len);
     
-    /* Compact buffer */
-    result = yamux_buffer_compact(&buffer);
+    /* Buffer should be empty now, and rewound */
+    result = yamux_buffer_read(&buffer, read_data, 8, &bytes_read);
     assert(result == YAMUX_OK);
+    assert(bytes_read == 0);
     assert(buffer.used == 0);
     assert(buffer.pos == 0);
+    assert(yamux_buffer_peek(&buffer, segs) == 0);
     
     /* Free buffer */
     yamux_buffer_free(&buffer);
@@ -36,10 +36,12 @@ void test_concurrent_streams(void) {
     server_mock = mock_io_init(8192);
     
     /* Set up IO callbacks */
+    memset(&client_io, 0, sizeof(client_io));
     client_io.read = mock_read;
     client_io.write = mock_write;
     client_io.ctx = client_mock;
     
+    memset(&server_io, 0, sizeof(server_io));
     server_io.read = mock_read;
     server_io.write = mock_write;
     server_io.ctx = server_mock;
@@ -198,6 +200,11 @@ void test_concurrent_streams(void) {
         state = yamux_stream_get_state(server_streams[i]);
         assert_true(state == YAMUX_STREAM_CLOSED, 
                     "Server stream not in CLOSED state");
+        
+        result = yamux_stream_free(client_streams[i]);
+        assert_true(result == YAMUX_OK, "Failed to free client stream");
+        result = yamux_stream_free(server_streams[i]);
+        assert_true(result == YAMUX_OK, "Failed to free server stream");
     }
     
     /* Clean up */
@@ -0,0 +1,279 @@
+/**
+ * @file test_egress_sched.c
+ * @brief Test for the egress scheduler's priorities and deficit round-robin
+ *
+ * The transport is held blocked while streams queue data, then released;
+ * the order of the frames written shows how the scheduler interleaved them.
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#if YAMUX_SCHED
+
+#define SCHED_TEST_QUANTUM 1024
+#define SCHED_TEST_BULK_LEN (48 * 1024)
+
+/* Transport that takes nothing while blocked */
+static int sched_blocked;
+
+static int sched_write(void *ctx, const uint8_t *buf, size_t len) {
+    if (sched_blocked) {
+        return 0;
+    }
+    return mock_write(ctx, buf, len);
+}
+
+/* One frame of the output */
+typedef struct {
+    uint8_t type;
+    uint16_t flags;
+    uint32_t stream_id;
+    uint32_t length;
+} sched_frame_t;
+
+/* Decode the frames written so far, from *pos on */
+static int next_frame(mock_io_t *mock, size_t *pos, sched_frame_t *frame) {
+    yamux_header_t header;
+
+    if (*pos + YAMUX_HEADER_SIZE > mock->write_buf_used ||
+        yamux_decode_header(mock->write_buf + *pos, YAMUX_HEADER_SIZE, &header) != YAMUX_OK) {
+        return 0;
+    }
+    frame->type = header.type;
+    frame->flags = header.flags;
+    frame->stream_id = header.stream_id;
+    frame->length = (header.type == YAMUX_DATA) ? header.length : 0;
+    *pos += YAMUX_HEADER_SIZE + YAMUX_FRAME_PAYLOAD_LEN(&header); /* Window updates carry small payloads too */
+    return 1;
+}
+
+static yamux_session_t *create_scheduled(mock_io_t *mock) {
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session;
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = sched_write;
+    io.ctx = mock;
+
+    config = yamux_default_config;
+    config.egress_quantum = SCHED_TEST_QUANTUM;
+    assert_true(yamux_session_create(&io, 1, &config, &session) == YAMUX_OK, "Failed to create session");
+    return session;
+}
+
+/* Write len bytes, as much as the stream's queue takes */
+static size_t queue_data(yamux_stream_t *stream, size_t len) {
+    static uint8_t data[SCHED_TEST_BULK_LEN];
+    size_t written = 0;
+
+    assert_true(yamux_stream_write(stream, data, len, &written) == YAMUX_OK, "Scheduled write failed");
+    return written;
+}
+
+/* A high-priority stream and a ping overtake queued bulk data */
+static void test_sched_priority(void) {
+    mock_io_t *mock = mock_io_init(4096);
+    yamux_session_t *session = create_scheduled(mock);
+    yamux_stream_t *bulk;
+    yamux_stream_t *urgent;
+    sched_frame_t frame;
+    size_t bulk_before = 0;
+    size_t pos = 0;
+    int ping_seen = 0;
+    int urgent_seen = 0;
+
+    assert_true(yamux_stream_open_detailed(session, 0, &bulk) == YAMUX_OK &&
+                yamux_stream_open_detailed(session, 0, &urgent) == YAMUX_OK, "Failed to open streams");
+    assert_true(yamux_stream_set_priority(urgent, YAMUX_PRIORITY_LEVELS, 1) == YAMUX_ERR_INVALID &&
+                yamux_stream_set_priority(urgent, 0, 0) == YAMUX_ERR_INVALID, "Bad priority accepted");
+    assert_true(yamux_stream_set_priority(urgent, 0, 1) == YAMUX_OK, "Failed to set priority");
+    pos = mock->write_buf_used; /* Past the SYNs */
+
+    sched_blocked = 1;
+    assert_true(queue_data(bulk, SCHED_TEST_BULK_LEN) == SCHED_TEST_BULK_LEN, "Bulk data not queued");
+    assert_true(bulk->sendq.used > 0 && session->send_buf_used <= session->send_buf_size,
+                "Bulk data should wait on the stream");
+    assert_true(yamux_session_ping(session) == YAMUX_OK, "Failed to queue ping");
+    assert_true(queue_data(urgent, 100) == 100, "Urgent data not queued");
+
+    sched_blocked = 0;
+    assert_true(yamux_session_flush(session) == YAMUX_OK, "Flush failed");
+    assert_true(bulk->sendq.used == 0 && urgent->sendq.used == 0, "Scheduled data left behind");
+
+    while (next_frame(mock, &pos, &frame) && !urgent_seen) {
+        if (frame.type == YAMUX_PING) {
+            ping_seen = 1;
+        } else if (frame.stream_id == urgent->id) {
+            urgent_seen = 1;
+        } else if (frame.stream_id == bulk->id) {
+            bulk_before += frame.length;
+        }
+    }
+    assert_true(ping_seen && urgent_seen, "Ping or urgent data missing");
+    assert_true(bulk_before <= session->send_buf_size / 2,
+                "Urgent data waited behind more than half the egress queue");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* Streams at one level share it by weight */
+static void test_sched_weights(void) {
+    mock_io_t *mock = mock_io_init(4096);
+    yamux_session_t *session = create_scheduled(mock);
+    yamux_stream_t *light;
+    yamux_stream_t *heavy;
+    sched_frame_t frame;
+    size_t light_bytes = 0;
+    size_t heavy_bytes = 0;
+    size_t pos;
+
+    assert_true(yamux_stream_open_detailed(session, 0, &light) == YAMUX_OK &&
+                yamux_stream_open_detailed(session, 0, &heavy) == YAMUX_OK, "Failed to open streams");
+    assert_true(yamux_stream_set_priority(heavy, YAMUX_DEFAULT_PRIORITY, 3) == YAMUX_OK,
+                "Failed to set weight");
+
+    sched_blocked = 1;
+    assert_true(queue_data(light, SCHED_TEST_BULK_LEN) == SCHED_TEST_BULK_LEN &&
+                queue_data(heavy, SCHED_TEST_BULK_LEN) == SCHED_TEST_BULK_LEN, "Data not queued");
+    pos = mock->write_buf_used;
+    sched_blocked = 0;
+    assert_true(yamux_session_flush(session) == YAMUX_OK, "Flush failed");
+
+    /* From the heavy stream's first frame until its last, it gets three times the bytes */
+    while (next_frame(mock, &pos, &frame) && heavy_bytes < SCHED_TEST_BULK_LEN) {
+        if (frame.stream_id == heavy->id) {
+            heavy_bytes += frame.length;
+        } else if (frame.stream_id == light->id && heavy_bytes > 0) {
+            light_bytes += frame.length;
+        }
+    }
+    assert_true(heavy_bytes == SCHED_TEST_BULK_LEN, "Heavy stream data missing");
+    assert_true(light_bytes + SCHED_TEST_QUANTUM >= SCHED_TEST_BULK_LEN / 3 &&
+                light_bytes <= SCHED_TEST_BULK_LEN / 3 + SCHED_TEST_QUANTUM,
+                "Bandwidth not shared 1:3");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* FIN follows a stream's queued data; RST drops it */
+static void test_sched_close(void) {
+    mock_io_t *mock = mock_io_init(4096);
+    yamux_session_t *session = create_scheduled(mock);
+    yamux_stream_t *finished;
+    yamux_stream_t *reset;
+    sched_frame_t frame;
+    uint32_t reset_id;
+    size_t finished_bytes = 0;
+    size_t pos;
+    int fin_after = 0;
+
+    assert_true(yamux_stream_open_detailed(session, 0, &finished) == YAMUX_OK &&
+                yamux_stream_open_detailed(session, 0, &reset) == YAMUX_OK, "Failed to open streams");
+    reset_id = reset->id;
+
+    sched_blocked = 1;
+    pos = mock->write_buf_used;
+    assert_true(queue_data(finished, SCHED_TEST_BULK_LEN) == SCHED_TEST_BULK_LEN &&
+                queue_data(reset, SCHED_TEST_BULK_LEN) == SCHED_TEST_BULK_LEN, "Data not queued");
+    assert_true(yamux_stream_close(finished, 0) == YAMUX_OK, "Close failed");
+    assert_true(yamux_stream_close(reset, 1) == YAMUX_OK, "Reset failed");
+    sched_blocked = 0;
+    assert_true(yamux_session_flush(session) == YAMUX_OK, "Flush failed");
+
+    while (next_frame(mock, &pos, &frame)) {
+        if (frame.stream_id == finished->id && (frame.flags & YAMUX_FLAG_FIN)) {
+            fin_after = (finished_bytes == SCHED_TEST_BULK_LEN);
+        } else if (frame.stream_id == finished->id) {
+            finished_bytes += frame.length;
+        } else if (frame.stream_id == reset_id && !(frame.flags & YAMUX_FLAG_RST)) {
+            /* Only what reached the egress queue before the reset */
+            assert_true(frame.length <= SCHED_TEST_QUANTUM, "Reset stream data still sent");
+        }
+    }
+    assert_true(fin_after, "FIN overtook the stream's data");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+#if !YAMUX_FIXED_FRAME_SIZE
+/* A stream's own frame limit, larger than the session's, sets its frame size */
+static void test_sched_frame_limit(void) {
+    mock_io_t *mock = mock_io_init(4096);
+    yamux_config_t config = yamux_default_config;
+    yamux_session_t *session;
+    yamux_stream_t *bulk;
+    yamux_io_t io;
+    sched_frame_t frame;
+    uint32_t largest = 0;
+    size_t pos;
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = sched_write;
+    io.ctx = mock;
+    config.egress_quantum = SCHED_TEST_BULK_LEN;
+    config.max_frame_size = SCHED_TEST_QUANTUM;
+    config.write_buffer_size = 4 * SCHED_TEST_BULK_LEN;
+    assert_true(yamux_session_create(&io, 1, &config, &session) == YAMUX_OK, "Failed to create session");
+    assert_true(yamux_stream_open_detailed(session, 0, &bulk) == YAMUX_OK &&
+                yamux_stream_set_max_frame_size(bulk, 16 * SCHED_TEST_QUANTUM) == YAMUX_OK,
+                "Failed to open stream");
+
+    sched_blocked = 1;
+    pos = mock->write_buf_used;
+    assert_true(queue_data(bulk, SCHED_TEST_BULK_LEN) == SCHED_TEST_BULK_LEN, "Data not queued");
+    sched_blocked = 0;
+    assert_true(yamux_session_flush(session) == YAMUX_OK && bulk->sendq.used == 0, "Flush failed");
+
+    while (next_frame(mock, &pos, &frame)) {
+        if (frame.stream_id == bulk->id && frame.length > largest) {
+            largest = frame.length;
+        }
+    }
+    assert_true(largest == 16 * SCHED_TEST_QUANTUM, "Frames cut to the session's frame limit");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+#endif
+
+void test_egress_sched(void) {
+    printf("Testing the egress scheduler...\n");
+
+    test_sched_priority();
+    test_sched_weights();
+    test_sched_close();
+#if !YAMUX_FIXED_FRAME_SIZE
+    test_sched_frame_limit();
+#endif
+}
+
+#else
+
+/* Test that sessions asking for the scheduler are refused */
+void test_egress_sched(void) {
+    yamux_config_t config = yamux_default_config;
+    mock_io_t *mock = mock_io_init(1024);
+    yamux_session_t *session;
+    yamux_io_t io;
+
+    printf("Testing the egress scheduler is compiled out...\n");
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+    config.egress_quantum = 1024;
+    assert_true(yamux_session_create(&io, 1, &config, &session) == YAMUX_ERR_INVALID,
+                "Scheduled session accepted");
+
+    mock_io_free(mock);
+}
+
+#endif /* YAMUX_SCHED */
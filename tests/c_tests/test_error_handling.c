@@ -117,6 +117,7 @@ void test_error_handling(void) {
     error_io = error_io_init();
     
     /* Set up IO callbacks */
+    memset(&io, 0, sizeof(io));
     io.read = error_read;
     io.write = error_write;
     io.ctx = error_io;
@@ -133,6 +134,8 @@ void test_error_handling(void) {
     result = yamux_stream_open_detailed(session, 0xFFFFFFFF, &stream);
     assert_true(result == YAMUX_ERR_INVALID, "Should fail with invalid stream ID 0xFFFFFFFF");
     
+    yamux_session_close(session, 0);
+    
     /* Clean up IO resources */
     if (error_io) {
         error_io_free(error_io);
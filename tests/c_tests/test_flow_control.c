@@ -305,11 +305,13 @@ void test_flow_control(void) {
     fflush(stdout);
     
     result = yamux_close_stream(client_stream, 0);
+    client_stream = NULL; /* Handle is freed by yamux_close_stream */
     if (result < 0) {
         printf("ERROR: Failed to close client stream, result=%d\n", result);
     }
     
     result = yamux_close_stream(server_stream, 0);
+    server_stream = NULL;
     if (result < 0) {
         printf("ERROR: Failed to close server stream, result=%d\n", result);
     }
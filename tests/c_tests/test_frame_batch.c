@@ -0,0 +1,154 @@
+/**
+ * @file test_frame_batch.c
+ * @brief Test for the batched frame header decoder
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define BATCH_TEST_PINGS (3 * YAMUX_DECODE_BATCH + 1)
+
+/* Append a frame with a patterned payload at buf + *pos (a PING's length is its ID) */
+static void put_frame(uint8_t *buf, size_t *pos, uint8_t type, uint16_t flags, uint32_t stream_id,
+                      uint32_t length) {
+    yamux_header_t header;
+    uint32_t payload_len;
+    uint32_t i;
+
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = type;
+    header.flags = flags;
+    header.stream_id = stream_id;
+    header.length = length;
+    payload_len = YAMUX_FRAME_PAYLOAD_LEN(&header);
+    yamux_encode_header(&header, buf + *pos);
+    for (i = 0; i < payload_len; i++) {
+        buf[*pos + YAMUX_HEADER_SIZE + i] = (uint8_t)(i + stream_id);
+    }
+    *pos += YAMUX_HEADER_SIZE + payload_len;
+}
+
+/* Headers survive the round trip, field for field */
+static void test_batch_round_trip(void) {
+    static const yamux_header_t cases[] = {
+        {YAMUX_PROTO_VERSION, YAMUX_DATA, 0x0000, 0x00000000, 0x00000000},
+        {YAMUX_PROTO_VERSION, YAMUX_WINDOW_UPDATE, 0x0001, 0x00000001, 0x00040000},
+        {YAMUX_PROTO_VERSION, YAMUX_PING, 0x8002, 0x80000001, 0x00000004},
+        {YAMUX_PROTO_VERSION, YAMUX_GO_AWAY, 0xFFFF, 0xFFFFFFFF, 0xFFFFFFFF},
+    };
+    static const uint8_t wire[YAMUX_HEADER_SIZE] = {0x00, 0x02, 0x80, 0x02, 0x80, 0x00, 0x00, 0x01,
+                                                    0x00, 0x00, 0x00, 0x04};
+    uint8_t buf[YAMUX_HEADER_SIZE + 1];
+    yamux_header_t header;
+    size_t i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        /* Unaligned on purpose */
+        assert_true(yamux_encode_header(&cases[i], buf + 1) == YAMUX_OK &&
+                    yamux_decode_header(buf + 1, YAMUX_HEADER_SIZE, &header) == YAMUX_OK, "Round trip failed");
+        assert_true(memcmp(&header, &cases[i], sizeof(header)) == 0, "Header changed in the round trip");
+    }
+    assert_true(yamux_encode_header(&cases[2], buf) == YAMUX_OK && memcmp(buf, wire, sizeof(wire)) == 0,
+                "Header not big-endian on the wire");
+
+    /* Version and type are checked together */
+    memcpy(buf, wire, sizeof(wire));
+    buf[0] = YAMUX_PROTO_VERSION + 1;
+    buf[1] = YAMUX_DATA;
+    assert_true(yamux_decode_header(buf, YAMUX_HEADER_SIZE, &header) == YAMUX_ERR_PROTOCOL, "Bad version accepted");
+    buf[0] = YAMUX_PROTO_VERSION;
+    buf[1] = YAMUX_GO_AWAY + 1;
+    assert_true(yamux_decode_header(buf, YAMUX_HEADER_SIZE, &header) == YAMUX_ERR_PROTOCOL, "Bad type accepted");
+    assert_true(yamux_decode_header(wire, YAMUX_HEADER_SIZE - 1, &header) == YAMUX_ERR_INVALID,
+                "Short header accepted");
+}
+
+/* Complete frames are found in one pass, up to the first incomplete or malformed one */
+static void test_batch_decode(void) {
+    uint8_t buf[256];
+    yamux_frame_desc_t frames[8];
+    yamux_result_t status;
+    size_t len = 0;
+    size_t n;
+
+    put_frame(buf, &len, YAMUX_PING, YAMUX_FLAG_SYN, 0, 0x12345678);
+    put_frame(buf, &len, YAMUX_WINDOW_UPDATE, 0, 3, 0);
+    put_frame(buf, &len, YAMUX_DATA, 0, 5, 20);
+    put_frame(buf, &len, YAMUX_DATA, YAMUX_FLAG_FIN, 7, 30);
+
+    n = yamux_decode_frames(buf, len, frames, 8, &status);
+    assert_true(n == 4 && status == YAMUX_ERR_WOULD_BLOCK, "Not every complete frame decoded");
+    assert_true(frames[0].offset == 0 && frames[0].header.type == YAMUX_PING &&
+                frames[0].header.length == 0x12345678 &&
+                frames[1].offset == 12 && frames[1].header.stream_id == 3 &&
+                frames[2].offset == 24 && frames[2].header.length == 20 &&
+                frames[3].offset == 56 && frames[3].header.flags == YAMUX_FLAG_FIN, "Descriptors wrong");
+
+    /* The batch size bounds it */
+    n = yamux_decode_frames(buf, len, frames, 2, &status);
+    assert_true(n == 2 && status == YAMUX_OK, "Batch limit not kept");
+
+    /* A payload or header cut short ends the batch */
+    n = yamux_decode_frames(buf, len - 1, frames, 8, &status);
+    assert_true(n == 3 && status == YAMUX_ERR_WOULD_BLOCK, "Incomplete payload decoded");
+    n = yamux_decode_frames(buf, 12 + YAMUX_HEADER_SIZE - 1, frames, 8, &status);
+    assert_true(n == 1 && status == YAMUX_ERR_WOULD_BLOCK, "Incomplete header decoded");
+
+    /* A malformed header stops it after the frames before it */
+    buf[24 + 1] = 0x7F;
+    n = yamux_decode_frames(buf, len, frames, 8, &status);
+    assert_true(n == 2 && status == YAMUX_ERR_PROTOCOL, "Malformed header not reported");
+}
+
+/* A storm of pings spanning several batches is answered in one process call */
+static void test_batch_ping_storm(void) {
+    mock_io_t *mock = mock_io_init((BATCH_TEST_PINGS + 1) * YAMUX_HEADER_SIZE);
+    yamux_header_t header;
+    yamux_session_t *session;
+    yamux_io_t io;
+    size_t len = 0;
+    size_t pos = 0;
+    int acks = 0;
+    int i;
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+    assert_true(yamux_session_create(&io, 0, NULL, &session) == YAMUX_OK, "Failed to create session");
+
+    for (i = 0; i < BATCH_TEST_PINGS; i++) {
+        put_frame(mock->read_buf, &len, YAMUX_PING, YAMUX_FLAG_SYN, 0, (uint32_t)i + 1);
+    }
+    /* Followed by the start of a frame that is not all here yet */
+    put_frame(mock->read_buf, &len, YAMUX_PING, YAMUX_FLAG_SYN, 0, BATCH_TEST_PINGS + 1);
+    mock->read_buf_used = len - 6;
+
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process pings");
+    while (pos < mock->write_buf_used) {
+        assert_true(yamux_decode_header(mock->write_buf + pos, YAMUX_HEADER_SIZE, &header) == YAMUX_OK &&
+                    header.type == YAMUX_PING && header.flags == YAMUX_FLAG_ACK, "Not a ping ACK");
+        assert_true(header.length == (uint32_t)acks + 1, "ACK does not echo the ping ID");
+        pos += YAMUX_HEADER_SIZE;
+        acks++;
+    }
+    assert_true(acks == BATCH_TEST_PINGS, "Pings not all answered");
+    assert_true(session->recv_buf_end - session->recv_buf_start == YAMUX_HEADER_SIZE - 6,
+                "Partial frame not kept");
+
+    /* Its last bytes complete it */
+    mock->read_buf_used = len;
+    assert_true(yamux_session_process(session) == YAMUX_OK && mock->write_buf_used == pos + YAMUX_HEADER_SIZE,
+                "Completed frame not handled");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+void test_frame_batch(void) {
+    printf("Testing batched frame decoding...\n");
+
+    test_batch_round_trip();
+    test_batch_decode();
+    test_batch_ping_storm();
+}
@@ -0,0 +1,182 @@
+/**
+ * @file test_frame_reader.c
+ * @brief Test for the session's buffered frame reader
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define READER_TEST_DATA_LEN 100
+#define READER_TEST_PINGS 3
+
+/* Append an encoded frame to the mock's inbound data (a PING's length is its ID) */
+static void append_frame(mock_io_t *mock, uint8_t type, uint16_t flags, uint32_t stream_id,
+                         const uint8_t *payload, uint32_t length) {
+    yamux_header_t header;
+    
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = type;
+    header.flags = flags;
+    header.stream_id = stream_id;
+    header.length = length;
+    length = YAMUX_FRAME_PAYLOAD_LEN(&header);
+    
+    assert_true(mock->read_buf_used + YAMUX_HEADER_SIZE + length <= mock->read_buf_size,
+                "Mock read buffer too small");
+    yamux_encode_header(&header, mock->read_buf + mock->read_buf_used);
+    mock->read_buf_used += YAMUX_HEADER_SIZE;
+    if (length > 0) {
+        memcpy(mock->read_buf + mock->read_buf_used, payload, length);
+        mock->read_buf_used += length;
+    }
+}
+
+/* Queue a stream open, several pings and a data frame */
+static void queue_frames(mock_io_t *mock) {
+    uint8_t window[4] = {0x00, 0x04, 0x00, 0x00};  /* 256 KB */
+    uint8_t data[READER_TEST_DATA_LEN];
+    int i;
+    
+    memset(data, 0xAB, sizeof(data));
+    append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 1, window, sizeof(window));
+    for (i = 0; i < READER_TEST_PINGS; i++) {
+        append_frame(mock, YAMUX_PING, 0, 0, NULL, (uint32_t)i + 1);
+    }
+    append_frame(mock, YAMUX_DATA, 0, 1, data, sizeof(data));
+}
+
+/* Check that every queued frame took effect on the server session */
+static void check_frames_handled(yamux_session_t *session, mock_io_t *mock) {
+    yamux_stream_t *stream;
+    size_t expected_out;
+    
+    stream = yamux_get_stream(session, 1);
+    assert_true(stream != NULL, "Stream was not created from SYN");
+    assert_true(stream->recvbuf.used == READER_TEST_DATA_LEN, "DATA payload not delivered");
+    
+    /* SYN-ACK with window payload, then one bare ping ACK per request */
+    expected_out = (YAMUX_HEADER_SIZE + 4) + READER_TEST_PINGS * YAMUX_HEADER_SIZE;
+    assert_true(mock->write_buf_used == expected_out, "Unexpected response bytes");
+}
+
+/* Test that one process call drains all buffered frames */
+void test_frame_reader(void) {
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session;
+    yamux_result_t result;
+    mock_io_t *mock;
+    int calls;
+    
+    printf("Testing buffered frame reader...\n");
+    
+    /* Default buffer: everything arrives in one read */
+    mock = mock_io_init(4096);
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+    
+    result = yamux_session_create(&io, 0, NULL, &session);
+    assert_true(result == YAMUX_OK, "Failed to create server session");
+    
+    queue_frames(mock);
+    result = yamux_session_process(session);
+    assert_true(result == YAMUX_OK, "Failed to process buffered frames");
+    assert_true(mock->read_pos == mock->read_buf_used, "Frames left unread after one call");
+    check_frames_handled(session, mock);
+    
+    /* An idle call is not an error */
+    result = yamux_session_process(session);
+    assert_true(result == YAMUX_OK, "Idle process call failed");
+    
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+    
+    /* Minimal buffer: frames straddle reads and the DATA payload arrives in pieces */
+    mock = mock_io_init(4096);
+    io.ctx = mock;
+    memset(&config, 0, sizeof(config));
+    config.read_buffer_size = 1;
+    
+    result = yamux_session_create(&io, 0, &config, &session);
+    assert_true(result == YAMUX_OK, "Failed to create session with small buffer");
+    
+    queue_frames(mock);
+    for (calls = 0; calls < 64 && mock->read_pos < mock->read_buf_used; calls++) {
+        result = yamux_session_process(session);
+        assert_true(result == YAMUX_OK || result == YAMUX_ERR_WOULD_BLOCK,
+                    "Failed to process partial frames");
+    }
+    assert_true(mock->read_pos == mock->read_buf_used, "Small buffer did not consume input");
+    assert_true(calls > 1, "Small buffer should need several reads");
+    
+    /* The last read may have left a complete frame for the next call */
+    result = yamux_session_process(session);
+    assert_true(result == YAMUX_OK, "Failed to process trailing frame");
+    check_frames_handled(session, mock);
+    
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* Test that a frame split across calls is resumed without losing bytes */
+void test_frame_reader_partial(void) {
+    yamux_io_t io;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    yamux_result_t result;
+    mock_io_t *mock;
+    size_t total;
+    
+    printf("Testing resumable frame parser...\n");
+    
+    mock = mock_io_init(4096);
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+    
+    result = yamux_session_create(&io, 0, NULL, &session);
+    assert_true(result == YAMUX_OK, "Failed to create server session");
+    
+    /* Build the input up front, then release it a few bytes at a time */
+    queue_frames(mock);
+    total = mock->read_buf_used;
+    
+    /* Half a header: nothing to handle yet */
+    mock->read_buf_used = YAMUX_HEADER_SIZE / 2;
+    result = yamux_session_process(session);
+    assert_true(result == YAMUX_ERR_WOULD_BLOCK, "Partial header should would-block");
+    result = yamux_session_process(session);
+    assert_true(result == YAMUX_ERR_WOULD_BLOCK, "Idle partial header should would-block");
+    
+    /* The rest of the SYN plus the pings */
+    mock->read_buf_used = total - READER_TEST_DATA_LEN - YAMUX_HEADER_SIZE;
+    result = yamux_session_process(session);
+    assert_true(result == YAMUX_OK, "Failed to complete the SYN frame");
+    stream = yamux_get_stream(session, 1);
+    assert_true(stream != NULL, "Stream was not created from resumed SYN");
+    
+    /* DATA header and part of its payload */
+    mock->read_buf_used = total - READER_TEST_DATA_LEN / 2;
+    result = yamux_session_process(session);
+    assert_true(result == YAMUX_OK, "Failed to start DATA payload");
+    assert_true(stream->recvbuf.used == READER_TEST_DATA_LEN - READER_TEST_DATA_LEN / 2,
+                "Partial payload not delivered");
+    result = yamux_session_process(session);
+    assert_true(result == YAMUX_ERR_WOULD_BLOCK, "Mid-payload idle call should would-block");
+    
+    /* Remainder of the payload */
+    mock->read_buf_used = total;
+    result = yamux_session_process(session);
+    assert_true(result == YAMUX_OK, "Failed to finish DATA payload");
+    check_frames_handled(session, mock);
+    
+    result = yamux_session_process(session);
+    assert_true(result == YAMUX_OK, "Idle process call failed");
+    
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
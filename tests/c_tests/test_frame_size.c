@@ -0,0 +1,160 @@
+/**
+ * @file test_frame_size.c
+ * @brief Test for the configurable DATA frame size limits
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define FRAME_TEST_LEN (64 * 1024)
+
+/* Collect the payload lengths of the DATA frames written, from *pos on */
+static int data_frames(mock_io_t *mock, size_t *pos, uint32_t *lengths, int max) {
+    yamux_header_t header;
+    int n = 0;
+
+    while (*pos + YAMUX_HEADER_SIZE <= mock->write_buf_used && n < max &&
+           yamux_decode_header(mock->write_buf + *pos, YAMUX_HEADER_SIZE, &header) == YAMUX_OK) {
+        if (header.type == YAMUX_DATA) {
+            lengths[n++] = header.length;
+        }
+        *pos += YAMUX_HEADER_SIZE + YAMUX_FRAME_PAYLOAD_LEN(&header);
+    }
+    return n;
+}
+
+static yamux_session_t *create_session(mock_io_t *mock, int client, uint32_t max_frame, uint32_t max_recv) {
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session;
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+
+    config = yamux_default_config;
+    config.max_frame_size = max_frame;
+    config.max_recv_frame_size = max_recv;
+    assert_true(yamux_session_create(&io, client, &config, &session) == YAMUX_OK, "Failed to create session");
+    return session;
+}
+
+#if !YAMUX_FIXED_FRAME_SIZE
+
+/* Test that sends respect the session and stream limits, and receives the receive limit */
+void test_frame_size(void) {
+    static uint8_t data[FRAME_TEST_LEN];
+    uint8_t frame[YAMUX_HEADER_SIZE + 2048];
+    uint8_t syn[4] = {0x00, 0x04, 0x00, 0x00};
+    uint32_t lengths[8];
+    yamux_header_t header;
+    mock_io_t *mock;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    size_t written;
+    size_t pos;
+
+    printf("Testing DATA frame size limits...\n");
+
+    /* The default stays at YAMUX_MAX_DATA_FRAME_SIZE */
+    mock = mock_io_init(4096);
+    session = create_session(mock, 1, 0, 0);
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    pos = mock->write_buf_used;
+    assert_true(yamux_stream_write(stream, data, FRAME_TEST_LEN, &written) == YAMUX_OK &&
+                written == FRAME_TEST_LEN, "Write failed");
+    assert_true(data_frames(mock, &pos, lengths, 8) == FRAME_TEST_LEN / YAMUX_MAX_DATA_FRAME_SIZE &&
+                lengths[0] == YAMUX_MAX_DATA_FRAME_SIZE, "Default frame size changed");
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+
+    /* A larger session limit sends a 64 KB write as one frame; a stream may go smaller */
+    mock = mock_io_init(4096);
+    session = create_session(mock, 1, FRAME_TEST_LEN, 0);
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    pos = mock->write_buf_used;
+    assert_true(yamux_stream_write(stream, data, FRAME_TEST_LEN, &written) == YAMUX_OK &&
+                written == FRAME_TEST_LEN, "Write failed");
+    assert_true(data_frames(mock, &pos, lengths, 8) == 1 && lengths[0] == FRAME_TEST_LEN,
+                "Write not sent as one frame");
+
+    assert_true(yamux_stream_set_max_frame_size(NULL, 0) == YAMUX_ERR_INVALID, "NULL stream accepted");
+    assert_true(yamux_stream_set_max_frame_size(stream, 4096) == YAMUX_OK, "Failed to set stream limit");
+    assert_true(yamux_stream_write(stream, data, 10000, &written) == YAMUX_OK && written == 10000,
+                "Write failed");
+    assert_true(data_frames(mock, &pos, lengths, 8) == 3 && lengths[0] == 4096 && lengths[1] == 4096 &&
+                lengths[2] == 10000 - 2 * 4096, "Stream limit not applied");
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+
+    /* Frames past the receive limit are a protocol error */
+    mock = mock_io_init(8192);
+    session = create_session(mock, 0, 0, 1024);
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = YAMUX_WINDOW_UPDATE;
+    header.flags = YAMUX_FLAG_SYN;
+    header.stream_id = 1;
+    header.length = sizeof(syn);
+    yamux_encode_header(&header, frame);
+    memcpy(frame + YAMUX_HEADER_SIZE, syn, sizeof(syn));
+    memcpy(mock->read_buf, frame, YAMUX_HEADER_SIZE + sizeof(syn));
+    mock->read_buf_used = YAMUX_HEADER_SIZE + sizeof(syn);
+
+    header.type = YAMUX_DATA;
+    header.flags = 0;
+    header.length = 1024;
+    yamux_encode_header(&header, mock->read_buf + mock->read_buf_used);
+    mock->read_buf_used += YAMUX_HEADER_SIZE + 1024;
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Frame at the limit rejected");
+    assert_true(yamux_get_stream(session, 1)->recvbuf.used == 1024, "Frame at the limit not delivered");
+
+    header.length = 2048;
+    yamux_encode_header(&header, mock->read_buf + mock->read_buf_used);
+    mock->read_buf_used += YAMUX_HEADER_SIZE + 2048;
+    assert_true(yamux_session_process(session) == YAMUX_ERR_PROTOCOL, "Oversized frame accepted");
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+#else
+
+/* Test that the compiled-in frame size is the only one taken, and the one sent */
+void test_frame_size(void) {
+    static uint8_t data[2 * YAMUX_MAX_DATA_FRAME_SIZE];
+    uint32_t lengths[8];
+    yamux_config_t config = yamux_default_config;
+    yamux_io_t io;
+    mock_io_t *mock;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    size_t written;
+    size_t pos;
+
+    printf("Testing the fixed DATA frame size...\n");
+
+    mock = mock_io_init(4096);
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+    config.max_frame_size = YAMUX_MAX_DATA_FRAME_SIZE / 2;
+    assert_true(yamux_session_create(&io, 1, &config, &session) == YAMUX_ERR_INVALID,
+                "Other session frame size accepted");
+
+    session = create_session(mock, 1, YAMUX_MAX_DATA_FRAME_SIZE, 0);
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    assert_true(yamux_stream_set_max_frame_size(stream, YAMUX_MAX_DATA_FRAME_SIZE / 2) == YAMUX_ERR_INVALID &&
+                yamux_stream_set_max_frame_size(stream, 0) == YAMUX_OK, "Other stream frame size accepted");
+    pos = mock->write_buf_used;
+    assert_true(yamux_stream_write(stream, data, sizeof(data), &written) == YAMUX_OK && written == sizeof(data),
+                "Write failed");
+    assert_true(data_frames(mock, &pos, lengths, 8) == 2 && lengths[0] == YAMUX_MAX_DATA_FRAME_SIZE &&
+                lengths[1] == YAMUX_MAX_DATA_FRAME_SIZE, "Frames not of the fixed size");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+#endif /* YAMUX_FIXED_FRAME_SIZE */
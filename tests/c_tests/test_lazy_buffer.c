@@ -0,0 +1,106 @@
+/**
+ * @file test_lazy_buffer.c
+ * @brief Test for receive buffers allocated only while a stream holds data
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define LAZY_TEST_SMALL_LEN 16
+#define LAZY_TEST_LARGE_LEN 1000
+
+/* Append an encoded frame to the mock's inbound data */
+static void append_frame(mock_io_t *mock, uint8_t type, uint16_t flags, uint32_t stream_id,
+                         const uint8_t *payload, uint32_t length) {
+    yamux_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = type;
+    header.flags = flags;
+    header.stream_id = stream_id;
+    header.length = length;
+
+    yamux_encode_header(&header, mock->read_buf + mock->read_buf_used);
+    mock->read_buf_used += YAMUX_HEADER_SIZE;
+    if (length > 0) {
+        memcpy(mock->read_buf + mock->read_buf_used, payload, length);
+        mock->read_buf_used += length;
+    }
+}
+
+/* Feed everything queued on the mock to the session */
+static void deliver(yamux_session_t *session, mock_io_t *mock) {
+    int calls;
+
+    for (calls = 0; calls < 64 && mock->read_pos < mock->read_buf_used; calls++) {
+        assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process frames");
+    }
+}
+
+/* Test that streams take buffer storage on first data and give it back when drained */
+void test_lazy_buffer(void) {
+    uint8_t window[4] = {0x00, 0x04, 0x00, 0x00};
+    uint8_t data[LAZY_TEST_LARGE_LEN];
+    uint8_t buf[LAZY_TEST_LARGE_LEN];
+    mock_io_t *mock;
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    size_t bytes_read;
+    int i;
+
+    printf("Testing lazy receive buffers...\n");
+
+    for (i = 0; i < LAZY_TEST_LARGE_LEN; i++) {
+        data[i] = (uint8_t)(i * 3);
+    }
+
+    mock = mock_io_init(4096);
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+
+    memset(&config, 0, sizeof(config));
+    assert_true(yamux_session_create(&io, 0, &config, &session) == YAMUX_OK, "Failed to create session");
+
+    /* A new stream has its capacity but no storage */
+    append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 1, window, sizeof(window));
+    append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_ACK, 1, NULL, 0);
+    deliver(session, mock);
+    stream = yamux_get_stream(session, 1);
+    assert_true(stream != NULL, "Stream was not created from SYN");
+    assert_true(stream->recvbuf.data == NULL && stream->recvbuf.size == YAMUX_DEFAULT_WINDOW_SIZE,
+                "Idle stream holds buffer storage");
+    assert_true(session->buffer_pool.in_use == 0, "Buffer taken for an idle stream");
+
+    /* A small payload stays inline in the stream */
+    append_frame(mock, YAMUX_DATA, 0, 1, data, LAZY_TEST_SMALL_LEN);
+    deliver(session, mock);
+    assert_true(stream->recvbuf.data == stream->recv_inline, "Small payload not stored inline");
+    assert_true(session->buffer_pool.in_use == 0, "Buffer taken for a small payload");
+
+    /* More data than fits inline moves to pooled storage, in order */
+    append_frame(mock, YAMUX_DATA, 0, 1, data + LAZY_TEST_SMALL_LEN, LAZY_TEST_LARGE_LEN - LAZY_TEST_SMALL_LEN);
+    deliver(session, mock);
+    assert_true(stream->recvbuf.used == LAZY_TEST_LARGE_LEN, "Payload not buffered");
+    assert_true(session->buffer_pool.in_use == 1 && stream->recvbuf.data != stream->recv_inline,
+                "Buffer storage not attached");
+
+    assert_true(yamux_stream_read(stream, buf, 100, &bytes_read) == YAMUX_OK && bytes_read == 100,
+                "Partial read failed");
+    assert_true(session->buffer_pool.in_use == 1, "Storage released before draining");
+    assert_true(yamux_stream_read(stream, buf + 100, sizeof(buf) - 100, &bytes_read) == YAMUX_OK &&
+                bytes_read == sizeof(buf) - 100, "Read failed");
+    assert_true(memcmp(buf, data, sizeof(buf)) == 0, "Data mismatch across inline and pooled storage");
+
+    /* Drained: the storage goes back to the pool */
+    assert_true(stream->recvbuf.data == NULL && session->buffer_pool.in_use == 0,
+                "Drained stream kept its buffer");
+    assert_true(session->buffer_pool.cached == 1, "Buffer not returned to the pool");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
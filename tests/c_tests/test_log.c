@@ -0,0 +1,72 @@
+/**
+ * @file test_log.c
+ * @brief Test for the log sink
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+/* Last message seen by the sink */
+typedef struct {
+    int calls;
+    int level;
+    char message[YAMUX_LOG_MESSAGE_SIZE];
+} log_record_t;
+
+static void record_log(int level, const char *message, void *user_data) {
+    log_record_t *rec = (log_record_t *)user_data;
+
+    rec->calls++;
+    rec->level = level;
+    strncpy(rec->message, message, sizeof(rec->message) - 1);
+}
+
+/* Test that compiled-in messages reach the runtime sink */
+void test_log_sink(void) {
+    uint8_t frame[YAMUX_HEADER_SIZE + 8];
+    yamux_header_t header;
+    yamux_io_t io;
+    yamux_session_t *session;
+    yamux_result_t result;
+    log_record_t rec;
+    mock_io_t *mock;
+
+    printf("Testing log sink...\n");
+
+    memset(&rec, 0, sizeof(rec));
+    yamux_set_log_sink(record_log, &rec);
+
+    mock = mock_io_init(4096);
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+    result = yamux_session_create(&io, 0, NULL, &session);
+    assert_true(result == YAMUX_OK, "Failed to create session");
+
+    /* A SYN with an 8-byte payload is a protocol error, logged at ERROR */
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = YAMUX_WINDOW_UPDATE;
+    header.flags = YAMUX_FLAG_SYN;
+    header.stream_id = 1;
+    header.length = 8;
+    yamux_encode_header(&header, frame);
+    memset(frame + YAMUX_HEADER_SIZE, 0, 8);
+    memcpy(mock->read_buf, frame, sizeof(frame));
+    mock->read_buf_used = sizeof(frame);
+
+    result = yamux_session_process(session);
+    assert_true(result == YAMUX_ERR_PROTOCOL, "Malformed SYN should be rejected");
+#if YAMUX_LOG_LEVEL >= YAMUX_LOG_LEVEL_ERROR
+    assert_true(rec.calls > 0 && rec.level == YAMUX_LOG_LEVEL_ERROR, "Error not delivered to the sink");
+    assert_true(strstr(rec.message, "yamux_handle_window_update") != NULL, "Unexpected message");
+    assert_true(strchr(rec.message, '\n') == NULL, "Message should not end in a newline");
+#else
+    assert_true(rec.calls == 0, "Logging compiled out but the sink was called");
+#endif
+
+    yamux_set_log_sink(NULL, NULL);
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
@@ -14,6 +14,32 @@ void test_flow_control(void);
 void test_stream_lifecycle(void);
 void test_concurrent_streams(void);
 void test_error_handling(void);
+void test_stream_table(void);
+void test_frame_reader(void);
+void test_frame_reader_partial(void);
+void test_writev(void);
+void test_transmit_queue(void);
+void test_zero_copy(void);
+void test_posted_read(void);
+void test_window_update(void);
+void test_window_autotune(void);
+void test_log_sink(void);
+void test_pool(void);
+void test_lazy_buffer(void);
+void test_recv_budget(void);
+void test_thread_safe(void);
+void test_timed_io(void);
+void test_stream_events(void);
+void test_egress_sched(void);
+void test_frame_size(void);
+void test_stats(void);
+void test_ping_rtt(void);
+void test_timers(void);
+void test_accept_queue(void);
+void test_open_batch(void);
+void test_stream_writev(void);
+void test_sendfile(void);
+void test_frame_batch(void);
 
 /* Test runner */
 typedef struct {
@@ -36,7 +62,33 @@ int main(void) {
         {"Flow Control", test_flow_control},
         {"Stream Lifecycle", test_stream_lifecycle},
         {"Concurrent Streams", test_concurrent_streams},
-        {"Error Handling", test_error_handling}
+        {"Error Handling", test_error_handling},
+        {"Stream Table", test_stream_table},
+        {"Frame Reader", test_frame_reader},
+        {"Resumable Frame Parser", test_frame_reader_partial},
+        {"Vectored Writes", test_writev},
+        {"Transmit Queue", test_transmit_queue},
+        {"Zero-Copy Receive", test_zero_copy},
+        {"Posted Reads", test_posted_read},
+        {"Batched Window Updates", test_window_update},
+        {"Window Auto-Tuning", test_window_autotune},
+        {"Log Sink", test_log_sink},
+        {"Pool", test_pool},
+        {"Lazy Receive Buffer", test_lazy_buffer},
+        {"Receive Memory Budget", test_recv_budget},
+        {"Thread-Safe Sessions", test_thread_safe},
+        {"Timed Stream I/O", test_timed_io},
+        {"Stream Event Callbacks", test_stream_events},
+        {"Egress Scheduler", test_egress_sched},
+        {"Frame Size Limits", test_frame_size},
+        {"Statistics", test_stats},
+        {"Ping Round Trips", test_ping_rtt},
+        {"Timers", test_timers},
+        {"Accept Queue", test_accept_queue},
+        {"Batch Open", test_open_batch},
+        {"Scatter-Gather Writes", test_stream_writev},
+        {"File-Backed Writes", test_sendfile},
+        {"Batched Frame Decoding", test_frame_batch}
     };
     
     int num_tests = sizeof(tests) / sizeof(test_case_t);
@@ -0,0 +1,133 @@
+/**
+ * @file test_open_batch.c
+ * @brief Test for opening many streams at once
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+/* 512, or as many as a session takes */
+#if YAMUX_MAX_STREAMS < 512
+#define BATCH_TEST_STREAMS YAMUX_MAX_STREAMS
+#else
+#define BATCH_TEST_STREAMS 512
+#endif
+
+/* Transport writes made so far */
+static int batch_writes;
+
+static int batch_write(void *ctx, const uint8_t *buf, size_t len) {
+    batch_writes++;
+    return mock_write(ctx, buf, len);
+}
+
+static yamux_session_t *create_client(mock_io_t *mock) {
+    yamux_io_t io;
+    yamux_session_t *session;
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = batch_write;
+    io.ctx = mock;
+
+    assert_true(yamux_session_create(&io, 1, NULL, &session) == YAMUX_OK, "Failed to create session");
+    return session;
+}
+
+/* Streams get consecutive IDs, one block of memory and one write of SYNs */
+static void test_batch_open(void) {
+    static yamux_stream_t *streams[BATCH_TEST_STREAMS];
+    mock_io_t *mock = mock_io_init(16384);
+    yamux_session_t *session = create_client(mock);
+    yamux_pool_block_t *block;
+    yamux_header_t header;
+    size_t pos = 0;
+    int i;
+
+    batch_writes = 0;
+    assert_true(yamux_stream_open_batch(session, BATCH_TEST_STREAMS, streams) == YAMUX_OK, "Batch open failed");
+    assert_true(batch_writes == 1, "SYNs not coalesced into one write");
+    assert_true(session->streams.count == BATCH_TEST_STREAMS && session->next_stream_id == 2 * BATCH_TEST_STREAMS + 1,
+                "Streams not all opened");
+
+    for (i = 0; i < BATCH_TEST_STREAMS; i++) {
+        assert_true(streams[i]->id == 2 * (uint32_t)i + 1 && streams[i]->state == YAMUX_STREAM_SYN_SENT,
+                    "Stream IDs not contiguous");
+        assert_true(yamux_decode_header(mock->write_buf + pos, YAMUX_HEADER_SIZE, &header) == YAMUX_OK &&
+                    header.type == YAMUX_WINDOW_UPDATE && header.flags == YAMUX_FLAG_SYN &&
+                    header.stream_id == streams[i]->id, "SYNs out of order");
+        pos += YAMUX_HEADER_SIZE + YAMUX_FRAME_PAYLOAD_LEN(&header);
+    }
+    assert_true(pos == mock->write_buf_used, "Unexpected frames written");
+
+    /* The streams came from one block, which serves the next batch too */
+    block = session->stream_pool.blocks;
+    assert_true(block && !block->next && block->count == BATCH_TEST_STREAMS, "Streams not allocated as one block");
+    for (i = 0; i < BATCH_TEST_STREAMS; i++) {
+        assert_true(yamux_stream_close(streams[i], 1) == YAMUX_OK, "Reset failed");
+    }
+    assert_true(yamux_stream_open_batch(session, BATCH_TEST_STREAMS, streams) == YAMUX_OK &&
+                session->stream_pool.blocks == block && !block->next, "Freed block not reused");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* Bad arguments and spent IDs open nothing */
+static void test_batch_open_errors(void) {
+    yamux_stream_t *streams[4];
+    mock_io_t *mock = mock_io_init(1024);
+    yamux_session_t *session = create_client(mock);
+
+    assert_true(yamux_stream_open_batch(NULL, 1, streams) == YAMUX_ERR_INVALID &&
+                yamux_stream_open_batch(session, 1, NULL) == YAMUX_ERR_INVALID &&
+                yamux_stream_open_batch(session, 0, streams) == YAMUX_ERR_INVALID, "Bad arguments accepted");
+
+    /* A fourth ID from 0xFFFFFFF9 on would be the reserved 0xFFFFFFFF */
+    session->next_stream_id = 0xFFFFFFF9u;
+    mock->write_buf_used = 0;
+    assert_true(yamux_stream_open_batch(session, 4, streams) == YAMUX_ERR_INVALID, "ID space overrun");
+    assert_true(session->streams.count == 0 && mock->write_buf_used == 0 && session->next_stream_id == 0xFFFFFFF9u,
+                "Failed batch opened streams");
+    assert_true(yamux_stream_open_batch(session, 3, streams) == YAMUX_OK && streams[2]->id == 0xFFFFFFFDu,
+                "Batch ending at the last ID refused");
+
+    session->go_away_received = 1;
+    assert_true(yamux_stream_open_batch(session, 1, streams) == YAMUX_ERR_CLOSED, "Opened after GO_AWAY");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* Reserved pool blocks hand out objects without touching the heap */
+static void test_pool_reserve(void) {
+    yamux_pool_t pool;
+    void *objects[8];
+    int i;
+
+    assert_true(yamux_pool_init(&pool, 32, 2) == YAMUX_OK, "Failed to create pool");
+    assert_true(yamux_pool_reserve(&pool, 2) == YAMUX_OK && pool.blocks == NULL,
+                "Preallocated objects not counted as free");
+    assert_true(yamux_pool_reserve(&pool, 8) == YAMUX_OK && pool.blocks && pool.blocks->count == 6 &&
+                pool.free_count == 8, "Block not sized to the shortfall");
+
+    for (i = 0; i < 8; i++) {
+        objects[i] = yamux_pool_get(&pool);
+    }
+    assert_true(pool.free_count == 0 && pool.cached == 0, "Reserved objects taken for heap objects");
+    for (i = 0; i < 8; i++) {
+        yamux_pool_put(&pool, objects[i]);
+    }
+    assert_true(pool.free_count == 8 && pool.cached == 0, "Reserved objects not kept");
+
+    yamux_pool_destroy(&pool);
+    assert_true(pool.blocks == NULL && pool.arena == NULL, "Pool not released");
+}
+
+void test_open_batch(void) {
+    printf("Testing batch stream open...\n");
+
+    test_batch_open();
+    test_batch_open_errors();
+    test_pool_reserve();
+}
@@ -0,0 +1,177 @@
+/**
+ * @file test_ping_rtt.c
+ * @brief Test for ping round-trip timing and the latency histogram
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#if YAMUX_STATS
+
+/* Clock the round trips are timed with */
+static uint64_t rtt_clock_ms;
+
+static uint64_t rtt_now_ms(void *ctx) {
+    (void)ctx;
+    return rtt_clock_ms;
+}
+
+static yamux_session_t *create_session(mock_io_t *mock) {
+    yamux_io_t io;
+    yamux_session_t *session;
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.now_ms = rtt_now_ms;
+    io.ctx = mock;
+
+    assert_true(yamux_session_create(&io, 1, NULL, &session) == YAMUX_OK, "Failed to create session");
+    return session;
+}
+
+/* Feed the session a ping ACK echoing id and process it */
+static void ack_ping(yamux_session_t *session, mock_io_t *mock, uint32_t id) {
+    yamux_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = YAMUX_PING;
+    header.flags = YAMUX_FLAG_ACK;
+    header.length = id;
+    mock->read_pos = 0;
+    yamux_encode_header(&header, mock->read_buf);
+    mock->read_buf_used = YAMUX_HEADER_SIZE;
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process ping ACK");
+}
+
+/* Send a ping, checking it carries its ID in the length field and no payload */
+static uint32_t send_ping(yamux_session_t *session, mock_io_t *mock) {
+    yamux_header_t header;
+    uint32_t id;
+    size_t pos = mock->write_buf_used;
+
+    assert_true(yamux_session_ping_id(session, &id) == YAMUX_OK, "Failed to ping");
+    assert_true(mock->write_buf_used == pos + YAMUX_HEADER_SIZE, "Ping has a payload");
+    assert_true(yamux_decode_header(mock->write_buf + pos, YAMUX_HEADER_SIZE, &header) == YAMUX_OK &&
+                header.type == YAMUX_PING && header.flags == YAMUX_FLAG_SYN && header.stream_id == 0,
+                "Not a ping");
+    assert_true(header.length == id, "Ping ID not sent in the length field");
+    return id;
+}
+
+/* Out-of-order ACKs are matched by ID; unknown IDs are ignored */
+static void test_rtt_ids(void) {
+    mock_io_t *mock = mock_io_init(1024);
+    yamux_session_t *session = create_session(mock);
+    yamux_rtt_stats_t rtt;
+    uint32_t first_id;
+    uint32_t second_id;
+
+    assert_true(yamux_session_get_rtt(NULL, &rtt) == YAMUX_ERR_INVALID &&
+                yamux_session_ping_id(session, NULL) == YAMUX_ERR_INVALID, "NULL accepted");
+    assert_true(yamux_session_get_rtt(session, &rtt) == YAMUX_OK && rtt.samples == 0,
+                "Stats before any ping");
+
+    rtt_clock_ms = 100;
+    first_id = send_ping(session, mock);
+    rtt_clock_ms = 110;
+    second_id = send_ping(session, mock);
+    assert_true(first_id != second_id, "Ping IDs repeat");
+
+    rtt_clock_ms = 130;
+    ack_ping(session, mock, 0xdeadbeef);
+    assert_true(yamux_session_get_rtt(session, &rtt) == YAMUX_OK && rtt.samples == 0,
+                "ACK for an unknown ID timed");
+    ack_ping(session, mock, second_id);
+    assert_true(yamux_session_get_rtt(session, &rtt) == YAMUX_OK && rtt.samples == 1 &&
+                rtt.last_id == second_id && rtt.last_ms == 20, "Second ping not timed");
+
+    rtt_clock_ms = 160;
+    ack_ping(session, mock, first_id);
+    ack_ping(session, mock, first_id);
+    assert_true(yamux_session_get_rtt(session, &rtt) == YAMUX_OK, "Failed to read RTT");
+    assert_true(rtt.samples == 2 && rtt.last_id == first_id && rtt.last_ms == 60, "First ping not timed");
+    assert_true(rtt.min_ms == 20 && rtt.max_ms == 60 && rtt.avg_ms == 40 && rtt.srtt_ms > 0,
+                "Summary wrong");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* The 99th percentile tracks the tail */
+static void test_rtt_p99(void) {
+    mock_io_t *mock = mock_io_init(1024);
+    yamux_session_t *session = create_session(mock);
+    yamux_rtt_stats_t rtt;
+    uint32_t id;
+    int i;
+
+    for (i = 0; i < 102; i++) {
+        rtt_clock_ms = 1000 * (uint64_t)i;
+        id = send_ping(session, mock);
+        rtt_clock_ms += (i == 0 || i >= 100) ? 1000 : 10;
+        ack_ping(session, mock, id);
+
+        if (i == 99) {
+            assert_true(yamux_session_get_rtt(session, &rtt) == YAMUX_OK, "Failed to read RTT");
+            assert_true(rtt.p99_ms >= 10 && rtt.p99_ms <= 12 && rtt.max_ms == 1000,
+                        "p99 should ignore one slow ping in a hundred");
+        }
+    }
+    assert_true(yamux_session_get_rtt(session, &rtt) == YAMUX_OK, "Failed to read RTT");
+    assert_true(rtt.samples == 102 && rtt.min_ms == 10 && rtt.p99_ms == 1000,
+                "p99 should see three slow pings in a hundred");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* A stream's data is timed until the peer credits it */
+static void test_rtt_ack_latency(void) {
+    static uint8_t data[1000];
+    mock_io_t *mock = mock_io_init(4096);
+    yamux_session_t *session = create_session(mock);
+    yamux_stream_stats_t stats;
+    yamux_stream_t *stream;
+    yamux_header_t header;
+    uint8_t credit[4] = {0x00, 0x00, 0x03, 0xe8};
+    size_t written;
+
+    rtt_clock_ms = 5000;
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    assert_true(yamux_stream_write(stream, data, sizeof(data), &written) == YAMUX_OK, "Write failed");
+
+    rtt_clock_ms = 5030;
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = YAMUX_WINDOW_UPDATE;
+    header.stream_id = stream->id;
+    header.length = sizeof(credit);
+    yamux_encode_header(&header, mock->read_buf);
+    memcpy(mock->read_buf + YAMUX_HEADER_SIZE, credit, sizeof(credit));
+    mock->read_buf_used = YAMUX_HEADER_SIZE + sizeof(credit);
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process window update");
+
+    assert_true(yamux_stream_get_stats(stream, &stats) == YAMUX_OK && stats.ack_latency_ms == 30,
+                "Write-to-credit latency not measured");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+void test_ping_rtt(void) {
+    printf("Testing ping round-trip timing...\n");
+
+    test_rtt_ids();
+    test_rtt_p99();
+    test_rtt_ack_latency();
+}
+
+#else
+
+void test_ping_rtt(void) {
+    printf("(skipped, built without YAMUX_STATS) ");
+}
+
+#endif /* YAMUX_STATS */
@@ -0,0 +1,127 @@
+/**
+ * @file test_pool.c
+ * @brief Test for pooled stream objects and receive buffers
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define POOL_TEST_PREALLOC 2
+#define POOL_TEST_OBJECT_SIZE 64
+
+/* Test the free list, preallocation and the heap cache of a pool */
+static void test_pool_objects(void) {
+    void *objects[POOL_TEST_PREALLOC + YAMUX_POOL_CACHE_SIZE + 1];
+    yamux_pool_t pool;
+    void *first;
+    int i;
+
+    assert_true(yamux_pool_init(&pool, 1, 0) == YAMUX_ERR_INVALID, "Undersized objects should be rejected");
+    assert_true(yamux_pool_init(&pool, POOL_TEST_OBJECT_SIZE, POOL_TEST_PREALLOC) == YAMUX_OK,
+                "Failed to create pool");
+
+    /* Preallocated objects come from the block, in order */
+    first = yamux_pool_get(&pool);
+    assert_true(first == (void *)pool.arena, "First object not taken from the block");
+    yamux_pool_put(&pool, first);
+    assert_true(yamux_pool_get(&pool) == first, "Returned object not reused");
+
+    /* Beyond the block the pool falls back to the heap */
+    objects[0] = first;
+    for (i = 1; i < (int)(sizeof(objects) / sizeof(objects[0])); i++) {
+        objects[i] = yamux_pool_get(&pool);
+        assert_true(objects[i] != NULL, "Pool allocation failed");
+    }
+    assert_true(pool.in_use == sizeof(objects) / sizeof(objects[0]), "In-use count mismatch");
+
+    /* Only YAMUX_POOL_CACHE_SIZE heap objects are kept once returned */
+    for (i = 0; i < (int)(sizeof(objects) / sizeof(objects[0])); i++) {
+        yamux_pool_put(&pool, objects[i]);
+    }
+    assert_true(pool.in_use == 0, "Objects still counted in use");
+    assert_true(pool.cached == YAMUX_POOL_CACHE_SIZE, "Heap cache not capped");
+
+    yamux_pool_destroy(&pool);
+    assert_true(pool.arena == NULL && pool.free_list == NULL, "Pool not released");
+}
+
+/* Build a SYN for stream_id into buf; returns the frame length */
+static size_t encode_syn(uint8_t *buf, uint32_t stream_id) {
+    yamux_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = YAMUX_WINDOW_UPDATE;
+    header.flags = YAMUX_FLAG_SYN;
+    header.stream_id = stream_id;
+    header.length = 0;
+    yamux_encode_header(&header, buf);
+    return YAMUX_HEADER_SIZE;
+}
+
+/* Test that sessions recycle stream memory across open and reset */
+void test_pool(void) {
+    mock_io_t *mock;
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    yamux_stream_t *reused;
+    yamux_header_t syn;
+
+    printf("Testing stream and buffer pools...\n");
+
+    test_pool_objects();
+
+    mock = mock_io_init(4096);
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+
+    memset(&config, 0, sizeof(config));
+    config.stream_pool_size = POOL_TEST_PREALLOC;
+    assert_true(yamux_session_create(&io, 1, &config, &session) == YAMUX_OK, "Failed to create session");
+    assert_true(session->stream_pool.arena != NULL && session->buffer_pool.arena != NULL,
+                "Stream memory not preallocated");
+
+    /* Opened streams live in the preallocated block */
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    assert_true((uint8_t *)stream == session->stream_pool.arena, "Stream not taken from the pool");
+
+    /* A reset stream's memory goes straight to the next one */
+    assert_true(yamux_stream_close(stream, 1) == YAMUX_OK, "Failed to reset stream");
+    assert_true(session->stream_pool.in_use == 0 && session->buffer_pool.in_use == 0,
+                "Reset stream not returned to the pools");
+    assert_true(yamux_stream_open_detailed(session, 0, &reused) == YAMUX_OK, "Failed to reopen stream");
+    assert_true(reused == stream, "Pooled memory not reused");
+    assert_true(reused->recvbuf.used == 0 && reused->id == 3, "Reused stream not reinitialized");
+
+    /* Peer-opened streams are pooled too */
+    yamux_session_close(session, YAMUX_NORMAL);
+    config.stream_pool_size = 0;
+    assert_true(yamux_session_create(&io, 0, &config, &session) == YAMUX_OK, "Failed to create server");
+    mock->read_buf_used = encode_syn(mock->read_buf, 1);
+    mock->read_pos = 0;
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process SYN");
+    stream = yamux_get_stream(session, 1);
+    assert_true(stream != NULL, "Stream was not created from SYN");
+    assert_true(session->stream_pool.in_use == 1, "Accepted stream not allocated from the pool");
+    yamux_stream_close(stream, 1);
+    assert_true(session->stream_pool.cached == 1, "Freed stream memory not cached");
+
+    /* So is one whose SYN-ACK could not be written */
+    memset(&syn, 0, sizeof(syn));
+    syn.version = YAMUX_PROTO_VERSION;
+    syn.type = YAMUX_WINDOW_UPDATE;
+    syn.flags = YAMUX_FLAG_SYN;
+    syn.stream_id = 3;
+    mock->should_fail_write = 1;
+    assert_true(yamux_handle_window_update(session, &syn, NULL) == YAMUX_ERR_IO, "Failed SYN-ACK not reported");
+    mock->should_fail_write = 0;
+    assert_true(yamux_get_stream(session, 3) == NULL && session->stream_pool.in_use == 0,
+                "Stream whose SYN-ACK failed not freed");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
@@ -0,0 +1,165 @@
+/**
+ * @file test_posted_read.c
+ * @brief Test for reads posted ahead of incoming data
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define POSTED_TEST_BUF_LEN 64
+#define POSTED_TEST_DATA_LEN 100
+#define POSTED_TEST_BULK_LEN 500
+
+/* Completion record */
+typedef struct {
+    uint8_t buf[POSTED_TEST_BULK_LEN];
+    size_t total;
+    int calls;
+    size_t last_bytes;
+    yamux_result_t last_result;
+    int repost;            /* Keep reading into the rest of buf */
+} read_record_t;
+
+static void on_read(yamux_stream_t *stream, uint8_t *buf, size_t bytes_read,
+                    yamux_result_t result, void *user_data) {
+    read_record_t *rec = (read_record_t *)user_data;
+
+    (void)buf;
+    rec->calls++;
+    rec->total += bytes_read;
+    rec->last_bytes = bytes_read;
+    rec->last_result = result;
+
+    if (rec->repost && result == YAMUX_OK && bytes_read > 0 && rec->total < sizeof(rec->buf)) {
+        yamux_stream_post_read(stream, rec->buf + rec->total, sizeof(rec->buf) - rec->total,
+                               on_read, rec);
+    }
+}
+
+/* Append an encoded frame to the mock's inbound data */
+static void append_frame(mock_io_t *mock, uint8_t type, uint16_t flags, uint32_t stream_id,
+                         const uint8_t *payload, uint32_t length) {
+    yamux_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = type;
+    header.flags = flags;
+    header.stream_id = stream_id;
+    header.length = length;
+
+    yamux_encode_header(&header, mock->read_buf + mock->read_buf_used);
+    mock->read_buf_used += YAMUX_HEADER_SIZE;
+    if (length > 0) {
+        memcpy(mock->read_buf + mock->read_buf_used, payload, length);
+        mock->read_buf_used += length;
+    }
+}
+
+/* Create a server session with stream 1 opened and acknowledged by the peer */
+static yamux_session_t *create_with_stream(mock_io_t *mock, size_t read_buffer_size,
+                                           yamux_stream_t **stream) {
+    uint8_t window[4] = {0x00, 0x04, 0x00, 0x00};
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session;
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+
+    memset(&config, 0, sizeof(config));
+    config.read_buffer_size = read_buffer_size;
+    assert_true(yamux_session_create(&io, 0, &config, &session) == YAMUX_OK, "Failed to create session");
+
+    append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 1, window, sizeof(window));
+    append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_ACK, 1, NULL, 0);
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process SYN");
+    *stream = yamux_get_stream(session, 1);
+    assert_true(*stream != NULL, "Stream was not created from SYN");
+    return session;
+}
+
+/* Test that posted reads are filled in place and complete through the callback */
+void test_posted_read(void) {
+    mock_io_t *mock;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    yamux_result_t result;
+    read_record_t rec;
+    uint8_t data[POSTED_TEST_BULK_LEN];
+    int calls;
+    int i;
+
+    printf("Testing posted reads...\n");
+
+    for (i = 0; i < POSTED_TEST_BULK_LEN; i++) {
+        data[i] = (uint8_t)(i * 7);
+    }
+
+    /* Data arriving for a posted read lands in the posted buffer */
+    mock = mock_io_init(4096);
+    session = create_with_stream(mock, 0, &stream);
+    memset(&rec, 0, sizeof(rec));
+    result = yamux_stream_post_read(stream, rec.buf, POSTED_TEST_BUF_LEN, on_read, &rec);
+    assert_true(result == YAMUX_OK, "Failed to post read");
+    assert_true(rec.calls == 0, "Read completed without data");
+    result = yamux_stream_post_read(stream, rec.buf, POSTED_TEST_BUF_LEN, on_read, &rec);
+    assert_true(result == YAMUX_ERR_INVALID, "Second pending read should be rejected");
+
+    append_frame(mock, YAMUX_DATA, 0, 1, data, POSTED_TEST_DATA_LEN);
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process DATA");
+    assert_true(rec.calls == 1 && rec.last_bytes == POSTED_TEST_BUF_LEN, "Posted read not completed");
+    assert_true(memcmp(rec.buf, data, POSTED_TEST_BUF_LEN) == 0, "Posted data mismatch");
+    assert_true(stream->recvbuf.used == POSTED_TEST_DATA_LEN - POSTED_TEST_BUF_LEN,
+                "Overflow not kept in the receive buffer");
+    assert_true(stream->recv_consumed == POSTED_TEST_BUF_LEN, "Posted bytes not counted as consumed");
+
+    /* With data buffered, a posted read completes at once */
+    result = yamux_stream_post_read(stream, rec.buf, POSTED_TEST_BUF_LEN, on_read, &rec);
+    assert_true(result == YAMUX_OK && rec.calls == 2, "Buffered read did not complete");
+    assert_true(rec.last_bytes == POSTED_TEST_DATA_LEN - POSTED_TEST_BUF_LEN, "Buffered read length");
+    assert_true(memcmp(rec.buf, data + POSTED_TEST_BUF_LEN, rec.last_bytes) == 0, "Buffered data mismatch");
+
+    /* FIN completes a pending read with end of stream */
+    result = yamux_stream_post_read(stream, rec.buf, POSTED_TEST_BUF_LEN, on_read, &rec);
+    assert_true(result == YAMUX_OK && rec.calls == 2, "Read completed early");
+    append_frame(mock, YAMUX_DATA, YAMUX_FLAG_FIN, 1, NULL, 0);
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process FIN");
+    assert_true(rec.calls == 3 && rec.last_bytes == 0 && rec.last_result == YAMUX_OK,
+                "FIN did not complete the read");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+
+    /* Bulk payload through a small ingress buffer, reposting from the callback */
+    mock = mock_io_init(4096);
+    session = create_with_stream(mock, 1, &stream);
+    memset(&rec, 0, sizeof(rec));
+    rec.repost = 1;
+    result = yamux_stream_post_read(stream, rec.buf, sizeof(rec.buf), on_read, &rec);
+    assert_true(result == YAMUX_OK, "Failed to post bulk read");
+
+    append_frame(mock, YAMUX_DATA, 0, 1, data, POSTED_TEST_BULK_LEN);
+    for (calls = 0; calls < 64 && mock->read_pos < mock->read_buf_used; calls++) {
+        result = yamux_session_process(session);
+        assert_true(result == YAMUX_OK || result == YAMUX_ERR_WOULD_BLOCK, "Failed to process bulk DATA");
+    }
+    assert_true(rec.total == POSTED_TEST_BULK_LEN, "Bulk payload not delivered");
+    assert_true(memcmp(rec.buf, data, POSTED_TEST_BULK_LEN) == 0, "Bulk data mismatch");
+    assert_true(stream->recvbuf.used == 0, "Bulk payload was staged in the receive buffer");
+    assert_true(stream->recv_window + stream->recv_consumed == YAMUX_DEFAULT_WINDOW_SIZE,
+                "Posted bytes not counted as consumed");
+
+    /* Closing the stream fails a pending read */
+    rec.repost = 0;
+    rec.calls = 0;
+    result = yamux_stream_post_read(stream, rec.buf, sizeof(rec.buf), on_read, &rec);
+    assert_true(result == YAMUX_OK, "Failed to post read before close");
+    yamux_stream_close(stream, 0);
+    assert_true(rec.calls == 1 && rec.last_result == YAMUX_ERR_CLOSED, "Close did not cancel the read");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
@@ -0,0 +1,149 @@
+/**
+ * @file test_recv_budget.c
+ * @brief Test for session and process-wide receive memory budgets
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define BUDGET_TEST_WINDOW 1024
+#define BUDGET_TEST_BUDGET 1500
+#define BUDGET_TEST_DATA_LEN 1000
+
+/* Append an encoded frame to the mock's inbound data */
+static void append_frame(mock_io_t *mock, uint8_t type, uint16_t flags, uint32_t stream_id,
+                         const uint8_t *payload, uint32_t length) {
+    yamux_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = type;
+    header.flags = flags;
+    header.stream_id = stream_id;
+    header.length = length;
+
+    yamux_encode_header(&header, mock->read_buf + mock->read_buf_used);
+    mock->read_buf_used += YAMUX_HEADER_SIZE;
+    if (length > 0) {
+        memcpy(mock->read_buf + mock->read_buf_used, payload, length);
+        mock->read_buf_used += length;
+    }
+}
+
+/* Sum the increments of the WINDOW_UPDATE frames for stream_id written since *pos */
+static uint32_t collect_credit(mock_io_t *mock, size_t *pos, uint32_t stream_id) {
+    yamux_header_t header;
+    const uint8_t *p;
+    uint32_t credit = 0;
+
+    while (*pos + YAMUX_HEADER_SIZE <= mock->write_buf_used) {
+        yamux_decode_header(mock->write_buf + *pos, mock->write_buf_used - *pos, &header);
+        p = mock->write_buf + *pos + YAMUX_HEADER_SIZE;
+        if (header.type == YAMUX_WINDOW_UPDATE && header.flags == 0 && header.length == 4 &&
+            header.stream_id == stream_id) {
+            credit += ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+        }
+        *pos += YAMUX_HEADER_SIZE + YAMUX_FRAME_PAYLOAD_LEN(&header);
+    }
+    return credit;
+}
+
+/* Open peer streams 1 and 3 on a fresh server session */
+static yamux_session_t *create_with_streams(mock_io_t *mock, uint32_t budget) {
+    uint8_t window[4] = {0x00, 0x00, 0x04, 0x00};
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session;
+    uint32_t id;
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+
+    memset(&config, 0, sizeof(config));
+    config.max_stream_window_size = BUDGET_TEST_WINDOW;
+    config.recv_memory_budget = budget;
+    assert_true(yamux_session_create(&io, 0, &config, &session) == YAMUX_OK, "Failed to create session");
+
+    for (id = 1; id <= 3; id += 2) {
+        append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, id, window, sizeof(window));
+        append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_ACK, id, NULL, 0);
+    }
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to open streams");
+    return session;
+}
+
+/* Deliver a payload on stream 1 and read it back */
+static void drain(yamux_session_t *session, mock_io_t *mock, yamux_stream_t *stream) {
+    uint8_t data[BUDGET_TEST_DATA_LEN];
+    size_t bytes_read;
+
+    memset(data, 0x42, sizeof(data));
+    mock->read_buf_used = 0;
+    mock->read_pos = 0;
+    append_frame(mock, YAMUX_DATA, 0, 1, data, sizeof(data));
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process DATA");
+    assert_true(yamux_stream_read(stream, data, sizeof(data), &bytes_read) == YAMUX_OK &&
+                bytes_read == sizeof(data), "Read failed");
+}
+
+/* Test that window credit is clamped to the budget left and resumes as it frees */
+void test_recv_budget(void) {
+    mock_io_t *mock;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    size_t baseline;
+    size_t pos;
+    uint32_t credit;
+
+    printf("Testing receive memory budgets...\n");
+
+    /* Both initial windows count: 2048 committed against a 1500 budget */
+    mock = mock_io_init(4096);
+    session = create_with_streams(mock, BUDGET_TEST_BUDGET);
+    stream = yamux_get_stream(session, 1);
+    assert_true(stream != NULL && yamux_get_stream(session, 3) != NULL, "Streams not opened");
+    assert_true(session->recv_committed == 2 * BUDGET_TEST_WINDOW, "Initial windows not committed");
+
+    /* Reading frees the data, but only what fits the budget is granted back */
+    pos = mock->write_buf_used;
+    drain(session, mock, stream);
+    credit = collect_credit(mock, &pos, 1);
+    assert_true(credit == BUDGET_TEST_BUDGET - (2 * BUDGET_TEST_WINDOW - BUDGET_TEST_DATA_LEN),
+                "Credit not clamped to the budget");
+    assert_true(stream->recv_blocked && session->recv_committed == BUDGET_TEST_BUDGET,
+                "Withheld credit not recorded");
+
+    /* Closing the other stream frees its window; the rest follows on the next process */
+    assert_true(yamux_stream_close(yamux_get_stream(session, 3), 1) == YAMUX_OK, "Failed to reset stream");
+    assert_true(session->recv_committed == BUDGET_TEST_BUDGET - BUDGET_TEST_WINDOW,
+                "Closed stream still committed");
+    mock->read_buf_used = 0;
+    mock->read_pos = 0;
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process");
+    credit += collect_credit(mock, &pos, 1);
+    assert_true(credit == BUDGET_TEST_DATA_LEN && !stream->recv_blocked, "Withheld credit not granted");
+    assert_true(stream->recv_window == BUDGET_TEST_WINDOW, "Window not fully reopened");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+
+    /* The process-wide budget applies across sessions the same way */
+    baseline = yamux_window_global_committed();
+    yamux_set_global_recv_budget(baseline + BUDGET_TEST_BUDGET);
+    mock = mock_io_init(4096);
+    session = create_with_streams(mock, 0);
+    stream = yamux_get_stream(session, 1);
+    pos = mock->write_buf_used;
+    drain(session, mock, stream);
+    credit = collect_credit(mock, &pos, 1);
+    assert_true(credit == BUDGET_TEST_BUDGET - (2 * BUDGET_TEST_WINDOW - BUDGET_TEST_DATA_LEN),
+                "Credit not clamped to the global budget");
+    assert_true(stream->recv_blocked, "Withheld credit not recorded");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    assert_true(yamux_window_global_committed() == baseline, "Closed session still committed");
+    mock_io_free(mock);
+    yamux_set_global_recv_budget(0);
+}
@@ -0,0 +1,212 @@
+/**
+ * @file test_sendfile.c
+ * @brief Test for file-backed stream writes
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+#include <unistd.h>
+
+#define SENDFILE_TEST_LEN (2 * YAMUX_MAX_DATA_FRAME_SIZE + YAMUX_MAX_DATA_FRAME_SIZE / 2)
+
+/* Transport moving file data with pread, optionally filling up after budget bytes */
+typedef struct {
+    mock_io_t *mock;
+    long budget;        /* Bytes taken before the transport is full (-1 = no limit) */
+    int sendfile_calls;
+} sendfile_io_t;
+
+/* Bytes of len the transport takes now */
+static size_t sf_take(sendfile_io_t *sio, size_t len) {
+    if (sio->budget >= 0) {
+        if (len > (size_t)sio->budget) {
+            len = (size_t)sio->budget;
+        }
+        sio->budget -= (long)len;
+    }
+    return len;
+}
+
+static int sf_read(void *ctx, uint8_t *buf, size_t len) {
+    return mock_read(((sendfile_io_t *)ctx)->mock, buf, len);
+}
+
+static int sf_write(void *ctx, const uint8_t *buf, size_t len) {
+    sendfile_io_t *sio = (sendfile_io_t *)ctx;
+
+    len = sf_take(sio, len);
+    return (len > 0) ? mock_write(sio->mock, buf, len) : 0;
+}
+
+static int sf_sendfile(void *ctx, int fd, uint64_t offset, size_t len) {
+    sendfile_io_t *sio = (sendfile_io_t *)ctx;
+    uint8_t buf[YAMUX_MAX_DATA_FRAME_SIZE];
+    ssize_t n;
+
+    sio->sendfile_calls++;
+    if (len > sizeof(buf)) {
+        len = sizeof(buf);
+    }
+    len = sf_take(sio, len);
+    if (len == 0) {
+        return 0;
+    }
+    n = pread(fd, buf, len, (off_t)offset);
+    return (n > 0) ? mock_write(sio->mock, buf, (size_t)n) : -1;
+}
+
+/* A temporary file holding SENDFILE_TEST_LEN bytes of a pattern */
+static FILE *sf_file(uint8_t *data) {
+    FILE *file = tmpfile();
+    size_t i;
+
+    for (i = 0; i < SENDFILE_TEST_LEN; i++) {
+        data[i] = (uint8_t)(i * 13 + 1);
+    }
+    assert_true(file && fwrite(data, 1, SENDFILE_TEST_LEN, file) == SENDFILE_TEST_LEN && fflush(file) == 0,
+                "Failed to write file");
+    return file;
+}
+
+static yamux_stream_t *sf_open(sendfile_io_t *sio, int with_sendfile, yamux_session_t **session) {
+    yamux_stream_t *stream;
+    yamux_io_t io;
+
+    memset(sio, 0, sizeof(*sio));
+    sio->mock = mock_io_init(1024);
+    sio->budget = -1;
+    memset(&io, 0, sizeof(io));
+    io.read = sf_read;
+    io.write = sf_write;
+    io.sendfile = with_sendfile ? sf_sendfile : NULL;
+    io.ctx = sio;
+
+    assert_true(yamux_session_create(&io, 1, NULL, session) == YAMUX_OK, "Failed to create session");
+    assert_true(yamux_stream_open_detailed(*session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    sio->mock->write_buf_used = 0;
+    return stream;
+}
+
+/* Split the DATA frames written into their payloads, checking each frame */
+static size_t sf_payload(mock_io_t *mock, uint8_t *out, size_t out_size, int *frames) {
+    yamux_header_t header;
+    size_t pos = 0;
+    size_t len = 0;
+
+    *frames = 0;
+    while (pos < mock->write_buf_used) {
+        assert_true(yamux_decode_header(mock->write_buf + pos, YAMUX_HEADER_SIZE, &header) == YAMUX_OK &&
+                    header.type == YAMUX_DATA && header.length <= YAMUX_MAX_DATA_FRAME_SIZE &&
+                    pos + YAMUX_HEADER_SIZE + YAMUX_FRAME_PAYLOAD_LEN(&header) <= mock->write_buf_used &&
+                    len + header.length <= out_size, "Bad DATA frame");
+        memcpy(out + len, mock->write_buf + pos + YAMUX_HEADER_SIZE, header.length);
+        pos += YAMUX_HEADER_SIZE + YAMUX_FRAME_PAYLOAD_LEN(&header);
+        len += header.length;
+        (*frames)++;
+    }
+    return len;
+}
+
+/* The file goes out in frames of the frame size, charged to the window */
+static void test_sendfile_frames(void) {
+    static uint8_t data[SENDFILE_TEST_LEN];
+    static uint8_t out[SENDFILE_TEST_LEN];
+    yamux_session_t *session;
+    sendfile_io_t sio;
+    yamux_stream_t *stream = sf_open(&sio, 1, &session);
+    FILE *file = sf_file(data);
+    yamux_stream_stats_t stats;
+    size_t written;
+    int frames;
+
+    assert_true(yamux_stream_sendfile(stream, fileno(file), 100, SENDFILE_TEST_LEN - 100, &written) == YAMUX_OK &&
+                written == SENDFILE_TEST_LEN - 100, "sendfile failed");
+    assert_true(sf_payload(sio.mock, out, sizeof(out), &frames) == SENDFILE_TEST_LEN - 100 && frames == 3 &&
+                memcmp(out, data + 100, SENDFILE_TEST_LEN - 100) == 0, "File data wrong on the wire");
+    assert_true(sio.sendfile_calls == 3 && stream->send_window == YAMUX_DEFAULT_WINDOW_SIZE - written &&
+                yamux_stream_get_stats(stream, &stats) == YAMUX_OK &&
+                (!YAMUX_STATS || (stats.frames_out == 3 && stats.bytes_out == written)), "Window or stats not charged");
+
+    /* The window bounds it */
+    stream->send_window = 1000;
+    assert_true(yamux_stream_sendfile(stream, fileno(file), 0, SENDFILE_TEST_LEN, &written) == YAMUX_OK &&
+                written == 1000, "Write not clamped to the window");
+    assert_true(yamux_stream_sendfile(stream, fileno(file), 0, SENDFILE_TEST_LEN, &written) ==
+                YAMUX_ERR_WOULD_BLOCK && written == 0, "Write past the window accepted");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(sio.mock);
+    fclose(file);
+}
+
+/* A frame the transport took part of is finished before anything after it */
+static void test_sendfile_partial(void) {
+    static uint8_t data[SENDFILE_TEST_LEN];
+    static uint8_t out[SENDFILE_TEST_LEN + 16];
+    static const uint8_t tail[] = "after";
+    yamux_session_t *session;
+    sendfile_io_t sio;
+    yamux_stream_t *stream = sf_open(&sio, 1, &session);
+    FILE *file = sf_file(data);
+    size_t written;
+    int frames;
+
+    /* Corked frames go first */
+    assert_true(yamux_session_cork(session) == YAMUX_OK &&
+                yamux_stream_write(stream, data, 10, &written) == YAMUX_OK && sio.mock->write_buf_used == 0,
+                "Corked write not queued");
+
+    /* The transport fills up 1000 bytes into the file frame */
+    sio.budget = (YAMUX_HEADER_SIZE + 10) + YAMUX_HEADER_SIZE + 1000;
+    assert_true(yamux_stream_sendfile(stream, fileno(file), 10, 3000, &written) == YAMUX_OK && written == 3000,
+                "Partial sendfile not committed");
+    assert_true(yamux_stream_sendfile(stream, fileno(file), 3010, 100, &written) == YAMUX_ERR_WOULD_BLOCK &&
+                written == 0 && yamux_session_queued(session), "Second frame started before the first ended");
+
+    /* Frames written meanwhile queue behind the file frame */
+    assert_true(yamux_stream_write(stream, tail, sizeof(tail), &written) == YAMUX_OK, "Queued write failed");
+    sio.budget = -1;
+    assert_true(yamux_session_uncork(session) == YAMUX_OK && !yamux_session_queued(session), "Flush failed");
+
+    memcpy(data + 3010, tail, sizeof(tail));
+    assert_true(sf_payload(sio.mock, out, sizeof(out), &frames) == 3010 + sizeof(tail) && frames == 3 &&
+                memcmp(out, data, 3010 + sizeof(tail)) == 0, "Frames torn or out of order");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(sio.mock);
+    fclose(file);
+}
+
+/* Without io.sendfile, or on a closed stream, nothing is written */
+static void test_sendfile_errors(void) {
+    yamux_session_t *session;
+    sendfile_io_t sio;
+    yamux_stream_t *stream = sf_open(&sio, 0, &session);
+    size_t written = 1;
+
+    assert_true(yamux_stream_sendfile(stream, 0, 0, 10, &written) == YAMUX_ERR_INVALID && written == 0,
+                "sendfile without io.sendfile accepted");
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(sio.mock);
+
+    stream = sf_open(&sio, 1, &session);
+    assert_true(yamux_stream_sendfile(stream, -1, 0, 10, &written) == YAMUX_ERR_INVALID &&
+                yamux_stream_sendfile(NULL, 0, 0, 10, &written) == YAMUX_ERR_INVALID &&
+                yamux_stream_sendfile(stream, 0, 0, 10, NULL) == YAMUX_ERR_INVALID, "Bad arguments accepted");
+    assert_true(yamux_stream_sendfile(stream, 0, 0, 0, &written) == YAMUX_OK && written == 0, "Empty write failed");
+    assert_true(yamux_stream_close(stream, 0) == YAMUX_OK && sio.mock->write_buf_used == YAMUX_HEADER_SIZE,
+                "Close failed");
+    assert_true(yamux_stream_sendfile(stream, 0, 0, 10, &written) == YAMUX_ERR_CLOSED && sio.sendfile_calls == 0,
+                "Wrote after FIN");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(sio.mock);
+}
+
+void test_sendfile(void) {
+    printf("Testing file-backed stream writes...\n");
+
+    test_sendfile_frames();
+    test_sendfile_partial();
+    test_sendfile_errors();
+}
@@ -21,6 +21,7 @@ void test_session_creation(void) {
     assert(io_ctx != NULL);
     
     /* Set up IO callbacks */
+    memset(&io, 0, sizeof(io));
     io.read = pipe_read;
     io.write = pipe_write;
     io.ctx = io_ctx;
@@ -57,16 +58,20 @@ void test_session_ping(void) {
     mock_io_t *client_mock, *server_mock;
     yamux_config_t config;
     yamux_result_t result;
+    yamux_header_t header;
+    uint32_t ping_id;
     
     /* Initialize mock IOs */
     client_mock = mock_io_init(1024);
     server_mock = mock_io_init(1024);
     
     /* Set up IO callbacks */
+    memset(&client_io, 0, sizeof(client_io));
     client_io.read = mock_read;
     client_io.write = mock_write;
     client_io.ctx = client_mock;
     
+    memset(&server_io, 0, sizeof(server_io));
     server_io.read = mock_read;
     server_io.write = mock_write;
     server_io.ctx = server_mock;
@@ -85,9 +90,13 @@ void test_session_ping(void) {
     result = yamux_session_create(&server_io, 0, &config, &server_session);
     assert_true(result == YAMUX_OK, "Failed to create server session");
     
-    /* Send ping from client to server */
-    result = yamux_session_ping(client_session);
+    /* Send ping from client to server: a bare header whose length is the ping ID */
+    result = yamux_session_ping_id(client_session, &ping_id);
     assert_true(result == YAMUX_OK, "Failed to send ping");
+    assert_true(client_mock->write_buf_used == YAMUX_HEADER_SIZE &&
+                yamux_decode_header(client_mock->write_buf, YAMUX_HEADER_SIZE, &header) == YAMUX_OK &&
+                header.type == YAMUX_PING && header.flags == YAMUX_FLAG_SYN && header.length == ping_id,
+                "Ping frame laid out wrong");
     
     /* Exchange data client -> server */
     mock_io_swap_buffers(client_mock, server_mock);
@@ -96,6 +105,12 @@ void test_session_ping(void) {
     result = yamux_session_process(server_session);
     assert_true(result == YAMUX_OK, "Failed to process server session");
     
+    /* The ACK echoes the ID, again with no payload */
+    assert_true(server_mock->write_buf_used == YAMUX_HEADER_SIZE &&
+                yamux_decode_header(server_mock->write_buf, YAMUX_HEADER_SIZE, &header) == YAMUX_OK &&
+                header.type == YAMUX_PING && header.flags == YAMUX_FLAG_ACK && header.length == ping_id,
+                "Ping ACK laid out wrong");
+    
     /* Exchange data server -> client (PING-ACK) */
     mock_io_swap_buffers(server_mock, client_mock);
     
@@ -147,6 +162,7 @@ void test_stream_data_transfer(void) {
     assert_true(server_mock != NULL, "Failed to create server mock IO");
     
     /* Set up client session */
+    memset(&io, 0, sizeof(io));
     io.read = mock_io_read;
     io.write = mock_io_write;
     io.ctx = client_mock;
@@ -154,6 +170,7 @@ void test_stream_data_transfer(void) {
     assert_true(result == YAMUX_OK, "Failed to create client session");
     
     /* Set up server session */
+    memset(&io, 0, sizeof(io));
     io.read = mock_io_read;
     io.write = mock_io_write;
     io.ctx = server_mock;
@@ -0,0 +1,231 @@
+/**
+ * @file test_static_memory.c
+ * @brief Test that a fixed_memory session never allocates once created
+ *
+ * Built with YAMUX_STATIC_MEMORY, so every allocation the library makes goes
+ * through the yamux_alloc()/yamux_free() hooks below. They count the calls
+ * made while armed, i.e. between session creation and teardown.
+ */
+
+#include "mock_io.h"
+
+#define STATIC_TEST_POOL 2
+#define STATIC_TEST_OPEN_TIMEOUT 1000
+#define STATIC_TEST_CLOSE_TIMEOUT 2000
+
+/* Allocator hooks: calls made while armed are counted */
+static int hooks_armed;
+static unsigned long hook_calls;
+
+void *yamux_alloc(size_t size) {
+    if (hooks_armed) {
+        hook_calls++;
+    }
+    return malloc(size);
+}
+
+void yamux_free(void *ptr) {
+    if (hooks_armed && ptr) {
+        hook_calls++;
+    }
+    free(ptr);
+}
+
+static void assert_true(int condition, const char *message) {
+    if (!condition) {
+        printf("FAILED: %s\n", message);
+        exit(1);
+    }
+}
+
+/* Transport with a settable clock */
+typedef struct {
+    mock_io_t *mock;
+    uint64_t now;
+} clock_io_t;
+
+static int clock_read(void *ctx, uint8_t *buf, size_t len) {
+    return mock_read(((clock_io_t *)ctx)->mock, buf, len);
+}
+
+static int clock_write(void *ctx, const uint8_t *buf, size_t len) {
+    return mock_write(((clock_io_t *)ctx)->mock, buf, len);
+}
+
+static uint64_t clock_now(void *ctx) {
+    return ((clock_io_t *)ctx)->now;
+}
+
+/* Replace the inbound data with one encoded frame */
+static void set_frame(mock_io_t *mock, uint8_t type, uint16_t flags, uint32_t stream_id,
+                      const uint8_t *payload, uint32_t length) {
+    yamux_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = type;
+    header.flags = flags;
+    header.stream_id = stream_id;
+    header.length = length;
+
+    yamux_encode_header(&header, mock->read_buf);
+    mock->read_buf_used = YAMUX_HEADER_SIZE;
+    mock->read_pos = 0;
+    if (payload) {
+        memcpy(mock->read_buf + YAMUX_HEADER_SIZE, payload, length);
+        mock->read_buf_used += length;
+    }
+}
+
+/* Process the inbound data completely */
+static void deliver(yamux_session_t *session, mock_io_t *mock) {
+    int calls;
+
+    for (calls = 0; calls < 256 && mock->read_pos < mock->read_buf_used; calls++) {
+        assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process frame");
+    }
+}
+
+/* Whether a header matching type, flags and stream_id was written since pos */
+static int written(mock_io_t *mock, size_t pos, uint8_t type, uint16_t flags, uint32_t stream_id) {
+    yamux_header_t header;
+
+    while (pos + YAMUX_HEADER_SIZE <= mock->write_buf_used) {
+        yamux_decode_header(mock->write_buf + pos, mock->write_buf_used - pos, &header);
+        if (header.type == type && (header.flags & flags) == flags && header.stream_id == stream_id) {
+            return 1;
+        }
+        pos += YAMUX_HEADER_SIZE + YAMUX_FRAME_PAYLOAD_LEN(&header);
+    }
+    return 0;
+}
+
+/* Settings fixed memory cannot honour are refused */
+static void test_static_config(void) {
+    clock_io_t cio;
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session = NULL;
+
+    memset(&cio, 0, sizeof(cio));
+    cio.mock = mock_io_init(1024);
+    memset(&io, 0, sizeof(io));
+    io.read = clock_read;
+    io.write = clock_write;
+    io.ctx = &cio;
+
+    memset(&config, 0, sizeof(config));
+    config.fixed_memory = 1;
+    config.egress_quantum = 1024;
+    assert_true(yamux_session_create(&io, 0, &config, &session) == YAMUX_ERR_INVALID,
+                "The scheduler should be refused with fixed memory");
+    assert_true(session == NULL, "Session returned for a refused config");
+
+    mock_io_free(cio.mock);
+}
+
+/* Run a session through streams, data, timers and pings without a hook call */
+static void test_static_session(void) {
+    static uint8_t data[YAMUX_DEFAULT_WINDOW_SIZE];
+    uint8_t window[4] = {0x00, 0x04, 0x00, 0x00};
+    const uint32_t initial = YAMUX_DEFAULT_WINDOW_SIZE;
+    yamux_stream_t *streams[STATIC_TEST_POOL];
+    yamux_stream_t *first, *second, *opened;
+    clock_io_t cio;
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session;
+    size_t bytes, total, pos;
+    uint32_t ping_id;
+
+    memset(&cio, 0, sizeof(cio));
+    cio.mock = mock_io_init(sizeof(data) + 1024);
+    memset(&io, 0, sizeof(io));
+    io.read = clock_read;
+    io.write = clock_write;
+    io.now_ms = clock_now;
+    io.ctx = &cio;
+
+    memset(&config, 0, sizeof(config));
+    config.fixed_memory = 1;
+    config.stream_pool_size = STATIC_TEST_POOL;
+    config.max_stream_window_size = 4 * initial;
+    config.stream_open_timeout = STATIC_TEST_OPEN_TIMEOUT;
+    config.stream_close_timeout = STATIC_TEST_CLOSE_TIMEOUT;
+    assert_true(yamux_session_create(&io, 0, &config, &session) == YAMUX_OK, "Failed to create session");
+    hooks_armed = 1;
+
+    /* The peer opens as many streams as the pool holds */
+    set_frame(cio.mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 1, window, sizeof(window));
+    deliver(session, cio.mock);
+    set_frame(cio.mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 3, window, sizeof(window));
+    deliver(session, cio.mock);
+    assert_true(yamux_stream_accept(session, &first) == YAMUX_OK, "Failed to accept first stream");
+    assert_true(yamux_stream_accept(session, &second) == YAMUX_OK, "Failed to accept second stream");
+    first->state = YAMUX_STREAM_ESTABLISHED; /* The peer leaves SYN_RECV on an explicit ACK */
+    second->state = YAMUX_STREAM_ESTABLISHED;
+
+    /* One more is refused rather than failing the session */
+    pos = cio.mock->write_buf_used;
+    set_frame(cio.mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 5, window, sizeof(window));
+    deliver(session, cio.mock);
+    assert_true(written(cio.mock, pos, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_RST, 5), "Stream beyond the pool not reset");
+    assert_true(yamux_get_stream(session, 5) == NULL, "Stream beyond the pool entered the table");
+
+    /* Opening locally with the pool empty fails */
+    assert_true(yamux_stream_open_detailed(session, 0, &opened) == YAMUX_ERR_NOMEM,
+                "Open beyond the pool should fail with NOMEM");
+    assert_true(yamux_stream_open_batch(session, 1, streams) == YAMUX_ERR_NOMEM,
+                "Batch open beyond the pool should fail with NOMEM");
+
+    /* A 50 ms round trip and a fast reader would grow the window, but the
+     * receive buffer is a pooled chunk, so it stays at the initial size */
+    assert_true(yamux_session_ping_id(session, &ping_id) == YAMUX_OK, "Failed to ping");
+    cio.now = 50;
+    set_frame(cio.mock, YAMUX_PING, YAMUX_FLAG_ACK, 0, NULL, ping_id);
+    deliver(session, cio.mock);
+    assert_true(session->rtt_ms == 50, "RTT not measured");
+    cio.now = 60;
+    set_frame(cio.mock, YAMUX_DATA, 0, 1, data, initial / 2);
+    deliver(session, cio.mock);
+    for (total = 0; total < initial / 2; total += bytes) {
+        assert_true(yamux_stream_read(first, data, sizeof(data), &bytes) == YAMUX_OK && bytes > 0, "Read failed");
+    }
+    assert_true(first->recv_window_size == initial && first->recvbuf.size == initial,
+                "Window grew past the pooled chunk");
+    assert_true(first->recv_window == initial, "Consumed credit not granted");
+
+    /* Writes and the first ticks run on memory taken at creation */
+    assert_true(yamux_stream_write(second, data, 100, &bytes) == YAMUX_OK && bytes == 100, "Write failed");
+    assert_true(yamux_session_tick(session, 100) == YAMUX_OK, "Tick failed");
+
+    /* A FIN the peer never answers is reset by the close timer */
+    pos = cio.mock->write_buf_used;
+    assert_true(yamux_stream_close(first, 0) == YAMUX_OK, "Close failed");
+    assert_true(yamux_session_tick(session, 100 + STATIC_TEST_CLOSE_TIMEOUT) == YAMUX_OK, "Tick failed");
+    assert_true(written(cio.mock, pos, YAMUX_DATA, YAMUX_FLAG_RST, 1), "Close timeout did not reset");
+    assert_true(yamux_stream_free(first) == YAMUX_OK, "Failed to free stream");
+
+    /* Its pooled memory serves the next stream, whose SYN then times out */
+    pos = cio.mock->write_buf_used;
+    assert_true(yamux_stream_open_detailed(session, 0, &opened) == YAMUX_OK, "Open after a free failed");
+    assert_true(yamux_session_tick(session, 200 + STATIC_TEST_CLOSE_TIMEOUT + STATIC_TEST_OPEN_TIMEOUT) == YAMUX_OK,
+                "Tick failed");
+    assert_true(written(cio.mock, pos, YAMUX_DATA, YAMUX_FLAG_RST, opened->id), "Open timeout did not reset");
+    assert_true(yamux_stream_free(opened) == YAMUX_OK, "Failed to free opened stream");
+
+    assert_true(hook_calls == 0, "Allocator hooks called after session creation");
+
+    /* Teardown gives the memory back */
+    hooks_armed = 0;
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(cio.mock);
+}
+
+int main(void) {
+    printf("Testing fixed-memory sessions...\n");
+    test_static_config();
+    test_static_session();
+    printf("Static memory tests passed!\n");
+    return 0;
+}
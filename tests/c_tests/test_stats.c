@@ -0,0 +1,182 @@
+/**
+ * @file test_stats.c
+ * @brief Test for the session and stream counters
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#if YAMUX_STATS
+
+/* Clock the stall timing reads */
+static uint64_t stats_clock_ms;
+
+static uint64_t stats_now_ms(void *ctx) {
+    (void)ctx;
+    return stats_clock_ms;
+}
+
+/* Transport that takes at most 10 bytes per write */
+static int stats_short_write(void *ctx, const uint8_t *buf, size_t len) {
+    return mock_write(ctx, buf, (len > 10) ? 10 : len);
+}
+
+static yamux_session_t *create_session(mock_io_t *mock, int client,
+                                       int (*write)(void *ctx, const uint8_t *buf, size_t len)) {
+    yamux_io_t io;
+    yamux_session_t *session;
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = write;
+    io.now_ms = stats_now_ms;
+    io.ctx = mock;
+
+    assert_true(yamux_session_create(&io, client, NULL, &session) == YAMUX_OK, "Failed to create session");
+    return session;
+}
+
+/* Append a frame to the mock's input */
+static void feed_frame(mock_io_t *mock, uint8_t type, uint16_t flags, uint32_t stream_id,
+                       const uint8_t *payload, uint32_t length) {
+    yamux_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = type;
+    header.flags = flags;
+    header.stream_id = stream_id;
+    header.length = length;
+    yamux_encode_header(&header, mock->read_buf + mock->read_buf_used);
+    mock->read_buf_used += YAMUX_HEADER_SIZE;
+    if (payload) {
+        memcpy(mock->read_buf + mock->read_buf_used, payload, length);
+        mock->read_buf_used += length;
+    }
+}
+
+/* Received frames, payload, the high-water mark and the accept queue */
+static void test_stats_input(void) {
+    static uint8_t data[1000];
+    uint8_t window[4] = {0x00, 0x04, 0x00, 0x00};
+    mock_io_t *mock = mock_io_init(8192);
+    yamux_session_t *session = create_session(mock, 0, mock_write);
+    yamux_session_stats_t stats;
+    yamux_stream_stats_t stream_stats;
+    yamux_stream_t *stream;
+    uint8_t buf[600];
+    size_t n;
+
+    assert_true(yamux_session_get_stats(NULL, &stats) == YAMUX_ERR_INVALID &&
+                yamux_stream_get_stats(NULL, &stream_stats) == YAMUX_ERR_INVALID, "NULL accepted");
+
+    feed_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 1, window, sizeof(window));
+    feed_frame(mock, YAMUX_DATA, 0, 1, data, 600);
+    feed_frame(mock, YAMUX_DATA, 0, 1, data, 400);
+    feed_frame(mock, YAMUX_PING, YAMUX_FLAG_SYN, 0, NULL, 0);
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Processing failed");
+
+    assert_true(yamux_session_get_stats(session, &stats) == YAMUX_OK, "Failed to read session stats");
+    assert_true(stats.frames_in[YAMUX_WINDOW_UPDATE] == 1 && stats.frames_in[YAMUX_DATA] == 2 &&
+                stats.frames_in[YAMUX_PING] == 1, "Frames in miscounted");
+    assert_true(stats.bytes_in == mock->read_buf_used && stats.data_bytes_in == 1000,
+                "Bytes in miscounted");
+    assert_true(stats.frames_out[YAMUX_WINDOW_UPDATE] == 1 && stats.frames_out[YAMUX_PING] == 1 &&
+                stats.bytes_out == mock->write_buf_used, "SYN-ACK or ping reply miscounted");
+    assert_true(stats.recv_high_water == 1000 && stats.accept_queue_depth == 1 && stats.streams == 1,
+                "Gauges wrong");
+
+    assert_true(yamux_stream_accept(session, &stream) == YAMUX_OK, "Accept failed");
+    assert_true(yamux_stream_read(stream, buf, sizeof(buf), &n) == YAMUX_OK && n == sizeof(buf),
+                "Read failed");
+    assert_true(yamux_stream_get_stats(stream, &stream_stats) == YAMUX_OK, "Failed to read stream stats");
+    assert_true(stream_stats.frames_in == 2 && stream_stats.bytes_in == 1000 &&
+                stream_stats.recv_high_water == 1000, "Stream counters wrong");
+    assert_true(yamux_session_get_stats(session, &stats) == YAMUX_OK && stats.accept_queue_depth == 0,
+                "Accepted stream still counted as queued");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* Sent frames, window stalls and their duration, WOULD_BLOCK */
+static void test_stats_stalls(void) {
+    static uint8_t data[YAMUX_DEFAULT_WINDOW_SIZE];
+    uint8_t credit[4] = {0x00, 0x00, 0x10, 0x00};
+    mock_io_t *mock = mock_io_init(4096);
+    yamux_session_t *session = create_session(mock, 1, mock_write);
+    yamux_session_stats_t stats;
+    yamux_stream_stats_t stream_stats;
+    yamux_stream_t *stream;
+    size_t written;
+
+    stats_clock_ms = 1000;
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    assert_true(yamux_stream_write(stream, data, sizeof(data), &written) == YAMUX_OK &&
+                written == sizeof(data), "Write failed");
+    assert_true(yamux_stream_write(stream, data, 1, &written) == YAMUX_ERR_WOULD_BLOCK,
+                "Write past the window did not block");
+
+    stats_clock_ms = 1250;
+    assert_true(yamux_stream_get_stats(stream, &stream_stats) == YAMUX_OK, "Failed to read stream stats");
+    assert_true(stream_stats.frames_out == sizeof(data) / YAMUX_MAX_DATA_FRAME_SIZE &&
+                stream_stats.bytes_out == sizeof(data), "Data out miscounted");
+    assert_true(stream_stats.window_stalls == 1 && stream_stats.stall_ms == 250 &&
+                stream_stats.would_block == 1, "Current stall not reported");
+
+    stats_clock_ms = 1400;
+    feed_frame(mock, YAMUX_WINDOW_UPDATE, 0, stream->id, credit, sizeof(credit));
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Processing failed");
+    stats_clock_ms = 2000;
+
+    assert_true(yamux_stream_get_stats(stream, &stream_stats) == YAMUX_OK &&
+                stream_stats.window_updates_in == 1 && stream_stats.stall_ms == 400, "Stall did not end");
+    assert_true(yamux_session_get_stats(session, &stats) == YAMUX_OK, "Failed to read session stats");
+    assert_true(stats.window_stalls == 1 && stats.stall_ms == 400 && stats.would_block == 1 &&
+                stats.window_updates_in == 1, "Session stall counters wrong");
+    assert_true(stats.frames_out[YAMUX_DATA] == stream_stats.frames_out &&
+                stats.data_bytes_out == sizeof(data) && stats.bytes_out == mock->write_buf_used,
+                "Session output counters wrong");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* Short transport writes */
+static void test_stats_partial(void) {
+    static uint8_t data[100];
+    mock_io_t *mock = mock_io_init(4096);
+    yamux_session_t *session = create_session(mock, 1, stats_short_write);
+    yamux_session_stats_t stats;
+    yamux_stream_t *stream;
+    size_t written;
+
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    assert_true(yamux_stream_write(stream, data, sizeof(data), &written) == YAMUX_OK, "Write failed");
+    while (session->send_buf_used > 0) {
+        assert_true(yamux_session_flush(session) != YAMUX_ERR_IO, "Flush failed");
+    }
+
+    assert_true(yamux_session_get_stats(session, &stats) == YAMUX_OK, "Failed to read session stats");
+    assert_true(stats.partial_writes > 0 && stats.bytes_out == mock->write_buf_used,
+                "Partial writes miscounted");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+void test_stats(void) {
+    printf("Testing session and stream statistics...\n");
+
+    test_stats_input();
+    test_stats_stalls();
+    test_stats_partial();
+}
+
+#else
+
+void test_stats(void) {
+    printf("(skipped, built without YAMUX_STATS) ");
+}
+
+#endif /* YAMUX_STATS */
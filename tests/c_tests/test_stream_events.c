@@ -0,0 +1,242 @@
+/**
+ * @file test_stream_events.c
+ * @brief Test for the per-session stream event callbacks
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define EVENTS_TEST_DATA_LEN 100
+
+/* What the callbacks saw */
+typedef struct {
+    int accepted;
+    int readable;
+    int writable;
+    int closed;
+    yamux_stream_t *last;
+    yamux_stream_state_t closed_state;
+    size_t readable_bytes;
+} event_record_t;
+
+static void on_accept(yamux_session_t *session, yamux_stream_t *stream, void *user_data) {
+    event_record_t *rec = (event_record_t *)user_data;
+    yamux_stream_t *accepted = NULL;
+
+    /* The stream is already queued for accept */
+    if (yamux_stream_accept(session, &accepted) == YAMUX_OK && accepted == stream) {
+        rec->accepted++;
+    }
+    rec->last = stream;
+}
+
+static void on_readable(yamux_stream_t *stream, void *user_data) {
+    event_record_t *rec = (event_record_t *)user_data;
+
+    rec->readable++;
+    rec->readable_bytes = stream->recvbuf.used;
+    rec->last = stream;
+}
+
+static void on_writable(yamux_stream_t *stream, void *user_data) {
+    event_record_t *rec = (event_record_t *)user_data;
+
+    rec->writable++;
+    rec->last = stream;
+}
+
+static void on_closed(yamux_stream_t *stream, void *user_data) {
+    event_record_t *rec = (event_record_t *)user_data;
+
+    rec->closed++;
+    rec->closed_state = stream->state;
+    rec->last = stream;
+}
+
+/* Append an encoded frame to the mock's inbound data */
+static void append_frame(mock_io_t *mock, uint8_t type, uint16_t flags, uint32_t stream_id,
+                         const uint8_t *payload, uint32_t length) {
+    yamux_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = type;
+    header.flags = flags;
+    header.stream_id = stream_id;
+    header.length = length;
+
+    yamux_encode_header(&header, mock->read_buf + mock->read_buf_used);
+    mock->read_buf_used += YAMUX_HEADER_SIZE;
+    if (length > 0) {
+        memcpy(mock->read_buf + mock->read_buf_used, payload, length);
+        mock->read_buf_used += length;
+    }
+}
+
+/* Read completion that records the result */
+static void on_read_done(yamux_stream_t *stream, uint8_t *buf, size_t bytes_read,
+                         yamux_result_t result, void *user_data) {
+    (void)stream;
+    (void)buf;
+    (void)bytes_read;
+    *(yamux_result_t *)user_data = result;
+}
+
+/* A stream reset by the peer (DATA|RST) is reported, and released once freed */
+static void test_stream_events_peer_reset(void) {
+    uint8_t buf[16];
+    mock_io_t *client_mock;
+    mock_io_t *server_mock;
+    yamux_io_t client_io;
+    yamux_io_t server_io;
+    yamux_callbacks_t callbacks;
+    yamux_session_t *client;
+    yamux_session_t *server;
+    yamux_stream_t *stream;
+    yamux_result_t read_result = YAMUX_OK;
+    event_record_t rec;
+
+    client_mock = mock_io_init(4096);
+    server_mock = mock_io_init(4096);
+    memset(&client_io, 0, sizeof(client_io));
+    client_io.read = mock_read;
+    client_io.write = mock_write;
+    client_io.ctx = client_mock;
+    server_io = client_io;
+    server_io.ctx = server_mock;
+    assert_true(yamux_session_create(&client_io, 1, NULL, &client) == YAMUX_OK, "Failed to create client");
+    assert_true(yamux_session_create(&server_io, 0, NULL, &server) == YAMUX_OK, "Failed to create server");
+
+    memset(&rec, 0, sizeof(rec));
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.on_stream_accept = on_accept;
+    callbacks.on_stream_closed = on_closed;
+    callbacks.user_data = &rec;
+    assert_true(yamux_session_set_callbacks(server, &callbacks) == YAMUX_OK, "Failed to set callbacks");
+
+    /* A stream the application holds: closed callback, pending read fails */
+    assert_true(yamux_stream_open_detailed(client, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    mock_io_swap_buffers(client_mock, server_mock);
+    assert_true(yamux_session_process(server) == YAMUX_OK && rec.accepted == 1, "Stream not accepted");
+    assert_true(yamux_stream_post_read(rec.last, buf, sizeof(buf), on_read_done, &read_result) == YAMUX_OK,
+                "Failed to post read");
+    assert_true(yamux_stream_close(stream, 1) == YAMUX_OK, "Failed to reset stream");
+    mock_io_swap_buffers(client_mock, server_mock);
+    assert_true(yamux_session_process(server) == YAMUX_OK, "Failed to process DATA RST");
+    assert_true(rec.closed == 1 && rec.closed_state == YAMUX_STREAM_CLOSED, "DATA RST not reported");
+    assert_true(read_result == YAMUX_ERR_CLOSED, "Pending read not failed by RST");
+    assert_true(yamux_get_stream(server, rec.last->id) == NULL && server->streams.count == 0,
+                "Reset stream not removed");
+    assert_true(yamux_stream_free(rec.last) == YAMUX_OK && server->stream_pool.in_use == 0,
+                "Reset stream not freed");
+
+    /* A stream the application already freed goes back to the pool silently */
+    assert_true(yamux_stream_open_detailed(client, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    mock_io_swap_buffers(client_mock, server_mock);
+    assert_true(yamux_session_process(server) == YAMUX_OK && rec.accepted == 2, "Stream not accepted");
+    assert_true(yamux_stream_free(rec.last) == YAMUX_OK && server->stream_pool.in_use == 1,
+                "Half-closed stream released early");
+    assert_true(yamux_stream_close(stream, 1) == YAMUX_OK, "Failed to reset stream");
+    mock_io_swap_buffers(client_mock, server_mock);
+    assert_true(yamux_session_process(server) == YAMUX_OK, "Failed to process DATA RST");
+    assert_true(rec.closed == 1, "Freed stream reported");
+    assert_true(server->streams.count == 0 && server->stream_pool.in_use == 0, "Freed stream not released");
+
+    /* An RST for a stream already gone is ignored */
+    append_frame(server_mock, YAMUX_DATA, YAMUX_FLAG_RST, 1, NULL, 0);
+    assert_true(yamux_session_process(server) == YAMUX_OK, "RST for unknown stream failed the session");
+
+    yamux_session_close(server, YAMUX_NORMAL);
+    yamux_session_close(client, YAMUX_NORMAL);
+    mock_io_free(server_mock);
+    mock_io_free(client_mock);
+}
+
+/* Test that each callback fires once for the frame that caused its event */
+void test_stream_events(void) {
+    uint8_t window[4] = {0x00, 0x04, 0x00, 0x00};
+    uint8_t credit[4] = {0x00, 0x00, 0x10, 0x00};
+    uint8_t data[EVENTS_TEST_DATA_LEN];
+    uint8_t *big;
+    mock_io_t *mock;
+    yamux_io_t io;
+    yamux_callbacks_t callbacks;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    event_record_t rec;
+    size_t written;
+
+    printf("Testing stream event callbacks...\n");
+
+    mock = mock_io_init(4096);
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+    assert_true(yamux_session_create(&io, 0, NULL, &session) == YAMUX_OK, "Failed to create session");
+    assert_true(yamux_session_set_callbacks(NULL, NULL) == YAMUX_ERR_INVALID, "NULL session accepted");
+
+    memset(&rec, 0, sizeof(rec));
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.on_stream_readable = on_readable;
+    callbacks.on_stream_writable = on_writable;
+    callbacks.on_stream_accept = on_accept;
+    callbacks.on_stream_closed = on_closed;
+    callbacks.user_data = &rec;
+    assert_true(yamux_session_set_callbacks(session, &callbacks) == YAMUX_OK, "Failed to set callbacks");
+
+    /* A SYN is reported once the stream can be accepted */
+    append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 1, window, sizeof(window));
+    append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_ACK, 1, NULL, 0);
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process SYN");
+    stream = yamux_get_stream(session, 1);
+    assert_true(stream != NULL && rec.accepted == 1 && rec.last == stream, "Accept not reported");
+    assert_true(rec.readable == 0 && rec.writable == 0 && rec.closed == 0, "Spurious events on open");
+
+    /* Data is reported after it is buffered */
+    memset(data, 0x42, sizeof(data));
+    append_frame(mock, YAMUX_DATA, 0, 1, data, sizeof(data));
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process DATA");
+    assert_true(rec.readable == 1 && rec.readable_bytes == sizeof(data), "Readable not reported with data");
+
+    /* Credit on an open window is not news; credit on an exhausted one is */
+    append_frame(mock, YAMUX_WINDOW_UPDATE, 0, 1, credit, sizeof(credit));
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process WINDOW_UPDATE");
+    assert_true(rec.writable == 0, "Writable reported while the window was open");
+
+    big = (uint8_t *)calloc(1, stream->send_window);
+    while (stream->send_window > 0) {
+        assert_true(yamux_stream_write(stream, big, stream->send_window, &written) == YAMUX_OK,
+                    "Write within the window failed");
+    }
+    free(big);
+    append_frame(mock, YAMUX_WINDOW_UPDATE, 0, 1, credit, sizeof(credit));
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process WINDOW_UPDATE");
+    assert_true(rec.writable == 1 && stream->send_window == 4096, "Reopened window not reported");
+
+    /* FIN makes the stream readable (end of stream) and closed by the peer */
+    append_frame(mock, YAMUX_DATA, YAMUX_FLAG_FIN, 1, NULL, 0);
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process FIN");
+    assert_true(rec.readable == 2 && rec.closed == 1 && rec.closed_state == YAMUX_STREAM_FIN_RECV,
+                "FIN not reported");
+
+    /* RST is reported while the stream is still valid */
+    append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 3, window, sizeof(window));
+    append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_RST, 3, NULL, 0);
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process RST");
+    assert_true(rec.accepted == 2 && rec.closed == 2 && rec.closed_state == YAMUX_STREAM_CLOSED,
+                "RST not reported");
+    assert_true(yamux_get_stream(session, 3) == NULL, "Reset stream not removed");
+    assert_true(yamux_stream_free(rec.last) == YAMUX_OK, "Failed to free reset stream");
+
+    /* Without callbacks frames are handled silently */
+    assert_true(yamux_session_set_callbacks(session, NULL) == YAMUX_OK, "Failed to clear callbacks");
+    append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 5, window, sizeof(window));
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process SYN");
+    assert_true(rec.accepted == 2, "Cleared callback still called");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+
+    test_stream_events_peer_reset();
+}
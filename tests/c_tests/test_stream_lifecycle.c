@@ -3,6 +3,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <arpa/inet.h>
 #include "mock_io.h"
 
 /* External assert function declaration */
@@ -41,10 +42,12 @@ void test_stream_lifecycle(void) {
     server_mock = mock_io_init(4096);
     
     /* Set up IO callbacks */
+    memset(&client_io, 0, sizeof(client_io));
     client_io.read = mock_read;
     client_io.write = mock_write;
     client_io.ctx = client_mock;
     
+    memset(&server_io, 0, sizeof(server_io));
     server_io.read = mock_read;
     server_io.write = mock_write;
     server_io.ctx = server_mock;
@@ -221,7 +224,38 @@ void test_stream_lifecycle(void) {
     assert_true(state == YAMUX_STREAM_CLOSED, 
                 "Client stream should be in CLOSED state");
     
-    /* TEST 9: Clean up */
+    /* TEST 9: Freeing the finished streams returns them to the pools */
+    assert_true(yamux_stream_free(client_stream) == YAMUX_OK && yamux_stream_free(server_stream) == YAMUX_OK,
+                "Failed to free closed streams");
+    assert_true(client_session->stream_pool.in_use == 0 && server_session->stream_pool.in_use == 0,
+                "Freed streams not returned to the pool");
+    
+    /* TEST 10: A stream freed while the peer is still open goes once the peer finishes */
+    result = yamux_stream_open_detailed(client_session, 0, &client_stream);
+    assert_true(result == YAMUX_OK, "Failed to open second client stream");
+    mock_io_swap_buffers(client_mock, server_mock);
+    result = yamux_session_process(server_session);
+    assert_true(result == YAMUX_OK, "Failed to process server session");
+    result = yamux_stream_accept(server_session, &server_stream);
+    assert_true(result == YAMUX_OK, "Failed to accept second stream");
+    mock_io_swap_buffers(server_mock, client_mock);
+    result = yamux_session_process(client_session);
+    assert_true(result == YAMUX_OK, "Failed to process client session");
+    
+    assert_true(yamux_stream_free(server_stream) == YAMUX_OK, "Failed to free open server stream");
+    assert_true(server_session->stream_pool.in_use == 1, "Stream released before the peer finished");
+    mock_io_swap_buffers(server_mock, client_mock);
+    result = yamux_session_process(client_session);
+    assert_true(result == YAMUX_OK, "Failed to process client session");
+    assert_true(yamux_stream_get_state(client_stream) == YAMUX_STREAM_FIN_RECV &&
+                yamux_stream_free(client_stream) == YAMUX_OK && client_session->stream_pool.in_use == 0,
+                "Finished client stream not released");
+    mock_io_swap_buffers(client_mock, server_mock);
+    result = yamux_session_process(server_session);
+    assert_true(result == YAMUX_OK, "Failed to process server session");
+    assert_true(server_session->stream_pool.in_use == 0, "Freed server stream not released on the peer's FIN");
+    
+    /* TEST 11: Clean up */
     result = yamux_session_close(client_session, 0);
     assert_true(result == YAMUX_OK, "Failed to close client session");
     
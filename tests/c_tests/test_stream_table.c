@@ -0,0 +1,131 @@
+/**
+ * @file test_stream_table.c
+ * @brief Test for the session stream table
+ */
+
+#include "test_common.h"
+
+/* External assert function declaration */
+void assert_true(int condition, const char *message);
+
+/* 1000, or one fewer than a session takes, so its duplicate can be tried */
+#if YAMUX_MAX_STREAMS <= 1000
+#define TABLE_TEST_STREAMS (YAMUX_MAX_STREAMS - 1)
+#else
+#define TABLE_TEST_STREAMS 1000
+#endif
+
+/* Test add, lookup and remove on a session's stream table */
+void test_stream_table(void) {
+    yamux_io_t io;
+    yamux_session_t *session;
+    yamux_stream_t *streams;
+    yamux_stream_t *closing;
+    yamux_header_t header;
+    yamux_result_t result;
+    pipe_io_context_t *io_ctx;
+    int i;
+    
+    printf("Testing stream table...\n");
+    
+    io_ctx = pipe_io_context_create(4096);
+    assert_true(io_ctx != NULL, "Failed to create pipe IO context");
+    
+    memset(&io, 0, sizeof(io));
+    io.read = pipe_read;
+    io.write = pipe_write;
+    io.ctx = io_ctx;
+    
+    result = yamux_session_create(&io, 1, NULL, &session);
+    assert_true(result == YAMUX_OK, "Failed to create session");
+    
+    /* Streams are owned by the test; the table only indexes them */
+    streams = (yamux_stream_t *)calloc(TABLE_TEST_STREAMS, sizeof(yamux_stream_t));
+    assert_true(streams != NULL, "Failed to allocate streams");
+    
+    /* Interleave odd (local) and even (remote) IDs like a real session */
+    for (i = 0; i < TABLE_TEST_STREAMS; i++) {
+        streams[i].session = session;
+        streams[i].id = (uint32_t)(i + 1);
+        streams[i].state = YAMUX_STREAM_CLOSED;
+        result = yamux_add_stream(session, &streams[i]);
+        assert_true(result == YAMUX_OK, "Failed to add stream");
+    }
+    assert_true(session->streams.count == TABLE_TEST_STREAMS, "Stream count mismatch after add");
+    
+    /* Duplicate IDs are rejected */
+    result = yamux_add_stream(session, &streams[0]);
+    assert_true(result == YAMUX_ERR_INVALID, "Duplicate stream ID should be rejected");
+    
+    /* Every stream is found */
+    for (i = 0; i < TABLE_TEST_STREAMS; i++) {
+        assert_true(yamux_get_stream(session, (uint32_t)(i + 1)) == &streams[i], "Lookup returned wrong stream");
+    }
+    assert_true(yamux_get_stream(session, TABLE_TEST_STREAMS + 1) == NULL, "Lookup of unknown ID should fail");
+    
+    /* Remove every third stream and check no other entry got lost */
+    for (i = 0; i < TABLE_TEST_STREAMS; i += 3) {
+        result = yamux_remove_stream(session, (uint32_t)(i + 1));
+        assert_true(result == YAMUX_OK, "Failed to remove stream");
+    }
+    result = yamux_remove_stream(session, 1);
+    assert_true(result == YAMUX_ERR_INVALID, "Removing a missing stream should fail");
+    
+    for (i = 0; i < TABLE_TEST_STREAMS; i++) {
+        yamux_stream_t *found = yamux_get_stream(session, (uint32_t)(i + 1));
+        if (i % 3 == 0) {
+            assert_true(found == NULL, "Removed stream is still present");
+        } else {
+            assert_true(found == &streams[i], "Surviving stream lost after removals");
+        }
+    }
+    
+    /* Re-adding the removed IDs reuses buckets */
+    for (i = 0; i < TABLE_TEST_STREAMS; i += 3) {
+        result = yamux_add_stream(session, &streams[i]);
+        assert_true(result == YAMUX_OK, "Failed to re-add stream");
+    }
+    assert_true(session->streams.count == TABLE_TEST_STREAMS, "Stream count mismatch after re-add");
+    
+    /* Empty the table before closing so the session does not free test memory */
+    for (i = 0; i < TABLE_TEST_STREAMS; i++) {
+        result = yamux_remove_stream(session, (uint32_t)(i + 1));
+        assert_true(result == YAMUX_OK, "Failed to remove stream during cleanup");
+    }
+    assert_true(session->streams.count == 0, "Stream table should be empty");
+    
+    /* A FIN exchange takes the stream out, whether the peer's FIN comes as DATA or as FIN-ACK */
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    for (i = 0; i < 2; i++) {
+        result = yamux_stream_open_detailed(session, 0, &closing);
+        assert_true(result == YAMUX_OK, "Failed to open stream");
+        closing->state = YAMUX_STREAM_ESTABLISHED;
+        result = yamux_stream_close(closing, 0);
+        assert_true(result == YAMUX_OK && closing->state == YAMUX_STREAM_FIN_SENT, "FIN not sent");
+        
+        header.stream_id = closing->id;
+        if (i == 0) {
+            header.type = YAMUX_DATA;
+            header.flags = YAMUX_FLAG_FIN;
+            result = yamux_handle_data(session, &header, NULL);
+        } else {
+            header.type = YAMUX_WINDOW_UPDATE;
+            header.flags = YAMUX_FLAG_FIN | YAMUX_FLAG_ACK;
+            result = yamux_handle_window_update(session, &header, NULL);
+        }
+        assert_true(result == YAMUX_OK && closing->state == YAMUX_STREAM_CLOSED, "Peer's FIN not applied");
+        assert_true(yamux_get_stream(session, closing->id) == NULL && session->streams.count == 0,
+                    "Stream closed by a FIN exchange left in the table");
+        result = yamux_stream_free(closing);
+        assert_true(result == YAMUX_OK && session->stream_pool.in_use == 0, "Closed stream not freed");
+    }
+    
+    result = yamux_session_close(session, YAMUX_NORMAL);
+    assert_true(result == YAMUX_OK, "Failed to close session");
+    
+    free(streams);
+    pipe_io_context_free(io_ctx);
+    
+    printf("Stream table tests passed!\n");
+}
@@ -0,0 +1,291 @@
+/**
+ * @file test_stream_writev.c
+ * @brief Test for scatter-gather stream writes
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define SWV_MAX_CALLS 64
+
+/* Transport recording the segments of every writev call */
+typedef struct {
+    mock_io_t *mock;
+    int write_calls;
+    int writev_calls;
+    int iovcnt[SWV_MAX_CALLS];
+    const uint8_t *last_base[SWV_MAX_CALLS];   /* Base of the last segment */
+} swv_io_t;
+
+static int swv_read(void *ctx, uint8_t *buf, size_t len) {
+    return mock_read(((swv_io_t *)ctx)->mock, buf, len);
+}
+
+static int swv_write(void *ctx, const uint8_t *buf, size_t len) {
+    swv_io_t *sio = (swv_io_t *)ctx;
+
+    sio->write_calls++;
+    return mock_write(sio->mock, buf, len);
+}
+
+static int swv_writev(void *ctx, const yamux_iovec_t *iov, int iovcnt) {
+    swv_io_t *sio = (swv_io_t *)ctx;
+    int total = 0;
+    int i;
+
+    if (sio->writev_calls < SWV_MAX_CALLS) {
+        sio->iovcnt[sio->writev_calls] = iovcnt;
+        sio->last_base[sio->writev_calls] = iov[iovcnt - 1].base;
+    }
+    sio->writev_calls++;
+    for (i = 0; i < iovcnt; i++) {
+        total += mock_write(sio->mock, iov[i].base, iov[i].len);
+    }
+    return total;
+}
+
+/* Open a client stream over sio, then forget the SYN written */
+static yamux_stream_t *swv_open(swv_io_t *sio, int use_writev, yamux_session_t **session) {
+    yamux_stream_t *stream;
+    yamux_io_t io;
+
+    memset(sio, 0, sizeof(*sio));
+    sio->mock = mock_io_init(1024);
+    memset(&io, 0, sizeof(io));
+    io.read = swv_read;
+    io.write = swv_write;
+    io.writev = use_writev ? swv_writev : NULL;
+    io.ctx = sio;
+
+    assert_true(yamux_session_create(&io, 1, NULL, session) == YAMUX_OK, "Failed to create session");
+    assert_true(yamux_stream_open_detailed(*session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    sio->mock->write_buf_used = 0;
+    sio->write_calls = 0;
+    sio->writev_calls = 0;
+    return stream;
+}
+
+static void swv_close(yamux_session_t *session, swv_io_t *sio) {
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(sio->mock);
+}
+
+/* Check the DATA frames written carry expected, each at most max_frame long */
+static int swv_frames(mock_io_t *mock, const uint8_t *expected, size_t len, size_t max_frame) {
+    yamux_header_t header;
+    size_t pos = 0;
+    size_t data = 0;
+    int frames = 0;
+
+    while (pos < mock->write_buf_used) {
+        assert_true(yamux_decode_header(mock->write_buf + pos, YAMUX_HEADER_SIZE, &header) == YAMUX_OK &&
+                    header.type == YAMUX_DATA && header.length <= max_frame, "Bad DATA frame");
+        pos += YAMUX_HEADER_SIZE;
+        assert_true(data + header.length <= len &&
+                    memcmp(mock->write_buf + pos, expected + data, header.length) == 0, "Payload corrupted");
+        pos += header.length;
+        data += header.length;
+        frames++;
+    }
+    assert_true(data == len, "Payload length wrong");
+    return frames;
+}
+
+/* A header, body and trailer leave as one frame in one uncopied writev */
+static void test_writev_one_frame(void) {
+    static const uint8_t head[] = "GET /";
+    static const uint8_t body[] = "index.html";
+    static const uint8_t tail[] = " HTTP/1.1\r\n";
+    uint8_t expected[sizeof(head) + sizeof(body) + sizeof(tail)];
+    yamux_iovec_t iov[3];
+    yamux_session_t *session;
+    swv_io_t sio;
+    yamux_stream_t *stream = swv_open(&sio, 1, &session);
+    yamux_stream_stats_t stats;
+    size_t written;
+
+    iov[0].base = head;
+    iov[0].len = sizeof(head);
+    iov[1].base = body;
+    iov[1].len = sizeof(body);
+    iov[2].base = tail;
+    iov[2].len = sizeof(tail);
+    memcpy(expected, head, sizeof(head));
+    memcpy(expected + sizeof(head), body, sizeof(body));
+    memcpy(expected + sizeof(head) + sizeof(body), tail, sizeof(tail));
+
+    assert_true(yamux_stream_writev(stream, iov, 3, &written) == YAMUX_OK && written == sizeof(expected),
+                "Gather write failed");
+    assert_true(sio.writev_calls == 1 && sio.write_calls == 0 && sio.iovcnt[0] == 4 && sio.last_base[0] == tail,
+                "Segments not passed through as they are");
+    assert_true(swv_frames(sio.mock, expected, sizeof(expected), sizeof(expected)) == 1, "Not one frame");
+    assert_true(stream->send_window == YAMUX_DEFAULT_WINDOW_SIZE - sizeof(expected) &&
+                yamux_stream_get_stats(stream, &stats) == YAMUX_OK &&
+                (!YAMUX_STATS || stats.bytes_out == sizeof(expected)), "Window or stats not charged");
+
+    swv_close(session, &sio);
+}
+
+/* Frames are filled to the frame size across segment boundaries */
+static void test_writev_frame_packing(void) {
+    static uint8_t data[3 * YAMUX_MAX_DATA_FRAME_SIZE];
+    yamux_iovec_t iov[5];
+    yamux_session_t *session;
+    swv_io_t sio;
+    yamux_stream_t *stream = swv_open(&sio, 1, &session);
+    size_t sizes[5] = {1000, YAMUX_MAX_DATA_FRAME_SIZE, 0, 7000, 3 * YAMUX_MAX_DATA_FRAME_SIZE - 1000 -
+                       YAMUX_MAX_DATA_FRAME_SIZE - 7000};
+    size_t pos = 0;
+    size_t written;
+    int i;
+
+    for (i = 0; i < (int)sizeof(data); i++) {
+        data[i] = (uint8_t)(i * 7);
+    }
+    for (i = 0; i < 5; i++) {
+        iov[i].base = data + pos;
+        iov[i].len = sizes[i];
+        pos += sizes[i];
+    }
+
+    assert_true(yamux_stream_writev(stream, iov, 5, &written) == YAMUX_OK && written == sizeof(data),
+                "Packed write failed");
+    assert_true(swv_frames(sio.mock, data, sizeof(data), YAMUX_MAX_DATA_FRAME_SIZE) == 3 && sio.writev_calls == 3,
+                "Frames not filled");
+
+    swv_close(session, &sio);
+}
+
+/* Many small segments take one frame per YAMUX_MAX_FRAME_SEGMENTS */
+static void test_writev_segment_limit(void) {
+    uint8_t data[3 * YAMUX_MAX_FRAME_SEGMENTS];
+    yamux_iovec_t iov[3 * YAMUX_MAX_FRAME_SEGMENTS];
+    yamux_session_t *session;
+    swv_io_t sio;
+    yamux_stream_t *stream = swv_open(&sio, 1, &session);
+    size_t written;
+    int i;
+
+    for (i = 0; i < 3 * YAMUX_MAX_FRAME_SEGMENTS; i++) {
+        data[i] = (uint8_t)i;
+        iov[i].base = data + i;
+        iov[i].len = 1;
+    }
+    assert_true(yamux_stream_writev(stream, iov, 3 * YAMUX_MAX_FRAME_SEGMENTS, &written) == YAMUX_OK &&
+                written == sizeof(data), "Segmented write failed");
+    assert_true(swv_frames(sio.mock, data, sizeof(data), YAMUX_MAX_FRAME_SEGMENTS) == 3 &&
+                sio.iovcnt[0] == 1 + YAMUX_MAX_FRAME_SEGMENTS, "Segments per frame wrong");
+
+    swv_close(session, &sio);
+}
+
+/* The window bounds the write; stalled, nothing is written */
+static void test_writev_window(void) {
+    static const uint8_t a[] = "0123456789";
+    static const uint8_t b[] = "abcdefghij";
+    yamux_iovec_t iov[2];
+    yamux_session_t *session;
+    swv_io_t sio;
+    yamux_stream_t *stream = swv_open(&sio, 1, &session);
+    yamux_stream_stats_t stats;
+    size_t written;
+
+    iov[0].base = a;
+    iov[0].len = 10;
+    iov[1].base = b;
+    iov[1].len = 10;
+    stream->send_window = 15;
+
+    assert_true(yamux_stream_writev(stream, iov, 2, &written) == YAMUX_OK && written == 15 &&
+                stream->send_window == 0, "Write not clamped to the window");
+    assert_true(sio.mock->write_buf_used == YAMUX_HEADER_SIZE + 15 &&
+                memcmp(sio.mock->write_buf + YAMUX_HEADER_SIZE + 10, b, 5) == 0, "Clamped frame wrong");
+    assert_true(yamux_stream_writev(stream, iov, 2, &written) == YAMUX_ERR_WOULD_BLOCK && written == 0 &&
+                yamux_stream_get_stats(stream, &stats) == YAMUX_OK && (!YAMUX_STATS || stats.would_block == 1),
+                "Write past the window accepted");
+
+    swv_close(session, &sio);
+}
+
+/* Queued (corked) or without io.writev the bytes on the wire are the same */
+static void test_writev_fallbacks(void) {
+    static uint8_t data[2 * YAMUX_MAX_CONTROL_PAYLOAD + 1000];
+    yamux_iovec_t iov[3];
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    swv_io_t sio;
+    size_t written;
+    int i;
+
+    for (i = 0; i < (int)sizeof(data); i++) {
+        data[i] = (uint8_t)(i ^ 0x55);
+    }
+    iov[0].base = data;
+    iov[0].len = YAMUX_MAX_CONTROL_PAYLOAD;
+    iov[1].base = data + YAMUX_MAX_CONTROL_PAYLOAD;
+    iov[1].len = YAMUX_MAX_CONTROL_PAYLOAD;
+    iov[2].base = data + 2 * YAMUX_MAX_CONTROL_PAYLOAD;
+    iov[2].len = 1000;
+
+    /* No io.writev: the header, then one write per segment */
+    stream = swv_open(&sio, 0, &session);
+    assert_true(yamux_stream_writev(stream, iov, 3, &written) == YAMUX_OK && written == sizeof(data),
+                "Write without writev failed");
+    assert_true(sio.write_calls == 4 && swv_frames(sio.mock, data, sizeof(data), sizeof(data)) == 1,
+                "Fallback writes wrong");
+    swv_close(session, &sio);
+
+    /* A small payload without io.writev is gathered behind the header */
+    stream = swv_open(&sio, 0, &session);
+    assert_true(yamux_stream_writev(stream, iov, 1, &written) == YAMUX_OK && sio.write_calls == 1,
+                "Small payload not sent in one write");
+    swv_close(session, &sio);
+
+    /* Corked: the segments are copied into the egress queue */
+    stream = swv_open(&sio, 1, &session);
+    assert_true(yamux_session_cork(session) == YAMUX_OK, "Cork failed");
+    assert_true(yamux_stream_writev(stream, iov, 3, &written) == YAMUX_OK && written == sizeof(data) &&
+                sio.mock->write_buf_used == 0, "Corked write not queued");
+    assert_true(yamux_session_uncork(session) == YAMUX_OK && sio.writev_calls == 0 &&
+                swv_frames(sio.mock, data, sizeof(data), sizeof(data)) == 1, "Queued frame wrong");
+    swv_close(session, &sio);
+}
+
+/* Bad arguments and closed streams write nothing */
+static void test_writev_errors(void) {
+    static const uint8_t a[] = "x";
+    yamux_iovec_t iov[2];
+    yamux_session_t *session;
+    swv_io_t sio;
+    yamux_stream_t *stream = swv_open(&sio, 1, &session);
+    size_t written = 1;
+
+    iov[0].base = a;
+    iov[0].len = 1;
+    iov[1].base = NULL;
+    iov[1].len = 1;
+    assert_true(yamux_stream_writev(stream, iov, 2, &written) == YAMUX_ERR_INVALID && written == 0,
+                "NULL segment accepted");
+    assert_true(yamux_stream_writev(stream, NULL, 1, &written) == YAMUX_ERR_INVALID &&
+                yamux_stream_writev(stream, iov, -1, &written) == YAMUX_ERR_INVALID &&
+                yamux_stream_writev(NULL, iov, 1, &written) == YAMUX_ERR_INVALID &&
+                yamux_stream_writev(stream, iov, 1, NULL) == YAMUX_ERR_INVALID, "Bad arguments accepted");
+    assert_true(yamux_stream_writev(stream, iov, 0, &written) == YAMUX_OK && written == 0, "Empty write failed");
+    assert_true(sio.mock->write_buf_used == 0, "Failed writes sent data");
+
+    assert_true(yamux_stream_close(stream, 0) == YAMUX_OK, "Close failed");
+    assert_true(yamux_stream_writev(stream, iov, 1, &written) == YAMUX_ERR_CLOSED, "Wrote after FIN");
+
+    swv_close(session, &sio);
+}
+
+void test_stream_writev(void) {
+    printf("Testing scatter-gather stream writes...\n");
+
+    test_writev_one_frame();
+    test_writev_frame_packing();
+    test_writev_segment_limit();
+    test_writev_window();
+    test_writev_fallbacks();
+    test_writev_errors();
+}
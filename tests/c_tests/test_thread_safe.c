@@ -0,0 +1,249 @@
+/**
+ * @file test_thread_safe.c
+ * @brief Test for thread-safe sessions and yamux_stream_wait()
+ *
+ * Two sessions over a blocking socketpair each get an I/O thread looping
+ * yamux_session_process(). Several client threads write to their own
+ * streams at once, more than a window each, and server threads read them
+ * back, all parking in yamux_stream_wait() instead of polling.
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+#include "yamux_internal.h"
+
+#ifdef YAMUX_THREADS
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define THREAD_TEST_STREAMS 4
+#define THREAD_TEST_LEN (600 * 1024)
+#define THREAD_TEST_CHUNK (20 * 1024)
+
+typedef struct {
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    int failed;
+} thread_test_worker_t;
+
+static int sock_read(void *ctx, uint8_t *buf, size_t len) {
+    ssize_t n = recv(*(int *)ctx, buf, len, 0);
+
+    if (n < 0) {
+        return (errno == EINTR) ? 0 : YAMUX_ERR_IO;
+    }
+    return n == 0 ? YAMUX_ERR_IO : (int)n;
+}
+
+static int sock_write(void *ctx, const uint8_t *buf, size_t len) {
+    ssize_t n = send(*(int *)ctx, buf, len, MSG_NOSIGNAL);
+
+    if (n < 0) {
+        return (errno == EINTR) ? 0 : YAMUX_ERR_IO;
+    }
+    return (int)n;
+}
+
+/* Byte at offset of a stream's payload */
+static uint8_t pattern(uint32_t stream_id, size_t offset) {
+    return (uint8_t)(offset * 7 + stream_id);
+}
+
+/* Drive a session until its transport is shut down */
+static void *io_thread(void *arg) {
+    yamux_session_t *session = (yamux_session_t *)arg;
+    yamux_result_t result;
+
+    do {
+        result = yamux_session_process(session);
+    } while (result == YAMUX_OK || result == YAMUX_ERR_WOULD_BLOCK);
+    return NULL;
+}
+
+/* Open a stream and write THREAD_TEST_LEN bytes, a chunk at a time */
+static void *writer_thread(void *arg) {
+    thread_test_worker_t *worker = (thread_test_worker_t *)arg;
+    uint8_t chunk[THREAD_TEST_CHUNK];
+    size_t sent = 0;
+    size_t written;
+    size_t len;
+    size_t i;
+    uint32_t id;
+
+    if (yamux_stream_open_detailed(worker->session, 0, &worker->stream) != YAMUX_OK) {
+        worker->failed = 1;
+        return NULL;
+    }
+    id = yamux_stream_get_id(worker->stream);
+
+    while (sent < THREAD_TEST_LEN) {
+        len = THREAD_TEST_LEN - sent;
+        if (len > sizeof(chunk)) {
+            len = sizeof(chunk);
+        }
+        for (i = 0; i < len; i++) {
+            chunk[i] = pattern(id, sent + i);
+        }
+        if (yamux_stream_write_timeout(worker->stream, chunk, len, 10000, &written) != YAMUX_OK ||
+            written != len) {
+            worker->failed = 1;
+            return NULL;
+        }
+        sent += written;
+    }
+    return NULL;
+}
+
+/* Read THREAD_TEST_LEN bytes from an accepted stream and check them */
+static void *reader_thread(void *arg) {
+    thread_test_worker_t *worker = (thread_test_worker_t *)arg;
+    uint8_t chunk[THREAD_TEST_CHUNK];
+    size_t received = 0;
+    size_t bytes_read;
+    size_t i;
+    uint32_t id = yamux_stream_get_id(worker->stream);
+
+    while (received < THREAD_TEST_LEN) {
+        if (yamux_stream_wait(worker->stream, YAMUX_WAIT_READABLE, 10000) != YAMUX_OK ||
+            yamux_stream_read(worker->stream, chunk, sizeof(chunk), &bytes_read) != YAMUX_OK) {
+            worker->failed = 1;
+            return NULL;
+        }
+        for (i = 0; i < bytes_read; i++) {
+            if (chunk[i] != pattern(id, received + i)) {
+                worker->failed = 1;
+                return NULL;
+            }
+        }
+        received += bytes_read;
+    }
+    return NULL;
+}
+
+static yamux_session_t *create_session(int *fd, int client) {
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session = NULL;
+
+    memset(&io, 0, sizeof(io));
+    io.read = sock_read;
+    io.write = sock_write;
+    io.ctx = fd;
+
+    memset(&config, 0, sizeof(config));
+    config.thread_safe = 1;
+    assert_true(yamux_session_create(&io, client, &config, &session) == YAMUX_OK,
+                "Failed to create thread-safe session");
+    assert_true(session->send_buf_size >= YAMUX_HEADER_SIZE + YAMUX_MAX_DATA_FRAME_SIZE,
+                "Egress queue too small for concurrent writers");
+    return session;
+}
+
+/* yamux_stream_wait() honours its timeout, and cannot wait on a bare non-blocking transport */
+static void test_wait_errors(void) {
+    mock_io_t mock;
+    yamux_io_t io;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    int fds[2];
+
+    memset(&mock, 0, sizeof(mock));
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = &mock;
+    assert_true(yamux_session_create(&io, 1, NULL, &session) == YAMUX_OK, "Failed to create session");
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    assert_true(yamux_stream_wait(stream, YAMUX_WAIT_READABLE, 10) == YAMUX_ERR_WOULD_BLOCK,
+                "Wait without io.poll on a non-blocking transport should not spin");
+    yamux_session_close(session, YAMUX_NORMAL);
+    free(mock.write_buf);
+
+    /* Nothing arrives, so a read wait times out */
+    assert_true(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair failed");
+    session = create_session(&fds[0], 1);
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    assert_true(yamux_stream_wait(stream, 0, 10) == YAMUX_ERR_INVALID, "Wait needs a condition");
+    assert_true(yamux_stream_wait(stream, YAMUX_WAIT_READABLE, 20) == YAMUX_ERR_TIMEOUT,
+                "Read wait should time out");
+    assert_true(yamux_stream_wait(stream, YAMUX_WAIT_READABLE | YAMUX_WAIT_WRITABLE, 20) == YAMUX_OK,
+                "Open stream with credit should be writable");
+    yamux_session_close(session, YAMUX_NORMAL);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+void test_thread_safe(void) {
+    thread_test_worker_t writers[THREAD_TEST_STREAMS];
+    thread_test_worker_t readers[THREAD_TEST_STREAMS];
+    pthread_t writer_tids[THREAD_TEST_STREAMS];
+    pthread_t reader_tids[THREAD_TEST_STREAMS];
+    pthread_t client_io;
+    pthread_t server_io;
+    yamux_session_t *client;
+    yamux_session_t *server;
+    yamux_stream_t *stream;
+    int fds[2];
+    int accepted = 0;
+    int tries;
+    int i;
+
+    test_wait_errors();
+
+    assert_true(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair failed");
+    client = create_session(&fds[0], 1);
+    server = create_session(&fds[1], 0);
+    assert_true(pthread_create(&client_io, NULL, io_thread, client) == 0, "Failed to start I/O thread");
+    assert_true(pthread_create(&server_io, NULL, io_thread, server) == 0, "Failed to start I/O thread");
+
+    memset(writers, 0, sizeof(writers));
+    memset(readers, 0, sizeof(readers));
+    for (i = 0; i < THREAD_TEST_STREAMS; i++) {
+        writers[i].session = client;
+        assert_true(pthread_create(&writer_tids[i], NULL, writer_thread, &writers[i]) == 0,
+                    "Failed to start writer");
+    }
+
+    /* Streams show up in the accept queue as the server's I/O thread sees them */
+    for (tries = 0; accepted < THREAD_TEST_STREAMS && tries < 10000; tries++) {
+        if (yamux_stream_accept(server, &stream) == YAMUX_OK) {
+            readers[accepted].session = server;
+            readers[accepted].stream = stream;
+            assert_true(pthread_create(&reader_tids[accepted], NULL, reader_thread,
+                                       &readers[accepted]) == 0, "Failed to start reader");
+            accepted++;
+        } else {
+            usleep(1000);
+        }
+    }
+    assert_true(accepted == THREAD_TEST_STREAMS, "Not every stream was accepted");
+
+    for (i = 0; i < THREAD_TEST_STREAMS; i++) {
+        pthread_join(writer_tids[i], NULL);
+        pthread_join(reader_tids[i], NULL);
+        assert_true(!writers[i].failed, "Writer failed");
+        assert_true(!readers[i].failed, "Reader failed or saw corrupted data");
+    }
+
+    /* The I/O threads stop once their transport fails */
+    shutdown(fds[0], SHUT_RDWR);
+    shutdown(fds[1], SHUT_RDWR);
+    pthread_join(client_io, NULL);
+    pthread_join(server_io, NULL);
+
+    yamux_session_close(client, YAMUX_NORMAL);
+    yamux_session_close(server, YAMUX_NORMAL);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+#else
+
+void test_thread_safe(void) {
+    printf("(skipped, built without YAMUX_THREADS) ");
+}
+
+#endif /* YAMUX_THREADS */
@@ -0,0 +1,128 @@
+/**
+ * @file test_timed_io.c
+ * @brief Test for timed stream reads and writes on a single-threaded session
+ *
+ * The mock transport's poll callback delivers one queued frame per call and
+ * otherwise reports a timeout, so every wait is visible to the test.
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define TIMED_TEST_DATA_LEN 100
+
+/* Frame the next poll delivers, and what the polls were asked for */
+static uint8_t poll_frame[YAMUX_HEADER_SIZE + TIMED_TEST_DATA_LEN];
+static size_t poll_frame_len;
+static int poll_calls;
+static int poll_events;
+
+/* Encode a frame for the next poll to deliver */
+static void queue_frame(uint8_t type, uint16_t flags, uint32_t stream_id,
+                        const uint8_t *payload, uint32_t length) {
+    yamux_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = type;
+    header.flags = flags;
+    header.stream_id = stream_id;
+    header.length = length;
+
+    yamux_encode_header(&header, poll_frame);
+    if (length > 0) {
+        memcpy(poll_frame + YAMUX_HEADER_SIZE, payload, length);
+    }
+    poll_frame_len = YAMUX_HEADER_SIZE + length;
+}
+
+static int mock_poll(void *ctx, int events, uint32_t timeout_ms) {
+    mock_io_t *mock = (mock_io_t *)ctx;
+
+    (void)timeout_ms;
+    poll_calls++;
+    poll_events = events;
+    if (poll_frame_len == 0) {
+        return 0;
+    }
+
+    memcpy(mock->read_buf, poll_frame, poll_frame_len);
+    mock->read_buf_used = poll_frame_len;
+    mock->read_pos = 0;
+    poll_frame_len = 0;
+    return 1;
+}
+
+/* Test that timed calls park in io.poll until frames arrive, or time out */
+void test_timed_io(void) {
+    uint8_t window[4] = {0x00, 0x04, 0x00, 0x00};
+    uint8_t credit[4] = {0x00, 0x00, 0x10, 0x00};
+    uint8_t data[TIMED_TEST_DATA_LEN];
+    uint8_t *big;
+    mock_io_t *mock;
+    yamux_io_t io;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    size_t done;
+
+    printf("Testing timed stream reads and writes...\n");
+
+    mock = mock_io_init(4096);
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.poll = mock_poll;
+    io.ctx = mock;
+    assert_true(yamux_session_create(&io, 1, NULL, &session) == YAMUX_OK, "Failed to create session");
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+
+    /* The SYN-ACK arrives while waiting for data, which times out after it */
+    queue_frame(YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN | YAMUX_FLAG_ACK, stream->id, window, sizeof(window));
+    poll_calls = 0;
+    assert_true(yamux_stream_read_timeout(stream, data, sizeof(data), 50, &done) == YAMUX_ERR_TIMEOUT,
+                "Read should time out");
+    assert_true(stream->state == YAMUX_STREAM_ESTABLISHED, "SYN-ACK not processed while waiting");
+    assert_true(poll_calls == 2 && poll_events == YAMUX_WAIT_READABLE, "Read did not wait in io.poll");
+
+    /* Data wakes a read */
+    memset(data, 0x5a, sizeof(data));
+    queue_frame(YAMUX_DATA, 0, stream->id, data, sizeof(data));
+    memset(data, 0, sizeof(data));
+    assert_true(yamux_stream_read_timeout(stream, data, sizeof(data), 50, &done) == YAMUX_OK &&
+                done == sizeof(data) && data[0] == 0x5a, "Read did not return the data");
+
+    /* Use up the send window; a timed write then waits for credit */
+    big = (uint8_t *)calloc(1, YAMUX_DEFAULT_WINDOW_SIZE);
+    assert_true(yamux_stream_write_timeout(stream, big, YAMUX_DEFAULT_WINDOW_SIZE, 50, &done) == YAMUX_OK &&
+                done == YAMUX_DEFAULT_WINDOW_SIZE, "Write within the window failed");
+    assert_true(stream->send_window == 0, "Window not used up");
+
+    poll_calls = 0;
+    assert_true(yamux_stream_write_timeout(stream, big, 8192, 50, &done) == YAMUX_ERR_TIMEOUT && done == 0,
+                "Write without credit should time out");
+    assert_true(poll_calls == 1, "Write did not wait in io.poll");
+
+    /* 4096 bytes of credit let half of it go, then the wait times out again */
+    queue_frame(YAMUX_WINDOW_UPDATE, 0, stream->id, credit, sizeof(credit));
+    assert_true(yamux_stream_write_timeout(stream, big, 8192, 50, &done) == YAMUX_ERR_TIMEOUT && done == 4096,
+                "Write should stop where the credit ran out");
+    queue_frame(YAMUX_WINDOW_UPDATE, 0, stream->id, credit, sizeof(credit));
+    assert_true(yamux_stream_write_timeout(stream, big + 4096, 4096, 50, &done) == YAMUX_OK && done == 4096,
+                "Write did not resume on WINDOW_UPDATE");
+    free(big);
+
+    /* FIN ends the stream: a timed read returns 0 bytes */
+    queue_frame(YAMUX_DATA, YAMUX_FLAG_FIN, stream->id, NULL, 0);
+    assert_true(yamux_stream_read_timeout(stream, data, sizeof(data), 50, &done) == YAMUX_OK && done == 0,
+                "Read should report the end of the stream");
+
+    /* Without io.poll a non-blocking transport is not spun on */
+    session->io.poll = NULL;
+    assert_true(yamux_stream_wait(stream, YAMUX_WAIT_WRITABLE, 50) == YAMUX_ERR_CLOSED,
+                "Finished stream should not be writable");
+    assert_true(yamux_stream_read_timeout(stream, data, sizeof(data), 0, &done) == YAMUX_OK && done == 0,
+                "End of stream should not wait");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
@@ -0,0 +1,379 @@
+/**
+ * @file test_timers.c
+ * @brief Test for keepalives and timeouts run from the timer wheel
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+/* Transport that refuses everything while blocked */
+static int timers_blocked;
+
+static int timers_write(void *ctx, const uint8_t *buf, size_t len) {
+    if (timers_blocked) {
+        return YAMUX_ERR_WOULD_BLOCK;
+    }
+    return mock_write(ctx, buf, len);
+}
+
+/* Callback counters */
+static int timers_failed;
+static yamux_result_t timers_failure;
+static int timers_closed;
+
+static void timers_on_failed(yamux_session_t *session, yamux_result_t error, void *user_data) {
+    (void)session;
+    (void)user_data;
+    timers_failed++;
+    timers_failure = error;
+}
+
+static void timers_on_closed(yamux_stream_t *stream, void *user_data) {
+    (void)stream;
+    (void)user_data;
+    timers_closed++;
+}
+
+static yamux_session_t *create_session(mock_io_t *mock, const yamux_config_t *config) {
+    yamux_callbacks_t callbacks;
+    yamux_io_t io;
+    yamux_session_t *session;
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = timers_write;
+    io.ctx = mock;
+
+    assert_true(yamux_session_create(&io, 1, config, &session) == YAMUX_OK, "Failed to create session");
+
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.on_session_failed = timers_on_failed;
+    callbacks.on_stream_closed = timers_on_closed;
+    assert_true(yamux_session_set_callbacks(session, &callbacks) == YAMUX_OK, "Failed to set callbacks");
+
+    timers_blocked = 0;
+    timers_failed = 0;
+    timers_failure = YAMUX_OK;
+    timers_closed = 0;
+    return session;
+}
+
+/* Keepalive every second, answered within half a second */
+static yamux_config_t keepalive_config(void) {
+    yamux_config_t config = yamux_default_config;
+
+    config.keepalive_interval = 1000;
+    config.connection_write_timeout = 500;
+    return config;
+}
+
+/* Count the frames of a type (and with a flag, if any) written so far */
+static int count_frames(mock_io_t *mock, uint8_t type, uint16_t flag) {
+    yamux_header_t header;
+    size_t pos = 0;
+    int count = 0;
+
+    while (pos + YAMUX_HEADER_SIZE <= mock->write_buf_used &&
+           yamux_decode_header(mock->write_buf + pos, YAMUX_HEADER_SIZE, &header) == YAMUX_OK) {
+        if (header.type == type && (!flag || (header.flags & flag))) {
+            count++;
+        }
+        pos += YAMUX_HEADER_SIZE + YAMUX_FRAME_PAYLOAD_LEN(&header);
+    }
+    return count;
+}
+
+/* Answer the last ping written, as the peer would, echoing its ID */
+static void ack_last_ping(yamux_session_t *session, mock_io_t *mock) {
+    yamux_header_t header;
+
+    assert_true(yamux_decode_header(mock->write_buf + mock->write_buf_used - YAMUX_HEADER_SIZE,
+                                    YAMUX_HEADER_SIZE, &header) == YAMUX_OK && header.type == YAMUX_PING,
+                "Last frame is not a ping");
+    header.flags = YAMUX_FLAG_ACK;
+    yamux_encode_header(&header, mock->read_buf);
+    mock->read_buf_used = YAMUX_HEADER_SIZE;
+    mock->read_pos = 0;
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process ping ACK");
+}
+
+/* Answered keepalives keep the session up; an unanswered one fails it */
+static void test_timers_keepalive(void) {
+    yamux_config_t config = keepalive_config();
+    mock_io_t *mock = mock_io_init(1024);
+    yamux_session_t *session = create_session(mock, &config);
+    yamux_stream_t *stream;
+    uint64_t now;
+
+    assert_true(yamux_session_tick(NULL, 0) == YAMUX_ERR_INVALID, "NULL accepted");
+    assert_true(yamux_session_tick(session, 10000) == YAMUX_OK && count_frames(mock, YAMUX_PING, 0) == 0,
+                "Ping before the interval");
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+
+    for (now = 10000; now <= 13000; now += 100) {
+        assert_true(yamux_session_tick(session, now) == YAMUX_OK, "Answered session failed");
+        if (now % 1000 == 0 && now > 10000) {
+            assert_true(count_frames(mock, YAMUX_PING, YAMUX_FLAG_SYN) == (int)(now - 10000) / 1000,
+                        "Keepalive not sent each interval");
+            ack_last_ping(session, mock);
+        }
+    }
+
+    /* The fourth ping goes unanswered */
+    assert_true(yamux_session_tick(session, 14000) == YAMUX_OK && count_frames(mock, YAMUX_PING, 0) == 4,
+                "Fourth keepalive missing");
+    assert_true(yamux_session_tick(session, 14400) == YAMUX_OK && timers_failed == 0, "Failed early");
+    assert_true(yamux_session_tick(session, 14500) == YAMUX_ERR_TIMEOUT, "Dead peer not detected");
+    assert_true(timers_failed == 1 && timers_failure == YAMUX_ERR_TIMEOUT && timers_closed == 1,
+                "Failure not reported");
+    assert_true(yamux_get_stream(session, stream->id) == stream && stream->state == YAMUX_STREAM_CLOSED,
+                "Stream not closed by the failure");
+    assert_true(yamux_session_process(session) == YAMUX_ERR_TIMEOUT, "Failed session still processed");
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_ERR_CLOSED,
+                "Failed session opened a stream");
+    assert_true(yamux_session_tick(session, 20000) == YAMUX_ERR_TIMEOUT && timers_failed == 1,
+                "Failure reported twice");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* Frames the transport stops taking fail the session */
+static void test_timers_write_timeout(void) {
+    static uint8_t data[100];
+    yamux_config_t config = yamux_default_config;
+    mock_io_t *mock = mock_io_init(1024);
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    size_t written;
+
+    config.enable_keepalive = 0;
+    config.connection_write_timeout = 500;
+    session = create_session(mock, &config);
+
+    assert_true(yamux_session_tick(session, 0) == YAMUX_OK, "Tick failed");
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    assert_true(yamux_stream_write(stream, data, sizeof(data), &written) == YAMUX_OK, "Write failed");
+
+    /* Blocked, but draining before the timeout */
+    timers_blocked = 1;
+    assert_true(yamux_stream_write(stream, data, sizeof(data), &written) == YAMUX_OK &&
+                session->send_buf_used > 0, "Nothing queued");
+    assert_true(yamux_session_tick(session, 400) == YAMUX_OK, "Tick failed");
+    timers_blocked = 0;
+    assert_true(yamux_session_flush(session) == YAMUX_OK && session->send_buf_used == 0, "Flush failed");
+    assert_true(yamux_session_tick(session, 2000) == YAMUX_OK, "Drained queue timed out");
+
+    /* Blocked for good */
+    timers_blocked = 1;
+    assert_true(yamux_stream_write(stream, data, sizeof(data), &written) == YAMUX_OK, "Write failed");
+    assert_true(yamux_session_flush(session) == YAMUX_ERR_WOULD_BLOCK, "Transport should block");
+    assert_true(yamux_session_tick(session, 2400) == YAMUX_OK, "Failed early");
+    assert_true(yamux_session_tick(session, 3500) == YAMUX_ERR_TIMEOUT && timers_failed == 1,
+                "Stuck transport not detected");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* Unanswered SYN and FIN reset the stream */
+static void test_timers_streams(void) {
+    yamux_config_t config = yamux_default_config;
+    mock_io_t *mock = mock_io_init(1024);
+    yamux_session_t *session;
+    yamux_stream_t *syn;
+    yamux_stream_t *fin;
+
+    config.enable_keepalive = 0;
+    config.stream_open_timeout = 1000;
+    config.stream_close_timeout = 2000;
+    session = create_session(mock, &config);
+
+    assert_true(yamux_session_tick(session, 0) == YAMUX_OK, "Tick failed");
+    assert_true(yamux_stream_open_detailed(session, 0, &syn) == YAMUX_OK &&
+                yamux_stream_open_detailed(session, 0, &fin) == YAMUX_OK, "Failed to open streams");
+    fin->state = YAMUX_STREAM_ESTABLISHED;
+    assert_true(yamux_stream_close(fin, 0) == YAMUX_OK && fin->state == YAMUX_STREAM_FIN_SENT, "FIN not sent");
+
+    assert_true(yamux_session_tick(session, 990) == YAMUX_OK && syn->state == YAMUX_STREAM_SYN_SENT,
+                "SYN timed out early");
+    assert_true(yamux_session_tick(session, 1000) == YAMUX_OK && syn->state == YAMUX_STREAM_CLOSED,
+                "SYN did not time out");
+    assert_true(yamux_get_stream(session, syn->id) == NULL && timers_closed == 1 &&
+                count_frames(mock, YAMUX_DATA, YAMUX_FLAG_RST) == 1, "Timed-out stream not reset");
+
+    assert_true(yamux_session_tick(session, 1990) == YAMUX_OK && fin->state == YAMUX_STREAM_FIN_SENT,
+                "FIN timed out early");
+    assert_true(yamux_session_tick(session, 2000) == YAMUX_OK && fin->state == YAMUX_STREAM_CLOSED &&
+                count_frames(mock, YAMUX_DATA, YAMUX_FLAG_RST) == 2, "FIN did not time out");
+    assert_true(timers_failed == 0, "Stream timeouts failed the session");
+
+    /* Timed-out streams stay the application's until freed */
+    assert_true(yamux_stream_free(syn) == YAMUX_OK && yamux_stream_free(fin) == YAMUX_OK &&
+                session->stream_pool.in_use == 0, "Timed-out streams not freed");
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* What the peer's closed callback saw */
+static int peer_closed;
+static yamux_stream_state_t peer_closed_state;
+
+static void peer_on_closed(yamux_stream_t *stream, void *user_data) {
+    (void)user_data;
+    peer_closed++;
+    peer_closed_state = stream->state;
+}
+
+/* The peer of a timed-out stream sees the reset: closed callback, stream removed */
+static void test_timers_peer_reset(void) {
+    yamux_config_t config = yamux_default_config;
+    mock_io_t *mock = mock_io_init(1024);
+    mock_io_t *peer_mock = mock_io_init(1024);
+    yamux_callbacks_t callbacks;
+    yamux_session_t *session;
+    yamux_session_t *peer;
+    yamux_stream_t *stream;
+    yamux_stream_t *accepted;
+    yamux_io_t io;
+
+    config.enable_keepalive = 0;
+    config.stream_open_timeout = 1000;
+    config.stream_close_timeout = 2000;
+    session = create_session(mock, &config);
+
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = peer_mock;
+    assert_true(yamux_session_create(&io, 0, NULL, &peer) == YAMUX_OK, "Failed to create peer");
+    memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.on_stream_closed = peer_on_closed;
+    assert_true(yamux_session_set_callbacks(peer, &callbacks) == YAMUX_OK, "Failed to set peer callbacks");
+    peer_closed = 0;
+
+    /* The peer accepts the stream, but its SYN-ACK is lost */
+    assert_true(yamux_session_tick(session, 0) == YAMUX_OK, "Tick failed");
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    mock_io_swap_buffers(mock, peer_mock);
+    assert_true(yamux_session_process(peer) == YAMUX_OK &&
+                yamux_stream_accept(peer, &accepted) == YAMUX_OK, "Peer did not accept the stream");
+    peer_mock->write_buf_used = 0;
+
+    assert_true(yamux_session_tick(session, 1000) == YAMUX_OK && stream->state == YAMUX_STREAM_CLOSED,
+                "SYN did not time out");
+    mock_io_swap_buffers(mock, peer_mock);
+    assert_true(yamux_session_process(peer) == YAMUX_OK, "Peer failed to process the reset");
+    assert_true(peer_closed == 1 && peer_closed_state == YAMUX_STREAM_CLOSED, "Peer not told of the SYN timeout");
+    assert_true(yamux_get_stream(peer, accepted->id) == NULL && peer->streams.count == 0,
+                "Peer kept the reset stream");
+    assert_true(yamux_stream_free(accepted) == YAMUX_OK && yamux_stream_free(stream) == YAMUX_OK &&
+                peer->stream_pool.in_use == 0, "Reset stream not freed");
+
+    /* A FIN the peer never answers: it sees the FIN, then the reset */
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    mock_io_swap_buffers(mock, peer_mock);
+    assert_true(yamux_session_process(peer) == YAMUX_OK &&
+                yamux_stream_accept(peer, &accepted) == YAMUX_OK, "Peer did not accept the stream");
+    mock_io_swap_buffers(peer_mock, mock);
+    assert_true(yamux_session_process(session) == YAMUX_OK && stream->state == YAMUX_STREAM_ESTABLISHED,
+                "SYN-ACK not received");
+    accepted->state = YAMUX_STREAM_ESTABLISHED; /* The peer leaves SYN_RECV on an explicit ACK */
+    assert_true(yamux_stream_close(stream, 0) == YAMUX_OK, "FIN not sent");
+    mock_io_swap_buffers(mock, peer_mock);
+    assert_true(yamux_session_process(peer) == YAMUX_OK && peer_closed == 2 &&
+                peer_closed_state == YAMUX_STREAM_FIN_RECV, "Peer did not see the FIN");
+
+    assert_true(yamux_session_tick(session, 3000) == YAMUX_OK && stream->state == YAMUX_STREAM_CLOSED,
+                "FIN did not time out");
+    mock_io_swap_buffers(mock, peer_mock);
+    assert_true(yamux_session_process(peer) == YAMUX_OK, "Peer failed to process the reset");
+    assert_true(peer_closed == 3 && peer_closed_state == YAMUX_STREAM_CLOSED, "Peer not told of the FIN timeout");
+    assert_true(yamux_get_stream(peer, accepted->id) == NULL && peer->streams.count == 0,
+                "Peer kept the reset stream");
+    assert_true(yamux_stream_free(accepted) == YAMUX_OK && yamux_stream_free(stream) == YAMUX_OK &&
+                peer->stream_pool.in_use == 0 && session->stream_pool.in_use == 0, "Reset streams not freed");
+
+    yamux_session_close(peer, YAMUX_NORMAL);
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(peer_mock);
+    mock_io_free(mock);
+}
+
+/* One wheel runs the timers of several sessions */
+static void test_timers_shared(void) {
+    yamux_config_t config = keepalive_config();
+    mock_io_t *mock_a = mock_io_init(1024);
+    mock_io_t *mock_b = mock_io_init(1024);
+    yamux_session_t *a = create_session(mock_a, &config);
+    yamux_session_t *b = create_session(mock_b, &config);
+    yamux_timer_wheel_t *wheel;
+
+    assert_true(yamux_timer_wheel_create(5000, &wheel) == YAMUX_OK, "Failed to create wheel");
+    assert_true(yamux_session_set_timer_wheel(a, wheel) == YAMUX_OK &&
+                yamux_session_set_timer_wheel(b, wheel) == YAMUX_OK, "Failed to attach sessions");
+
+    assert_true(yamux_timer_wheel_tick(wheel, 6000) == YAMUX_OK, "Tick failed");
+    assert_true(count_frames(mock_a, YAMUX_PING, 0) == 1 && count_frames(mock_b, YAMUX_PING, 0) == 1,
+                "Shared wheel did not ping both sessions");
+
+    /* Only a answers; b is found dead, a goes on */
+    ack_last_ping(a, mock_a);
+    assert_true(yamux_session_tick(a, 6500) == YAMUX_OK, "Answered session failed");
+    assert_true(yamux_session_tick(b, 6500) == YAMUX_ERR_TIMEOUT, "Silent session not failed");
+
+    /* Detached, a pings no more */
+    assert_true(yamux_session_set_timer_wheel(a, NULL) == YAMUX_OK, "Failed to detach");
+    assert_true(yamux_timer_wheel_tick(wheel, 9000) == YAMUX_OK && count_frames(mock_a, YAMUX_PING, 0) == 1,
+                "Detached session still pinged");
+
+    yamux_session_close(a, YAMUX_NORMAL);
+    yamux_session_close(b, YAMUX_NORMAL);
+    yamux_timer_wheel_destroy(wheel);
+    mock_io_free(mock_a);
+    mock_io_free(mock_b);
+}
+
+/* Long delays come back from the outer levels on time */
+static void test_timers_long(void) {
+    yamux_config_t config = yamux_default_config;
+    mock_io_t *mock = mock_io_init(1024);
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    uint64_t start = 123456789;
+    uint64_t now;
+
+    config.enable_keepalive = 0;
+    config.stream_open_timeout = 0;
+    config.stream_close_timeout = 3000000; /* Past a turn of the third level (2621 s) */
+    session = create_session(mock, &config);
+
+    assert_true(yamux_session_tick(session, start) == YAMUX_OK, "Tick failed");
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    stream->state = YAMUX_STREAM_ESTABLISHED;
+    assert_true(yamux_stream_close(stream, 0) == YAMUX_OK, "FIN not sent");
+
+    for (now = start; now < start + 3000000 - 10; now += 7770) {
+        assert_true(yamux_session_tick(session, now) == YAMUX_OK && stream->state == YAMUX_STREAM_FIN_SENT,
+                    "Long timeout fired early");
+    }
+    assert_true(yamux_session_tick(session, start + 3000000 - 10) == YAMUX_OK &&
+                stream->state == YAMUX_STREAM_FIN_SENT, "Long timeout fired early");
+    assert_true(yamux_session_tick(session, start + 3000000 + YAMUX_TIMER_TICK_MS) == YAMUX_OK &&
+                stream->state == YAMUX_STREAM_CLOSED, "Long timeout did not fire");
+
+    yamux_stream_free(stream);
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+void test_timers(void) {
+    printf("Testing keepalives and timeouts...\n");
+
+    test_timers_keepalive();
+    test_timers_write_timeout();
+    test_timers_streams();
+    test_timers_peer_reset();
+    test_timers_shared();
+    test_timers_long();
+}
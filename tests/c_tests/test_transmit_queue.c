@@ -0,0 +1,151 @@
+/**
+ * @file test_transmit_queue.c
+ * @brief Test for the session egress queue, cork and flush
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define TXQ_TEST_STREAMS 3
+#define TXQ_TEST_DATA_LEN 64
+
+/* Transport that counts writes and can be throttled */
+typedef struct {
+    mock_io_t *mock;
+    int write_calls;
+    size_t budget;         /* Bytes accepted before reporting would-block */
+    int throttled;
+} throttled_io_t;
+
+static int throttled_read(void *ctx, uint8_t *buf, size_t len) {
+    return mock_read(((throttled_io_t *)ctx)->mock, buf, len);
+}
+
+static int throttled_write(void *ctx, const uint8_t *buf, size_t len) {
+    throttled_io_t *tio = (throttled_io_t *)ctx;
+    
+    tio->write_calls++;
+    if (tio->throttled) {
+        if (tio->budget == 0) {
+            return 0;
+        }
+        if (len > tio->budget) {
+            len = tio->budget;
+        }
+        tio->budget -= len;
+    }
+    return mock_write(tio->mock, buf, len);
+}
+
+static yamux_session_t *create_session(throttled_io_t *tio) {
+    yamux_io_t io;
+    yamux_session_t *session;
+    
+    memset(tio, 0, sizeof(*tio));
+    tio->mock = mock_io_init(4096);
+    
+    memset(&io, 0, sizeof(io));
+    io.read = throttled_read;
+    io.write = throttled_write;
+    io.ctx = tio;
+    
+    assert_true(yamux_session_create(&io, 1, NULL, &session) == YAMUX_OK, "Failed to create session");
+    return session;
+}
+
+/* A full-size frame the transport takes only part of is queued whole */
+static void test_transmit_short_write(void) {
+    static uint8_t data[YAMUX_MAX_DATA_FRAME_SIZE];
+    throttled_io_t tio;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    size_t written = 0;
+    
+    session = create_session(&tio);
+    assert_true(session->send_buf_size >= YAMUX_HEADER_SIZE + YAMUX_MAX_DATA_FRAME_SIZE,
+                "Egress queue cannot hold a whole frame");
+    assert_true(yamux_stream_open_detailed(session, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    
+    tio.throttled = 1;
+    tio.budget = 100;
+    assert_true(yamux_stream_write(stream, data, sizeof(data), &written) == YAMUX_OK &&
+                written == sizeof(data), "Short write of a full frame failed");
+    
+    tio.throttled = 0;
+    assert_true(yamux_session_flush(session) == YAMUX_OK, "Failed to flush the rest of the frame");
+    assert_true(tio.mock->write_buf_used == (YAMUX_HEADER_SIZE + 4) + YAMUX_HEADER_SIZE + sizeof(data),
+                "Bytes of the torn frame lost");
+    
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(tio.mock);
+}
+
+/* Test that corked frames leave in one write and in order */
+void test_transmit_queue(void) {
+    throttled_io_t tio;
+    yamux_session_t *session;
+    yamux_stream_t *streams[TXQ_TEST_STREAMS];
+    yamux_header_t header;
+    uint8_t data[TXQ_TEST_DATA_LEN];
+    uint8_t reference[1024];
+    size_t reference_len;
+    size_t written;
+    size_t expected;
+    int i;
+    
+    printf("Testing transmit queue...\n");
+    
+    memset(data, 0x42, sizeof(data));
+    expected = TXQ_TEST_STREAMS * ((YAMUX_HEADER_SIZE + 4) + (YAMUX_HEADER_SIZE + TXQ_TEST_DATA_LEN));
+    
+    /* Corked: nothing reaches the transport until uncork */
+    session = create_session(&tio);
+    assert_true(yamux_session_cork(session) == YAMUX_OK, "Failed to cork");
+    for (i = 0; i < TXQ_TEST_STREAMS; i++) {
+        assert_true(yamux_stream_open_detailed(session, 0, &streams[i]) == YAMUX_OK, "Failed to open stream");
+        assert_true(yamux_stream_write(streams[i], data, sizeof(data), &written) == YAMUX_OK,
+                    "Failed to write while corked");
+    }
+    assert_true(tio.write_calls == 0, "Corked session wrote to the transport");
+    
+    assert_true(yamux_session_uncork(session) == YAMUX_OK, "Failed to uncork");
+    assert_true(tio.write_calls == 1, "Uncork should coalesce into one write");
+    assert_true(tio.mock->write_buf_used == expected, "Unexpected bytes after uncork");
+    
+    /* Keep the corked output to compare against the throttled run */
+    memcpy(reference, tio.mock->write_buf, expected);
+    reference_len = expected;
+    
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(tio.mock);
+    
+    /* Throttled transport: a partial flush keeps the remainder queued */
+    session = create_session(&tio);
+    yamux_session_cork(session);
+    for (i = 0; i < TXQ_TEST_STREAMS; i++) {
+        assert_true(yamux_stream_open_detailed(session, 0, &streams[i]) == YAMUX_OK, "Failed to open stream");
+        assert_true(yamux_stream_write(streams[i], data, sizeof(data), &written) == YAMUX_OK,
+                    "Failed to write while corked");
+    }
+    
+    tio.throttled = 1;
+    tio.budget = 50;
+    assert_true(yamux_session_uncork(session) == YAMUX_ERR_WOULD_BLOCK, "Throttled flush should would-block");
+    assert_true(tio.mock->write_buf_used == 50, "Transport should have taken its budget");
+    
+    /* Uncorked, but behind the backlog: the ping is queued, not reordered */
+    assert_true(yamux_session_ping(session) == YAMUX_OK, "Failed to queue ping");
+    assert_true(tio.mock->write_buf_used == 50, "Ping must not bypass the backlog");
+    
+    tio.throttled = 0;
+    assert_true(yamux_session_flush(session) == YAMUX_OK, "Failed to finish flush");
+    assert_true(tio.mock->write_buf_used == reference_len + YAMUX_HEADER_SIZE, "Bytes lost in flush");
+    assert_true(memcmp(tio.mock->write_buf, reference, reference_len) == 0, "Queued frames reordered");
+    assert_true(yamux_decode_header(tio.mock->write_buf + reference_len, YAMUX_HEADER_SIZE, &header) == YAMUX_OK &&
+                header.type == YAMUX_PING && header.length == session->last_ping_id, "Ping should come last");
+    
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(tio.mock);
+    
+    test_transmit_short_write();
+}
@@ -0,0 +1,238 @@
+/**
+ * @file test_window_update.c
+ * @brief Test for batched receive-window credit and auto-tuning
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define WU_TEST_WINDOW 1024
+#define WU_TEST_DATA_LEN 1000
+#define WU_TEST_READ_LEN 100
+
+/* Append an encoded frame to the mock's inbound data */
+static void append_frame(mock_io_t *mock, uint8_t type, uint16_t flags, uint32_t stream_id,
+                         const uint8_t *payload, uint32_t length) {
+    yamux_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = type;
+    header.flags = flags;
+    header.stream_id = stream_id;
+    header.length = length;
+    length = YAMUX_FRAME_PAYLOAD_LEN(&header);
+
+    yamux_encode_header(&header, mock->read_buf + mock->read_buf_used);
+    mock->read_buf_used += YAMUX_HEADER_SIZE;
+    if (length > 0) {
+        memcpy(mock->read_buf + mock->read_buf_used, payload, length);
+        mock->read_buf_used += length;
+    }
+}
+
+/* Sum the increments of the WINDOW_UPDATE frames written since *pos */
+static int collect_updates(mock_io_t *mock, size_t *pos, uint32_t *credit) {
+    yamux_header_t header;
+    const uint8_t *p;
+    int frames = 0;
+
+    while (*pos + YAMUX_HEADER_SIZE <= mock->write_buf_used) {
+        yamux_decode_header(mock->write_buf + *pos, mock->write_buf_used - *pos, &header);
+        p = mock->write_buf + *pos + YAMUX_HEADER_SIZE;
+        if (header.type == YAMUX_WINDOW_UPDATE && header.flags == 0 && header.length == 4) {
+            *credit += ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+            frames++;
+        }
+        *pos += YAMUX_HEADER_SIZE + YAMUX_FRAME_PAYLOAD_LEN(&header);
+    }
+    return frames;
+}
+
+/* Test that consumed bytes are credited back in batches */
+void test_window_update(void) {
+    uint8_t window[4] = {0x00, 0x04, 0x00, 0x00};
+    uint8_t data[WU_TEST_DATA_LEN];
+    uint8_t buf[WU_TEST_READ_LEN];
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    yamux_result_t result;
+    mock_io_t *mock;
+    size_t bytes_read;
+    size_t pos;
+    uint32_t credit = 0;
+    int frames = 0;
+    int i;
+
+    printf("Testing batched window updates...\n");
+
+    memset(data, 0x5A, sizeof(data));
+    mock = mock_io_init(4096);
+    memset(&io, 0, sizeof(io));
+    io.read = mock_read;
+    io.write = mock_write;
+    io.ctx = mock;
+
+    /* Credit is returned once half the window has been consumed */
+    memset(&config, 0, sizeof(config));
+    config.max_stream_window_size = WU_TEST_WINDOW;
+    config.window_update_percent = 50;
+    result = yamux_session_create(&io, 0, &config, &session);
+    assert_true(result == YAMUX_OK, "Failed to create session");
+
+    append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 1, window, sizeof(window));
+    append_frame(mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_ACK, 1, NULL, 0);
+    append_frame(mock, YAMUX_DATA, 0, 1, data, sizeof(data));
+    result = yamux_session_process(session);
+    assert_true(result == YAMUX_OK, "Failed to process frames");
+    stream = yamux_get_stream(session, 1);
+    assert_true(stream != NULL, "Stream was not created from SYN");
+    assert_true(stream->recv_window == WU_TEST_WINDOW - WU_TEST_DATA_LEN, "Window not charged");
+    pos = mock->write_buf_used;
+
+    /* Small reads stay quiet until the threshold */
+    for (i = 0; i < 5; i++) {
+        result = yamux_stream_read(stream, buf, sizeof(buf), &bytes_read);
+        assert_true(result == YAMUX_OK && bytes_read == sizeof(buf), "Read failed");
+    }
+    assert_true(collect_updates(mock, &pos, &credit) == 0, "Window update sent below threshold");
+    assert_true(stream->recv_consumed == 5 * WU_TEST_READ_LEN, "Consumed bytes not tracked");
+
+    /* Crossing it grants everything consumed in a single frame */
+    result = yamux_stream_read(stream, buf, sizeof(buf), &bytes_read);
+    assert_true(result == YAMUX_OK && bytes_read == sizeof(buf), "Read failed");
+    frames = collect_updates(mock, &pos, &credit);
+    assert_true(frames == 1 && credit == 6 * WU_TEST_READ_LEN, "Expected one batched update");
+    assert_true(stream->recv_consumed == 0, "Credit not cleared");
+    assert_true(stream->recv_window == WU_TEST_WINDOW - WU_TEST_DATA_LEN + 6 * WU_TEST_READ_LEN,
+                "Window not reopened by the credit");
+
+    /* Peek/consume follows the same rule */
+    result = yamux_stream_consume(stream, 4 * WU_TEST_READ_LEN);
+    assert_true(result == YAMUX_OK, "Consume failed");
+    assert_true(collect_updates(mock, &pos, &credit) == 0, "Consume sent an early update");
+    assert_true(stream->recv_consumed == 4 * WU_TEST_READ_LEN, "Consume not tracked");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(mock);
+}
+
+/* Transport with a settable clock */
+typedef struct {
+    mock_io_t *mock;
+    uint64_t now;
+} clock_io_t;
+
+static int clock_read(void *ctx, uint8_t *buf, size_t len) {
+    return mock_read(((clock_io_t *)ctx)->mock, buf, len);
+}
+
+static int clock_write(void *ctx, const uint8_t *buf, size_t len) {
+    return mock_write(((clock_io_t *)ctx)->mock, buf, len);
+}
+
+static uint64_t clock_now(void *ctx) {
+    return ((clock_io_t *)ctx)->now;
+}
+
+/* Deliver len bytes on stream 1 and read them all back, at the current time */
+static void transfer(yamux_session_t *session, clock_io_t *cio, yamux_stream_t *stream,
+                     uint8_t *data, size_t len) {
+    size_t bytes_read;
+    size_t total = 0;
+    int calls;
+
+    cio->mock->read_buf_used = 0;
+    cio->mock->read_pos = 0;
+    append_frame(cio->mock, YAMUX_DATA, 0, 1, data, (uint32_t)len);
+    for (calls = 0; calls < 256 && cio->mock->read_pos < cio->mock->read_buf_used; calls++) {
+        assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process DATA");
+    }
+    assert_true(stream->recvbuf.used == len, "DATA not buffered");
+
+    while (total < len) {
+        assert_true(yamux_stream_read(stream, data, len, &bytes_read) == YAMUX_OK, "Read failed");
+        assert_true(bytes_read > 0, "Read returned no data");
+        total += bytes_read;
+    }
+}
+
+/* Test that the receive window grows with a fast reader and can be trimmed */
+void test_window_autotune(void) {
+    static uint8_t data[2 * YAMUX_DEFAULT_WINDOW_SIZE];
+    uint8_t window[4] = {0x00, 0x04, 0x00, 0x00};
+    const uint32_t initial = YAMUX_DEFAULT_WINDOW_SIZE;
+    clock_io_t cio;
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    size_t pos;
+    uint32_t credit;
+    uint32_t ping_id;
+
+    printf("Testing receive window auto-tuning...\n");
+
+    memset(&cio, 0, sizeof(cio));
+    cio.mock = mock_io_init(sizeof(data) + 1024);
+    memset(&io, 0, sizeof(io));
+    io.read = clock_read;
+    io.write = clock_write;
+    io.now_ms = clock_now;
+    io.ctx = &cio;
+
+    memset(&config, 0, sizeof(config));
+    config.max_stream_window_size = 4 * initial;
+    assert_true(yamux_session_create(&io, 0, &config, &session) == YAMUX_OK, "Failed to create session");
+
+    append_frame(cio.mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 1, window, sizeof(window));
+    append_frame(cio.mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_ACK, 1, NULL, 0);
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to open stream");
+    stream = yamux_get_stream(session, 1);
+    assert_true(stream != NULL, "Stream was not created from SYN");
+    assert_true(stream->recv_window_size == initial && stream->recvbuf.size == initial,
+                "Tuned window should start at the protocol default");
+
+    /* A ping answered after 50 ms gives the round-trip estimate */
+    assert_true(yamux_session_ping_id(session, &ping_id) == YAMUX_OK, "Failed to ping");
+    cio.now = 50;
+    cio.mock->read_buf_used = 0;
+    cio.mock->read_pos = 0;
+    append_frame(cio.mock, YAMUX_PING, YAMUX_FLAG_ACK, 0, NULL, ping_id);
+    assert_true(yamux_session_process(session) == YAMUX_OK, "Failed to process ping ACK");
+    assert_true(session->rtt_ms == 50, "RTT not measured");
+
+    /* Half a window drained within two round trips: the window doubles */
+    cio.now = 60;
+    pos = cio.mock->write_buf_used;
+    credit = 0;
+    transfer(session, &cio, stream, data, initial / 2);
+    assert_true(collect_updates(cio.mock, &pos, &credit) == 1, "Expected one window update");
+    assert_true(credit == initial / 2 + initial, "Growth not granted with the update");
+    assert_true(stream->recv_window_size == 2 * initial && stream->recvbuf.size == 2 * initial,
+                "Window did not grow");
+    assert_true(stream->recv_window == 2 * initial, "Peer credit mismatch after growth");
+
+    /* A slow reader does not grow it further */
+    cio.now = 2000;
+    credit = 0;
+    transfer(session, &cio, stream, data, initial);
+    assert_true(collect_updates(cio.mock, &pos, &credit) == 1 && credit == initial,
+                "Slow reader should get plain credit");
+    assert_true(stream->recv_window_size == 2 * initial, "Window grew for a slow reader");
+
+    /* Trimming withholds credit until the peer's share fits the initial window */
+    assert_true(yamux_session_trim_windows(session) == YAMUX_OK, "Trim failed");
+    assert_true(stream->recv_window_size == initial, "Window size not trimmed");
+    cio.now = 4000;
+    credit = 0;
+    transfer(session, &cio, stream, data, initial);
+    assert_true(collect_updates(cio.mock, &pos, &credit) == 0, "Credit granted while shrinking");
+    assert_true(stream->recv_window == initial, "Peer credit not reduced");
+    assert_true(stream->recvbuf.size == initial, "Receive buffer not shrunk");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(cio.mock);
+}
@@ -0,0 +1,111 @@
+/**
+ * @file test_writev.c
+ * @brief Test for the optional vectored write callback
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define WRITEV_TEST_DATA_LEN 100
+
+/* Transport that counts calls and appends everything to a mock_io_t */
+typedef struct {
+    mock_io_t *mock;
+    int write_calls;
+    int writev_calls;
+} counting_io_t;
+
+static int counting_read(void *ctx, uint8_t *buf, size_t len) {
+    return mock_read(((counting_io_t *)ctx)->mock, buf, len);
+}
+
+static int counting_write(void *ctx, const uint8_t *buf, size_t len) {
+    counting_io_t *cio = (counting_io_t *)ctx;
+    
+    cio->write_calls++;
+    return mock_write(cio->mock, buf, len);
+}
+
+static int counting_writev(void *ctx, const yamux_iovec_t *iov, int iovcnt) {
+    counting_io_t *cio = (counting_io_t *)ctx;
+    int total = 0;
+    int i;
+    
+    cio->writev_calls++;
+    for (i = 0; i < iovcnt; i++) {
+        if (mock_write(cio->mock, iov[i].base, iov[i].len) != (int)iov[i].len) {
+            return -1;
+        }
+        total += (int)iov[i].len;
+    }
+    return total;
+}
+
+/* Open a stream and write one DATA frame, returning the session */
+static yamux_session_t *open_and_write(counting_io_t *cio, int use_writev) {
+    yamux_io_t io;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    yamux_result_t result;
+    uint8_t data[WRITEV_TEST_DATA_LEN];
+    size_t written;
+    
+    memset(&io, 0, sizeof(io));
+    io.read = counting_read;
+    io.write = counting_write;
+    io.ctx = cio;
+    if (use_writev) {
+        io.writev = counting_writev;
+    }
+    
+    result = yamux_session_create(&io, 1, NULL, &session);
+    assert_true(result == YAMUX_OK, "Failed to create session");
+    
+    result = yamux_stream_open_detailed(session, 0, &stream);
+    assert_true(result == YAMUX_OK, "Failed to open stream");
+    
+    memset(data, 0x5A, sizeof(data));
+    result = yamux_stream_write(stream, data, sizeof(data), &written);
+    assert_true(result == YAMUX_OK, "Failed to write stream data");
+    assert_true(written == sizeof(data), "Short stream write");
+    
+    return session;
+}
+
+/* Test that frames use one gather write when writev is provided */
+void test_writev(void) {
+    counting_io_t cio;
+    yamux_session_t *session;
+    size_t expected;
+    
+    printf("Testing vectored writes...\n");
+    
+    /* SYN (header + window) and DATA (header + payload) */
+    expected = (YAMUX_HEADER_SIZE + 4) + (YAMUX_HEADER_SIZE + WRITEV_TEST_DATA_LEN);
+    
+    /* With writev: one call per frame */
+    memset(&cio, 0, sizeof(cio));
+    cio.mock = mock_io_init(1024);
+    session = open_and_write(&cio, 1);
+    assert_true(cio.writev_calls == 2, "Expected one writev per frame");
+    assert_true(cio.write_calls == 0, "Frames with payload should not use write");
+    assert_true(cio.mock->write_buf_used == expected, "Unexpected bytes on the wire");
+    
+    /* A payload-less frame (FIN; pings carry their ID) still goes through write */
+    assert_true(yamux_stream_close(yamux_get_stream(session, 1), 0) == YAMUX_OK, "Failed to send FIN");
+    assert_true(cio.write_calls == 1, "FIN should use a single write");
+    
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(cio.mock);
+    
+    /* Without writev: SYN is one write, DATA is header then payload */
+    memset(&cio, 0, sizeof(cio));
+    cio.mock = mock_io_init(1024);
+    session = open_and_write(&cio, 0);
+    assert_true(cio.writev_calls == 0, "writev used although not provided");
+    assert_true(cio.write_calls == 3, "Unexpected fallback write count");
+    assert_true(cio.mock->write_buf_used == expected, "Unexpected bytes on the wire");
+    
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(cio.mock);
+}
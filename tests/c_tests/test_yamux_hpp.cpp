@@ -0,0 +1,218 @@
+/**
+ * @file test_yamux_hpp.cpp
+ * @brief Test for the C++20 wrapper in yamux.hpp
+ *
+ * Connects a client and a server Session over a socket pair and drives
+ * both from one loop. Coroutines push more data than the window holds
+ * through one co_await, read it back in pieces, and see the end of the
+ * stream, a close of their own Stream and a failed session.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <vector>
+#include "../../include/yamux.hpp"
+#include "../../include/yamux_config.h"
+
+#define HPP_TEST_LEN (3 * YAMUX_DEFAULT_WINDOW_SIZE + 123)
+#define HPP_TEST_LOOPS 100000
+
+#define CHECK(cond, msg) do { \
+    if (!(cond)) { \
+        printf("FAILED: %s\n", msg); \
+        exit(1); \
+    } \
+} while (0)
+
+/* Coroutine that starts at once and frees itself when it returns */
+struct Task {
+    struct promise_type {
+        Task get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::abort(); }
+    };
+};
+
+static int fd_read(void *ctx, uint8_t *buf, size_t len) {
+    ssize_t n = read(*static_cast<int *>(ctx), buf, len);
+
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    return (n == 0) ? -1 : static_cast<int>(n);
+}
+
+static int fd_write(void *ctx, const uint8_t *buf, size_t len) {
+    ssize_t n = write(*static_cast<int *>(ctx), buf, len);
+
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+    }
+    return static_cast<int>(n);
+}
+
+static yamux_io_t fd_io(int *fd) {
+    yamux_io_t io = {};
+
+    io.read = fd_read;
+    io.write = fd_write;
+    io.ctx = fd;
+    return io;
+}
+
+/* Process both sessions until done is set */
+static void drive(yamux::Session &client, yamux::Session &server, const bool &done, const char *msg) {
+    int i;
+
+    for (i = 0; i < HPP_TEST_LOOPS && !done; i++) {
+        yamux_result_t c = client.process();
+        yamux_result_t s = server.process();
+
+        CHECK((c == YAMUX_OK || c == YAMUX_ERR_WOULD_BLOCK) && (s == YAMUX_OK || s == YAMUX_ERR_WOULD_BLOCK),
+              "process failed");
+    }
+    CHECK(done, msg);
+}
+
+static std::vector<uint8_t> payload;
+static bool sent, received, at_end, cancelled, failed;
+
+/* Writes the payload with a single co_await, then reads the reply to the end of the stream */
+static Task send_all(yamux::Stream &stream) {
+    uint8_t reply[8];
+    size_t got = 0;
+    yamux::IoResult r = co_await stream.write(payload);
+
+    CHECK(r.result == YAMUX_OK && r.bytes == payload.size(), "Awaited write incomplete");
+    sent = true;
+    do {
+        r = co_await stream.read(std::span<uint8_t>(reply + got, sizeof(reply) - got));
+        CHECK(r.result == YAMUX_OK && got + r.bytes <= 4, "Reply read failed");
+        got += r.bytes;
+    } while (r.bytes > 0);
+    CHECK(got == 4 && memcmp(reply, "done", 4) == 0, "Wrong reply");
+    at_end = true;
+}
+
+/* Reads the payload in small pieces, then replies and closes */
+static Task receive_all(yamux::Stream &stream) {
+    static const uint8_t reply[4] = {'d', 'o', 'n', 'e'};
+    uint8_t buf[4096];
+    size_t total = 0;
+    yamux::IoResult r;
+
+    while (total < payload.size()) {
+        r = co_await stream.read(buf);
+        CHECK(r.result == YAMUX_OK && r.bytes > 0 && total + r.bytes <= payload.size(), "Awaited read failed");
+        CHECK(memcmp(buf, payload.data() + total, r.bytes) == 0, "Data corrupted");
+        total += r.bytes;
+    }
+    r = co_await stream.write(reply);
+    CHECK(r.result == YAMUX_OK && r.bytes == sizeof(reply), "Reply write failed");
+    CHECK(stream.close() == YAMUX_OK, "Close failed");
+    received = true;
+}
+
+/* Waits on a stream that is closed, or whose session fails, under it */
+static Task wait_failed(yamux::Stream &stream, yamux_result_t expected, bool &flag) {
+    uint8_t buf[16];
+    yamux::IoResult r = co_await stream.read(buf);
+
+    CHECK(r.result == expected && r.bytes == 0, "Waiter not told why it stopped");
+    flag = true;
+}
+
+int main(void) {
+    yamux::Session client;
+    yamux::Session server;
+    yamux::Stream out;
+    yamux::Stream in;
+    yamux::Stream moved;
+    yamux_config_t locked = yamux_default_config;
+    int fds[2];
+    size_t n;
+    int i;
+
+    printf("Testing C++ wrapper...\n");
+
+    /* The peer's socket closes under it below */
+    signal(SIGPIPE, SIG_IGN);
+
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair failed");
+    for (i = 0; i < 2; i++) {
+        CHECK(fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL, 0) | O_NONBLOCK) == 0, "fcntl failed");
+    }
+    yamux_io_t client_io = fd_io(&fds[0]);
+    yamux_io_t server_io = fd_io(&fds[1]);
+
+    locked.thread_safe = 1;
+    CHECK(yamux::Session::create(client_io, true, &locked, client) == YAMUX_ERR_INVALID && !client,
+          "Thread-safe session accepted");
+    CHECK(yamux::Session::create(client_io, true, nullptr, client) == YAMUX_OK &&
+          yamux::Session::create(server_io, false, nullptr, server) == YAMUX_OK, "Failed to create sessions");
+
+    /* Move-only handles: the moved-from one is empty and closes nothing */
+    CHECK(client.open(out) == YAMUX_OK && out && out.id() == 1, "Open failed");
+    moved = std::move(out);
+    CHECK(!out && moved && moved.id() == 1 && out.close() == YAMUX_ERR_INVALID, "Move left two owners");
+    out = std::move(moved);
+
+    /* Span reads and writes */
+    static const uint8_t hello[] = "hello";
+    uint8_t buf[16];
+    CHECK(out.write(hello, n) == YAMUX_OK && n == sizeof(hello), "Span write failed");
+    for (i = 0; i < HPP_TEST_LOOPS && !in; i++) {
+        (void)server.process();
+        (void)server.accept(in);
+    }
+    CHECK(in && in.id() == 1, "Accept failed");
+    CHECK(in.read(buf, n) == YAMUX_OK && n == sizeof(hello) && memcmp(buf, hello, n) == 0, "Span read failed");
+    yamux_iovec_t iov[2] = {{hello, 2}, {hello + 2, 3}};
+    CHECK(out.writev(iov, n) == YAMUX_OK && n == 5, "Span writev failed");
+    (void)server.process();
+    CHECK(in.read(std::span<uint8_t>(buf, 5), n) == YAMUX_OK && n == 5 && memcmp(buf, "hello", 5) == 0,
+          "Vectored data wrong");
+
+    /* More than the window in one co_await on each side */
+    payload.resize(HPP_TEST_LEN);
+    for (i = 0; i < HPP_TEST_LEN; i++) {
+        payload[i] = static_cast<uint8_t>(i * 7 + 3);
+    }
+    receive_all(in);
+    send_all(out);
+    CHECK(!sent && !received, "Write past the window finished without waiting");
+    drive(client, server, at_end, "Payload, reply or end of stream did not arrive");
+    CHECK(sent && received && !in, "Coroutines did not finish");
+    CHECK(out.close() == YAMUX_OK && !out, "Close failed");
+
+    /* Closing a Stream finishes its own waiters */
+    CHECK(client.open(out) == YAMUX_OK, "Second open failed");
+    wait_failed(out, YAMUX_ERR_CLOSED, cancelled);
+    CHECK(!cancelled && out.close() == YAMUX_OK, "Close failed");
+    drive(client, server, cancelled, "Close did not finish the waiter");
+
+    /* A failed session finishes every waiter with its error: here the peer hangs up */
+    CHECK(client.open(out) == YAMUX_OK, "Third open failed");
+    wait_failed(out, YAMUX_ERR_IO, failed);
+    close(fds[1]);
+    for (i = 0; i < HPP_TEST_LOOPS && !failed; i++) {
+        (void)client.process();
+    }
+    CHECK(failed, "Session failure not delivered");
+
+    out = yamux::Stream();
+    client = yamux::Session();
+    server = yamux::Session();
+    close(fds[0]);
+
+    printf("C++ wrapper test passed!\n");
+    return 0;
+}
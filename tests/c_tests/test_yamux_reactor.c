@@ -0,0 +1,168 @@
+/**
+ * @file test_yamux_reactor.c
+ * @brief Test for the epoll/kqueue reactor
+ *
+ * Drives a client and a server session over a socket pair from one
+ * reactor, with a small socket buffer so that writes back up and the
+ * reactor has to flush queued frames when the socket drains. The second
+ * half of the data is sent from a file with yamux_fd_sendfile().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../../include/yamux.h"
+#include "../../include/yamux_reactor.h"
+#include "yamux_internal.h"
+
+#define REACTOR_TEST_LEN (128 * 1024)
+#define REACTOR_TEST_POLLS 10000
+
+#define CHECK(cond, msg) do { \
+    if (!(cond)) { \
+        printf("FAILED: %s\n", msg); \
+        exit(1); \
+    } \
+} while (0)
+
+/* Server side: accepts the stream and collects what arrives on it */
+typedef struct {
+    yamux_stream_t *stream;
+    uint8_t *received;
+    size_t received_len;
+    int events;
+    yamux_result_t last_result;
+} server_state_t;
+
+static void on_server(yamux_reactor_t *reactor, int fd, yamux_session_t *session,
+                      yamux_result_t result, void *user_data) {
+    server_state_t *state = (server_state_t *)user_data;
+    size_t bytes_read;
+
+    state->events++;
+    state->last_result = result;
+    if (result != YAMUX_OK) {
+        yamux_reactor_remove(reactor, fd);
+        return;
+    }
+
+    if (!state->stream && yamux_stream_accept(session, &state->stream) != YAMUX_OK) {
+        return;
+    }
+    while (state->received_len < REACTOR_TEST_LEN &&
+           yamux_stream_read(state->stream, state->received + state->received_len,
+                             REACTOR_TEST_LEN - state->received_len, &bytes_read) == YAMUX_OK &&
+           bytes_read > 0) {
+        state->received_len += bytes_read;
+    }
+}
+
+static void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    CHECK(flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0, "fcntl failed");
+}
+
+static yamux_session_t *create_session(int *fd, int client) {
+    yamux_io_t io;
+    yamux_session_t *session;
+
+    memset(&io, 0, sizeof(io));
+    io.read = yamux_fd_read;
+    io.write = yamux_fd_write;
+    io.sendfile = yamux_fd_sendfile;
+    io.ctx = fd;
+    CHECK(yamux_session_create(&io, client, NULL, &session) == YAMUX_OK, "Failed to create session");
+    return session;
+}
+
+int main(void) {
+    static uint8_t data[REACTOR_TEST_LEN];
+    static uint8_t received[REACTOR_TEST_LEN];
+    yamux_reactor_t *reactor;
+    yamux_session_t *client;
+    yamux_session_t *server;
+    yamux_stream_t *stream;
+    server_state_t state;
+    yamux_result_t result;
+    size_t sent = 0;
+    size_t bytes_written;
+    int sndbuf = 4096;
+    int backed_up = 0;
+    FILE *file;
+    int fds[2];
+    int polls;
+    size_t i;
+
+    printf("Testing reactor...\n");
+
+    for (i = 0; i < REACTOR_TEST_LEN; i++) {
+        data[i] = (uint8_t)(i * 31 + 7);
+    }
+    file = tmpfile();
+    CHECK(file && fwrite(data, 1, REACTOR_TEST_LEN, file) == REACTOR_TEST_LEN && fflush(file) == 0,
+          "Failed to write file");
+
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair failed");
+    set_nonblocking(fds[0]);
+    set_nonblocking(fds[1]);
+    (void)setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf));
+
+    CHECK(yamux_reactor_create(&reactor) == YAMUX_OK, "Failed to create reactor");
+    client = create_session(&fds[0], 1);
+    server = create_session(&fds[1], 0);
+
+    memset(&state, 0, sizeof(state));
+    state.received = received;
+    CHECK(yamux_reactor_add(reactor, fds[0], client, NULL, NULL) == YAMUX_OK, "Failed to add client");
+    CHECK(yamux_reactor_add(reactor, fds[1], server, on_server, &state) == YAMUX_OK, "Failed to add server");
+    CHECK(yamux_reactor_add(reactor, fds[1], server, on_server, &state) == YAMUX_ERR_INVALID,
+          "Duplicate registration accepted");
+
+    /* Write as fast as flow control and the socket allow, one thread serving both ends */
+    CHECK(yamux_stream_open_detailed(client, 0, &stream) == YAMUX_OK, "Failed to open stream");
+    for (polls = 0; polls < REACTOR_TEST_POLLS && state.received_len < REACTOR_TEST_LEN; polls++) {
+        if (sent < REACTOR_TEST_LEN) {
+            bytes_written = 0;
+            if (sent < REACTOR_TEST_LEN / 2) {
+                result = yamux_stream_write(stream, data + sent, REACTOR_TEST_LEN / 2 - sent, &bytes_written);
+            } else {
+                result = yamux_stream_sendfile(stream, fileno(file), sent, REACTOR_TEST_LEN - sent,
+                                               &bytes_written);
+            }
+            CHECK(result == YAMUX_OK || result == YAMUX_ERR_WOULD_BLOCK, "Write failed");
+            sent += bytes_written;
+            CHECK(yamux_reactor_flush(reactor, fds[0]) == YAMUX_OK, "Flush failed");
+            if (yamux_session_queued(client)) {
+                backed_up = 1;
+            }
+        }
+        CHECK(yamux_reactor_poll(reactor, 100) >= 0, "Poll failed");
+    }
+
+    CHECK(state.received_len == REACTOR_TEST_LEN, "Not all data arrived");
+    CHECK(memcmp(received, data, REACTOR_TEST_LEN) == 0, "Data mismatch");
+    CHECK(backed_up, "Socket never filled; queued flushing was not exercised");
+    CHECK(!yamux_session_queued(client), "Frames left queued");
+    fclose(file);
+
+    /* The server hears about the peer going away and unregisters itself */
+    CHECK(yamux_reactor_remove(reactor, fds[0]) == YAMUX_OK, "Failed to remove client");
+    CHECK(yamux_reactor_remove(reactor, fds[0]) == YAMUX_ERR_INVALID, "Removed twice");
+    yamux_session_close(client, YAMUX_NORMAL);
+    close(fds[0]);
+    for (polls = 0; polls < 100 && state.last_result == YAMUX_OK; polls++) {
+        CHECK(yamux_reactor_poll(reactor, 100) >= 0, "Poll failed");
+    }
+    CHECK(state.last_result != YAMUX_OK, "Peer close not reported");
+    CHECK(yamux_reactor_flush(reactor, fds[1]) == YAMUX_ERR_INVALID, "Server still registered");
+
+    yamux_reactor_destroy(reactor);
+    yamux_session_close(server, YAMUX_NORMAL);
+    close(fds[1]);
+
+    printf("Reactor test passed!\n");
+    return 0;
+}
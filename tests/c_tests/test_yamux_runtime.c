@@ -0,0 +1,235 @@
+/**
+ * @file test_yamux_runtime.c
+ * @brief Test for the sharded multi-core runtime
+ *
+ * Puts both ends of several socket pairs on a runtime of a few shards.
+ * Application threads hand writes to the shards owning the client
+ * sessions, the servers echo them back, and every callback must run on
+ * the thread of the shard its session was placed on. A last server
+ * connection is ended by a peer that says GO_AWAY and hangs up; its
+ * session must still be freed when the shard drops it (run under ASan).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include "../../include/yamux.h"
+#include "../../include/yamux_runtime.h"
+
+#define RUNTIME_TEST_SHARDS 4
+#define RUNTIME_TEST_CONNS 16
+#define RUNTIME_TEST_MSG_LEN 32
+#define RUNTIME_TEST_WAIT_MS 5000
+
+#define CHECK(cond, msg) do { \
+    if (!(cond)) { \
+        printf("FAILED: %s\n", msg); \
+        exit(1); \
+    } \
+} while (0)
+
+/* One end of a connection */
+typedef struct {
+    int fd;
+    int client;
+    uint64_t hash;
+    uint8_t msg[RUNTIME_TEST_MSG_LEN];
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    uint8_t received[RUNTIME_TEST_MSG_LEN];
+    size_t received_len;
+    yamux_shard_task_t task;
+} conn_t;
+
+static conn_t conns[2 * RUNTIME_TEST_CONNS];
+static conn_t goaway_conn;      /* Server whose peer sends GO_AWAY */
+static pthread_t shard_thread[RUNTIME_TEST_SHARDS];
+static int shard_seen[RUNTIME_TEST_SHARDS];
+static int wrong_thread;
+static int opened;              /* Sessions created (atomic) */
+static int echoed;              /* Clients that got their message back (atomic) */
+static int failed;              /* Server sessions told their peer went away (atomic) */
+static int goaway_failed;       /* goaway_conn told its peer went away (atomic) */
+
+/* Each shard's callbacks must all run on one thread, its own */
+static void check_thread(yamux_shard_t *shard) {
+    uint32_t index = yamux_shard_index(shard);
+
+    if (!shard_seen[index]) {
+        shard_thread[index] = pthread_self();
+        shard_seen[index] = 1;
+    } else if (!pthread_equal(shard_thread[index], pthread_self())) {
+        __atomic_store_n(&wrong_thread, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void on_event(yamux_shard_t *shard, int fd, yamux_session_t *session, yamux_result_t result,
+                     void *user_data) {
+    conn_t *conn = (conn_t *)user_data;
+    yamux_stream_t *stream;
+    uint8_t buf[RUNTIME_TEST_MSG_LEN];
+    size_t n;
+    size_t written;
+
+    (void)fd;
+    check_thread(shard);
+    CHECK(session != NULL, "Session not created");
+    if (result != YAMUX_OK) {
+        if (conn == &goaway_conn) {
+            /* The shard frees the session once this returns */
+            conn->session = NULL;
+            __atomic_add_fetch(&goaway_failed, 1, __ATOMIC_RELEASE);
+        } else if (!conn->client) {
+            __atomic_add_fetch(&failed, 1, __ATOMIC_RELAXED);
+        }
+        return;
+    }
+    if (!conn->session) {
+        conn->session = session;
+        __atomic_add_fetch(&opened, 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    if (conn->client) {
+        while (conn->stream && conn->received_len < RUNTIME_TEST_MSG_LEN &&
+               yamux_stream_read(conn->stream, conn->received + conn->received_len,
+                                 RUNTIME_TEST_MSG_LEN - conn->received_len, &n) == YAMUX_OK && n > 0) {
+            conn->received_len += n;
+            if (conn->received_len == RUNTIME_TEST_MSG_LEN) {
+                __atomic_add_fetch(&echoed, 1, __ATOMIC_RELEASE);
+            }
+        }
+        return;
+    }
+
+    /* Server: echo whatever arrives */
+    while (!conn->stream && yamux_stream_accept(session, &stream) == YAMUX_OK) {
+        conn->stream = stream;
+    }
+    while (conn->stream && yamux_stream_read(conn->stream, buf, sizeof(buf), &n) == YAMUX_OK && n > 0) {
+        CHECK(yamux_stream_write(conn->stream, buf, n, &written) == YAMUX_OK && written == n, "Echo failed");
+    }
+}
+
+/* Task: open a stream on a client session and send its message */
+static void send_message(yamux_shard_t *shard, yamux_shard_task_t *task) {
+    conn_t *conn = (conn_t *)task->arg;
+    size_t written;
+
+    check_thread(shard);
+    CHECK(yamux_stream_open_detailed(conn->session, 0, &conn->stream) == YAMUX_OK, "Open failed");
+    CHECK(yamux_stream_write(conn->stream, conn->msg, RUNTIME_TEST_MSG_LEN, &written) == YAMUX_OK &&
+          written == RUNTIME_TEST_MSG_LEN, "Write failed");
+    CHECK(yamux_reactor_flush(yamux_shard_reactor(shard), conn->fd) == YAMUX_OK, "Flush failed");
+}
+
+/* Task: drop a client session and close its socket */
+static void hang_up(yamux_shard_t *shard, yamux_shard_task_t *task) {
+    conn_t *conn = (conn_t *)task->arg;
+
+    CHECK(yamux_shard_remove(shard, conn->fd) == YAMUX_OK, "Remove failed");
+    CHECK(yamux_shard_remove(shard, conn->fd) == YAMUX_ERR_INVALID, "Removed twice");
+    close(conn->fd);
+}
+
+/* Wait until *counter reaches target */
+static int wait_for(int *counter, int target) {
+    int ms;
+
+    for (ms = 0; ms < RUNTIME_TEST_WAIT_MS && __atomic_load_n(counter, __ATOMIC_ACQUIRE) < target; ms++) {
+        usleep(1000);
+    }
+    return __atomic_load_n(counter, __ATOMIC_ACQUIRE) >= target;
+}
+
+static void set_nonblocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    CHECK(flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0, "fcntl failed");
+}
+
+int main(void) {
+    yamux_runtime_t *runtime;
+    int used[RUNTIME_TEST_SHARDS] = {0};
+    yamux_shard_task_t bad_task;
+    static const uint8_t go_away[16] = {0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+                                        0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00};
+    int fds[2];
+    int i;
+    int j;
+
+    printf("Testing sharded runtime...\n");
+
+    CHECK(yamux_runtime_create(RUNTIME_TEST_SHARDS, 1, &runtime) == YAMUX_OK, "Failed to create runtime");
+    CHECK(yamux_runtime_shard_count(runtime) == RUNTIME_TEST_SHARDS, "Wrong shard count");
+    CHECK(yamux_runtime_shard(runtime, RUNTIME_TEST_SHARDS) == NULL, "Shard out of range returned");
+    memset(&bad_task, 0, sizeof(bad_task));
+    CHECK(yamux_shard_post(yamux_runtime_shard(runtime, 0), &bad_task) == YAMUX_ERR_INVALID,
+          "Task without run accepted");
+
+    for (i = 0; i < RUNTIME_TEST_CONNS; i++) {
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair failed");
+        for (j = 0; j < 2; j++) {
+            conn_t *conn = &conns[2 * i + j];
+
+            set_nonblocking(fds[j]);
+            conn->fd = fds[j];
+            conn->client = (j == 0);
+            conn->hash = 0x9E3779B97F4A7C15ULL * (uint64_t)(2 * i + j + 1);
+            memset(conn->msg, 'a' + i, sizeof(conn->msg));
+            used[yamux_shard_index(yamux_runtime_shard_for(runtime, conn->hash))]++;
+            CHECK(yamux_runtime_add(runtime, conn->fd, conn->hash, conn->client, NULL, on_event, conn) == YAMUX_OK,
+                  "Failed to add connection");
+        }
+    }
+    for (i = 0; i < RUNTIME_TEST_SHARDS; i++) {
+        CHECK(used[i] > 0, "A shard got no connections");
+    }
+    CHECK(wait_for(&opened, 2 * RUNTIME_TEST_CONNS), "Sessions not created");
+
+    /* This thread owns no session: it hands each write to the session's shard */
+    for (i = 0; i < RUNTIME_TEST_CONNS; i++) {
+        conn_t *conn = &conns[2 * i];
+
+        conn->task.run = send_message;
+        conn->task.arg = conn;
+        CHECK(yamux_shard_post(yamux_runtime_shard_for(runtime, conn->hash), &conn->task) == YAMUX_OK,
+              "Post failed");
+    }
+    CHECK(wait_for(&echoed, RUNTIME_TEST_CONNS), "Not every message came back");
+    for (i = 0; i < RUNTIME_TEST_CONNS; i++) {
+        CHECK(memcmp(conns[2 * i].received, conns[2 * i].msg, RUNTIME_TEST_MSG_LEN) == 0, "Echo corrupted");
+    }
+
+    /* Client hang-ups are reported to the servers, whose sessions go */
+    for (i = 0; i < RUNTIME_TEST_CONNS; i++) {
+        conn_t *conn = &conns[2 * i];
+
+        conn->task.run = hang_up;
+        CHECK(yamux_shard_post(yamux_runtime_shard_for(runtime, conn->hash), &conn->task) == YAMUX_OK,
+              "Post failed");
+    }
+    CHECK(wait_for(&failed, RUNTIME_TEST_CONNS), "Hang-ups not reported");
+    CHECK(!__atomic_load_n(&wrong_thread, __ATOMIC_RELAXED), "Callback ran off its shard");
+
+    /* A peer that ends with a well-formed GO_AWAY, then hangs up */
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair failed");
+    set_nonblocking(fds[0]);
+    goaway_conn.fd = fds[0];
+    CHECK(yamux_runtime_add(runtime, goaway_conn.fd, 1, 0, NULL, on_event, &goaway_conn) == YAMUX_OK,
+          "Failed to add connection");
+    CHECK(write(fds[1], go_away, sizeof(go_away)) == (ssize_t)sizeof(go_away), "GO_AWAY write failed");
+    close(fds[1]);
+    CHECK(wait_for(&goaway_failed, 1), "Hang-up after GO_AWAY not reported");
+
+    yamux_runtime_destroy(runtime);
+    for (i = 0; i < RUNTIME_TEST_CONNS; i++) {
+        close(conns[2 * i + 1].fd);
+    }
+
+    printf("Runtime test passed!\n");
+    return 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * @file test_yamux_uring.c
+ * @brief Test for the io_uring transport
+ *
+ * The server session runs on the io_uring transport with a handful of
+ * small receive buffers, so a transfer only completes if buffers are
+ * handed back to the kernel as they are read. The client uses plain
+ * non-blocking socket calls. Skipped where io_uring is not available.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "../../include/yamux.h"
+#include "../../include/yamux_uring.h"
+#include "yamux_internal.h"
+
+#define URING_TEST_LEN (128 * 1024)
+#define URING_TEST_ROUNDS 100000
+
+#define CHECK(cond, msg) do { \
+    if (!(cond)) { \
+        printf("FAILED: %s\n", msg); \
+        exit(1); \
+    } \
+} while (0)
+
+static int client_read(void *ctx, uint8_t *buf, size_t len) {
+    ssize_t n = recv(*(int *)ctx, buf, len, 0);
+
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : YAMUX_ERR_IO;
+    }
+    return n == 0 ? YAMUX_ERR_IO : (int)n;
+}
+
+static int client_write(void *ctx, const uint8_t *buf, size_t len) {
+    ssize_t n = send(*(int *)ctx, buf, len, MSG_NOSIGNAL);
+
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : YAMUX_ERR_IO;
+    }
+    return (int)n;
+}
+
+int main(void) {
+    static uint8_t data[URING_TEST_LEN];
+    static uint8_t received[URING_TEST_LEN];
+    yamux_uring_t *uring;
+    yamux_session_t *client;
+    yamux_session_t *server;
+    yamux_stream_t *client_stream;
+    yamux_stream_t *server_stream = NULL;
+    yamux_io_t io;
+    yamux_result_t result;
+    uint8_t reply[8];
+    size_t sent = 0;
+    size_t received_len = 0;
+    size_t bytes;
+    int fds[2];
+    int rounds;
+    size_t i;
+
+    printf("Testing io_uring transport...\n");
+
+    for (i = 0; i < URING_TEST_LEN; i++) {
+        data[i] = (uint8_t)(i * 13 + 5);
+    }
+
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0, "socketpair failed");
+    CHECK(fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL, 0) | O_NONBLOCK) == 0, "fcntl failed");
+
+    result = yamux_uring_create(fds[1], 8, 4096, &uring);
+    if (result == YAMUX_ERR_IO && (errno == ENOSYS || errno == EPERM || errno == EINVAL)) {
+        printf("io_uring not available, skipping\n");
+        close(fds[0]);
+        close(fds[1]);
+        return 0;
+    }
+    CHECK(result == YAMUX_OK, "Failed to create transport");
+
+    memset(&io, 0, sizeof(io));
+    io.read = client_read;
+    io.write = client_write;
+    io.ctx = &fds[0];
+    CHECK(yamux_session_create(&io, 1, NULL, &client) == YAMUX_OK, "Failed to create client");
+
+    memset(&io, 0, sizeof(io));
+    yamux_uring_io(uring, &io);
+    CHECK(yamux_session_create(&io, 0, NULL, &server) == YAMUX_OK, "Failed to create server");
+
+    /* 128 KB through 32 KB of receive buffers */
+    CHECK(yamux_stream_open_detailed(client, 0, &client_stream) == YAMUX_OK, "Failed to open stream");
+    for (rounds = 0; rounds < URING_TEST_ROUNDS && received_len < URING_TEST_LEN; rounds++) {
+        if (sent < URING_TEST_LEN) {
+            bytes = 0;
+            if (yamux_stream_write(client_stream, data + sent, URING_TEST_LEN - sent, &bytes) == YAMUX_OK) {
+                sent += bytes;
+            }
+        }
+        (void)yamux_session_flush(client);
+        (void)yamux_session_process(client);
+
+        CHECK(yamux_uring_run(uring, server, 0) == YAMUX_OK, "Run failed");
+        if (!server_stream && yamux_stream_accept(server, &server_stream) != YAMUX_OK) {
+            server_stream = NULL;
+            continue;
+        }
+        while (received_len < URING_TEST_LEN &&
+               yamux_stream_read(server_stream, received + received_len,
+                                 URING_TEST_LEN - received_len, &bytes) == YAMUX_OK && bytes > 0) {
+            received_len += bytes;
+        }
+        usleep(10);
+    }
+
+    CHECK(received_len == URING_TEST_LEN, "Not all data arrived");
+    CHECK(memcmp(received, data, URING_TEST_LEN) == 0, "Data mismatch");
+
+    /* Writes on the transport are sent by the next run */
+    CHECK(yamux_stream_write(server_stream, (const uint8_t *)"pong", 4, &bytes) == YAMUX_OK && bytes == 4,
+          "Reply write failed");
+    bytes = 0;
+    for (rounds = 0; rounds < URING_TEST_ROUNDS && bytes == 0; rounds++) {
+        CHECK(yamux_uring_run(uring, server, 0) == YAMUX_OK, "Run failed");
+        (void)yamux_session_process(client);
+        CHECK(yamux_stream_read(client_stream, reply, sizeof(reply), &bytes) == YAMUX_OK, "Reply read failed");
+        usleep(10);
+    }
+    CHECK(bytes == 4 && memcmp(reply, "pong", 4) == 0, "Reply not received");
+
+    /* The peer going away ends the run loop */
+    yamux_session_close(client, YAMUX_NORMAL);
+    close(fds[0]);
+    result = YAMUX_OK;
+    for (rounds = 0; rounds < 1000 && result == YAMUX_OK; rounds++) {
+        result = yamux_uring_run(uring, server, 1);
+    }
+    CHECK(result != YAMUX_OK, "Peer close not reported");
+
+    yamux_session_close(server, YAMUX_NORMAL);
+    yamux_uring_destroy(uring);
+    close(fds[1]);
+
+    printf("io_uring transport test passed!\n");
+    return 0;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file test_zero_copy.c
+ * @brief Test for direct payload reads and stream peek/consume
+ */
+
+#include "test_main.h"
+#include "mock_io.h"
+
+#define ZC_TEST_DATA_LEN 1000
+#define ZC_TEST_CONSUME 400
+
+/* Transport that records reads landing in a stream's receive buffer */
+typedef struct {
+    mock_io_t *mock;
+    yamux_session_t *session;
+    size_t direct_bytes;
+} direct_io_t;
+
+static int direct_read(void *ctx, uint8_t *buf, size_t len) {
+    direct_io_t *dio = (direct_io_t *)ctx;
+    yamux_stream_t *stream = dio->session ? yamux_get_stream(dio->session, 1) : NULL;
+    int n = mock_read(dio->mock, buf, len);
+
+    if (n > 0 && stream && buf >= stream->recvbuf.data &&
+        buf < stream->recvbuf.data + stream->recvbuf.size) {
+        dio->direct_bytes += (size_t)n;
+    }
+    return n;
+}
+
+static int direct_write(void *ctx, const uint8_t *buf, size_t len) {
+    return mock_write(((direct_io_t *)ctx)->mock, buf, len);
+}
+
+/* Append an encoded frame to the mock's inbound data */
+static void append_frame(mock_io_t *mock, uint8_t type, uint16_t flags, uint32_t stream_id,
+                         const uint8_t *payload, uint32_t length) {
+    yamux_header_t header;
+
+    memset(&header, 0, sizeof(header));
+    header.version = YAMUX_PROTO_VERSION;
+    header.type = type;
+    header.flags = flags;
+    header.stream_id = stream_id;
+    header.length = length;
+
+    yamux_encode_header(&header, mock->read_buf + mock->read_buf_used);
+    mock->read_buf_used += YAMUX_HEADER_SIZE;
+    if (length > 0) {
+        memcpy(mock->read_buf + mock->read_buf_used, payload, length);
+        mock->read_buf_used += length;
+    }
+}
+
+/* Test that DATA payloads bypass the ingress buffer and can be parsed in place */
+void test_zero_copy(void) {
+    direct_io_t dio;
+    yamux_io_t io;
+    yamux_config_t config;
+    yamux_session_t *session;
+    yamux_stream_t *stream;
+    yamux_result_t result;
+    uint8_t window[4] = {0x00, 0x04, 0x00, 0x00};
+    uint8_t data[ZC_TEST_DATA_LEN];
+    const uint8_t *peeked;
+    size_t peeked_len;
+    uint32_t window_before;
+    int calls;
+    int i;
+
+    printf("Testing zero-copy receive...\n");
+
+    for (i = 0; i < ZC_TEST_DATA_LEN; i++) {
+        data[i] = (uint8_t)i;
+    }
+
+    memset(&dio, 0, sizeof(dio));
+    dio.mock = mock_io_init(4096);
+    memset(&io, 0, sizeof(io));
+    io.read = direct_read;
+    io.write = direct_write;
+    io.ctx = &dio;
+
+    /* A small ingress buffer leaves most of the payload for direct reads */
+    memset(&config, 0, sizeof(config));
+    config.read_buffer_size = 64;
+    result = yamux_session_create(&io, 0, &config, &session);
+    assert_true(result == YAMUX_OK, "Failed to create server session");
+    dio.session = session;
+
+    append_frame(dio.mock, YAMUX_WINDOW_UPDATE, YAMUX_FLAG_SYN, 1, window, sizeof(window));
+    append_frame(dio.mock, YAMUX_DATA, 0, 1, data, sizeof(data));
+
+    for (calls = 0; calls < 64 && dio.mock->read_pos < dio.mock->read_buf_used; calls++) {
+        result = yamux_session_process(session);
+        assert_true(result == YAMUX_OK || result == YAMUX_ERR_WOULD_BLOCK, "Failed to process frames");
+    }
+    assert_true(dio.mock->read_pos == dio.mock->read_buf_used, "Input not consumed");
+
+    stream = yamux_get_stream(session, 1);
+    assert_true(stream != NULL, "Stream was not created from SYN");
+    assert_true(stream->recvbuf.used == ZC_TEST_DATA_LEN, "Payload not delivered");
+    assert_true(dio.direct_bytes >= ZC_TEST_DATA_LEN - config.read_buffer_size,
+                "Payload was staged in the ingress buffer");
+    assert_true(stream->recv_window == YAMUX_DEFAULT_WINDOW_SIZE - ZC_TEST_DATA_LEN,
+                "Receive window not charged for direct reads");
+
+    /* Peek sees the payload in place, in order */
+    result = yamux_stream_peek(stream, &peeked, &peeked_len);
+    assert_true(result == YAMUX_OK, "Peek failed");
+    assert_true(peeked_len == ZC_TEST_DATA_LEN, "Peek length mismatch");
+    assert_true(memcmp(peeked, data, ZC_TEST_DATA_LEN) == 0, "Peeked data mismatch");
+
+    /* Consume part of it: the bytes count towards the next window update */
+    window_before = stream->recv_window;
+    result = yamux_stream_consume(stream, ZC_TEST_CONSUME);
+    assert_true(result == YAMUX_OK, "Consume failed");
+    assert_true(stream->recv_window + stream->recv_consumed == window_before + ZC_TEST_CONSUME,
+                "Consumed bytes not credited");
+
+    result = yamux_stream_peek(stream, &peeked, &peeked_len);
+    assert_true(result == YAMUX_OK, "Second peek failed");
+    assert_true(peeked_len == ZC_TEST_DATA_LEN - ZC_TEST_CONSUME, "Remaining length mismatch");
+    assert_true(memcmp(peeked, data + ZC_TEST_CONSUME, peeked_len) == 0, "Remaining data mismatch");
+
+    /* Cannot consume more than is buffered */
+    result = yamux_stream_consume(stream, peeked_len + 1);
+    assert_true(result == YAMUX_ERR_INVALID, "Over-consume should fail");
+
+    result = yamux_stream_consume(stream, peeked_len);
+    assert_true(result == YAMUX_OK, "Final consume failed");
+    result = yamux_stream_peek(stream, &peeked, &peeked_len);
+    assert_true(result == YAMUX_OK && peeked == NULL && peeked_len == 0, "Empty peek mismatch");
+
+    yamux_session_close(session, YAMUX_NORMAL);
+    mock_io_free(dio.mock);
+}
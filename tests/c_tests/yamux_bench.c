@@ -0,0 +1,570 @@
+/**
+ * @file yamux_bench.c
+ * @brief Wall-clock benchmarks of throughput, open/close rate and latency
+ *
+ * A client and a server session run in one thread, either over an
+ * in-memory pipe, a socketpair or loopback TCP (linux_socket_adapter.h),
+ * across a matrix of stream counts and message sizes. Everything is timed
+ * with CLOCK_MONOTONIC. --json writes the results in a machine-readable
+ * form so runs of different releases can be compared.
+ *
+ * Usage: yamux_bench [--quick] [--transport mock|socketpair|tcp] [--json FILE|-]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <netinet/tcp.h>
+#include "../../include/yamux.h"
+#include "../../include/yamux_config.h"
+#include "linux_socket_adapter.h"
+
+/* In-memory pipe capacity, about what a socket buffers */
+#define BENCH_PIPE_SIZE (256 * 1024)
+
+/* Most results one run produces */
+#define BENCH_MAX_RESULTS 128
+
+#define CHECK(cond, msg) do { \
+    if (!(cond)) { \
+        fprintf(stderr, "yamux_bench: %s\n", msg); \
+        exit(1); \
+    } \
+} while (0)
+
+/* One direction of the in-memory transport */
+typedef struct {
+    uint8_t data[BENCH_PIPE_SIZE];
+    size_t pos;
+    size_t used;
+} bench_pipe_t;
+
+/* An end of the in-memory transport */
+typedef struct {
+    bench_pipe_t *in;
+    bench_pipe_t *out;
+} bench_end_t;
+
+/* A connected client and server */
+typedef struct {
+    yamux_session_t *client;
+    yamux_session_t *server;
+    bench_pipe_t *pipes;
+    bench_end_t ends[2];
+    linux_socket_t *socks[2];
+} bench_conn_t;
+
+/* One measurement */
+typedef struct {
+    const char *scenario;
+    const char *transport;
+    int streams;
+    size_t message_size;
+    uint64_t operations;             /* Messages, round trips or streams */
+    uint64_t bytes;                  /* Payload moved */
+    uint64_t frames;                 /* DATA frames received */
+    double seconds;
+    double p50_us;                   /* Latency percentiles (echo only) */
+    double p99_us;
+} bench_result_t;
+
+static bench_result_t bench_results[BENCH_MAX_RESULTS];
+static int bench_result_count;
+static uint8_t bench_data[64 * 1024];
+static uint8_t bench_sink[64 * 1024];
+
+static double bench_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int bench_pipe_read(void *ctx, uint8_t *buf, size_t len) {
+    bench_pipe_t *pipe = ((bench_end_t *)ctx)->in;
+    size_t n = pipe->used - pipe->pos;
+
+    if (n > len) {
+        n = len;
+    }
+    memcpy(buf, pipe->data + pipe->pos, n);
+    pipe->pos += n;
+    if (pipe->pos == pipe->used) {
+        pipe->pos = 0;
+        pipe->used = 0;
+    }
+    return (int)n;
+}
+
+static int bench_pipe_write(void *ctx, const uint8_t *buf, size_t len) {
+    bench_pipe_t *pipe = ((bench_end_t *)ctx)->out;
+    size_t n;
+
+    if (pipe->pos > 0 && pipe->used + len > BENCH_PIPE_SIZE) {
+        memmove(pipe->data, pipe->data + pipe->pos, pipe->used - pipe->pos);
+        pipe->used -= pipe->pos;
+        pipe->pos = 0;
+    }
+    n = BENCH_PIPE_SIZE - pipe->used;
+    if (n > len) {
+        n = len;
+    }
+    memcpy(pipe->data + pipe->used, buf, n);
+    pipe->used += n;
+    return (int)n;
+}
+
+/* Wrap a connected descriptor for the socket adapter */
+static linux_socket_t *bench_socket(int fd) {
+    linux_socket_t *sock = (linux_socket_t *)calloc(1, sizeof(linux_socket_t));
+
+    CHECK(sock != NULL, "out of memory");
+    sock->fd = fd;
+    sock->connected = 1;
+    return sock;
+}
+
+/* Connect two sockets over loopback TCP; 0 if it is unavailable */
+static int bench_tcp_pair(linux_socket_t *socks[2]) {
+    linux_socket_t *listener = linux_socket_create_server(0);
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    int one = 1;
+
+    if (!listener) {
+        return 0;
+    }
+    if (getsockname(listener->fd, (struct sockaddr *)&addr, &addrlen) < 0 ||
+        !(socks[0] = linux_socket_create_client("127.0.0.1", ntohs(addr.sin_port)))) {
+        linux_socket_close(listener);
+        return 0;
+    }
+    socks[1] = linux_socket_accept(listener);
+    linux_socket_close(listener);
+    if (!socks[1]) {
+        linux_socket_close(socks[0]);
+        return 0;
+    }
+    setsockopt(socks[0]->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    setsockopt(socks[1]->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return 1;
+}
+
+/* Set up a client and a server session over the transport; 0 if it is unavailable */
+static int bench_connect(bench_conn_t *conn, const char *transport) {
+    yamux_io_t io[2];
+    int fds[2];
+    int i;
+
+    memset(conn, 0, sizeof(*conn));
+    memset(io, 0, sizeof(io));
+
+    if (strcmp(transport, "mock") == 0) {
+        conn->pipes = (bench_pipe_t *)calloc(2, sizeof(bench_pipe_t));
+        CHECK(conn->pipes != NULL, "out of memory");
+        for (i = 0; i < 2; i++) {
+            conn->ends[i].in = &conn->pipes[i];
+            conn->ends[i].out = &conn->pipes[1 - i];
+            io[i].read = bench_pipe_read;
+            io[i].write = bench_pipe_write;
+            io[i].ctx = &conn->ends[i];
+        }
+    } else {
+        if (strcmp(transport, "socketpair") == 0) {
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+                return 0;
+            }
+            conn->socks[0] = bench_socket(fds[0]);
+            conn->socks[1] = bench_socket(fds[1]);
+        } else if (!bench_tcp_pair(conn->socks)) {
+            return 0;
+        }
+        for (i = 0; i < 2; i++) {
+            fcntl(conn->socks[i]->fd, F_SETFL, fcntl(conn->socks[i]->fd, F_GETFL) | O_NONBLOCK);
+            io[i].read = linux_socket_read;
+            io[i].write = linux_socket_write;
+            io[i].ctx = conn->socks[i];
+        }
+    }
+
+    CHECK(yamux_session_create(&io[0], 1, NULL, &conn->client) == YAMUX_OK, "client session failed");
+    CHECK(yamux_session_create(&io[1], 0, NULL, &conn->server) == YAMUX_OK, "server session failed");
+    return 1;
+}
+
+static void bench_disconnect(bench_conn_t *conn) {
+    yamux_session_close(conn->client, YAMUX_NORMAL);
+    yamux_session_close(conn->server, YAMUX_NORMAL);
+    linux_socket_close(conn->socks[0]);
+    linux_socket_close(conn->socks[1]);
+    free(conn->pipes);
+}
+
+/* Let both sessions handle what has arrived and send what is queued */
+static void bench_pump(bench_conn_t *conn) {
+    yamux_result_t result;
+
+    result = yamux_session_process(conn->client);
+    CHECK(result == YAMUX_OK || result == YAMUX_ERR_WOULD_BLOCK, "client processing failed");
+    result = yamux_session_process(conn->server);
+    CHECK(result == YAMUX_OK || result == YAMUX_ERR_WOULD_BLOCK, "server processing failed");
+    (void)yamux_session_flush(conn->client);
+    (void)yamux_session_flush(conn->server);
+}
+
+/* Open count streams from the client and accept them on the server (in any order) */
+static void bench_open(bench_conn_t *conn, int count, yamux_stream_t **client, yamux_stream_t **server) {
+    int accepted = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        CHECK(yamux_stream_open_detailed(conn->client, 0, &client[i]) == YAMUX_OK, "open failed");
+    }
+    while (accepted < count) {
+        bench_pump(conn);
+        while (accepted < count && yamux_stream_accept(conn->server, &server[accepted]) == YAMUX_OK) {
+            accepted++;
+        }
+    }
+}
+
+/* Write what the stream takes of len bytes; returns the bytes written */
+static size_t bench_write(yamux_stream_t *stream, size_t len) {
+    size_t written = 0;
+    yamux_result_t result;
+
+    if (len > sizeof(bench_data)) {
+        len = sizeof(bench_data);
+    }
+    result = yamux_stream_write(stream, bench_data, len, &written);
+    CHECK(result == YAMUX_OK || result == YAMUX_ERR_WOULD_BLOCK, "write failed");
+    return (result == YAMUX_OK) ? written : 0;
+}
+
+/* Read what the stream has, up to len bytes; returns the bytes read */
+static size_t bench_read(yamux_stream_t *stream, size_t len) {
+    size_t n = 0;
+    yamux_result_t result;
+
+    if (len > sizeof(bench_sink)) {
+        len = sizeof(bench_sink);
+    }
+    result = yamux_stream_read(stream, bench_sink, len, &n);
+    CHECK(result == YAMUX_OK || result == YAMUX_ERR_WOULD_BLOCK, "read failed");
+    return (result == YAMUX_OK) ? n : 0;
+}
+
+static uint64_t bench_frames_in(yamux_session_t *session) {
+    yamux_session_stats_t stats;
+
+    CHECK(yamux_session_get_stats(session, &stats) == YAMUX_OK, "stats failed");
+    return stats.frames_in[YAMUX_DATA];
+}
+
+static bench_result_t *bench_record(const char *scenario, const char *transport, int streams,
+                                    size_t message_size) {
+    bench_result_t *r;
+
+    CHECK(bench_result_count < BENCH_MAX_RESULTS, "too many results");
+    r = &bench_results[bench_result_count++];
+    memset(r, 0, sizeof(*r));
+    r->scenario = scenario;
+    r->transport = transport;
+    r->streams = streams;
+    r->message_size = message_size;
+    return r;
+}
+
+/* Stream total bytes, in messages of size bytes spread over streams, client to server */
+static void bench_throughput(const char *transport, int streams, size_t size, size_t total) {
+    yamux_stream_t **client = (yamux_stream_t **)calloc((size_t)streams, sizeof(yamux_stream_t *));
+    yamux_stream_t **server = (yamux_stream_t **)calloc((size_t)streams, sizeof(yamux_stream_t *));
+    size_t *sent = (size_t *)calloc((size_t)streams, sizeof(size_t));
+    size_t per_stream = (total / (size_t)streams + size - 1) / size * size;
+    size_t received = 0;
+    bench_result_t *r;
+    bench_conn_t conn;
+    uint64_t frames;
+    double start;
+    size_t n;
+    int i;
+
+    CHECK(client && server && sent, "out of memory");
+    if (!bench_connect(&conn, transport)) {
+        free(client);
+        free(server);
+        free(sent);
+        return;
+    }
+    bench_open(&conn, streams, client, server);
+
+    frames = bench_frames_in(conn.server);
+    start = bench_now();
+    while (received < per_stream * (size_t)streams) {
+        for (i = 0; i < streams; i++) {
+            /* Whole messages while the window lasts */
+            while (sent[i] < per_stream) {
+                n = bench_write(client[i], size - sent[i] % size);
+                if (n == 0) {
+                    break;
+                }
+                sent[i] += n;
+            }
+        }
+        bench_pump(&conn);
+        for (i = 0; i < streams; i++) {
+            while ((n = bench_read(server[i], sizeof(bench_sink))) > 0) {
+                received += n;
+            }
+        }
+        bench_pump(&conn);
+    }
+
+    r = bench_record("throughput", transport, streams, size);
+    r->seconds = bench_now() - start;
+    r->operations = received / size;
+    r->bytes = received;
+    r->frames = bench_frames_in(conn.server) - frames;
+
+    bench_disconnect(&conn);
+    free(client);
+    free(server);
+    free(sent);
+}
+
+static int bench_compare(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* Echo rounds messages of size bytes on each of streams at once, timing each round trip */
+static void bench_echo(const char *transport, int streams, size_t size, int rounds) {
+    yamux_stream_t **client = (yamux_stream_t **)calloc((size_t)streams, sizeof(yamux_stream_t *));
+    yamux_stream_t **server = (yamux_stream_t **)calloc((size_t)streams, sizeof(yamux_stream_t *));
+    size_t *sent = (size_t *)calloc((size_t)streams, sizeof(size_t));
+    size_t *echo = (size_t *)calloc((size_t)streams, sizeof(size_t));
+    size_t *back = (size_t *)calloc((size_t)streams, sizeof(size_t));
+    double *begun = (double *)calloc((size_t)streams, sizeof(double));
+    int *done = (int *)calloc((size_t)streams, sizeof(int));
+    size_t total = (size_t)streams * (size_t)rounds;
+    double *samples = (double *)calloc(total, sizeof(double));
+    size_t count = 0;
+    bench_result_t *r;
+    bench_conn_t conn;
+    uint64_t frames;
+    double start;
+    double now;
+    size_t n;
+    int i;
+
+    CHECK(client && server && sent && echo && back && begun && done && samples, "out of memory");
+    if (!bench_connect(&conn, transport)) {
+        goto out;
+    }
+    bench_open(&conn, streams, client, server);
+
+    frames = bench_frames_in(conn.server);
+    start = bench_now();
+    for (i = 0; i < streams; i++) {
+        begun[i] = start;
+    }
+    while (count < total) {
+        for (i = 0; i < streams; i++) {
+            if (done[i] < rounds && sent[i] < size) {
+                sent[i] += bench_write(client[i], size - sent[i]);
+            }
+        }
+        bench_pump(&conn);
+
+        /* The server writes back what it reads */
+        for (i = 0; i < streams; i++) {
+            echo[i] += bench_read(server[i], sizeof(bench_sink));
+            while (echo[i] > 0 && (n = bench_write(server[i], echo[i])) > 0) {
+                echo[i] -= n;
+            }
+        }
+        bench_pump(&conn);
+
+        now = bench_now();
+        for (i = 0; i < streams; i++) {
+            back[i] += bench_read(client[i], size - back[i]);
+            if (done[i] < rounds && back[i] == size) {
+                samples[count++] = (now - begun[i]) * 1e6;
+                done[i]++;
+                sent[i] = 0;
+                back[i] = 0;
+                begun[i] = now;
+            }
+        }
+    }
+
+    r = bench_record("echo", transport, streams, size);
+    r->seconds = bench_now() - start;
+    r->operations = count;
+    r->bytes = 2 * count * size;
+    r->frames = bench_frames_in(conn.server) - frames;
+    qsort(samples, count, sizeof(double), bench_compare);
+    r->p50_us = samples[(count + 1) / 2 - 1];
+    r->p99_us = samples[(count * 99 + 99) / 100 - 1];
+
+    bench_disconnect(&conn);
+out:
+    free(client);
+    free(server);
+    free(sent);
+    free(echo);
+    free(back);
+    free(begun);
+    free(done);
+    free(samples);
+}
+
+/* Open batch streams, close them from both ends, and repeat until total */
+static void bench_open_close(const char *transport, int batch, int total) {
+    yamux_stream_t **client = (yamux_stream_t **)calloc((size_t)batch, sizeof(yamux_stream_t *));
+    yamux_stream_t **server = (yamux_stream_t **)calloc((size_t)batch, sizeof(yamux_stream_t *));
+    bench_result_t *r;
+    bench_conn_t conn;
+    double start;
+    int finished;
+    int opened;
+    int i;
+
+    CHECK(client && server, "out of memory");
+    if (!bench_connect(&conn, transport)) {
+        free(client);
+        free(server);
+        return;
+    }
+
+    start = bench_now();
+    for (opened = 0; opened < total; opened += batch) {
+        bench_open(&conn, batch, client, server);
+        for (i = 0; i < batch; i++) {
+            CHECK(yamux_stream_close(server[i], 0) == YAMUX_OK, "server close failed");
+        }
+        /* Each client stream closes once the server's FIN is in */
+        for (finished = 0; finished < batch; ) {
+            bench_pump(&conn);
+            for (i = 0; i < batch; i++) {
+                if (client[i] && yamux_stream_get_state(client[i]) == YAMUX_STREAM_FIN_RECV) {
+                    CHECK(yamux_stream_close(client[i], 0) == YAMUX_OK, "client close failed");
+                    client[i] = NULL;
+                    finished++;
+                }
+            }
+        }
+        bench_pump(&conn);
+    }
+
+    r = bench_record("open_close", transport, batch, 0);
+    r->seconds = bench_now() - start;
+    r->operations = (uint64_t)opened;
+
+    bench_disconnect(&conn);
+    free(client);
+    free(server);
+}
+
+static void bench_print(FILE *out, const bench_result_t *r) {
+    fprintf(out, "%-10s %-10s streams=%-4d size=%-6zu %10.1f ops/s", r->scenario, r->transport,
+            r->streams, r->message_size, (double)r->operations / r->seconds);
+    if (r->bytes > 0) {
+        fprintf(out, " %9.1f MiB/s %10.0f frames/s", (double)r->bytes / r->seconds / (1024.0 * 1024.0),
+                (double)r->frames / r->seconds);
+    }
+    if (r->p99_us > 0) {
+        fprintf(out, "  p50=%.1fus p99=%.1fus", r->p50_us, r->p99_us);
+    }
+    fprintf(out, "\n");
+}
+
+static void bench_print_json(FILE *out, int quick) {
+    const bench_result_t *r;
+    int i;
+
+    fprintf(out, "{\n  \"benchmark\": \"yamux-bench\",\n  \"version\": %d,\n  \"quick\": %s,\n  \"results\": [\n",
+            YAMUX_VERSION, quick ? "true" : "false");
+    for (i = 0; i < bench_result_count; i++) {
+        r = &bench_results[i];
+        fprintf(out, "    {\"scenario\": \"%s\", \"transport\": \"%s\", \"streams\": %d, "
+                "\"message_size\": %zu, \"operations\": %llu, \"bytes\": %llu, \"frames\": %llu, "
+                "\"seconds\": %.6f, \"ops_per_sec\": %.1f, \"bytes_per_sec\": %.1f, "
+                "\"frames_per_sec\": %.1f, \"p50_us\": %.2f, \"p99_us\": %.2f}%s\n",
+                r->scenario, r->transport, r->streams, r->message_size,
+                (unsigned long long)r->operations, (unsigned long long)r->bytes,
+                (unsigned long long)r->frames, r->seconds, (double)r->operations / r->seconds,
+                (double)r->bytes / r->seconds, (double)r->frames / r->seconds, r->p50_us, r->p99_us,
+                (i + 1 < bench_result_count) ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    static const char *transports[] = {"mock", "socketpair", "tcp"};
+    static const int stream_counts[] = {1, 16, 128};
+    static const size_t sizes[] = {64, 1024, 16 * 1024, 64 * 1024};
+    const char *only = NULL;
+    const char *json = NULL;
+    FILE *human = stdout;
+    FILE *out;
+    int quick = 0;
+    int first;
+    size_t t;
+    size_t s;
+    size_t m;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) {
+            quick = 1;
+        } else if (strcmp(argv[i], "--transport") == 0 && i + 1 < argc) {
+            only = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            json = argv[++i];
+        } else {
+            fprintf(stderr, "usage: %s [--quick] [--transport mock|socketpair|tcp] [--json FILE|-]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (json && strcmp(json, "-") == 0) {
+        human = stderr;
+    }
+
+    for (t = 0; t < sizeof(transports) / sizeof(transports[0]); t++) {
+        if (only && strcmp(only, transports[t]) != 0) {
+            continue;
+        }
+        first = bench_result_count;
+        for (s = 0; s < sizeof(stream_counts) / sizeof(stream_counts[0]); s++) {
+            for (m = 0; m < sizeof(sizes) / sizeof(sizes[0]); m++) {
+                bench_throughput(transports[t], stream_counts[s], sizes[m],
+                                 quick ? (size_t)2 << 20 : (size_t)32 << 20);
+            }
+            for (m = 0; m < sizeof(sizes) / sizeof(sizes[0]); m++) {
+                bench_echo(transports[t], stream_counts[s], sizes[m], quick ? 50 : 1000);
+            }
+            bench_open_close(transports[t], stream_counts[s], quick ? 1024 : 16384);
+        }
+        if (bench_result_count == first) {
+            fprintf(stderr, "yamux_bench: %s unavailable, skipped\n", transports[t]);
+        }
+        for (i = first; i < bench_result_count; i++) {
+            bench_print(human, &bench_results[i]);
+        }
+    }
+
+    if (json) {
+        out = (strcmp(json, "-") == 0) ? stdout : fopen(json, "w");
+        CHECK(out != NULL, "cannot write the JSON results");
+        bench_print_json(out, quick);
+        if (out != stdout) {
+            fclose(out);
+        }
+    }
+    return 0;
+}
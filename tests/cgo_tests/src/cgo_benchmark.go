@@ -0,0 +1,698 @@
+//go:build cgo
+
+package main
+
+/*
+#cgo CFLAGS: -I../../../include -Wall
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../../../include/yamux.h"
+
+// cgo_compatibility_runner.go defines its own YAMUX_OK and YAMUX_ERR_WOULD_BLOCK
+// for Go; these names carry the library's values without clashing
+enum {
+    BENCH_OK = YAMUX_OK,
+    BENCH_WOULD_BLOCK = YAMUX_ERR_WOULD_BLOCK
+};
+
+// The library is linked as tiny_yamux_cgo, built with YAMUX_STATIC_MEMORY, so
+// every allocation it makes comes through these hooks. Each block carries its
+// size in front so that frees can be counted against the live total.
+#define BENCH_ALLOC_HEADER 16
+
+static uint64_t bench_c_allocs;
+static uint64_t bench_c_bytes;
+static int64_t bench_c_live;
+
+void *yamux_alloc(size_t size) {
+    uint8_t *block = (uint8_t *)malloc(BENCH_ALLOC_HEADER + size);
+
+    if (!block) {
+        return NULL;
+    }
+    memcpy(block, &size, sizeof(size));
+    __atomic_add_fetch(&bench_c_allocs, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bench_c_bytes, size, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&bench_c_live, (int64_t)size, __ATOMIC_RELAXED);
+    return block + BENCH_ALLOC_HEADER;
+}
+
+void yamux_free(void *ptr) {
+    uint8_t *block;
+    size_t size;
+
+    if (!ptr) {
+        return;
+    }
+    block = (uint8_t *)ptr - BENCH_ALLOC_HEADER;
+    memcpy(&size, block, sizeof(size));
+    __atomic_sub_fetch(&bench_c_live, (int64_t)size, __ATOMIC_RELAXED);
+    free(block);
+}
+
+// Allocations and bytes the library has taken so far, and the bytes it still holds
+static void bench_c_counters(uint64_t *allocs, uint64_t *bytes, int64_t *live) {
+    *allocs = __atomic_load_n(&bench_c_allocs, __ATOMIC_RELAXED);
+    *bytes = __atomic_load_n(&bench_c_bytes, __ATOMIC_RELAXED);
+    *live = __atomic_load_n(&bench_c_live, __ATOMIC_RELAXED);
+}
+
+// Transport of a C session under benchmark: two non-blocking pipe ends
+typedef struct {
+    int read_fd;
+    int write_fd;
+} bench_pipe_ctx_t;
+
+// 0 means "no data yet"; a closed pipe ends the session
+static int bench_pipe_read(void *ctx, uint8_t *buf, size_t len) {
+    bench_pipe_ctx_t *pipe_ctx = (bench_pipe_ctx_t *)ctx;
+    ssize_t n = read(pipe_ctx->read_fd, buf, len);
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : YAMUX_ERR_IO;
+    }
+    return n == 0 ? YAMUX_ERR_CLOSED : (int)n;
+}
+
+static int bench_pipe_write(void *ctx, const uint8_t *buf, size_t len) {
+    bench_pipe_ctx_t *pipe_ctx = (bench_pipe_ctx_t *)ctx;
+    ssize_t n = write(pipe_ctx->write_fd, buf, len);
+    if (n < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? YAMUX_ERR_WOULD_BLOCK : YAMUX_ERR_IO;
+    }
+    return (int)n;
+}
+
+// Lets the session sleep instead of spin; the Go runtime's signals are retried
+static int bench_pipe_poll(void *ctx, int events, uint32_t timeout_ms) {
+    bench_pipe_ctx_t *pipe_ctx = (bench_pipe_ctx_t *)ctx;
+    struct pollfd fds[2];
+    int count = 0;
+    int n;
+
+    if (events & YAMUX_WAIT_READABLE) {
+        fds[count].fd = pipe_ctx->read_fd;
+        fds[count].events = POLLIN;
+        count++;
+    }
+    if (events & YAMUX_WAIT_WRITABLE) {
+        fds[count].fd = pipe_ctx->write_fd;
+        fds[count].events = POLLOUT;
+        count++;
+    }
+    do {
+        n = poll(fds, (nfds_t)count, timeout_ms ? (int)timeout_ms : -1);
+    } while (n < 0 && errno == EINTR);
+    return n;
+}
+
+// Single-threaded session without keepalives, driven by the benchmark's own calls
+static yamux_session_t *bench_session_create(bench_pipe_ctx_t *ctx, int client) {
+    yamux_config_t config = yamux_default_config;
+    yamux_session_t *session;
+    yamux_io_t io;
+
+    memset(&io, 0, sizeof(io));
+    io.read = bench_pipe_read;
+    io.write = bench_pipe_write;
+    io.poll = bench_pipe_poll;
+    io.ctx = ctx;
+    config.enable_keepalive = 0;
+
+    if (yamux_session_create(&io, client, &config, &session) != YAMUX_OK) {
+        return NULL;
+    }
+    return session;
+}
+*/
+import "C"
+
+import (
+	"encoding/json"
+	"fmt"
+	"io"
+	"log"
+	"net"
+	"os"
+	"runtime"
+	"sort"
+	"syscall"
+	"time"
+	"unsafe"
+
+	go_yamux "github.com/hashicorp/yamux"
+)
+
+const (
+	// C memory each C peer moves stream data through, and the largest message
+	benchBufSize = 64 * 1024
+	// Longest any read, write or accept may wait, in ms
+	benchWaitMs = 10000
+	// Longest one benchmark may run before the harness gives up
+	benchTimeout = 2 * time.Minute
+)
+
+// benchStream is one end of a stream under test, on either side
+type benchStream interface {
+	io.Reader
+	io.Writer
+	Close() error
+}
+
+// benchPeer is one session under test, in C or in Go
+type benchPeer interface {
+	Open() (benchStream, error)
+	Accept() (benchStream, error)
+	// Drain keeps the session moving until done is closed, so that frames
+	// queued after the last write still leave and credit still arrives
+	Drain(done <-chan struct{})
+	Close()
+}
+
+// goPeer is a session of the Go yamux implementation
+type goPeer struct {
+	session *go_yamux.Session
+}
+
+func (p *goPeer) Open() (benchStream, error) {
+	s, err := p.session.OpenStream()
+	if err != nil {
+		return nil, err
+	}
+	return s, nil
+}
+
+func (p *goPeer) Accept() (benchStream, error) {
+	s, err := p.session.AcceptStream()
+	if err != nil {
+		return nil, err
+	}
+	return s, nil
+}
+
+// The Go session runs its own goroutines
+func (p *goPeer) Drain(done <-chan struct{}) { <-done }
+
+func (p *goPeer) Close() { p.session.Close() }
+
+// cPeer is a session of this library. Only one goroutine uses it at a time.
+type cPeer struct {
+	session *C.yamux_session_t
+	ctx     *C.bench_pipe_ctx_t
+	buf     unsafe.Pointer
+}
+
+// cStream is a stream of a cPeer
+type cStream struct {
+	peer   *cPeer
+	stream *C.yamux_stream_t
+}
+
+// newCPeer runs a C session over the given pipe ends, closing them if it cannot
+func newCPeer(readFd, writeFd int, client bool) (*cPeer, error) {
+	p := &cPeer{}
+	p.ctx = (*C.bench_pipe_ctx_t)(C.malloc(C.size_t(unsafe.Sizeof(C.bench_pipe_ctx_t{}))))
+	p.buf = C.malloc(benchBufSize)
+	if p.ctx != nil && p.buf != nil {
+		*p.ctx = C.bench_pipe_ctx_t{read_fd: C.int(readFd), write_fd: C.int(writeFd)}
+		role := 0
+		if client {
+			role = 1
+		}
+		p.session = C.bench_session_create(p.ctx, C.int(role))
+	}
+	if p.session == nil {
+		p.free()
+		syscall.Close(readFd)
+		syscall.Close(writeFd)
+		return nil, fmt.Errorf("failed to create C session")
+	}
+	return p, nil
+}
+
+func (p *cPeer) free() {
+	if p.ctx != nil {
+		C.free(unsafe.Pointer(p.ctx))
+	}
+	if p.buf != nil {
+		C.free(p.buf)
+	}
+}
+
+func (p *cPeer) Open() (benchStream, error) {
+	var stream *C.yamux_stream_t
+	if res := C.yamux_stream_open_detailed(p.session, 0, &stream); res != C.BENCH_OK {
+		return nil, fmt.Errorf("C stream open failed: %d", res)
+	}
+	return &cStream{peer: p, stream: stream}, nil
+}
+
+func (p *cPeer) Accept() (benchStream, error) {
+	var stream *C.yamux_stream_t
+	deadline := time.Now().Add(benchWaitMs * time.Millisecond)
+
+	for time.Now().Before(deadline) {
+		res := C.yamux_stream_accept(p.session, &stream)
+		if res == C.BENCH_OK {
+			return &cStream{peer: p, stream: stream}, nil
+		}
+		if res != C.YAMUX_ERR_TIMEOUT {
+			return nil, fmt.Errorf("C stream accept failed: %d", res)
+		}
+		if err := p.step(); err != nil {
+			return nil, err
+		}
+	}
+	return nil, fmt.Errorf("C stream accept timed out")
+}
+
+// step processes what has arrived and writes out what is queued, waiting
+// briefly for the transport when there is nothing to do
+func (p *cPeer) step() error {
+	res := C.yamux_session_process(p.session)
+	if res != C.BENCH_OK && res != C.BENCH_WOULD_BLOCK {
+		return fmt.Errorf("C session processing failed: %d", res)
+	}
+	res = C.yamux_session_flush(p.session)
+	if res != C.BENCH_OK && res != C.BENCH_WOULD_BLOCK {
+		return fmt.Errorf("C session flush failed: %d", res)
+	}
+	C.bench_pipe_poll(unsafe.Pointer(p.ctx), C.YAMUX_WAIT_READABLE, 1)
+	return nil
+}
+
+func (p *cPeer) Drain(done <-chan struct{}) {
+	for {
+		select {
+		case <-done:
+			return
+		default:
+		}
+		if err := p.step(); err != nil {
+			log.Fatalf("Benchmark: %v", err)
+		}
+	}
+}
+
+func (p *cPeer) Close() {
+	C.yamux_session_close(p.session, C.YAMUX_NORMAL)
+	syscall.Close(int(p.ctx.read_fd))
+	syscall.Close(int(p.ctx.write_fd))
+	p.free()
+}
+
+func (s *cStream) Read(b []byte) (int, error) {
+	var got C.size_t
+	n := len(b)
+	if n > benchBufSize {
+		n = benchBufSize
+	}
+	res := C.yamux_stream_read_timeout(s.stream, (*C.uint8_t)(s.peer.buf), C.size_t(n), benchWaitMs, &got)
+	if res != C.BENCH_OK {
+		return 0, fmt.Errorf("C stream read failed: %d", res)
+	}
+	if got == 0 {
+		return 0, io.EOF
+	}
+	copy(b, unsafe.Slice((*byte)(s.peer.buf), int(got)))
+	return int(got), nil
+}
+
+func (s *cStream) Write(b []byte) (int, error) {
+	total := 0
+	for total < len(b) {
+		var written C.size_t
+		n := copy(unsafe.Slice((*byte)(s.peer.buf), benchBufSize), b[total:])
+		res := C.yamux_stream_write_timeout(s.stream, (*C.uint8_t)(s.peer.buf), C.size_t(n), benchWaitMs, &written)
+		total += int(written)
+		if res != C.BENCH_OK {
+			return total, fmt.Errorf("C stream write failed: %d", res)
+		}
+	}
+	return total, nil
+}
+
+func (s *cStream) Close() error {
+	if res := C.yamux_stream_free(s.stream); res != C.BENCH_OK {
+		return fmt.Errorf("C stream close failed: %d", res)
+	}
+	C.yamux_session_flush(s.peer.session)
+	return nil
+}
+
+// newGoPeer runs a Go session over the given pipe ends, closing them if it cannot
+func newGoPeer(readFd, writeFd int, client bool) (*goPeer, error) {
+	reader := os.NewFile(uintptr(readFd), "benchGoReader")
+	writer := os.NewFile(uintptr(writeFd), "benchGoWriter")
+	conn := PipeConn{ReadWriteCloser: struct {
+		io.Reader
+		io.Writer
+		io.Closer
+	}{
+		Reader: reader,
+		Writer: writer,
+		Closer: &pipeCloser{files: []*os.File{reader, writer}},
+	}}
+
+	config := go_yamux.DefaultConfig()
+	config.LogOutput = io.Discard
+	config.EnableKeepAlive = false
+
+	var session *go_yamux.Session
+	var err error
+	if client {
+		session, err = go_yamux.Client(net.Conn(conn), config)
+	} else {
+		session, err = go_yamux.Server(net.Conn(conn), config)
+	}
+	if err != nil {
+		conn.Close()
+		return nil, err
+	}
+	return &goPeer{session: session}, nil
+}
+
+// newBenchPeers connects a client and a server ("c" or "go") over two pipes
+func newBenchPeers(clientKind, serverKind string) (client, server benchPeer, err error) {
+	var fds [4]int
+	if fds[0], fds[1], err = CreateOSPipe(); err != nil {
+		return nil, nil, err
+	}
+	if fds[2], fds[3], err = CreateOSPipe(); err != nil {
+		syscall.Close(fds[0])
+		syscall.Close(fds[1])
+		return nil, nil, err
+	}
+
+	newPeer := func(kind string, readFd, writeFd int, isClient bool) (benchPeer, error) {
+		if kind == "c" {
+			return newCPeer(readFd, writeFd, isClient)
+		}
+		return newGoPeer(readFd, writeFd, isClient)
+	}
+	if client, err = newPeer(clientKind, fds[0], fds[3], true); err != nil {
+		syscall.Close(fds[1])
+		syscall.Close(fds[2])
+		return nil, nil, err
+	}
+	if server, err = newPeer(serverKind, fds[2], fds[1], false); err != nil {
+		client.Close()
+		return nil, nil, err
+	}
+	return client, server, nil
+}
+
+// benchResult is one measurement
+type benchResult struct {
+	Scenario      string  `json:"scenario"`
+	Direction     string  `json:"direction"`
+	MessageSize   int     `json:"message_size"`
+	Operations    int64   `json:"operations"`
+	Bytes         int64   `json:"bytes"`
+	Seconds       float64 `json:"seconds"`
+	OpsPerSec     float64 `json:"ops_per_sec"`
+	BytesPerSec   float64 `json:"bytes_per_sec"`
+	GoAllocsPerOp float64 `json:"go_allocs_per_op"`
+	GoBytesPerOp  float64 `json:"go_bytes_per_op"`
+	GoHeapGrowth  int64   `json:"go_heap_growth"`
+	CAllocsPerOp  float64 `json:"c_allocs_per_op"`
+	CBytesPerOp   float64 `json:"c_bytes_per_op"`
+	CHeapGrowth   int64   `json:"c_heap_growth"`
+	P50us         float64 `json:"p50_us"`
+	P99us         float64 `json:"p99_us"`
+}
+
+// benchMeter takes the allocation counters at the start of a measurement:
+// the Go runtime's, and the library's as counted by the yamux_alloc hooks
+type benchMeter struct {
+	start   time.Time
+	mallocs uint64
+	alloced uint64
+	heap    uint64
+	cAllocs C.uint64_t
+	cBytes  C.uint64_t
+	cLive   C.int64_t
+}
+
+func startBenchMeter() benchMeter {
+	var ms runtime.MemStats
+	runtime.GC()
+	runtime.ReadMemStats(&ms)
+	m := benchMeter{mallocs: ms.Mallocs, alloced: ms.TotalAlloc, heap: ms.HeapAlloc}
+	C.bench_c_counters(&m.cAllocs, &m.cBytes, &m.cLive)
+	m.start = time.Now()
+	return m
+}
+
+func (m benchMeter) finish(r *benchResult) {
+	var ms runtime.MemStats
+	var cAllocs, cBytes C.uint64_t
+	var cLive C.int64_t
+	r.Seconds = time.Since(m.start).Seconds()
+	C.bench_c_counters(&cAllocs, &cBytes, &cLive)
+	// Collect first so heap growth counts what the run kept, not its garbage
+	runtime.GC()
+	runtime.ReadMemStats(&ms)
+	r.OpsPerSec = float64(r.Operations) / r.Seconds
+	r.BytesPerSec = float64(r.Bytes) / r.Seconds
+	r.GoAllocsPerOp = float64(ms.Mallocs-m.mallocs) / float64(r.Operations)
+	r.GoBytesPerOp = float64(ms.TotalAlloc-m.alloced) / float64(r.Operations)
+	r.GoHeapGrowth = int64(ms.HeapAlloc) - int64(m.heap)
+	r.CAllocsPerOp = float64(cAllocs-m.cAllocs) / float64(r.Operations)
+	r.CBytesPerOp = float64(cBytes-m.cBytes) / float64(r.Operations)
+	r.CHeapGrowth = int64(cLive - m.cLive)
+}
+
+// drainUntil keeps peer moving until wait returns
+func drainUntil(peer benchPeer, wait func()) {
+	done := make(chan struct{})
+	go func() {
+		wait()
+		close(done)
+	}()
+	peer.Drain(done)
+}
+
+// benchTransfer sends count messages of size bytes on one stream, sender to receiver
+func benchTransfer(scenario, direction string, sender, receiver benchPeer, size int, count int64) (*benchResult, error) {
+	type outcome struct {
+		bytes int64
+		err   error
+	}
+	received := make(chan outcome, 1)
+	go func() {
+		s, err := receiver.Accept()
+		if err != nil {
+			received <- outcome{err: err}
+			return
+		}
+		buf := make([]byte, benchBufSize)
+		var total int64
+		for {
+			n, err := s.Read(buf)
+			total += int64(n)
+			if err == io.EOF {
+				break
+			}
+			if err != nil {
+				received <- outcome{bytes: total, err: err}
+				return
+			}
+		}
+		received <- outcome{bytes: total, err: s.Close()}
+	}()
+
+	r := &benchResult{Scenario: scenario, Direction: direction, MessageSize: size, Operations: count, Bytes: int64(size) * count}
+	msg := make([]byte, size)
+	meter := startBenchMeter()
+
+	s, err := sender.Open()
+	if err != nil {
+		return nil, err
+	}
+	for i := int64(0); i < count; i++ {
+		if _, err := s.Write(msg); err != nil {
+			return nil, err
+		}
+	}
+	if err := s.Close(); err != nil {
+		return nil, err
+	}
+	var got outcome
+	drainUntil(sender, func() { got = <-received })
+	meter.finish(r)
+
+	if got.err != nil {
+		return nil, got.err
+	}
+	if got.bytes != r.Bytes {
+		return nil, fmt.Errorf("received %d of %d bytes", got.bytes, r.Bytes)
+	}
+	return r, nil
+}
+
+// benchEcho times rounds of size-byte messages the echoer sends straight back
+func benchEcho(direction string, pinger, echoer benchPeer, size, rounds int) (*benchResult, error) {
+	echoed := make(chan error, 1)
+	go func() {
+		s, err := echoer.Accept()
+		if err != nil {
+			echoed <- err
+			return
+		}
+		buf := make([]byte, benchBufSize)
+		for {
+			n, err := s.Read(buf)
+			if n > 0 {
+				if _, werr := s.Write(buf[:n]); werr != nil {
+					echoed <- werr
+					return
+				}
+			}
+			if err == io.EOF {
+				break
+			}
+			if err != nil {
+				echoed <- err
+				return
+			}
+		}
+		echoed <- s.Close()
+	}()
+
+	r := &benchResult{Scenario: "echo", Direction: direction, MessageSize: size, Operations: int64(rounds), Bytes: 2 * int64(size) * int64(rounds)}
+	msg := make([]byte, size)
+	reply := make([]byte, size)
+	latencies := make([]time.Duration, rounds)
+	meter := startBenchMeter()
+
+	s, err := pinger.Open()
+	if err != nil {
+		return nil, err
+	}
+	for i := 0; i < rounds; i++ {
+		sent := time.Now()
+		if _, err := s.Write(msg); err != nil {
+			return nil, err
+		}
+		if _, err := io.ReadFull(s, reply); err != nil {
+			return nil, err
+		}
+		latencies[i] = time.Since(sent)
+	}
+	if err := s.Close(); err != nil {
+		return nil, err
+	}
+	var echoErr error
+	drainUntil(pinger, func() { echoErr = <-echoed })
+	meter.finish(r)
+
+	if echoErr != nil {
+		return nil, echoErr
+	}
+	sort.Slice(latencies, func(i, j int) bool { return latencies[i] < latencies[j] })
+	r.P50us = float64(latencies[rounds/2].Nanoseconds()) / 1000
+	r.P99us = float64(latencies[rounds*99/100].Nanoseconds()) / 1000
+	return r, nil
+}
+
+// benchDirection is who sends: the client (always the one that opens) to the server
+type benchDirection struct {
+	name   string
+	client string
+	server string
+}
+
+var benchDirections = []benchDirection{
+	{"c->go", "c", "go"},
+	{"go->c", "go", "c"},
+	{"go->go", "go", "go"},
+}
+
+func printBenchResult(r *benchResult) {
+	fmt.Printf("%-6s %-7s size=%-6d %10.1f ops/s %9.1f MiB/s  go: %6.2f allocs/op %8.1f B/op heap %+d B"+
+		"  c: %6.2f allocs/op %8.1f B/op heap %+d B",
+		r.Scenario, r.Direction, r.MessageSize, r.OpsPerSec, r.BytesPerSec/(1024*1024),
+		r.GoAllocsPerOp, r.GoBytesPerOp, r.GoHeapGrowth, r.CAllocsPerOp, r.CBytesPerOp, r.CHeapGrowth)
+	if r.P99us > 0 {
+		fmt.Printf("  p50=%.1fus p99=%.1fus", r.P50us, r.P99us)
+	}
+	fmt.Println()
+}
+
+// runBenchmarks measures bulk, small-message and echo traffic between a C
+// and a Go session in both directions, with Go to Go as the baseline the C
+// side is compared against. jsonPath ("" for none) receives the results.
+func runBenchmarks(quick bool, jsonPath string) error {
+	bulkCount, smallCount, echoRounds := int64(1024), int64(200000), 5000
+	if quick {
+		bulkCount, smallCount, echoRounds = 128, 20000, 500
+	}
+
+	var results []*benchResult
+	for _, d := range benchDirections {
+		for _, scenario := range []string{"bulk", "small", "echo"} {
+			client, server, err := newBenchPeers(d.client, d.server)
+			if err != nil {
+				return err
+			}
+			watchdog := time.AfterFunc(benchTimeout, func() {
+				log.Fatalf("Benchmark %s %s did not finish in %v", scenario, d.name, benchTimeout)
+			})
+
+			var r *benchResult
+			switch scenario {
+			case "bulk":
+				r, err = benchTransfer(scenario, d.name, client, server, benchBufSize, bulkCount)
+			case "small":
+				r, err = benchTransfer(scenario, d.name, client, server, 64, smallCount)
+			default:
+				r, err = benchEcho(d.name, client, server, 64, echoRounds)
+			}
+			watchdog.Stop()
+			// The C side goes first so its GO_AWAY still has a reader
+			if d.client == "c" {
+				client.Close()
+				server.Close()
+			} else {
+				server.Close()
+				client.Close()
+			}
+			if err != nil {
+				return fmt.Errorf("%s %s: %v", scenario, d.name, err)
+			}
+			printBenchResult(r)
+			results = append(results, r)
+		}
+	}
+
+	// How the C side compares with Go talking to Go
+	baseline := map[string]*benchResult{}
+	for _, r := range results {
+		if r.Direction == "go->go" {
+			baseline[r.Scenario] = r
+		}
+	}
+	for _, r := range results {
+		if b := baseline[r.Scenario]; b != nil && r != b {
+			fmt.Printf("%-6s %-7s %5.2fx the Go to Go rate\n", r.Scenario, r.Direction, r.OpsPerSec/b.OpsPerSec)
+		}
+	}
+
+	if jsonPath == "" {
+		return nil
+	}
+	out, err := json.MarshalIndent(struct {
+		Benchmark string         `json:"benchmark"`
+		Quick     bool           `json:"quick"`
+		Results   []*benchResult `json:"results"`
+	}{"cgo-bench", quick, results}, "", "  ")
+	if err != nil {
+		return err
+	}
+	return os.WriteFile(jsonPath, append(out, '\n'), 0644)
+}
@@ -4,7 +4,8 @@ package main
 
 /*
 #cgo CFLAGS: -I../../../include -Wall -Wno-unused-variable -Wno-unused-function
-#cgo LDFLAGS: -L../../../build -ltiny_yamux_port -ltiny_yamux
+// tiny_yamux_cgo allocates through the counting hooks in cgo_benchmark.go
+#cgo LDFLAGS: -L../../../build -ltiny_yamux_cgo
 
 #include <stdlib.h>
 #include <string.h>
@@ -131,6 +132,7 @@ void dummy_c_function(void) {
 import "C"
 
 import (
+	"flag"
 	"fmt"
 	"io"
 	"log"
@@ -353,6 +355,17 @@ func runGoClientCServerStreamOpenSendReceive() error {
 }
 
 func main() {
+	bench := flag.Bool("bench", false, "measure C to Go throughput, allocations and latency instead of testing")
+	quick := flag.Bool("quick", false, "with -bench, run a short pass")
+	jsonPath := flag.String("json", "", "with -bench, write the results to this JSON file")
+	flag.Parse()
+	if *bench {
+		if err := runBenchmarks(*quick, *jsonPath); err != nil {
+			log.Fatalf("Benchmark FAILED: %v", err)
+		}
+		return
+	}
+
 	C.dummy_c_function()
 	log.Println("Starting Yamux CGO Interop Main Program...")
 